@@ -73,6 +73,13 @@ enum {
 /* Uncomment this to have proper peak counter. */
 #define USE_ATOMIC_MAX
 
+/* Keep freed small blocks in per-thread lists of size classes, so they can be reused
+ * without going through the system allocator (which may lock when used from many threads).
+ * Memory accounting is unaffected: it's based on requested sizes, and cached blocks are free. */
+#if !defined(WIN32)
+#  define USE_THREAD_CACHE
+#endif
+
 MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
 {
 #ifdef USE_ATOMIC_MAX
@@ -82,6 +89,261 @@ MEM_INLINE void update_maximum(size_t *maximum_value, size_t value)
 #endif
 }
 
+#ifdef USE_THREAD_CACHE
+
+#include <pthread.h>
+
+/* Sizes are rounded up to a multiple of the step, blocks of #THREAD_CACHE_SIZE_MAX and more
+ * are never cached. Any (non-mmap, non-aligned) block below this size is allocated with
+ * the capacity of its class, so it can be reused by any request of the same class. */
+#define THREAD_CACHE_CLASS_STEP 16
+#define THREAD_CACHE_SIZE_MAX 512
+#define THREAD_CACHE_CLASS_NUM (THREAD_CACHE_SIZE_MAX / THREAD_CACHE_CLASS_STEP)
+
+/* Maximum number of blocks a thread keeps per class,
+ * when exceeded a batch of blocks is moved to the global pool. */
+#define THREAD_CACHE_LOCAL_MAX 64
+#define THREAD_CACHE_BATCH (THREAD_CACHE_LOCAL_MAX / 2)
+/* Maximum memory kept per class by the global pool, further blocks are given back to the system. */
+#define THREAD_CACHE_GLOBAL_SIZE_MAX (256 * 1024)
+
+/* Stored in place of the #MemHead of cached blocks. */
+typedef struct CacheBlock {
+	struct CacheBlock *next;
+} CacheBlock;
+
+typedef struct CacheList {
+	CacheBlock *first;
+	unsigned int count;
+} CacheList;
+
+typedef struct ThreadCache {
+	CacheList lists[THREAD_CACHE_CLASS_NUM];
+} ThreadCache;
+
+typedef struct GlobalCache {
+	pthread_mutex_t mutex;
+	CacheList list;
+} GlobalCache;
+
+static GlobalCache global_cache[THREAD_CACHE_CLASS_NUM];
+static pthread_once_t global_cache_once = PTHREAD_ONCE_INIT;
+/* Only used to flush the cache of exiting threads. */
+static pthread_key_t thread_cache_key;
+static __thread ThreadCache *thread_cache = NULL;
+
+MEM_INLINE size_t thread_cache_class(size_t len)
+{
+	return len / THREAD_CACHE_CLASS_STEP;
+}
+
+MEM_INLINE size_t thread_cache_class_size(size_t index)
+{
+	return (index + 1) * THREAD_CACHE_CLASS_STEP;
+}
+
+/**
+ * Remove up to \a num blocks from the start of \a list, returning them as a chain.
+ */
+static CacheBlock *cache_list_pop_chain(CacheList *list, unsigned int num, CacheBlock **r_last, unsigned int *r_num)
+{
+	CacheBlock *first = list->first, *last = NULL, *block = first;
+	unsigned int i;
+
+	for (i = 0; i < num && block; i++) {
+		last = block;
+		block = block->next;
+	}
+	if (last) {
+		last->next = NULL;
+	}
+	list->first = block;
+	list->count -= i;
+
+	*r_last = last;
+	*r_num = i;
+	return first;
+}
+
+/**
+ * Move a chain of blocks to the global pool, freeing them when it's full.
+ */
+static void global_cache_push_chain(size_t index, CacheBlock *first, CacheBlock *last, unsigned int num)
+{
+	GlobalCache *gc = &global_cache[index];
+	const unsigned int count_max = (unsigned int)(THREAD_CACHE_GLOBAL_SIZE_MAX / thread_cache_class_size(index));
+	bool is_full;
+
+	if (first == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&gc->mutex);
+	is_full = (gc->list.count + num > count_max);
+	if (!is_full) {
+		last->next = gc->list.first;
+		gc->list.first = first;
+		gc->list.count += num;
+	}
+	pthread_mutex_unlock(&gc->mutex);
+
+	if (is_full) {
+		while (first) {
+			CacheBlock *next = first->next;
+			free(first);
+			first = next;
+		}
+	}
+}
+
+static void thread_cache_free(void *tc_v)
+{
+	ThreadCache *tc = tc_v;
+	size_t index;
+
+	for (index = 0; index < THREAD_CACHE_CLASS_NUM; index++) {
+		CacheList *list = &tc->lists[index];
+		CacheBlock *last;
+		unsigned int num;
+		CacheBlock *first = cache_list_pop_chain(list, list->count, &last, &num);
+		global_cache_push_chain(index, first, last, num);
+	}
+
+	if (thread_cache == tc) {
+		thread_cache = NULL;
+	}
+	free(tc);
+}
+
+static void global_cache_init(void)
+{
+	size_t index;
+	for (index = 0; index < THREAD_CACHE_CLASS_NUM; index++) {
+		pthread_mutex_init(&global_cache[index].mutex, NULL);
+	}
+	pthread_key_create(&thread_cache_key, thread_cache_free);
+}
+
+MEM_INLINE ThreadCache *thread_cache_ensure(void)
+{
+	ThreadCache *tc = thread_cache;
+	if (UNLIKELY(tc == NULL)) {
+		pthread_once(&global_cache_once, global_cache_init);
+		tc = calloc(1, sizeof(*tc));
+		if (tc) {
+			pthread_setspecific(thread_cache_key, tc);
+			thread_cache = tc;
+		}
+	}
+	return tc;
+}
+
+/**
+ * Get a cached block able to hold \a len bytes, or NULL.
+ */
+MEM_INLINE MemHead *thread_cache_pop(size_t len)
+{
+	const size_t index = thread_cache_class(len);
+	ThreadCache *tc = thread_cache_ensure();
+	CacheList *list;
+	CacheBlock *block;
+
+	if (UNLIKELY(tc == NULL)) {
+		return NULL;
+	}
+
+	list = &tc->lists[index];
+	if (list->first == NULL) {
+		/* Refill from blocks other threads gave back.
+		 * Unlocked check to avoid locking when the pool is empty, the list is only used under lock. */
+		GlobalCache *gc = &global_cache[index];
+		if (gc->list.first == NULL) {
+			return NULL;
+		}
+		pthread_mutex_lock(&gc->mutex);
+		list->first = cache_list_pop_chain(&gc->list, THREAD_CACHE_BATCH, &block, &list->count);
+		pthread_mutex_unlock(&gc->mutex);
+		if (list->first == NULL) {
+			return NULL;
+		}
+	}
+
+	block = list->first;
+	list->first = block->next;
+	list->count--;
+	return (MemHead *)block;
+}
+
+/**
+ * Keep the block at \a memh (of \a len bytes) for later reuse.
+ */
+MEM_INLINE void thread_cache_push(MemHead *memh, size_t len)
+{
+	const size_t index = thread_cache_class(len);
+	ThreadCache *tc = thread_cache_ensure();
+	CacheList *list;
+	CacheBlock *block = (CacheBlock *)memh;
+
+	if (UNLIKELY(tc == NULL)) {
+		free(memh);
+		return;
+	}
+
+	list = &tc->lists[index];
+	block->next = list->first;
+	list->first = block;
+	list->count++;
+
+	if (UNLIKELY(list->count > THREAD_CACHE_LOCAL_MAX)) {
+		CacheBlock *first, *last;
+		unsigned int num;
+		first = cache_list_pop_chain(list, THREAD_CACHE_BATCH, &last, &num);
+		global_cache_push_chain(index, first, last, num);
+	}
+}
+
+#endif  /* USE_THREAD_CACHE */
+
+/**
+ * Allocate a (non-aligned, non-mmap) block for \a len bytes of data.
+ */
+MEM_INLINE MemHead *mem_block_alloc(size_t len, bool clear)
+{
+	MemHead *memh;
+#ifdef USE_THREAD_CACHE
+	if (len < THREAD_CACHE_SIZE_MAX) {
+		memh = thread_cache_pop(len);
+		if (memh) {
+			if (clear) {
+				memset(memh + 1, 0, len);
+			}
+			return memh;
+		}
+		len = thread_cache_class_size(thread_cache_class(len));
+	}
+#endif
+	if (clear) {
+		memh = (MemHead *)calloc(1, len + sizeof(MemHead));
+	}
+	else {
+		memh = (MemHead *)malloc(len + sizeof(MemHead));
+	}
+	return memh;
+}
+
+MEM_INLINE void mem_block_free(MemHead *memh, size_t len)
+{
+#ifdef USE_THREAD_CACHE
+	if (len < THREAD_CACHE_SIZE_MAX) {
+		thread_cache_push(memh, len);
+		return;
+	}
+#else
+	(void)len;
+#endif
+	free(memh);
+}
+
 #ifdef __GNUC__
 __attribute__ ((format(printf, 1, 2)))
 #endif
@@ -161,7 +423,7 @@ void MEM_lockfree_freeN(void *vmemh)
 			aligned_free(MEMHEAD_REAL_PTR(memh_aligned));
 		}
 		else {
-			free(memh);
+			mem_block_free(memh, len);
 		}
 	}
 }
@@ -278,7 +540,7 @@ void *MEM_lockfree_callocN(size_t len, const char *str)
 
 	len = SIZET_ALIGN_4(len);
 
-	memh = (MemHead *)calloc(1, len + sizeof(MemHead));
+	memh = mem_block_alloc(len, true);
 
 	if (LIKELY(memh)) {
 		memh->len = len;
@@ -314,7 +576,7 @@ void *MEM_lockfree_mallocN(size_t len, const char *str)
 
 	len = SIZET_ALIGN_4(len);
 
-	memh = (MemHead *)malloc(len + sizeof(MemHead));
+	memh = mem_block_alloc(len, false);
 
 	if (LIKELY(memh)) {
 		if (UNLIKELY(malloc_debug_memset && len)) {
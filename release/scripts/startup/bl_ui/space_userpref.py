@@ -1061,6 +1061,7 @@ class USERPREF_PT_file(Panel):
         col.prop(paths, "use_relative_paths")
         col.prop(paths, "use_file_compression")
         col.prop(paths, "use_load_ui")
+        col.prop(paths, "use_lazy_packed_data")
         col.prop(paths, "use_filter_files")
         col.prop(paths, "show_hidden_files_datablocks")
         col.prop(paths, "hide_recent_locations")
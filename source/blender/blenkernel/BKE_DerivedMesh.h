@@ -522,6 +522,10 @@ void DM_from_template(
  */
 int DM_release(DerivedMesh *dm);
 
+/** memory used by the layers of a DerivedMesh, shared layers are counted separately
+ */
+void DM_memory_usage(DerivedMesh *dm, size_t *r_mem_owned, size_t *r_mem_shared);
+
 /** utility function to convert a DerivedMesh to a Mesh
  */
 void DM_to_mesh(DerivedMesh *dm, struct Mesh *me, struct Object *ob, CustomDataMask mask, bool take_ownership);
@@ -741,6 +745,14 @@ void makeDerivedMesh(
         struct Scene *scene, struct Object *ob, struct BMEditMesh *em,
         CustomDataMask dataMask, const bool build_shapekey_layers);
 
+/* free the modifier results kept for eModifierMode_CacheResult */
+void mesh_modifier_stack_cache_free(struct Object *ob);
+
+/* exposed for tests */
+bool mesh_modifier_stack_cache_modifier_hash(
+        struct Scene *scene, struct Object *ob, struct ModifierData *md, const int required_mode,
+        uint64_t *r_hash);
+
 void weight_to_rgb(float r_rgb[3], const float weight);
 /** Update the weight MCOL preview layer.
  * If weights are NULL, use object's active vgroup(s).
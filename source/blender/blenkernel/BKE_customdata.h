@@ -73,6 +73,10 @@ extern const CustomDataMask CD_MASK_EVERYTHING;
 #define CD_REFERENCE 3  /* use data pointers, set layer flag NOFREE */
 #define CD_DUPLICATE 4  /* do a full copy of all layers, only allowed if source
                          * has same number of elements */
+#define CD_SHARE     5  /* share data pointers with the source (reference counted), set layer flag NOFREE,
+                         * layers are copied when written (see CustomData_duplicate_referenced_layer).
+                         * Note this marks the source layers as shared (even when passed as const),
+                         * which is thread safe, the same source can be shared from multiple threads */
 
 #define CD_TYPE_AS_MASK(_type) (CustomDataMask)((CustomDataMask)1 << (CustomDataMask)(_type))
 
@@ -100,6 +104,8 @@ bool CustomData_bmesh_has_free(const struct CustomData *data);
  */
 bool CustomData_has_referenced(const struct CustomData *data);
 
+void CustomData_memory_usage(const struct CustomData *data, int totelem, size_t *r_mem_owned, size_t *r_mem_shared);
+
 /* copies the "value" (e.g. mloopuv uv or mloopcol colors) from one block to
  * another, while not overwriting anything else (e.g. flags).  probably only
  * implemented for mloopuv/mloopcol, for now.*/
@@ -194,13 +200,18 @@ bool CustomData_has_layer(const struct CustomData *data, int type);
 int CustomData_number_of_layers(const struct CustomData *data, int type);
 int CustomData_number_of_layers_typemask(const struct CustomData *data, CustomDataMask mask);
 
-/* duplicate data of a layer with flag NOFREE, and remove that flag.
+/* duplicate data of a layer with flag NOFREE, and remove that flag,
+ * shared layers are only duplicated while they have other users.
  * returns the layer data */
 void *CustomData_duplicate_referenced_layer(struct CustomData *data, const int type, const int totelem);
 void *CustomData_duplicate_referenced_layer_n(struct CustomData *data, const int type, const int n, const int totelem);
 void *CustomData_duplicate_referenced_layer_named(struct CustomData *data,
                                                   const int type, const char *name, const int totelem);
 bool CustomData_is_referenced_layer(struct CustomData *data, int type);
+bool CustomData_is_shared_layer(const struct CustomData *data, int type);
+/* duplicate all layers referencing data owned elsewhere (NOFREE but not shared),
+ * so the data stays valid when its owner frees it */
+void CustomData_duplicate_unshared_referenced_layers(struct CustomData *data, const int totelem);
 
 /* set the CD_FLAG_NOCOPY flag in custom data layers where the mask is
  * zero for the layer type, so only layer types specified by the mask
@@ -343,6 +354,7 @@ void CustomData_set_layer_stencil_index(struct CustomData *data, int type, int n
 void CustomData_set_layer_flag(struct CustomData *data, int type, int flag);
 
 void CustomData_bmesh_set_default(struct CustomData *data, void **block);
+void CustomData_bmesh_alloc_block(struct CustomData *data, void **block);
 void CustomData_bmesh_free_block(struct CustomData *data, void **block);
 void CustomData_bmesh_free_block_data(struct CustomData *data, void *block);
 
@@ -34,6 +34,7 @@
 #include "BKE_customdata.h"
 #include "bmesh.h"
 
+struct BMBVHTree;
 struct BMesh;
 struct BMLoop;
 struct Mesh;
@@ -41,6 +42,30 @@ struct Scene;
 struct DerivedMesh;
 struct MeshStatVis;
 
+/**
+ * Faces and vertices which depend on a known set of vertices,
+ * so moving those vertices only needs these to be updated.
+ * Only valid while the topology doesn't change (checked using the element counts).
+ *
+ * See #BKE_editmesh_partial_begin.
+ */
+typedef struct BMEditMeshPartial {
+	struct BMFace **faces;
+	/* index of the first triangle of each face in #BMEditMesh.looptris */
+	int *faces_looptris_index;
+	int faces_len;
+
+	/* vertices of 'faces', their normals need updating */
+	struct BMVert **verts;
+	int verts_len;
+
+	/* to detect topology changes */
+	int totvert, totedge, totloop, totface, tottri;
+
+	/* optional, see #BKE_editmesh_partial_bmbvh_get */
+	struct BMBVHTree *bmbvh;
+} BMEditMeshPartial;
+
 /**
  * This structure is used for mesh edit-mode.
  *
@@ -79,6 +104,9 @@ typedef struct BMEditMesh {
 
 	/*temp variables for x-mirror editing*/
 	int mirror_cdlayer; /* -1 is invalid */
+
+	/* optional, for partial updates while transforming */
+	BMEditMeshPartial *partial;
 } BMEditMesh;
 
 /* editmesh.c */
@@ -90,6 +118,12 @@ void        BKE_editmesh_free_derivedmesh(BMEditMesh *em);
 void        BKE_editmesh_free(BMEditMesh *em);
 void        BKE_editmesh_update_linked_customdata(BMEditMesh *em);
 
+void        BKE_editmesh_partial_begin(BMEditMesh *em, struct BMVert **verts, const int verts_len);
+void        BKE_editmesh_partial_end(BMEditMesh *em);
+bool        BKE_editmesh_partial_is_valid(const BMEditMesh *em);
+void        BKE_editmesh_partial_update(BMEditMesh *em);
+struct BMBVHTree *BKE_editmesh_partial_bmbvh_get(BMEditMesh *em);
+
 void        BKE_editmesh_color_free(BMEditMesh *em);
 void        BKE_editmesh_color_ensure(BMEditMesh *em, const char htype);
 float     (*BKE_editmesh_vertexCos_get_orco(BMEditMesh *em, int *r_numVerts))[3];
@@ -54,6 +54,7 @@ BMBVHTree      *BKE_bmbvh_new_ex(
 BMBVHTree      *BKE_bmbvh_new(
         struct BMesh *bm, struct BMLoop *(*looptris)[3], int looptris_tot, int flag,
         const float (*cos_cage)[3], const bool cos_cage_free);
+bool            BKE_bmbvh_update_partial(BMBVHTree *tree, struct BMEditMesh *em);
 void            BKE_bmbvh_free(BMBVHTree *tree);
 struct BVHTree *BKE_bmbvh_tree_get(BMBVHTree *tree);
 
@@ -36,10 +36,12 @@
 #include "MEM_guardedalloc.h"
 
 #include "DNA_cloth_types.h"
+#include "DNA_color_types.h"
 #include "DNA_key_types.h"
 #include "DNA_material_types.h"
 #include "DNA_mesh_types.h"
 #include "DNA_meshdata_types.h"
+#include "DNA_modifier_types.h"
 #include "DNA_object_types.h"
 #include "DNA_scene_types.h"
 
@@ -50,6 +52,7 @@
 #include "BLI_utildefines.h"
 #include "BLI_linklist.h"
 #include "BLI_task.h"
+#include "BLI_hash_mm2a.h"
 
 #include "BKE_cdderivedmesh.h"
 #include "BKE_colorband.h"
@@ -402,6 +405,22 @@ void DM_from_template(
 	        CD_MASK_DERIVEDMESH);
 }
 
+/**
+ * Memory used by the custom-data layers of \a dm,
+ * \a r_mem_shared is the memory of layers shared with other meshes (see #CustomData_memory_usage).
+ */
+void DM_memory_usage(DerivedMesh *dm, size_t *r_mem_owned, size_t *r_mem_shared)
+{
+	*r_mem_owned = 0;
+	*r_mem_shared = 0;
+
+	CustomData_memory_usage(&dm->vertData, dm->numVertData, r_mem_owned, r_mem_shared);
+	CustomData_memory_usage(&dm->edgeData, dm->numEdgeData, r_mem_owned, r_mem_shared);
+	CustomData_memory_usage(&dm->faceData, dm->numTessFaceData, r_mem_owned, r_mem_shared);
+	CustomData_memory_usage(&dm->loopData, dm->numLoopData, r_mem_owned, r_mem_shared);
+	CustomData_memory_usage(&dm->polyData, dm->numPolyData, r_mem_owned, r_mem_shared);
+}
+
 int DM_release(DerivedMesh *dm)
 {
 	if (dm->needsFree) {
@@ -1744,6 +1763,605 @@ static void dm_ensure_display_normals(DerivedMesh *dm)
 	}
 }
 
+/* -------------------------------------------------------------------- */
+/** \name Modifier Stack Cache
+ *
+ * The results of modifiers using #eModifierMode_CacheResult are kept on the object,
+ * when the stack is evaluated again the evaluation continues from the last valid result,
+ * so changing a modifier only re-evaluates the modifiers from it.
+ *
+ * Instead of tracking changes, each result is stored with a hash of everything the stack
+ * depends on up to that modifier: the mesh data, the deformed coordinates, the settings
+ * of the modifiers and the state of the objects they use.
+ * Stacks depending on data which can't be hashed (time, simulations, textures,
+ * other kinds of objects, binding data...) are not cached after that point.
+ *
+ * \{ */
+
+/* Memory used by the results kept for a single object. */
+#define MODIFIER_STACK_CACHE_MEM_MAX ((size_t)512 * 1024 * 1024)
+
+typedef struct ModifierStackCacheEntry {
+	struct ModifierStackCacheEntry *next, *prev;
+	/* Only used for comparison, the modifier may have been freed since. */
+	const ModifierData *md;
+	uint64_t hash;
+	DerivedMesh *dm;
+	size_t mem;
+} ModifierStackCacheEntry;
+
+typedef struct ModifierStackCache {
+	ListBase entries;
+} ModifierStackCache;
+
+typedef struct ModifierStackCacheCandidate {
+	ModifierData *md;
+	uint64_t hash;
+} ModifierStackCacheCandidate;
+
+/* Two 32bit hashes, false matches of the cache would go unnoticed. */
+typedef struct ModifierStackCacheHash {
+	BLI_HashMurmur2A mm2[2];
+	bool is_valid;
+} ModifierStackCacheHash;
+
+static void stack_cache_hash_init(ModifierStackCacheHash *h)
+{
+	BLI_hash_mm2a_init(&h->mm2[0], 0);
+	BLI_hash_mm2a_init(&h->mm2[1], 0x9e3779b9);
+	h->is_valid = true;
+}
+
+static void stack_cache_hash_add(ModifierStackCacheHash *h, const void *data, const size_t len)
+{
+	BLI_hash_mm2a_add(&h->mm2[0], data, len);
+	BLI_hash_mm2a_add(&h->mm2[1], data, len);
+}
+
+static void stack_cache_hash_add_int(ModifierStackCacheHash *h, const int data)
+{
+	BLI_hash_mm2a_add_int(&h->mm2[0], data);
+	BLI_hash_mm2a_add_int(&h->mm2[1], data);
+}
+
+static uint64_t stack_cache_hash_get(const ModifierStackCacheHash *h)
+{
+	/* copy, the hash state is added to after this. */
+	BLI_HashMurmur2A mm2[2] = {h->mm2[0], h->mm2[1]};
+	return ((uint64_t)BLI_hash_mm2a_end(&mm2[0]) << 32) | (uint64_t)BLI_hash_mm2a_end(&mm2[1]);
+}
+
+static void stack_cache_hash_customdata(ModifierStackCacheHash *h, const CustomData *data, const int totelem)
+{
+	int i;
+
+	stack_cache_hash_add_int(h, totelem);
+
+	for (i = 0; i < data->totlayer; i++) {
+		const CustomDataLayer *layer = &data->layers[i];
+
+		stack_cache_hash_add_int(h, layer->type);
+		stack_cache_hash_add(h, layer->name, strlen(layer->name));
+
+		if (layer->data == NULL) {
+			continue;
+		}
+
+		/* hash the data of layers using pointers, not the pointers */
+		switch (layer->type) {
+			case CD_MDEFORMVERT:
+			{
+				const MDeformVert *dvert = layer->data;
+				int j;
+				for (j = 0; j < totelem; j++, dvert++) {
+					stack_cache_hash_add_int(h, dvert->totweight);
+					if (dvert->totweight) {
+						stack_cache_hash_add(h, dvert->dw, sizeof(*dvert->dw) * (size_t)dvert->totweight);
+					}
+				}
+				break;
+			}
+			case CD_MDISPS:
+			{
+				const MDisps *mdisps = layer->data;
+				int j;
+				for (j = 0; j < totelem; j++, mdisps++) {
+					stack_cache_hash_add_int(h, mdisps->totdisp);
+					stack_cache_hash_add_int(h, mdisps->level);
+					if (mdisps->disps) {
+						stack_cache_hash_add(h, mdisps->disps, sizeof(*mdisps->disps) * (size_t)mdisps->totdisp);
+					}
+				}
+				break;
+			}
+			case CD_GRID_PAINT_MASK:
+				h->is_valid = false;
+				break;
+			default:
+				stack_cache_hash_add(h, layer->data, (size_t)CustomData_sizeof(layer->type) * (size_t)totelem);
+				break;
+		}
+	}
+}
+
+static void stack_cache_hash_dm(ModifierStackCacheHash *h, DerivedMesh *dm)
+{
+	if (dm->type == DM_TYPE_CDDM) {
+		stack_cache_hash_customdata(h, &dm->vertData, dm->numVertData);
+		stack_cache_hash_customdata(h, &dm->edgeData, dm->numEdgeData);
+		stack_cache_hash_customdata(h, &dm->loopData, dm->numLoopData);
+		stack_cache_hash_customdata(h, &dm->polyData, dm->numPolyData);
+	}
+	else {
+		/* other types don't store their geometry in custom-data */
+		stack_cache_hash_add_int(h, dm->type);
+		stack_cache_hash_add(h, dm->getVertArray(dm), sizeof(MVert) * (size_t)dm->getNumVerts(dm));
+		stack_cache_hash_add(h, dm->getEdgeArray(dm), sizeof(MEdge) * (size_t)dm->getNumEdges(dm));
+		stack_cache_hash_add(h, dm->getLoopArray(dm), sizeof(MLoop) * (size_t)dm->getNumLoops(dm));
+		stack_cache_hash_add(h, dm->getPolyArray(dm), sizeof(MPoly) * (size_t)dm->getNumPolys(dm));
+	}
+}
+
+/* Hash the curves of \a cumap, not the tables evaluated from them or UI state. */
+static void stack_cache_hash_curvemapping(ModifierStackCacheHash *h, const CurveMapping *cumap)
+{
+	int i, j;
+
+	if (cumap == NULL) {
+		stack_cache_hash_add_int(h, 0);
+		return;
+	}
+
+	stack_cache_hash_add_int(h, cumap->flag);
+	stack_cache_hash_add(h, &cumap->clipr, sizeof(cumap->clipr));
+	stack_cache_hash_add(h, cumap->black, sizeof(cumap->black));
+	stack_cache_hash_add(h, cumap->white, sizeof(cumap->white));
+
+	for (i = 0; i < CM_TOT; i++) {
+		const CurveMap *cuma = &cumap->cm[i];
+
+		stack_cache_hash_add_int(h, cuma->flag);
+		stack_cache_hash_add_int(h, cuma->totpoint);
+		for (j = 0; j < cuma->totpoint; j++) {
+			const CurveMapPoint *cmp = &cuma->curve[j];
+			stack_cache_hash_add(h, &cmp->x, sizeof(cmp->x));
+			stack_cache_hash_add(h, &cmp->y, sizeof(cmp->y));
+			stack_cache_hash_add_int(h, cmp->flag & ~CUMA_SELECT);
+		}
+	}
+}
+
+/**
+ * Hash the settings of \a md.
+ *
+ * Data owned by the modifier (curves, vertex indices...) is hashed instead of its pointer,
+ * pointers to runtime data are skipped. ID pointers are kept, see #stack_cache_hash_id_link.
+ */
+static void stack_cache_hash_modifier_settings(ModifierStackCacheHash *h, ModifierData *md)
+{
+	const ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+	ModifierData *md_copy = MEM_mallocN((size_t)mti->structSize, __func__);
+
+	memcpy(md_copy, md, (size_t)mti->structSize);
+
+	switch (md->type) {
+		case eModifierType_Subsurf:
+		{
+			SubsurfModifierData *smd = (SubsurfModifierData *)md_copy;
+			smd->emCache = smd->mCache = NULL;
+			break;
+		}
+		case eModifierType_Armature:
+		{
+			ArmatureModifierData *amd = (ArmatureModifierData *)md_copy;
+			amd->prevCos = NULL;
+			break;
+		}
+		case eModifierType_Hook:
+		{
+			HookModifierData *hmd = (HookModifierData *)md_copy;
+			stack_cache_hash_curvemapping(h, hmd->curfalloff);
+			if (hmd->indexar) {
+				stack_cache_hash_add(h, hmd->indexar, sizeof(*hmd->indexar) * (size_t)hmd->totindex);
+			}
+			hmd->curfalloff = NULL;
+			hmd->indexar = NULL;
+			break;
+		}
+		case eModifierType_Warp:
+		{
+			WarpModifierData *wmd = (WarpModifierData *)md_copy;
+			stack_cache_hash_curvemapping(h, wmd->curfalloff);
+			wmd->curfalloff = NULL;
+			break;
+		}
+		case eModifierType_WeightVGEdit:
+		{
+			WeightVGEditModifierData *wmd = (WeightVGEditModifierData *)md_copy;
+			stack_cache_hash_curvemapping(h, wmd->cmap_curve);
+			wmd->cmap_curve = NULL;
+			break;
+		}
+		case eModifierType_CorrectiveSmooth:
+		{
+			CorrectiveSmoothModifierData *csmd = (CorrectiveSmoothModifierData *)md_copy;
+			if (csmd->bind_coords) {
+				stack_cache_hash_add(h, csmd->bind_coords, sizeof(*csmd->bind_coords) * (size_t)csmd->bind_coords_num);
+			}
+			csmd->bind_coords = NULL;
+			/* calculated from the input */
+			csmd->delta_cache = NULL;
+			csmd->delta_cache_num = 0;
+			break;
+		}
+		default:
+			break;
+	}
+
+	stack_cache_hash_add(h, (const char *)md_copy + sizeof(ModifierData),
+	                     (size_t)mti->structSize - sizeof(ModifierData));
+
+	MEM_freeN(md_copy);
+}
+
+typedef struct StackCacheIDLinkData {
+	ModifierStackCacheHash *hash;
+	bool has_objects;
+} StackCacheIDLinkData;
+
+static void stack_cache_hash_id_link(void *userData, Object *UNUSED(ob), ID **idpoin, int UNUSED(cb_flag))
+{
+	StackCacheIDLinkData *data = userData;
+	ModifierStackCacheHash *h = data->hash;
+	ID *id = *idpoin;
+
+	if (id == NULL) {
+		stack_cache_hash_add_int(h, 0);
+		return;
+	}
+
+	stack_cache_hash_add(h, id->name, strlen(id->name));
+
+	if (GS(id->name) == ID_OB) {
+		Object *ob_link = (Object *)id;
+
+		stack_cache_hash_add(h, ob_link->obmat, sizeof(ob_link->obmat));
+		data->has_objects = true;
+
+		if (ob_link->type == OB_EMPTY) {
+			/* only the transform is used */
+		}
+		else if (ob_link->type == OB_MESH && ob_link->derivedFinal) {
+			stack_cache_hash_dm(h, ob_link->derivedFinal);
+		}
+		else {
+			h->is_valid = false;
+		}
+	}
+	else {
+		/* textures, images... may change without this being noticed */
+		h->is_valid = false;
+	}
+}
+
+static bool stack_cache_modifier_is_supported(ModifierData *md)
+{
+	const ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+
+	if (mti->flags & eModifierTypeFlag_UsesPointCache) {
+		return false;
+	}
+	if (mti->dependsOnTime && mti->dependsOnTime(md)) {
+		return false;
+	}
+	/* simulations and modifiers using particles */
+	if (ELEM(md->type,
+	         eModifierType_ParticleSystem, eModifierType_ParticleInstance, eModifierType_Explode,
+	         eModifierType_Collision, eModifierType_Surface, eModifierType_DynamicPaint,
+	         eModifierType_Fluidsim, eModifierType_Smoke, eModifierType_Ocean))
+	{
+		return false;
+	}
+	/* binding data isn't hashed */
+	if (ELEM(md->type, eModifierType_MeshDeform, eModifierType_SurfaceDeform, eModifierType_LaplacianDeform)) {
+		return false;
+	}
+	return true;
+}
+
+static void stack_cache_hash_eval_options(
+        ModifierStackCacheHash *h, Scene *scene, const int required_mode,
+        const CustomDataMask dataMask, const bool need_mapping)
+{
+	const bool use_render = (required_mode == eModifierMode_Render);
+
+	stack_cache_hash_add_int(h, required_mode);
+	stack_cache_hash_add(h, &dataMask, sizeof(dataMask));
+	stack_cache_hash_add_int(h, need_mapping);
+
+	/* simplify limits the subdivision levels, see get_render_subsurf_level() */
+	if (scene->r.mode & R_SIMPLIFY) {
+		stack_cache_hash_add_int(h, use_render ? scene->r.simplify_subsurf_render : scene->r.simplify_subsurf);
+	}
+	else {
+		stack_cache_hash_add_int(h, -1);
+	}
+}
+
+/* Hash \a md and the data it uses, invalidating \a h when the modifier can't be cached. */
+static void stack_cache_hash_modifier(
+        ModifierStackCacheHash *h, Object *ob, ModifierData *md, const CustomDataMask mask)
+{
+	const ModifierTypeInfo *mti = modifierType_getInfo(md->type);
+	StackCacheIDLinkData link_data = {.hash = h, .has_objects = false};
+	/* UI only flags */
+	const int mode = md->mode & ~(eModifierMode_Expanded | eModifierMode_Editmode | eModifierMode_OnCage);
+
+	if (!stack_cache_modifier_is_supported(md)) {
+		h->is_valid = false;
+		return;
+	}
+
+	stack_cache_hash_add_int(h, md->type);
+	stack_cache_hash_add_int(h, mode);
+	stack_cache_hash_add(h, &mask, sizeof(mask));
+	stack_cache_hash_modifier_settings(h, md);
+
+	if (mti->foreachIDLink) {
+		mti->foreachIDLink(md, ob, stack_cache_hash_id_link, &link_data);
+	}
+	else if (mti->foreachObjectLink) {
+		mti->foreachObjectLink(md, ob, (ObjectWalkFunc)stack_cache_hash_id_link, &link_data);
+	}
+
+	/* other objects are used relative to this one */
+	if (link_data.has_objects) {
+		stack_cache_hash_add(h, ob->obmat, sizeof(ob->obmat));
+	}
+}
+
+/**
+ * Fill \a r_candidates with the modifiers using #eModifierMode_CacheResult,
+ * along with the hash of the stack up to them.
+ *
+ * \return the number of candidates.
+ */
+static int mesh_modifier_stack_cache_candidates(
+        Scene *scene, Object *ob, ModifierData *md, CDMaskLink *curr,
+        const float (*deformedVerts)[3], const int numVerts, const int required_mode,
+        const CustomDataMask dataMask, const bool need_mapping,
+        ModifierStackCacheCandidate **r_candidates)
+{
+	Mesh *me = ob->data;
+	ModifierStackCacheCandidate *candidates = NULL;
+	ModifierStackCacheHash hash;
+	ModifierData *md_iter;
+	CDMaskLink *curr_iter;
+	bDeformGroup *dg;
+	int candidates_len = 0, candidates_max = 0;
+
+	*r_candidates = NULL;
+
+	/* Original coordinates are calculated by applying modifiers to the original mesh
+	 * along with the stack (see 'orcodm'), this can't be resumed. */
+	if (dataMask & (CD_MASK_ORCO | CD_MASK_CLOTH_ORCO)) {
+		return 0;
+	}
+	for (md_iter = md, curr_iter = curr; md_iter; md_iter = md_iter->next, curr_iter = curr_iter->next) {
+		if (curr_iter->mask & (CD_MASK_ORCO | CD_MASK_CLOTH_ORCO)) {
+			return 0;
+		}
+		if ((md_iter->mode & eModifierMode_CacheResult) && modifier_isEnabled(scene, md_iter, required_mode)) {
+			candidates_max++;
+		}
+	}
+
+	if (candidates_max == 0) {
+		return 0;
+	}
+
+	stack_cache_hash_init(&hash);
+	stack_cache_hash_eval_options(&hash, scene, required_mode, dataMask, need_mapping);
+
+	/* object & mesh data */
+	for (dg = ob->defbase.first; dg; dg = dg->next) {
+		stack_cache_hash_add(&hash, dg->name, strlen(dg->name));
+	}
+	stack_cache_hash_add_int(&hash, ob->totcol);
+	stack_cache_hash_add_int(&hash, me->totcol);
+	stack_cache_hash_add_int(&hash, me->flag);
+	stack_cache_hash_add(&hash, &me->smoothresh, sizeof(me->smoothresh));
+	stack_cache_hash_customdata(&hash, &me->vdata, me->totvert);
+	stack_cache_hash_customdata(&hash, &me->edata, me->totedge);
+	stack_cache_hash_customdata(&hash, &me->ldata, me->totloop);
+	stack_cache_hash_customdata(&hash, &me->pdata, me->totpoly);
+
+	/* result of the leading deform modifiers */
+	if (deformedVerts) {
+		stack_cache_hash_add(&hash, deformedVerts, sizeof(*deformedVerts) * (size_t)numVerts);
+	}
+
+	candidates = MEM_malloc_arrayN((size_t)candidates_max, sizeof(*candidates), __func__);
+
+	for (md_iter = md, curr_iter = curr; md_iter; md_iter = md_iter->next, curr_iter = curr_iter->next) {
+		if (!modifier_isEnabled(scene, md_iter, required_mode)) {
+			continue;
+		}
+
+		stack_cache_hash_modifier(&hash, ob, md_iter, curr_iter->mask);
+
+		if (!hash.is_valid) {
+			break;
+		}
+
+		if (md_iter->mode & eModifierMode_CacheResult) {
+			candidates[candidates_len].md = md_iter;
+			candidates[candidates_len].hash = stack_cache_hash_get(&hash);
+			candidates_len++;
+		}
+	}
+
+	if (candidates_len == 0) {
+		MEM_freeN(candidates);
+		candidates = NULL;
+	}
+
+	*r_candidates = candidates;
+	return candidates_len;
+}
+
+/**
+ * Hash of the evaluation options and \a md alone, as used by the cache.
+ *
+ * \return false when the result of \a md can't be cached.
+ * \note Exposed for tests.
+ */
+bool mesh_modifier_stack_cache_modifier_hash(
+        Scene *scene, Object *ob, ModifierData *md, const int required_mode, uint64_t *r_hash)
+{
+	ModifierStackCacheHash hash;
+
+	stack_cache_hash_init(&hash);
+	stack_cache_hash_eval_options(&hash, scene, required_mode, 0, false);
+	stack_cache_hash_modifier(&hash, ob, md, 0);
+
+	*r_hash = stack_cache_hash_get(&hash);
+	return hash.is_valid;
+}
+
+static void mesh_modifier_stack_cache_entry_free(ModifierStackCache *cache, ModifierStackCacheEntry *entry)
+{
+	entry->dm->needsFree = 1;
+	entry->dm->release(entry->dm);
+	BLI_freelinkN(&cache->entries, entry);
+}
+
+static ModifierStackCacheEntry *mesh_modifier_stack_cache_find(
+        ModifierStackCache *cache, const ModifierStackCacheCandidate *candidate)
+{
+	ModifierStackCacheEntry *entry;
+
+	for (entry = cache->entries.first; entry; entry = entry->next) {
+		if ((entry->md == candidate->md) && (entry->hash == candidate->hash)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Free the results which don't match the current stack.
+ *
+ * \return the index of the last candidate with a result or -1.
+ */
+static int mesh_modifier_stack_cache_update(
+        Object *ob, const ModifierStackCacheCandidate *candidates, const int candidates_len)
+{
+	ModifierStackCache *cache = ob->modifier_stack_cache;
+	ModifierStackCacheEntry *entry, *entry_next;
+	int i, index = -1;
+
+	if (cache == NULL) {
+		return -1;
+	}
+
+	for (entry = cache->entries.first; entry; entry = entry_next) {
+		entry_next = entry->next;
+
+		for (i = 0; i < candidates_len; i++) {
+			if ((entry->md == candidates[i].md) && (entry->hash == candidates[i].hash)) {
+				index = max_ii(index, i);
+				break;
+			}
+		}
+
+		if (i == candidates_len) {
+			mesh_modifier_stack_cache_entry_free(cache, entry);
+		}
+	}
+
+	if (BLI_listbase_is_empty(&cache->entries)) {
+		mesh_modifier_stack_cache_free(ob);
+	}
+
+	return index;
+}
+
+/**
+ * Keep the result of the \a candidate modifier,
+ * \a r_dm is replaced by a copy sharing its data with the stored result.
+ */
+static void mesh_modifier_stack_cache_store(
+        Object *ob, ModifierData *firstmd, const ModifierStackCacheCandidate *candidate, DerivedMesh **r_dm)
+{
+	ModifierStackCache *cache = ob->modifier_stack_cache;
+	ModifierStackCacheEntry *entry;
+	ModifierData *md;
+	DerivedMesh *dm;
+	size_t mem_owned, mem_shared, mem_total = 0;
+
+	if (cache && mesh_modifier_stack_cache_find(cache, candidate)) {
+		return;
+	}
+
+	/* errors would not be set again when using the result */
+	for (md = firstmd; md; md = md->next) {
+		if (md->error) {
+			return;
+		}
+		if (md == candidate->md) {
+			break;
+		}
+	}
+
+	if (cache) {
+		for (entry = cache->entries.first; entry; entry = entry->next) {
+			mem_total += entry->mem;
+		}
+	}
+
+	dm = CDDM_copy_shared(*r_dm);
+	/* the result may reference the original mesh data, which is freed or reallocated
+	 * while the result is kept (leaving edit-mode for e.g.), only keep owned or shared data */
+	CDDM_duplicate_unshared_referenced_layers(dm);
+	DM_memory_usage(dm, &mem_owned, &mem_shared);
+
+	if (mem_total + mem_owned + mem_shared > MODIFIER_STACK_CACHE_MEM_MAX) {
+		dm->release(dm);
+		return;
+	}
+
+	if (cache == NULL) {
+		cache = ob->modifier_stack_cache = MEM_callocN(sizeof(*cache), __func__);
+	}
+
+	entry = MEM_mallocN(sizeof(*entry), __func__);
+	entry->md = candidate->md;
+	entry->hash = candidate->hash;
+	entry->dm = dm;
+	entry->mem = mem_owned + mem_shared;
+	BLI_addtail(&cache->entries, entry);
+
+	/* continue with the same data as when the result is used */
+	(*r_dm)->release(*r_dm);
+	*r_dm = CDDM_copy_shared(dm);
+}
+
+void mesh_modifier_stack_cache_free(Object *ob)
+{
+	ModifierStackCache *cache = ob->modifier_stack_cache;
+
+	if (cache) {
+		while (cache->entries.first) {
+			mesh_modifier_stack_cache_entry_free(cache, cache->entries.first);
+		}
+		MEM_freeN(cache);
+		ob->modifier_stack_cache = NULL;
+	}
+}
+
+/** \} */
+
 /**
  * new value for useDeform -1  (hack for the gameengine):
  *
@@ -1770,6 +2388,9 @@ static void mesh_calc_modifiers(
 	int numVerts = me->totvert;
 	const int required_mode = useRenderParams ? eModifierMode_Render : eModifierMode_Realtime;
 	bool isPrevDeform = false;
+	/* When no modifier is applied after the leading deforming modifiers,
+	 * the final mesh is the same as the deform mesh. */
+	bool is_deform_final = true;
 	const bool skipVirtualArmature = (useDeform < 0);
 	MultiresModifierData *mmd = get_multires_modifier(scene, ob, 0);
 	const bool has_multires = (mmd && mmd->sculptlvl != 0);
@@ -1796,6 +2417,9 @@ static void mesh_calc_modifiers(
 	ModifierApplyFlag app_flags = useRenderParams ? MOD_APPLY_RENDER : 0;
 	ModifierApplyFlag deform_app_flags = app_flags;
 
+	/* Results kept for modifiers using eModifierMode_CacheResult (only for regular viewport evaluation). */
+	ModifierStackCacheCandidate *cache_candidates = NULL;
+	int cache_candidates_len = 0, cache_candidate_index = 0;
 
 	if (useCache)
 		app_flags |= MOD_APPLY_USECACHE;
@@ -1905,6 +2529,38 @@ static void mesh_calc_modifiers(
 	orcodm = NULL;
 	clothorcodm = NULL;
 
+	if ((useDeform > 0) && !useRenderParams && (index == -1) && !inputVertexCos && !build_shapekey_layers &&
+	    !sculpt_mode && !do_init_wmcol && (previewmd == NULL))
+	{
+		int cache_index;
+
+		cache_candidates_len = mesh_modifier_stack_cache_candidates(
+		        scene, ob, md, curr, (const float (*)[3])deformedVerts, numVerts, required_mode,
+		        dataMask, need_mapping, &cache_candidates);
+		cache_index = mesh_modifier_stack_cache_update(ob, cache_candidates, cache_candidates_len);
+
+		if (cache_index != -1) {
+			/* Continue from the kept result. */
+			ModifierStackCacheEntry *entry = mesh_modifier_stack_cache_find(
+			        ob->modifier_stack_cache, &cache_candidates[cache_index]);
+
+			while (md != cache_candidates[cache_index].md) {
+				md = md->next;
+				curr = curr->next;
+			}
+			md = md->next;
+			curr = curr->next;
+
+			dm = CDDM_copy_shared(entry->dm);
+			if (deformedVerts) {
+				MEM_freeN(deformedVerts);
+				deformedVerts = NULL;
+			}
+			is_deform_final = false;
+			cache_candidate_index = cache_index + 1;
+		}
+	}
+
 	for (; md; md = md->next, curr = curr->next) {
 		const ModifierTypeInfo *mti = modifierType_getInfo(md->type);
 
@@ -1972,6 +2628,8 @@ static void mesh_calc_modifiers(
 		if (dm && (mask & CD_MASK_ORCO))
 			add_orco_dm(ob, NULL, dm, orcodm, CD_ORCO);
 
+		is_deform_final = false;
+
 		/* How to apply modifier depends on (a) what we already have as
 		 * a result of previous modifiers (could be a DerivedMesh or just
 		 * deformed vertices) and (b) what type the modifier is.
@@ -2018,7 +2676,8 @@ static void mesh_calc_modifiers(
 			/* apply vertex coordinates or build a DerivedMesh as necessary */
 			if (dm) {
 				if (deformedVerts) {
-					DerivedMesh *tdm = CDDM_copy(dm);
+					/* only coordinates change, share all other data */
+					DerivedMesh *tdm = CDDM_copy_shared(dm);
 					dm->release(dm);
 					dm = tdm;
 
@@ -2151,6 +2810,17 @@ static void mesh_calc_modifiers(
 
 		isPrevDeform = (mti->type == eModifierTypeType_OnlyDeform);
 
+		if (dm && !deformedVerts) {
+			int i;
+			for (i = cache_candidate_index; i < cache_candidates_len; i++) {
+				if (cache_candidates[i].md == md) {
+					mesh_modifier_stack_cache_store(ob, firstmd, &cache_candidates[i], &dm);
+					cache_candidate_index = i + 1;
+					break;
+				}
+			}
+		}
+
 		/* grab modifiers until index i */
 		if ((index != -1) && (BLI_findindex(&ob->modifiers, md) >= index))
 			break;
@@ -2163,12 +2833,16 @@ static void mesh_calc_modifiers(
 	for (md = firstmd; md; md = md->next)
 		modifier_freeTemporaryData(md);
 
+	if (cache_candidates) {
+		MEM_freeN(cache_candidates);
+	}
+
 	/* Yay, we are done. If we have a DerivedMesh and deformed vertices
 	 * need to apply these back onto the DerivedMesh. If we have no
 	 * DerivedMesh then we need to build one.
 	 */
 	if (dm && deformedVerts) {
-		finaldm = CDDM_copy(dm);
+		finaldm = CDDM_copy_shared(dm);
 
 		dm->release(dm);
 
@@ -2189,6 +2863,17 @@ static void mesh_calc_modifiers(
 			DM_update_weight_mcol(ob, finaldm, draw_flag, NULL, 0, NULL);
 #endif
 	}
+	else if (is_deform_final && r_deform && *r_deform && !build_shapekey_layers) {
+		/* Only deforming modifiers, share the deformed coordinates (and the rest)
+		 * instead of copying the vertices again.
+		 * Vertex normals are stored in the vertices, calculate them before sharing
+		 * so the final mesh doesn't need its own copy to update them. */
+		DM_ensure_normals(*r_deform);
+		finaldm = CDDM_copy_shared(*r_deform);
+
+		if (do_init_wmcol)
+			DM_update_weight_mcol(ob, finaldm, draw_flag, NULL, 0, NULL);
+	}
 	else {
 		finaldm = CDDM_from_mesh(me);
 		
@@ -2405,10 +3090,15 @@ static void editbmesh_calc_modifiers(
 			/* apply vertex coordinates or build a DerivedMesh as necessary */
 			if (dm) {
 				if (deformedVerts) {
-					DerivedMesh *tdm = CDDM_copy(dm);
+					DerivedMesh *tdm;
 					if (!(r_cage && dm == *r_cage)) {
+						/* only coordinates change, share all other data */
+						tdm = CDDM_copy_shared(dm);
 						dm->release(dm);
 					}
+					else {
+						tdm = CDDM_copy(dm);
+					}
 					dm = tdm;
 
 					CDDM_apply_vert_coords(dm, deformedVerts);
@@ -2519,11 +3209,13 @@ static void editbmesh_calc_modifiers(
 	 * then we need to build one.
 	 */
 	if (dm && deformedVerts) {
-		*r_final = CDDM_copy(dm);
-
 		if (!(r_cage && dm == *r_cage)) {
+			*r_final = CDDM_copy_shared(dm);
 			dm->release(dm);
 		}
+		else {
+			*r_final = CDDM_copy(dm);
+		}
 
 		CDDM_apply_vert_coords(*r_final, deformedVerts);
 	}
@@ -2635,6 +3327,22 @@ static bool calc_modifiers_skip_orco(Scene *scene,
 }
 #endif
 
+static void mesh_build_data_print_memory(const char *name, DerivedMesh *dm_final, DerivedMesh *dm_other)
+{
+	size_t mem_owned, mem_shared;
+
+	DM_memory_usage(dm_final, &mem_owned, &mem_shared);
+	if (dm_other && dm_other != dm_final) {
+		size_t mem_other_owned, mem_other_shared;
+		DM_memory_usage(dm_other, &mem_other_owned, &mem_other_shared);
+		mem_owned += mem_other_owned;
+		mem_shared += mem_other_shared;
+	}
+
+	printf("%s: %s derived mesh memory, owned: %.3f MB, shared: %.3f MB\n",
+	       __func__, name, (double)mem_owned / (1024.0 * 1024.0), (double)mem_shared / (1024.0 * 1024.0));
+}
+
 static void mesh_build_data(
         Scene *scene, Object *ob, CustomDataMask dataMask,
         const bool build_shapekey_layers, const bool need_mapping)
@@ -2662,6 +3370,10 @@ static void mesh_build_data(
 	ob->lastDataMask = dataMask;
 	ob->lastNeedMapping = need_mapping;
 
+	if (G.debug & G_DEBUG_DEPSGRAPH_EVAL) {
+		mesh_build_data_print_memory(ob->id.name + 2, ob->derivedFinal, ob->derivedDeform);
+	}
+
 	if ((ob->mode & OB_MODE_ALL_SCULPT) && ob->sculpt) {
 		/* create PBVH immediately (would be created on the fly too,
 		 * but this avoids waiting on first stroke) */
@@ -2695,6 +3407,10 @@ static void editbmesh_build_data(Scene *scene, Object *obedit, BMEditMesh *em, C
 	em->derivedFinal->needsFree = 0;
 	em->derivedCage->needsFree = 0;
 
+	if (G.debug & G_DEBUG_DEPSGRAPH_EVAL) {
+		mesh_build_data_print_memory(obedit->id.name + 2, em->derivedFinal, em->derivedCage);
+	}
+
 	BLI_assert(!(em->derivedFinal->dirty & DM_DIRTY_NORMALS));
 }
 
@@ -40,6 +40,7 @@
 #include "BLI_edgehash.h"
 #include "BLI_utildefines.h"
 #include "BLI_utildefines_stack.h"
+#include "BLI_task.h"
 
 #include "BKE_pbvh.h"
 #include "BKE_cdderivedmesh.h"
@@ -2480,6 +2481,70 @@ DerivedMesh *CDDM_copy_with_tessface(DerivedMesh *source)
 	return cddm_copy_ex(source, true, false);
 }
 
+/**
+ * Same as #CDDM_copy but the layers of a CDDM \a source are shared instead of duplicated,
+ * they're only copied when written (see #CD_SHARE), other DerivedMesh types are copied.
+ *
+ * Use when only some of the data is going to change, e.g. applying deformed coordinates.
+ */
+DerivedMesh *CDDM_copy_shared(DerivedMesh *source)
+{
+	const CustomDataMask mask = (CD_MASK_DERIVEDMESH |
+	                             CD_MASK_MVERT | CD_MASK_MEDGE | CD_MASK_MLOOP | CD_MASK_MPOLY);
+	CDDerivedMesh *cddm;
+	DerivedMesh *dm;
+
+	if (source->type != DM_TYPE_CDDM) {
+		return CDDM_copy(source);
+	}
+
+	cddm = cdDM_create(__func__);
+	dm = &cddm->dm;
+
+	DM_init(dm, DM_TYPE_CDDM, source->numVertData, source->numEdgeData, 0,
+	        source->numLoopData, source->numPolyData);
+	dm->deformedOnly = source->deformedOnly;
+	dm->cd_flag = source->cd_flag;
+	/* Tessellation data is never copied, same as #CDDM_copy. */
+	dm->dirty = source->dirty | DM_DIRTY_TESS_CDLAYERS;
+
+	CustomData_merge(&source->vertData, &dm->vertData, mask, CD_SHARE, dm->numVertData);
+	CustomData_merge(&source->edgeData, &dm->edgeData, mask, CD_SHARE, dm->numEdgeData);
+	CustomData_merge(&source->loopData, &dm->loopData, mask, CD_SHARE, dm->numLoopData);
+	CustomData_merge(&source->polyData, &dm->polyData, mask, CD_SHARE, dm->numPolyData);
+
+	cddm->mvert = CustomData_get_layer(&dm->vertData, CD_MVERT);
+	cddm->medge = CustomData_get_layer(&dm->edgeData, CD_MEDGE);
+	cddm->mloop = CustomData_get_layer(&dm->loopData, CD_MLOOP);
+	cddm->mpoly = CustomData_get_layer(&dm->polyData, CD_MPOLY);
+
+	return dm;
+}
+
+/**
+ * Duplicate the data \a dm references from elsewhere (the original mesh for e.g.),
+ * so \a dm can be kept after its owner is freed or changed.
+ * Data shared with other derived meshes is kept, it's reference counted.
+ */
+void CDDM_duplicate_unshared_referenced_layers(DerivedMesh *dm)
+{
+	CDDerivedMesh *cddm = (CDDerivedMesh *)dm;
+
+	BLI_assert(dm->type == DM_TYPE_CDDM);
+
+	CustomData_duplicate_unshared_referenced_layers(&dm->vertData, dm->numVertData);
+	CustomData_duplicate_unshared_referenced_layers(&dm->edgeData, dm->numEdgeData);
+	CustomData_duplicate_unshared_referenced_layers(&dm->faceData, dm->numTessFaceData);
+	CustomData_duplicate_unshared_referenced_layers(&dm->loopData, dm->numLoopData);
+	CustomData_duplicate_unshared_referenced_layers(&dm->polyData, dm->numPolyData);
+
+	cddm->mvert = CustomData_get_layer(&dm->vertData, CD_MVERT);
+	cddm->medge = CustomData_get_layer(&dm->edgeData, CD_MEDGE);
+	cddm->mface = CustomData_get_layer(&dm->faceData, CD_MFACE);
+	cddm->mloop = CustomData_get_layer(&dm->loopData, CD_MLOOP);
+	cddm->mpoly = CustomData_get_layer(&dm->polyData, CD_MPOLY);
+}
+
 /* note, the CD_ORIGINDEX layers are all 0, so if there is a direct
  * relationship between mesh data this needs to be set by the caller. */
 DerivedMesh *CDDM_from_template_ex(
@@ -2582,11 +2647,13 @@ void CDDM_calc_normals_mapping_ex(DerivedMesh *dm, const bool only_face_normals)
 	/* now we skip calculating vertex normals for referenced layer,
 	 * no need to duplicate verts.
 	 * WATCH THIS, bmesh only change!,
-	 * need to take care of the side effects here - campbell */
-#if 0
-	/* we don't want to overwrite any referenced layers */
-	cddm->mvert = CustomData_duplicate_referenced_layer(&dm->vertData, CD_MVERT, dm->numVertData);
-#endif
+	 * need to take care of the side effects here - campbell
+	 *
+	 * Vertices shared with another derived mesh (see CD_SHARE) must be copied
+	 * before their normals are written though. */
+	if (!only_face_normals && CustomData_is_shared_layer(&dm->vertData, CD_MVERT)) {
+		cddm->mvert = CustomData_duplicate_referenced_layer(&dm->vertData, CD_MVERT, dm->numVertData);
+	}
 
 #if 0
 	if (dm->numTessFaceData == 0) {
@@ -2695,9 +2762,18 @@ void CDDM_calc_loop_normals_spacearr(
 	const int numLoops = dm->getNumLoops(dm);
 	const int numPolys = dm->getNumPolys(dm);
 
+	/* don't write vertex normals into vertices shared with another derived mesh
+	 * (also used by CCGDM, which keeps no vertex layer of its own) */
+	if ((dm->type == DM_TYPE_CDDM) && (dm->dirty & DM_DIRTY_NORMALS) &&
+	    CustomData_is_shared_layer(&dm->vertData, CD_MVERT))
+	{
+		CDDerivedMesh *cddm = (CDDerivedMesh *)dm;
+		cddm->mvert = mverts = CustomData_duplicate_referenced_layer(&dm->vertData, CD_MVERT, numVerts);
+	}
+
 	ldata = dm->getLoopDataLayout(dm);
 	if (CustomData_has_layer(ldata, CD_NORMAL)) {
-		lnors = CustomData_get_layer(ldata, CD_NORMAL);
+		lnors = CustomData_duplicate_referenced_layer(ldata, CD_NORMAL, numLoops);
 	}
 	else {
 		lnors = CustomData_add_layer(ldata, CD_NORMAL, CD_CALLOC, NULL, numLoops);
@@ -2706,7 +2782,7 @@ void CDDM_calc_loop_normals_spacearr(
 	/* Compute poly (always needed) and vert normals. */
 	/* Note we can't use DM_ensure_normals, since it won't keep computed poly nors... */
 	pdata = dm->getPolyDataLayout(dm);
-	pnors = CustomData_get_layer(pdata, CD_NORMAL);
+	pnors = CustomData_duplicate_referenced_layer(pdata, CD_NORMAL, numPolys);
 	if (!pnors) {
 		pnors = CustomData_add_layer(pdata, CD_NORMAL, CD_CALLOC, NULL, numPolys);
 	}
@@ -3466,74 +3542,122 @@ void CDDM_calc_edges_tessface(DerivedMesh *dm)
 	BLI_edgeset_free(eh);
 }
 
+typedef struct CDDMCalcEdgesData {
+	const MPoly *mpoly;
+	MLoop *mloop;
+	unsigned int (*edges)[2];
+	const unsigned int *edge_map;
+	const unsigned int *edge_first;
+	/* Edges used by loops, these don't keep their original data. */
+	bool *edge_from_loop;
+	const MEdge *medge_orig;
+	const int *eindex;
+	MEdge *medge;
+	int *index;
+	int numEdges_orig;
+} CDDMCalcEdgesData;
+
+static void cddm_calc_edges_loop_fill_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	CDDMCalcEdgesData *data = userdata;
+	const MPoly *mp = &data->mpoly[i];
+	unsigned int (*edges)[2] = &data->edges[data->numEdges_orig + mp->loopstart];
+	for (int j = 0; j < mp->totloop; j++) {
+		edges[j][0] = data->mloop[mp->loopstart + j].v;
+		edges[j][1] = ME_POLY_LOOP_NEXT(data->mloop, mp, j)->v;
+	}
+}
+
+static void cddm_calc_edges_loop_assign_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	CDDMCalcEdgesData *data = userdata;
+	const unsigned int edge_index = data->edge_map[data->numEdges_orig + i];
+	data->mloop[i].e = edge_index;
+	data->edge_from_loop[edge_index] = true;
+}
+
+static void cddm_calc_edges_edge_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	CDDMCalcEdgesData *data = userdata;
+	const unsigned int j = data->edge_first[i];
+	MEdge *med = &data->medge[i];
+
+	med->v1 = MIN2(data->edges[j][0], data->edges[j][1]);
+	med->v2 = MAX2(data->edges[j][0], data->edges[j][1]);
+
+	if (data->edge_from_loop[i] || !data->eindex) {
+		med->flag = ME_EDGEDRAW | ME_EDGERENDER;
+		data->index[i] = ORIGINDEX_NONE;
+	}
+	else {
+		BLI_assert((int)j < data->numEdges_orig);
+		med->flag = ME_EDGEDRAW | ME_EDGERENDER | data->medge_orig[j].flag;
+		data->index[i] = data->eindex[j];
+	}
+}
+
 /* warning, this uses existing edges but CDDM_calc_edges_tessface() doesn't */
 void CDDM_calc_edges(DerivedMesh *dm)
 {
 	CDDerivedMesh *cddm = (CDDerivedMesh *)dm;
 	CustomData edgeData;
-	EdgeHashIterator *ehi;
-	MPoly *mp = cddm->mpoly;
-	MLoop *ml;
-	MEdge *med, *origmed;
-	EdgeHash *eh;
-	unsigned int eh_reserve;
-	int v1, v2;
-	const int *eindex;
-	int i, j, *index;
+	MEdge *med = cddm->medge;
 	const int numFaces = dm->numPolyData;
 	const int numLoops = dm->numLoopData;
-	int numEdges = dm->numEdgeData;
-
-	eindex = DM_get_edge_data_layer(dm, CD_ORIGINDEX);
-	med = cddm->medge;
-
-	eh_reserve = max_ii(med ? numEdges : 0, BLI_EDGEHASH_SIZE_GUESS_FROM_LOOPS(numLoops));
-	eh = BLI_edgehash_new_ex(__func__, eh_reserve);
-	if (med) {
-		for (i = 0; i < numEdges; i++, med++) {
-			BLI_edgehash_insert(eh, med->v1, med->v2, SET_INT_IN_POINTER(i + 1));
-		}
-	}
-
-	for (i = 0; i < numFaces; i++, mp++) {
-		ml = cddm->mloop + mp->loopstart;
-		for (j = 0; j < mp->totloop; j++, ml++) {
-			v1 = ml->v;
-			v2 = ME_POLY_LOOP_NEXT(cddm->mloop, mp, j)->v;
-			BLI_edgehash_reinsert(eh, v1, v2, NULL);
-		}
-	}
+	const int numEdges_orig = med ? dm->numEdgeData : 0;
+	const int numEdges_all = numEdges_orig + numLoops;
+	int numEdges;
+	int i;
 
-	numEdges = BLI_edgehash_len(eh);
+	CDDMCalcEdgesData data = {
+		.mpoly = cddm->mpoly,
+		.mloop = cddm->mloop,
+		.edges = MEM_mallocN(sizeof(*data.edges) * (size_t)numEdges_all, __func__),
+		.medge_orig = med,
+		.eindex = DM_get_edge_data_layer(dm, CD_ORIGINDEX),
+		.numEdges_orig = numEdges_orig,
+	};
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (numLoops > BKE_MESH_OMP_LIMIT);
+	settings.min_iter_per_thread = 1024;
+
+	/* existing edges first, then the edges of all loops */
+	for (i = 0; i < numEdges_orig; i++, med++) {
+		data.edges[i][0] = med->v1;
+		data.edges[i][1] = med->v2;
+	}
+	BLI_task_parallel_range(0, numFaces, &data, cddm_calc_edges_loop_fill_cb, &settings);
+
+	unsigned int *edge_map = MEM_mallocN(sizeof(*edge_map) * (size_t)numEdges_all, __func__);
+	unsigned int *edge_first = MEM_mallocN(sizeof(*edge_first) * (size_t)numEdges_all, __func__);
+	numEdges = (int)BLI_edges_dedup(
+	        (const unsigned int (*)[2])data.edges, (unsigned int)numEdges_all, (unsigned int)dm->numVertData,
+	        edge_map, edge_first, settings.use_threading);
+	data.edge_map = edge_map;
+	data.edge_first = edge_first;
+	data.edge_from_loop = MEM_callocN(sizeof(*data.edge_from_loop) * (size_t)numEdges, __func__);
+
+	BLI_task_parallel_range(0, numLoops, &data, cddm_calc_edges_loop_assign_cb, &settings);
 
 	/* write new edges into a temporary CustomData */
 	CustomData_reset(&edgeData);
 	CustomData_add_layer(&edgeData, CD_MEDGE, CD_CALLOC, NULL, numEdges);
 	CustomData_add_layer(&edgeData, CD_ORIGINDEX, CD_CALLOC, NULL, numEdges);
 
-	origmed = cddm->medge;
-	med = CustomData_get_layer(&edgeData, CD_MEDGE);
-	index = CustomData_get_layer(&edgeData, CD_ORIGINDEX);
-
-	for (ehi = BLI_edgehashIterator_new(eh), i = 0;
-	     BLI_edgehashIterator_isDone(ehi) == false;
-	     BLI_edgehashIterator_step(ehi), ++i, ++med, ++index)
-	{
-		BLI_edgehashIterator_getKey(ehi, &med->v1, &med->v2);
-		j = GET_INT_FROM_POINTER(BLI_edgehashIterator_getValue(ehi));
-
-		if (j == 0 || !eindex) {
-			med->flag = ME_EDGEDRAW | ME_EDGERENDER;
-			*index = ORIGINDEX_NONE;
-		}
-		else {
-			med->flag = ME_EDGEDRAW | ME_EDGERENDER | origmed[j - 1].flag;
-			*index = eindex[j - 1];
-		}
-
-		BLI_edgehashIterator_setValue(ehi, SET_INT_IN_POINTER(i));
-	}
-	BLI_edgehashIterator_free(ehi);
+	data.medge = CustomData_get_layer(&edgeData, CD_MEDGE);
+	data.index = CustomData_get_layer(&edgeData, CD_ORIGINDEX);
+	BLI_task_parallel_range(0, numEdges, &data, cddm_calc_edges_edge_cb, &settings);
 
 	/* free old CustomData and assign new one */
 	CustomData_free(&dm->edgeData, dm->numEdgeData);
@@ -3542,17 +3666,10 @@ void CDDM_calc_edges(DerivedMesh *dm)
 
 	cddm->medge = CustomData_get_layer(&dm->edgeData, CD_MEDGE);
 
-	mp = cddm->mpoly;
-	for (i = 0; i < numFaces; i++, mp++) {
-		ml = cddm->mloop + mp->loopstart;
-		for (j = 0; j < mp->totloop; j++, ml++) {
-			v1 = ml->v;
-			v2 = ME_POLY_LOOP_NEXT(cddm->mloop, mp, j)->v;
-			ml->e = GET_INT_FROM_POINTER(BLI_edgehash_lookup(eh, v1, v2));
-		}
-	}
-
-	BLI_edgehash_free(eh, NULL);
+	MEM_freeN(data.edges);
+	MEM_freeN(data.edge_from_loop);
+	MEM_freeN(edge_map);
+	MEM_freeN(edge_first);
 }
 
 void CDDM_lower_num_verts(DerivedMesh *dm, int numVerts)
@@ -60,6 +60,8 @@
 
 #include "bmesh.h"
 
+#include "atomic_ops.h"
+
 /* only for customdata_data_transfer_interp_normal_normals */
 #include "data_transfer_intern.h"
 
@@ -69,6 +71,12 @@
 /* ensure typemap size is ok */
 BLI_STATIC_ASSERT(ARRAY_SIZE(((CustomData *)NULL)->typemap) == CD_NUMTYPES, "size mismatch");
 
+/* Layer data shared between several layers (see CD_SHARE),
+ * the data is freed by the last layer using it. */
+typedef struct CustomDataShared {
+	int users;
+} CustomDataShared;
+
 
 /********************* Layer type information **********************/
 typedef struct LayerTypeInfo {
@@ -1437,6 +1445,62 @@ static bool customdata_typemap_is_valid(const CustomData *data)
 }
 #endif
 
+/**
+ * Share the data of \a layer with \a layer_dst (a reference to the same data),
+ * an owned layer becomes shared on first use.
+ * Referenced layers are owned elsewhere, \a layer_dst only references them too.
+ *
+ * \note \a layer may be shared from multiple threads at once (merging from the same source),
+ * the user counter is created with an atomic compare-and-swap and only then flagged NOFREE.
+ */
+static void customData_layer_share(CustomDataLayer *layer, CustomDataLayer *layer_dst)
+{
+	/* Read the flag before the counter: when another thread made the layer shared,
+	 * its counter is set before the flag. */
+	const int flag = layer->flag;
+	CustomDataShared *shared = atomic_cas_ptr((void **)&layer->shared, NULL, NULL);
+
+	if (shared == NULL) {
+		CustomDataShared *shared_new;
+
+		if (flag & CD_FLAG_NOFREE) {
+			return;
+		}
+
+		shared_new = MEM_mallocN(sizeof(*shared_new), __func__);
+		shared_new->users = 1;
+		shared = atomic_cas_ptr((void **)&layer->shared, NULL, shared_new);
+		if (shared == NULL) {
+			shared = shared_new;
+			atomic_fetch_and_or_int32(&layer->flag, CD_FLAG_NOFREE);
+		}
+		else {
+			MEM_freeN(shared_new);
+		}
+	}
+
+	atomic_add_and_fetch_int32(&shared->users, 1);
+	layer_dst->shared = shared;
+}
+
+/**
+ * Remove the user of shared data from \a layer.
+ *
+ * \return true when it was the last user, the layer then owns the data.
+ */
+static bool customData_layer_unshare(CustomDataLayer *layer)
+{
+	const bool is_last = (atomic_sub_and_fetch_int32(&layer->shared->users, 1) == 0);
+
+	if (is_last) {
+		MEM_freeN(layer->shared);
+		layer->flag &= ~CD_FLAG_NOFREE;
+	}
+	layer->shared = NULL;
+
+	return is_last;
+}
+
 bool CustomData_merge(const struct CustomData *source, struct CustomData *dest,
                       CustomDataMask mask, int alloctype, int totelem)
 {
@@ -1475,6 +1539,7 @@ bool CustomData_merge(const struct CustomData *source, struct CustomData *dest,
 			case CD_ASSIGN:
 			case CD_REFERENCE:
 			case CD_DUPLICATE:
+			case CD_SHARE:
 				data = layer->data;
 				break;
 			default:
@@ -1482,7 +1547,16 @@ bool CustomData_merge(const struct CustomData *source, struct CustomData *dest,
 				break;
 		}
 
-		if ((alloctype == CD_ASSIGN) && (flag & CD_FLAG_NOFREE)) {
+		if ((alloctype == CD_SHARE) ||
+		    (layer->shared && ELEM(alloctype, CD_ASSIGN, CD_REFERENCE)))
+		{
+			/* referencing shared data has to add a user, so it isn't freed meanwhile */
+			newlayer = customData_add_layer__internal(dest, type, CD_REFERENCE, data, totelem, layer->name);
+			if (newlayer && data) {
+				customData_layer_share(layer, newlayer);
+			}
+		}
+		else if ((alloctype == CD_ASSIGN) && (flag & CD_FLAG_NOFREE)) {
 			newlayer = customData_add_layer__internal(dest, type, CD_REFERENCE, data, totelem, layer->name);
 		}
 		else {
@@ -1531,18 +1605,25 @@ void CustomData_copy(const struct CustomData *source, struct CustomData *dest,
 	CustomData_merge(source, dest, mask, alloctype, totelem);
 }
 
-static void customData_free_layer__internal(CustomDataLayer *layer, int totelem)
+static void customData_free_layer_data(int type, void *data, int totelem)
 {
-	const LayerTypeInfo *typeInfo;
+	const LayerTypeInfo *typeInfo = layerType_getInfo(type);
 
-	if (!(layer->flag & CD_FLAG_NOFREE) && layer->data) {
-		typeInfo = layerType_getInfo(layer->type);
+	if (typeInfo->free)
+		typeInfo->free(data, totelem, typeInfo->size);
+
+	MEM_freeN(data);
+}
 
-		if (typeInfo->free)
-			typeInfo->free(layer->data, totelem, typeInfo->size);
+static void customData_free_layer__internal(CustomDataLayer *layer, int totelem)
+{
+	if (layer->shared) {
+		/* the last user frees the data */
+		customData_layer_unshare(layer);
+	}
 
-		if (layer->data)
-			MEM_freeN(layer->data);
+	if (!(layer->flag & CD_FLAG_NOFREE) && layer->data) {
+		customData_free_layer_data(layer->type, layer->data, totelem);
 	}
 }
 
@@ -1882,6 +1963,7 @@ static CustomDataLayer *customData_add_layer__internal(CustomData *data, int typ
 	data->layers[index].type = type;
 	data->layers[index].flag = flag;
 	data->layers[index].data = newlayerdata;
+	data->layers[index].shared = NULL;
 
 	if (name || (name = DATA_(typeInfo->defaultname))) {
 		BLI_strncpy(data->layers[index].name, name, sizeof(data->layers[index].name));
@@ -2039,12 +2121,18 @@ static void *customData_duplicate_referenced_layer_index(CustomData *data, const
 
 	layer = &data->layers[layer_index];
 
+	if (layer->shared && (layer->shared->users == 1)) {
+		/* other users are gone, no need to copy */
+		customData_layer_unshare(layer);
+	}
+
 	if (layer->flag & CD_FLAG_NOFREE) {
 		/* MEM_dupallocN won't work in case of complex layers, like e.g.
 		 * CD_MDEFORMVERT, which has pointers to allocated data...
 		 * So in case a custom copy function is defined, use it!
 		 */
 		const LayerTypeInfo *typeInfo = layerType_getInfo(layer->type);
+		void *src_data = layer->data;
 
 		if (typeInfo->copy) {
 			void *dst_data = MEM_malloc_arrayN((size_t)totelem, typeInfo->size, "CD duplicate ref layer");
@@ -2056,6 +2144,16 @@ static void *customData_duplicate_referenced_layer_index(CustomData *data, const
 		}
 
 		layer->flag &= ~CD_FLAG_NOFREE;
+
+		if (layer->shared) {
+			CustomDataLayer layer_src = *layer;
+			layer_src.data = src_data;
+			layer->shared = NULL;
+			/* other users may have been freed while copying */
+			if (customData_layer_unshare(&layer_src)) {
+				customData_free_layer_data(layer_src.type, src_data, totelem);
+			}
+		}
 	}
 
 	return layer->data;
@@ -2106,6 +2204,29 @@ bool CustomData_is_referenced_layer(struct CustomData *data, int type)
 	return (layer->flag & CD_FLAG_NOFREE) != 0;
 }
 
+/* is the first layer of type shared with other CustomData (see CD_SHARE) */
+bool CustomData_is_shared_layer(const CustomData *data, int type)
+{
+	const int layer_index = CustomData_get_layer_index(data, type);
+
+	if (layer_index == -1)
+		return false;
+
+	return data->layers[layer_index].shared != NULL;
+}
+
+void CustomData_duplicate_unshared_referenced_layers(CustomData *data, const int totelem)
+{
+	int i;
+
+	for (i = 0; i < data->totlayer; i++) {
+		const CustomDataLayer *layer = &data->layers[i];
+		if ((layer->flag & CD_FLAG_NOFREE) && (layer->shared == NULL)) {
+			customData_duplicate_referenced_layer_index(data, i, totelem);
+		}
+	}
+}
+
 void CustomData_free_temporary(CustomData *data, int totelem)
 {
 	CustomDataLayer *layer;
@@ -2829,7 +2950,12 @@ void CustomData_bmesh_free_block_data(CustomData *data, void *block)
 		memset(block, 0, data->totsize);
 }
 
-static void CustomData_bmesh_alloc_block(CustomData *data, void **block)
+/**
+ * Allocate (without initializing) the block of an element.
+ * Only the allocation uses the layers pool, so elements can be allocated first,
+ * then filled from multiple threads (see #CustomData_to_bmesh_block).
+ */
+void CustomData_bmesh_alloc_block(CustomData *data, void **block)
 {
 
 	if (*block)
@@ -3001,6 +3127,29 @@ bool CustomData_has_referenced(const struct CustomData *data)
 	return false;
 }
 
+/**
+ * Add the memory used by the layers of \a data to \a r_mem_owned,
+ * layers shared with (or referenced from) other data are added to \a r_mem_shared.
+ *
+ * \note Memory allocated by the elements of complex layers (e.g. deform weights) isn't included.
+ */
+void CustomData_memory_usage(const struct CustomData *data, int totelem, size_t *r_mem_owned, size_t *r_mem_shared)
+{
+	int i;
+	for (i = 0; i < data->totlayer; ++i) {
+		const CustomDataLayer *layer = &data->layers[i];
+		if (layer->data) {
+			const size_t mem = (size_t)totelem * (size_t)layerType_getInfo(layer->type)->size;
+			if (layer->flag & CD_FLAG_NOFREE) {
+				*r_mem_shared += mem;
+			}
+			else {
+				*r_mem_owned += mem;
+			}
+		}
+	}
+}
+
 /* copies the "value" (e.g. mloopuv uv or mloopcol colors) from one block to
  * another, while not overwriting anything else (e.g. flags)*/
 void CustomData_data_copy_value(int type, const void *source, void *dest)
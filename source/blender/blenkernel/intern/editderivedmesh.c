@@ -2413,6 +2413,26 @@ static void uv_from_jitter_v2(float uv[2])
 	CLAMP(uv[1], 0.0f, 1.0f);
 }
 
+/**
+ * While transforming, the tree kept by the partial data is updated instead of built again.
+ * \a r_is_owned is set when the caller needs to free the tree.
+ */
+static struct BMBVHTree *statvis_bmbvh_get(BMEditMesh *em, const float (*vertexCos)[3], bool *r_is_owned)
+{
+	struct BMBVHTree *bmtree = NULL;
+
+	if (vertexCos == NULL) {
+		bmtree = BKE_editmesh_partial_bmbvh_get(em);
+	}
+
+	*r_is_owned = (bmtree == NULL);
+	if (bmtree == NULL) {
+		bmtree = BKE_bmbvh_new_from_editmesh(em, 0, vertexCos, false);
+	}
+
+	return bmtree;
+}
+
 static void statvis_calc_thickness(
         BMEditMesh *em,
         const float (*vertexCos)[3],
@@ -2436,6 +2456,7 @@ static void statvis_calc_thickness(
 	const unsigned char col_fallback[4] = {64, 64, 64, 255};
 
 	struct BMBVHTree *bmtree;
+	bool bmtree_is_owned;
 
 	BLI_assert(min <= max);
 
@@ -2456,7 +2477,7 @@ static void statvis_calc_thickness(
 		BM_mesh_elem_index_ensure(bm, BM_VERT);
 	}
 
-	bmtree = BKE_bmbvh_new_from_editmesh(em, 0, vertexCos, false);
+	bmtree = statvis_bmbvh_get(em, vertexCos, &bmtree_is_owned);
 
 	for (i = 0; i < tottri; i++) {
 		BMFace *f_hit;
@@ -2512,7 +2533,9 @@ static void statvis_calc_thickness(
 		}
 	}
 
-	BKE_bmbvh_free(bmtree);
+	if (bmtree_is_owned) {
+		BKE_bmbvh_free(bmtree);
+	}
 
 	/* convert floats into color! */
 	for (i = 0; i < bm->totface; i++) {
@@ -2548,6 +2571,7 @@ static void statvis_calc_intersect(
 	unsigned char col[3];
 
 	struct BMBVHTree *bmtree;
+	bool bmtree_is_owned;
 	BVHTreeOverlap *overlap;
 	unsigned int overlap_len;
 
@@ -2558,7 +2582,7 @@ static void statvis_calc_intersect(
 		BM_mesh_elem_index_ensure(bm, BM_VERT);
 	}
 
-	bmtree = BKE_bmbvh_new_from_editmesh(em, 0, vertexCos, false);
+	bmtree = statvis_bmbvh_get(em, vertexCos, &bmtree_is_owned);
 
 	overlap = BKE_bmbvh_overlap(bmtree, bmtree, &overlap_len);
 
@@ -2586,7 +2610,9 @@ static void statvis_calc_intersect(
 		MEM_freeN(overlap);
 	}
 
-	BKE_bmbvh_free(bmtree);
+	if (bmtree_is_owned) {
+		BKE_bmbvh_free(bmtree);
+	}
 }
 
 static void statvis_calc_distort(
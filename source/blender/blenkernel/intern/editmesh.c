@@ -36,9 +36,13 @@
 #include "DNA_mesh_types.h"
 
 #include "BLI_math.h"
+#include "BLI_bitmap.h"
+#include "BLI_memarena.h"
+#include "BLI_task.h"
 
 #include "BKE_editmesh.h"
 #include "BKE_cdderivedmesh.h"
+#include "BKE_editmesh_bvh.h"
 
 
 BMEditMesh *BKE_editmesh_create(BMesh *bm, const bool do_tessellate)
@@ -59,6 +63,7 @@ BMEditMesh *BKE_editmesh_copy(BMEditMesh *em)
 	*em_copy = *em;
 
 	em_copy->derivedCage = em_copy->derivedFinal = NULL;
+	em_copy->partial = NULL;
 
 	em_copy->derivedVertColor = NULL;
 	em_copy->derivedVertColorLen = 0;
@@ -165,6 +170,251 @@ void BKE_editmesh_tessface_calc(BMEditMesh *em)
 #endif
 }
 
+/* -------------------------------------------------------------------- */
+/** \name Partial Updates
+ *
+ * When only vertex coordinates change (while transforming for example),
+ * only the faces using those vertices need their normals and tessellation recalculated.
+ * \{ */
+
+/**
+ * Store the faces & vertices which need updating when \a verts move,
+ * so #BKE_editmesh_partial_update doesn't need to update the whole mesh.
+ *
+ * \note This loops over all faces once, call before the vertices are moved.
+ */
+void BKE_editmesh_partial_begin(BMEditMesh *em, BMVert **verts, const int verts_len)
+{
+	BMesh *bm = em->bm;
+	BMEditMeshPartial *partial;
+	BLI_bitmap *faces_tag, *verts_tag;
+	BMIter iter;
+	BMFace *f;
+	int i, looptris_index;
+
+	BKE_editmesh_partial_end(em);
+
+	BM_mesh_elem_index_ensure(bm, BM_VERT | BM_FACE);
+
+	faces_tag = BLI_BITMAP_NEW(bm->totface, __func__);
+	verts_tag = BLI_BITMAP_NEW(bm->totvert, __func__);
+
+	partial = MEM_callocN(sizeof(*partial), __func__);
+	partial->totvert = bm->totvert;
+	partial->totedge = bm->totedge;
+	partial->totloop = bm->totloop;
+	partial->totface = bm->totface;
+
+	for (i = 0; i < verts_len; i++) {
+		BMIter fiter;
+		const int v_index = BM_elem_index_get(verts[i]);
+
+		/* loose vertices need their normals updated too */
+		if (!BLI_BITMAP_TEST(verts_tag, v_index)) {
+			BLI_BITMAP_ENABLE(verts_tag, v_index);
+			partial->verts_len++;
+		}
+
+		BM_ITER_ELEM (f, &fiter, verts[i], BM_FACES_OF_VERT) {
+			const int f_index = BM_elem_index_get(f);
+			if (!BLI_BITMAP_TEST(faces_tag, f_index)) {
+				BLI_BITMAP_ENABLE(faces_tag, f_index);
+				partial->faces_len++;
+			}
+		}
+	}
+
+	partial->faces = MEM_mallocN(sizeof(*partial->faces) * (size_t)partial->faces_len, __func__);
+	partial->faces_looptris_index = MEM_mallocN(
+	        sizeof(*partial->faces_looptris_index) * (size_t)partial->faces_len, __func__);
+
+	/* the tessellation stores the triangles of each face in order,
+	 * faces with less than 3 sides don't have any (see #BM_mesh_calc_tessellation). */
+	looptris_index = 0;
+	partial->faces_len = 0;
+	BM_ITER_MESH_INDEX (f, &iter, bm, BM_FACES_OF_MESH, i) {
+		if (BLI_BITMAP_TEST(faces_tag, i)) {
+			BMLoop *l_iter, *l_first;
+
+			partial->faces[partial->faces_len] = f;
+			partial->faces_looptris_index[partial->faces_len] = looptris_index;
+			partial->faces_len++;
+
+			l_iter = l_first = BM_FACE_FIRST_LOOP(f);
+			do {
+				const int v_index = BM_elem_index_get(l_iter->v);
+				if (!BLI_BITMAP_TEST(verts_tag, v_index)) {
+					BLI_BITMAP_ENABLE(verts_tag, v_index);
+					partial->verts_len++;
+				}
+			} while ((l_iter = l_iter->next) != l_first);
+		}
+		if (f->len >= 3) {
+			looptris_index += f->len - 2;
+		}
+	}
+	partial->tottri = looptris_index;
+
+	partial->verts = MEM_mallocN(sizeof(*partial->verts) * (size_t)partial->verts_len, __func__);
+	{
+		BMVert *v;
+		int verts_len_test = 0;
+		BM_ITER_MESH_INDEX (v, &iter, bm, BM_VERTS_OF_MESH, i) {
+			if (BLI_BITMAP_TEST(verts_tag, i)) {
+				partial->verts[verts_len_test++] = v;
+			}
+		}
+		BLI_assert(verts_len_test == partial->verts_len);
+	}
+
+	MEM_freeN(faces_tag);
+	MEM_freeN(verts_tag);
+
+	em->partial = partial;
+}
+
+void BKE_editmesh_partial_end(BMEditMesh *em)
+{
+	BMEditMeshPartial *partial = em->partial;
+
+	if (partial) {
+		if (partial->bmbvh) {
+			BKE_bmbvh_free(partial->bmbvh);
+		}
+		MEM_freeN(partial->faces);
+		MEM_freeN(partial->faces_looptris_index);
+		MEM_freeN(partial->verts);
+		MEM_freeN(partial);
+		em->partial = NULL;
+	}
+}
+
+/**
+ * Check the partial data still matches the mesh & its tessellation.
+ */
+bool BKE_editmesh_partial_is_valid(const BMEditMesh *em)
+{
+	const BMEditMeshPartial *partial = em->partial;
+	const BMesh *bm = em->bm;
+
+	return ((partial != NULL) &&
+	        (em->looptris != NULL) &&
+	        (partial->tottri == em->tottri) &&
+	        (partial->totvert == bm->totvert) &&
+	        (partial->totedge == bm->totedge) &&
+	        (partial->totloop == bm->totloop) &&
+	        (partial->totface == bm->totface));
+}
+
+typedef struct EditMeshPartialData {
+	BMEditMesh *em;
+} EditMeshPartialData;
+
+typedef struct EditMeshPartialTLS {
+	MemArena *pf_arena;
+} EditMeshPartialTLS;
+
+static void editmesh_partial_faces_cb(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict tls)
+{
+	EditMeshPartialData *data = userdata;
+	EditMeshPartialTLS *tls_data = tls->userdata_chunk;
+	BMEditMesh *em = data->em;
+	BMFace *f = em->partial->faces[index];
+
+	/* the normal is needed to tessellate ngons */
+	BM_face_normal_update(f);
+	BM_face_calc_looptris(f, &em->looptris[em->partial->faces_looptris_index[index]], &tls_data->pf_arena);
+}
+
+static void editmesh_partial_faces_finalize(
+        void *__restrict UNUSED(userdata),
+        void *__restrict userdata_chunk)
+{
+	EditMeshPartialTLS *tls_data = userdata_chunk;
+
+	if (tls_data->pf_arena) {
+		BLI_memarena_free(tls_data->pf_arena);
+	}
+}
+
+static void editmesh_partial_verts_cb(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EditMeshPartialData *data = userdata;
+	BMVert *v = data->em->partial->verts[index];
+
+	/* matches #BM_mesh_normals_update */
+	BM_vert_normal_update(v);
+	if (UNLIKELY(is_zero_v3(v->no))) {
+		normalize_v3_v3(v->no, v->co);
+	}
+}
+
+/**
+ * Recalculate normals and tessellation after vertices have been moved,
+ * only for the faces stored by #BKE_editmesh_partial_begin.
+ * When there is no valid partial data, update the whole mesh.
+ */
+void BKE_editmesh_partial_update(BMEditMesh *em)
+{
+	BMEditMeshPartial *partial = em->partial;
+	EditMeshPartialData data = {em};
+	EditMeshPartialTLS tls_data = {NULL};
+	ParallelRangeSettings settings;
+
+	if (!BKE_editmesh_partial_is_valid(em)) {
+		BM_mesh_normals_update(em->bm);
+		BKE_editmesh_tessface_calc(em);
+		return;
+	}
+
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (partial->faces_len >= BM_OMP_LIMIT);
+	settings.userdata_chunk = &tls_data;
+	settings.userdata_chunk_size = sizeof(tls_data);
+	settings.func_finalize = editmesh_partial_faces_finalize;
+	BLI_task_parallel_range(0, partial->faces_len, &data, editmesh_partial_faces_cb, &settings);
+
+	/* vertex normals depend on all face normals being updated */
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (partial->verts_len >= BM_OMP_LIMIT);
+	BLI_task_parallel_range(0, partial->verts_len, &data, editmesh_partial_verts_cb, &settings);
+}
+
+/**
+ * Return a BVH tree of the edit-mesh (without cage coordinates or filtering), owned by the partial data.
+ * It's created on first use, then only the bounds of the faces stored by #BKE_editmesh_partial_begin
+ * are updated, instead of building a new tree each time the vertices move.
+ *
+ * \return NULL when there is no valid partial data, the caller needs to create its own tree.
+ */
+BMBVHTree *BKE_editmesh_partial_bmbvh_get(BMEditMesh *em)
+{
+	BMEditMeshPartial *partial = em->partial;
+
+	if (!BKE_editmesh_partial_is_valid(em)) {
+		return NULL;
+	}
+
+	if (partial->bmbvh && !BKE_bmbvh_update_partial(partial->bmbvh, em)) {
+		BKE_bmbvh_free(partial->bmbvh);
+		partial->bmbvh = NULL;
+	}
+
+	if (partial->bmbvh == NULL) {
+		partial->bmbvh = BKE_bmbvh_new_from_editmesh(em, 0, NULL, false);
+	}
+
+	return partial->bmbvh;
+}
+
+/** \} */
+
 void BKE_editmesh_update_linked_customdata(BMEditMesh *em)
 {
 	BMesh *bm = em->bm;
@@ -204,6 +454,8 @@ void BKE_editmesh_free(BMEditMesh *em)
 {
 	BKE_editmesh_free_derivedmesh(em);
 
+	BKE_editmesh_partial_end(em);
+
 	BKE_editmesh_color_free(em);
 
 	if (em->looptris) MEM_freeN(em->looptris);
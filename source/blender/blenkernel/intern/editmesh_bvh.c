@@ -185,6 +185,60 @@ BMBVHTree *BKE_bmbvh_new(
 }
 
 
+/**
+ * Update the bounds of the triangles which depend on the vertices passed to #BKE_editmesh_partial_begin,
+ * instead of building a new tree when vertices move.
+ *
+ * \return false when the tree can't be updated (filtered or out of sync with \a em),
+ * in this case it must be freed and created again.
+ */
+bool BKE_bmbvh_update_partial(BMBVHTree *bmtree, BMEditMesh *em)
+{
+	const BMEditMeshPartial *partial = em->partial;
+	float cos[3][3];
+	int i, j;
+
+	if (!((bmtree->bm == em->bm) &&
+	      (bmtree->looptris == em->looptris) &&
+	      (bmtree->looptris_tot == em->tottri) &&
+	      /* faces were skipped by a filter, tree nodes don't match the looptris */
+	      (BLI_bvhtree_get_len(bmtree->tree) == em->tottri) &&
+	      BKE_editmesh_partial_is_valid(em)))
+	{
+		return false;
+	}
+
+	if (bmtree->cos_cage) {
+		BM_mesh_elem_index_ensure(em->bm, BM_VERT);
+	}
+
+	for (i = 0; i < partial->faces_len; i++) {
+		const int looptris_index = partial->faces_looptris_index[i];
+		const int looptris_len = partial->faces[i]->len - 2;
+
+		for (j = looptris_index; j < looptris_index + looptris_len; j++) {
+			BMLoop **ltri = bmtree->looptris[j];
+
+			if (bmtree->cos_cage) {
+				copy_v3_v3(cos[0], bmtree->cos_cage[BM_elem_index_get(ltri[0]->v)]);
+				copy_v3_v3(cos[1], bmtree->cos_cage[BM_elem_index_get(ltri[1]->v)]);
+				copy_v3_v3(cos[2], bmtree->cos_cage[BM_elem_index_get(ltri[2]->v)]);
+			}
+			else {
+				copy_v3_v3(cos[0], ltri[0]->v->co);
+				copy_v3_v3(cos[1], ltri[1]->v->co);
+				copy_v3_v3(cos[2], ltri[2]->v->co);
+			}
+
+			BLI_bvhtree_update_node(bmtree->tree, j, (float *)cos, NULL, 3);
+		}
+	}
+
+	BLI_bvhtree_update_tree(bmtree->tree);
+
+	return true;
+}
+
 void BKE_bmbvh_free(BMBVHTree *bmtree)
 {
 	BLI_bvhtree_free(bmtree->tree);
@@ -40,6 +40,7 @@
 #include "BLI_listbase.h"
 #include "BLI_bitmap.h"
 #include "BLI_math.h"
+#include "BLI_task.h"
 
 #include "DNA_mesh_types.h"
 #include "DNA_meshdata_types.h"
@@ -342,6 +343,8 @@ void BKE_lattice_make_local(Main *bmain, Lattice *lt, const bool lib_local)
 typedef struct LatticeDeformData {
 	Object *object;
 	float *latticedata;
+	/* Vertex group weight of each lattice point, NULL when no group is used. */
+	float *lattice_weights;
 	float latmat[4][4];
 } LatticeDeformData;
 
@@ -358,6 +361,8 @@ LatticeDeformData *init_latt_deform(Object *oblatt, Object *ob)
 	float *latticedata;
 	float latmat[4][4];
 	LatticeDeformData *lattice_deform_data;
+	MDeformVert *dvert = BKE_lattice_deform_verts_get(oblatt);
+	float *lattice_weights = NULL;
 
 	if (lt->editlatt) lt = lt->editlatt->latt;
 	bp = lt->def;
@@ -400,8 +405,24 @@ LatticeDeformData *init_latt_deform(Object *oblatt, Object *ob)
 		}
 	}
 
+	/* vgroup influence, looked up once here instead of for every deformed point */
+	if (lt->vgroup[0] && dvert) {
+		const int defgrp_index = defgroup_name_index(oblatt, lt->vgroup);
+
+		if (defgrp_index != -1) {
+			const int tot = lt->pntsu * lt->pntsv * lt->pntsw;
+			int i;
+
+			lattice_weights = MEM_mallocN(sizeof(float) * tot, "lattice_weights");
+			for (i = 0; i < tot; i++) {
+				lattice_weights[i] = defvert_find_weight(dvert + i, defgrp_index);
+			}
+		}
+	}
+
 	lattice_deform_data = MEM_mallocN(sizeof(LatticeDeformData), "Lattice Deform Data");
 	lattice_deform_data->latticedata = latticedata;
+	lattice_deform_data->lattice_weights = lattice_weights;
 	lattice_deform_data->object = oblatt;
 	copy_m4_m4(lattice_deform_data->latmat, latmat);
 
@@ -418,16 +439,13 @@ void calc_latt_deform(LatticeDeformData *lattice_deform_data, float co[3], float
 	int ui, vi, wi, uu, vv, ww;
 
 	/* vgroup influence */
-	int defgrp_index = -1;
+	const float *lattice_weights = lattice_deform_data->lattice_weights;
 	float co_prev[3], weight_blend = 0.0f;
-	MDeformVert *dvert = BKE_lattice_deform_verts_get(ob);
-
 
 	if (lt->editlatt) lt = lt->editlatt->latt;
 	if (lattice_deform_data->latticedata == NULL) return;
 
-	if (lt->vgroup[0] && dvert) {
-		defgrp_index = defgroup_name_index(ob, lt->vgroup);
+	if (lattice_weights) {
 		copy_v3_v3(co_prev, co);
 	}
 
@@ -507,8 +525,8 @@ void calc_latt_deform(LatticeDeformData *lattice_deform_data, float co[3], float
 
 							madd_v3_v3fl(co, &lattice_deform_data->latticedata[idx_u * 3], u);
 
-							if (defgrp_index != -1)
-								weight_blend += (u * defvert_find_weight(dvert + idx_u, defgrp_index));
+							if (lattice_weights)
+								weight_blend += (u * lattice_weights[idx_u]);
 						}
 					}
 				}
@@ -516,7 +534,7 @@ void calc_latt_deform(LatticeDeformData *lattice_deform_data, float co[3], float
 		}
 	}
 
-	if (defgrp_index != -1)
+	if (lattice_weights)
 		interp_v3_v3v3(co, co_prev, co, weight_blend);
 
 }
@@ -525,6 +543,8 @@ void end_latt_deform(LatticeDeformData *lattice_deform_data)
 {
 	if (lattice_deform_data->latticedata)
 		MEM_freeN(lattice_deform_data->latticedata);
+	if (lattice_deform_data->lattice_weights)
+		MEM_freeN(lattice_deform_data->lattice_weights);
 
 	MEM_freeN(lattice_deform_data);
 }
@@ -705,12 +725,98 @@ static bool calc_curve_deform(Scene *scene, Object *par, float co[3],
 	return false;
 }
 
+/* Minimum number of points deformed by a single thread. */
+#ifdef DEBUG
+#  define DEFORM_THREAD_MIN_ITER 16
+#else
+#  define DEFORM_THREAD_MIN_ITER 1024
+#endif
+
+typedef struct CurveDeformUserdata {
+	Scene *scene;
+	Object *cuOb;
+	CurveDeform *cd;
+	float (*vertexCos)[3];
+	/* When set, deformation is weighted by the vertex group. */
+	const MDeformVert *dvert;
+	int defgrp_index;
+	short defaxis;
+	/* Points are already in curve space (done while calculating the bounds). */
+	bool is_curvespace;
+} CurveDeformUserdata;
+
+typedef struct CurveDeformBounds {
+	float min[3], max[3];
+} CurveDeformBounds;
+
+BLI_INLINE float curve_deform_vert_weight(const CurveDeformUserdata *data, const int index)
+{
+	return data->dvert ? defvert_find_weight(&data->dvert[index], data->defgrp_index) : 1.0f;
+}
+
+/* Move points in curve space and calculate their bounds. */
+static void curve_deform_bounds_func(
+        void *__restrict userdata, const int start, const int stop, void *__restrict r_value)
+{
+	const CurveDeformUserdata *data = userdata;
+	CurveDeformBounds *bounds = r_value;
+	int a;
+
+	for (a = start; a < stop; a++) {
+		if (curve_deform_vert_weight(data, a) > 0.0f) {
+			mul_m4_v3(data->cd->curvespace, data->vertexCos[a]);
+			minmax_v3v3_v3(bounds->min, bounds->max, data->vertexCos[a]);
+		}
+	}
+}
+
+static void curve_deform_bounds_join(
+        void *__restrict UNUSED(userdata), void *__restrict r_value, const void *__restrict value)
+{
+	CurveDeformBounds *bounds = r_value;
+	const CurveDeformBounds *bounds_chunk = value;
+
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		bounds->min[i] = min_ff(bounds->min[i], bounds_chunk->min[i]);
+		bounds->max[i] = max_ff(bounds->max[i], bounds_chunk->max[i]);
+	}
+}
+
+static void curve_deform_vert_task(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	const CurveDeformUserdata *data = userdata;
+	float *co = data->vertexCos[index];
+	const float weight = curve_deform_vert_weight(data, index);
+
+	if (weight > 0.0f) {
+		if (!data->is_curvespace) {
+			mul_m4_v3(data->cd->curvespace, co);
+		}
+
+		if (data->dvert) {
+			float vec[3];
+			copy_v3_v3(vec, co);
+			calc_curve_deform(data->scene, data->cuOb, vec, data->defaxis, data->cd, NULL);
+			interp_v3_v3v3(co, co, vec, weight);
+		}
+		else {
+			calc_curve_deform(data->scene, data->cuOb, co, data->defaxis, data->cd, NULL);
+		}
+
+		mul_m4_v3(data->cd->objectspace, co);
+	}
+}
+
 void curve_deform_verts(
         Scene *scene, Object *cuOb, Object *target, DerivedMesh *dm, float (*vertexCos)[3],
         int numVerts, const char *vgroup, short defaxis)
 {
 	Curve *cu;
-	int a;
 	CurveDeform cd;
 	MDeformVert *dvert = NULL;
 	int defgrp_index = -1;
@@ -754,71 +860,43 @@ void curve_deform_verts(
 		}
 	}
 
-	if (dvert) {
-		MDeformVert *dvert_iter;
-		float vec[3];
+#ifdef CYCLIC_DEPENDENCY_WORKAROUND
+	/* done here, calc_curve_deform() is called from threads */
+	if (cuOb->curve_cache == NULL) {
+		BKE_displist_make_curveTypes(scene, cuOb, false);
+	}
+#endif
 
-		if (cu->flag & CU_DEFORM_BOUNDS_OFF) {
-			for (a = 0, dvert_iter = dvert; a < numVerts; a++, dvert_iter++) {
-				const float weight = defvert_find_weight(dvert_iter, defgrp_index);
+	CurveDeformUserdata data = {
+	    .scene = scene,
+	    .cuOb = cuOb,
+	    .cd = &cd,
+	    .vertexCos = vertexCos,
+	    .dvert = dvert,
+	    .defgrp_index = defgrp_index,
+	    .defaxis = defaxis,
+	    .is_curvespace = false,
+	};
 
-				if (weight > 0.0f) {
-					mul_m4_v3(cd.curvespace, vertexCos[a]);
-					copy_v3_v3(vec, vertexCos[a]);
-					calc_curve_deform(scene, cuOb, vec, defaxis, &cd, NULL);
-					interp_v3_v3v3(vertexCos[a], vertexCos[a], vec, weight);
-					mul_m4_v3(cd.objectspace, vertexCos[a]);
-				}
-			}
-		}
-		else {
-			/* set mesh min/max bounds */
-			INIT_MINMAX(cd.dmin, cd.dmax);
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.min_iter_per_thread = DEFORM_THREAD_MIN_ITER;
 
-			for (a = 0, dvert_iter = dvert; a < numVerts; a++, dvert_iter++) {
-				if (defvert_find_weight(dvert_iter, defgrp_index) > 0.0f) {
-					mul_m4_v3(cd.curvespace, vertexCos[a]);
-					minmax_v3v3_v3(cd.dmin, cd.dmax, vertexCos[a]);
-				}
-			}
+	if ((cu->flag & CU_DEFORM_BOUNDS_OFF) == 0) {
+		/* set mesh min/max bounds */
+		CurveDeformBounds bounds_init, bounds;
+		INIT_MINMAX(bounds_init.min, bounds_init.max);
 
-			for (a = 0, dvert_iter = dvert; a < numVerts; a++, dvert_iter++) {
-				const float weight = defvert_find_weight(dvert_iter, defgrp_index);
+		BLI_task_parallel_reduce(
+		        0, numVerts, &data, &bounds_init, sizeof(bounds),
+		        curve_deform_bounds_func, curve_deform_bounds_join, &bounds, &settings);
 
-				if (weight > 0.0f) {
-					/* already in 'cd.curvespace', prev for loop */
-					copy_v3_v3(vec, vertexCos[a]);
-					calc_curve_deform(scene, cuOb, vec, defaxis, &cd, NULL);
-					interp_v3_v3v3(vertexCos[a], vertexCos[a], vec, weight);
-					mul_m4_v3(cd.objectspace, vertexCos[a]);
-				}
-			}
-		}
-	}
-	else {
-		if (cu->flag & CU_DEFORM_BOUNDS_OFF) {
-			for (a = 0; a < numVerts; a++) {
-				mul_m4_v3(cd.curvespace, vertexCos[a]);
-				calc_curve_deform(scene, cuOb, vertexCos[a], defaxis, &cd, NULL);
-				mul_m4_v3(cd.objectspace, vertexCos[a]);
-			}
-		}
-		else {
-			/* set mesh min max bounds */
-			INIT_MINMAX(cd.dmin, cd.dmax);
-				
-			for (a = 0; a < numVerts; a++) {
-				mul_m4_v3(cd.curvespace, vertexCos[a]);
-				minmax_v3v3_v3(cd.dmin, cd.dmax, vertexCos[a]);
-			}
-	
-			for (a = 0; a < numVerts; a++) {
-				/* already in 'cd.curvespace', prev for loop */
-				calc_curve_deform(scene, cuOb, vertexCos[a], defaxis, &cd, NULL);
-				mul_m4_v3(cd.objectspace, vertexCos[a]);
-			}
-		}
+		copy_v3_v3(cd.dmin, bounds.min);
+		copy_v3_v3(cd.dmax, bounds.max);
+		data.is_curvespace = true;
 	}
+
+	BLI_task_parallel_range(0, numVerts, &data, curve_deform_vert_task, &settings);
 }
 
 /* input vec and orco = local coord in armature space */
@@ -856,59 +934,82 @@ void curve_deform_vector(Scene *scene, Object *cuOb, Object *target,
 
 }
 
+typedef struct LatticeDeformUserdata {
+	LatticeDeformData *lattice_deform_data;
+	float (*vertexCos)[3];
+	/* When set, deformation is weighted by the vertex group. */
+	const MDeformVert *dvert;
+	int defgrp_index;
+	float fac;
+} LatticeDeformUserdata;
+
+static void lattice_deform_vert_task(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	const LatticeDeformUserdata *data = userdata;
+
+	if (data->dvert) {
+		const float weight = defvert_find_weight(&data->dvert[index], data->defgrp_index);
+		if (weight > 0.0f) {
+			calc_latt_deform(data->lattice_deform_data, data->vertexCos[index], weight * data->fac);
+		}
+	}
+	else {
+		calc_latt_deform(data->lattice_deform_data, data->vertexCos[index], data->fac);
+	}
+}
+
 void lattice_deform_verts(Object *laOb, Object *target, DerivedMesh *dm,
                           float (*vertexCos)[3], int numVerts, const char *vgroup, float fac)
 {
 	LatticeDeformData *lattice_deform_data;
-	int a;
-	bool use_vgroups;
+	MDeformVert *dvert = NULL;
+	int defgrp_index = -1;
 
 	if (laOb->type != OB_LATTICE)
 		return;
 
-	lattice_deform_data = init_latt_deform(laOb, target);
-
 	/* check whether to use vertex groups (only possible if target is a Mesh)
 	 * we want either a Mesh with no derived data, or derived data with
 	 * deformverts
 	 */
-	if (target && target->type == OB_MESH) {
+	if (vgroup && vgroup[0] && target && target->type == OB_MESH) {
 		/* if there's derived data without deformverts, don't use vgroups */
 		if (dm) {
-			use_vgroups = (dm->getVertDataArray(dm, CD_MDEFORMVERT) != NULL);
+			dvert = dm->getVertDataArray(dm, CD_MDEFORMVERT);
 		}
 		else {
 			Mesh *me = target->data;
-			use_vgroups = (me->dvert != NULL);
+			dvert = me->dvert;
 		}
-	}
-	else {
-		use_vgroups = false;
-	}
-	
-	if (vgroup && vgroup[0] && use_vgroups) {
-		Mesh *me = target->data;
-		const int defgrp_index = defgroup_name_index(target, vgroup);
-		float weight;
-
-		if (defgrp_index >= 0 && (me->dvert || dm)) {
-			MDeformVert *dvert = me->dvert;
-			
-			for (a = 0; a < numVerts; a++, dvert++) {
-				if (dm) dvert = dm->getVertData(dm, a, CD_MDEFORMVERT);
 
-				weight = defvert_find_weight(dvert, defgrp_index);
+		if (dvert) {
+			defgrp_index = defgroup_name_index(target, vgroup);
 
-				if (weight > 0.0f)
-					calc_latt_deform(lattice_deform_data, vertexCos[a], weight * fac);
+			if (defgrp_index == -1) {
+				/* the group doesn't exist: nothing is deformed */
+				return;
 			}
 		}
 	}
-	else {
-		for (a = 0; a < numVerts; a++) {
-			calc_latt_deform(lattice_deform_data, vertexCos[a], fac);
-		}
-	}
+
+	lattice_deform_data = init_latt_deform(laOb, target);
+
+	LatticeDeformUserdata data = {
+	    .lattice_deform_data = lattice_deform_data,
+	    .vertexCos = vertexCos,
+	    .dvert = dvert,
+	    .defgrp_index = defgrp_index,
+	    .fac = fac,
+	};
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.min_iter_per_thread = DEFORM_THREAD_MIN_ITER;
+	BLI_task_parallel_range(0, numVerts, &data, lattice_deform_vert_task, &settings);
+
 	end_latt_deform(lattice_deform_data);
 }
 
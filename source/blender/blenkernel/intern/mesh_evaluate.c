@@ -175,6 +175,13 @@ typedef struct MeshCalcNormalsData {
 	float (*pnors)[3];
 	float (*lnors_weighted)[3];
 	float (*vnors)[3];
+	int numLoops;
+	int numVerts;
+	/* Vertex to loops map used by #mesh_calc_normals_poly_accum_cb,
+	 * loops of vertex i are vert_loops[vert_loops_offset[i]] to vert_loops[vert_loops_offset[i + 1] - 1]. */
+	int *vert_loops_offset;
+	int *vert_loops_fill;
+	int *vert_loops;
 } MeshCalcNormalsData;
 
 static void mesh_calc_normals_poly_cb(
@@ -253,6 +260,73 @@ static void mesh_calc_normals_poly_prepare_cb(
 	}
 }
 
+static void mesh_calc_normals_poly_vert_loops_count_cb(
+        void *__restrict userdata,
+        const int lidx,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcNormalsData *data = userdata;
+
+	atomic_add_and_fetch_int32(&data->vert_loops_offset[data->mloop[lidx].v], 1);
+}
+
+static void mesh_calc_normals_poly_vert_loops_fill_cb(
+        void *__restrict userdata,
+        const int lidx,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcNormalsData *data = userdata;
+	const unsigned int v = data->mloop[lidx].v;
+
+	const int i = atomic_fetch_and_add_int32(&data->vert_loops_fill[v], 1);
+	data->vert_loops[data->vert_loops_offset[v] + i] = lidx;
+}
+
+static int mesh_calc_normals_vert_loops_cmp(const void *a, const void *b)
+{
+	const int la = *(const int *)a, lb = *(const int *)b;
+	return (la > lb) - (la < lb);
+}
+
+/* Loops of a vertex are filled in any order, sort them so they are accumulated
+ * in the same order as a serial loop would do (same results). */
+static void mesh_calc_normals_vert_loops_sort(int *vert_loops, const int len)
+{
+	if (len > 16) {
+		qsort(vert_loops, (size_t)len, sizeof(*vert_loops), mesh_calc_normals_vert_loops_cmp);
+		return;
+	}
+
+	for (int i = 1; i < len; i++) {
+		const int lidx = vert_loops[i];
+		int j = i;
+		for (; (j > 0) && (vert_loops[j - 1] > lidx); j--) {
+			vert_loops[j] = vert_loops[j - 1];
+		}
+		vert_loops[j] = lidx;
+	}
+}
+
+/* Each vertex only gets the weighted normals of its own loops, so threads never write to the same vertex normal. */
+static void mesh_calc_normals_poly_accum_cb(
+        void *__restrict userdata,
+        const int vidx,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcNormalsData *data = userdata;
+	const float (*lnors_weighted)[3] = (const float (*)[3])data->lnors_weighted;
+	float *no = data->vnors[vidx];
+
+	int *vert_loops = &data->vert_loops[data->vert_loops_offset[vidx]];
+	const int vert_loops_len = data->vert_loops_offset[vidx + 1] - data->vert_loops_offset[vidx];
+
+	mesh_calc_normals_vert_loops_sort(vert_loops, vert_loops_len);
+
+	for (int i = 0; i < vert_loops_len; i++) {
+		add_v3_v3(no, lnors_weighted[vert_loops[i]]);
+	}
+}
+
 static void mesh_calc_normals_poly_finalize_cb(
         void *__restrict userdata,
         const int vidx,
@@ -310,17 +384,36 @@ void BKE_mesh_calc_normals_poly(
 
 	MeshCalcNormalsData data = {
 	    .mpolys = mpolys, .mloop = mloop, .mverts = mverts,
-	    .pnors = pnors, .lnors_weighted = lnors_weighted, .vnors = vnors
+	    .pnors = pnors, .lnors_weighted = lnors_weighted, .vnors = vnors,
+	    .numLoops = numLoops, .numVerts = numVerts,
 	};
 
 	/* Compute poly normals, and prepare weighted loop normals. */
 	BLI_task_parallel_range(0, numPolys, &data, mesh_calc_normals_poly_prepare_cb, &settings);
 
-	/* Actually accumulate weighted loop normals into vertex ones. */
-	/* Unfortunately, not possible to thread that (not in a reasonable, totally lock- and barrier-free fashion),
-	 * since several loops will point to the same vertex... */
-	for (int lidx = 0; lidx < numLoops; lidx++) {
-		add_v3_v3(vnors[mloop[lidx].v], data.lnors_weighted[lidx]);
+	/* Actually accumulate weighted loop normals into vertex ones.
+	 * Several loops point to the same vertex, so instead of threading over loops (which would need atomics
+	 * and give order-dependent results), build a vertex to loops map and thread over vertices. */
+	if ((numLoops > BKE_MESH_OMP_LIMIT) && (BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) > 1)) {
+		data.vert_loops_offset = MEM_calloc_arrayN((size_t)numVerts + 1, sizeof(*data.vert_loops_offset), __func__);
+		data.vert_loops_fill = MEM_calloc_arrayN((size_t)numVerts, sizeof(*data.vert_loops_fill), __func__);
+		data.vert_loops = MEM_malloc_arrayN((size_t)numLoops, sizeof(*data.vert_loops), __func__);
+
+		BLI_task_parallel_range(0, numLoops, &data, mesh_calc_normals_poly_vert_loops_count_cb, &settings);
+		data.vert_loops_offset[numVerts] = BLI_task_parallel_scan_i(
+		        data.vert_loops_offset, data.vert_loops_offset, numVerts, false, true);
+		BLI_task_parallel_range(0, numLoops, &data, mesh_calc_normals_poly_vert_loops_fill_cb, &settings);
+
+		BLI_task_parallel_range(0, numVerts, &data, mesh_calc_normals_poly_accum_cb, &settings);
+
+		MEM_freeN(data.vert_loops_offset);
+		MEM_freeN(data.vert_loops_fill);
+		MEM_freeN(data.vert_loops);
+	}
+	else {
+		for (int lidx = 0; lidx < numLoops; lidx++) {
+			add_v3_v3(vnors[mloop[lidx].v], data.lnors_weighted[lidx]);
+		}
 	}
 
 	/* Normalize and validate computed vertex normals. */
@@ -706,6 +799,12 @@ typedef struct LoopSplitTaskDataCommon {
 	int *loop_to_poly;
 	const float (*polynors)[3];
 
+	/* Only used by the threaded generator, tags loops from which a fan (or single loop) is computed. */
+	char *loop_is_entry;
+	/* Only used by the threaded generator, the loop a walk around a smooth fan started from (see
+	 * loop_split_cyclic_fan_tag_entry()). */
+	int *loop_fan_owner;
+
 	int numEdges;
 	int numLoops;
 	int numPolys;
@@ -1176,36 +1275,6 @@ static void loop_split_worker_do(
 	}
 }
 
-static void loop_split_worker(TaskPool * __restrict pool, void *taskdata, int UNUSED(threadid))
-{
-	LoopSplitTaskDataCommon *common_data = BLI_task_pool_userdata(pool);
-	LoopSplitTaskData *data = taskdata;
-
-	/* Temp edge vectors stack, only used when computing lnor spacearr. */
-	BLI_Stack *edge_vectors = common_data->lnors_spacearr ? BLI_stack_new(sizeof(float[3]), __func__) : NULL;
-
-#ifdef DEBUG_TIME
-	TIMEIT_START_AVERAGED(loop_split_worker);
-#endif
-
-	for (int i = 0; i < LOOP_SPLIT_TASK_BLOCK_SIZE; i++, data++) {
-		/* A NULL ml_curr is used to tag ended data! */
-		if (data->ml_curr == NULL) {
-			break;
-		}
-
-		loop_split_worker_do(common_data, data, edge_vectors);
-	}
-
-	if (edge_vectors) {
-		BLI_stack_free(edge_vectors);
-	}
-
-#ifdef DEBUG_TIME
-	TIMEIT_END_AVERAGED(loop_split_worker);
-#endif
-}
-
 /* Check whether gievn loop is part of an unknown-so-far cyclic smooth fan, or not.
  * Needed because cyclic smooth fans have no obvious 'entry point', and yet we need to walk them once, and only once. */
 static bool loop_split_generator_check_cyclic_smooth_fan(
@@ -1267,7 +1336,7 @@ static bool loop_split_generator_check_cyclic_smooth_fan(
 	}
 }
 
-static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common_data)
+static void loop_split_generator(LoopSplitTaskDataCommon *common_data)
 {
 	MLoopNorSpaceArray *lnors_spacearr = common_data->lnors_spacearr;
 	float (*loopnors)[3] = common_data->loopnors;
@@ -1289,20 +1358,15 @@ static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common
 
 	BLI_bitmap *skip_loops = BLI_BITMAP_NEW(numLoops, __func__);
 
-	LoopSplitTaskData *data_buff = NULL;
-	int data_idx = 0;
-
-	/* Temp edge vectors stack, only used when computing lnor spacearr (and we are not multi-threading). */
+	/* Temp edge vectors stack, only used when computing lnor spacearr. */
 	BLI_Stack *edge_vectors = NULL;
 
 #ifdef DEBUG_TIME
 	TIMEIT_START_AVERAGED(loop_split_generator);
 #endif
 
-	if (!pool) {
-		if (lnors_spacearr) {
-			edge_vectors = BLI_stack_new(sizeof(float[3]), __func__);
-		}
+	if (lnors_spacearr) {
+		edge_vectors = BLI_stack_new(sizeof(float[3]), __func__);
 	}
 
 	/* We now know edges that can be smoothed (with their vector, and their two loops), and edges that will be hard!
@@ -1346,16 +1410,8 @@ static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common
 
 //				printf("PROCESSING!\n");
 
-				if (pool) {
-					if (data_idx == 0) {
-						data_buff = MEM_calloc_arrayN(LOOP_SPLIT_TASK_BLOCK_SIZE, sizeof(*data_buff), __func__);
-					}
-					data = &data_buff[data_idx];
-				}
-				else {
-					data = &data_local;
-					memset(data, 0, sizeof(*data));
-				}
+				data = &data_local;
+				memset(data, 0, sizeof(*data));
 
 				if (IS_EDGE_SHARP(e2l_curr) && IS_EDGE_SHARP(e2l_prev)) {
 					data->lnor = lnors;
@@ -1394,16 +1450,7 @@ static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common
 					}
 				}
 
-				if (pool) {
-					data_idx++;
-					if (data_idx == LOOP_SPLIT_TASK_BLOCK_SIZE) {
-						BLI_task_pool_push(pool, loop_split_worker, data_buff, true, TASK_PRIORITY_LOW);
-						data_idx = 0;
-					}
-				}
-				else {
-					loop_split_worker_do(common_data, data, edge_vectors);
-				}
+				loop_split_worker_do(common_data, data, edge_vectors);
 			}
 
 			ml_prev = ml_curr;
@@ -1411,11 +1458,6 @@ static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common
 		}
 	}
 
-	/* Last block of data... Since it is calloc'ed and we use first NULL item as stopper, everything is fine. */
-	if (pool && data_idx) {
-		BLI_task_pool_push(pool, loop_split_worker, data_buff, true, TASK_PRIORITY_LOW);
-	}
-
 	if (edge_vectors) {
 		BLI_stack_free(edge_vectors);
 	}
@@ -1426,6 +1468,255 @@ static void loop_split_generator(TaskPool *pool, LoopSplitTaskDataCommon *common
 #endif
 }
 
+/* Threaded version of loop_split_generator().
+ *
+ * Instead of pushing one task per fan (or block of fans) from a serial generator, the loops are handled in
+ * three passes over the polys:
+ *   - Tag each loop that is the 'entry point' of a fan (or a single loop), in parallel.
+ *     For cyclic smooth fans, the entry is the loop the serial generator would reach first, so that both
+ *     paths give exactly the same results (including lnor spaces).
+ *   - Create the lnor spaces of all entry loops, serially (memarena is not threadsafe).
+ *   - Compute the normals of all fans, in parallel, each entry loop doing its whole fan. */
+
+/* Order in which the serial generator reaches loops (polys first, then their loops). */
+BLI_INLINE bool loop_split_loop_order_lt(
+        const LoopSplitTaskDataCommon *common_data, const int ml_a_index, const int ml_b_index)
+{
+	const int mp_a_index = common_data->loop_to_poly[ml_a_index];
+	const int mp_b_index = common_data->loop_to_poly[ml_b_index];
+	return (mp_a_index < mp_b_index) || (mp_a_index == mp_b_index && ml_a_index < ml_b_index);
+}
+
+/* Claim \a ml_index for the walk started from \a ml_start_index, unless a walk started from an earlier loop
+ * (in serial order) already did. */
+static bool loop_split_fan_owner_claim(
+        const LoopSplitTaskDataCommon *common_data, const int ml_index, const int ml_start_index)
+{
+	int *owner_p = &common_data->loop_fan_owner[ml_index];
+	int owner = *owner_p;
+
+	while ((owner == -1) || loop_split_loop_order_lt(common_data, ml_start_index, owner)) {
+		const int owner_prev = atomic_cas_int32(owner_p, owner, ml_start_index);
+		if (owner_prev == owner) {
+			return true;
+		}
+		owner = owner_prev;
+	}
+	return (owner == ml_start_index);
+}
+
+/* Walk the smooth fan of given smooth loop, when it is cyclic tag its entry point.
+ *
+ * Each fan is walked once (rather than from each of its loops): walked loops are claimed by the walk,
+ * the first loop of an already claimed fan doesn't start another one. When multiple threads start walking
+ * the same fan at once, walks stop on reaching loops claimed by an earlier one, the earliest walk always
+ * goes around the whole fan. */
+static void loop_split_cyclic_fan_tag_entry(
+        const LoopSplitTaskDataCommon *common_data, const int *e2l_prev,
+        const MLoop *ml_curr, const MLoop *ml_prev, const int ml_curr_index, const int ml_prev_index,
+        const int mp_curr_index)
+{
+	const MLoop *mloops = common_data->mloops;
+	const MPoly *mpolys = common_data->mpolys;
+	const int *loop_to_poly = common_data->loop_to_poly;
+	const int (*edge_to_loops)[2] = (const int (*)[2])common_data->edge_to_loops;
+
+	const unsigned int mv_pivot_index = ml_curr->v;  /* The vertex we are "fanning" around! */
+	const int *e2lfan_curr;
+	const MLoop *mlfan_curr;
+	int mlfan_curr_index, mlfan_vert_index, mpfan_curr_index;
+	/* The entry, first loop of the fan in serial order. */
+	int ml_entry_index = ml_curr_index;
+	int steps;
+
+	e2lfan_curr = e2l_prev;
+	if (IS_EDGE_SHARP(e2lfan_curr)) {
+		return;
+	}
+
+	if (atomic_cas_int32(&common_data->loop_fan_owner[ml_curr_index], -1, ml_curr_index) != -1) {
+		/* Already walked (or being walked) from another loop. */
+		return;
+	}
+
+	mlfan_curr = ml_prev;
+	mlfan_curr_index = ml_prev_index;
+	mlfan_vert_index = ml_curr_index;
+	mpfan_curr_index = mp_curr_index;
+
+	/* The cap only protects against infinite loops on broken geometry. */
+	for (steps = common_data->numLoops; steps--; ) {
+		BKE_mesh_loop_manifold_fan_around_vert_next(
+		            mloops, mpolys, loop_to_poly, e2lfan_curr, mv_pivot_index,
+		            &mlfan_curr, &mlfan_curr_index, &mlfan_vert_index, &mpfan_curr_index);
+
+		if (mlfan_vert_index == ml_curr_index) {
+			/* Walked the whole fan, it's cyclic. */
+			atomic_fetch_and_or_uint8((uint8_t *)&common_data->loop_is_entry[ml_entry_index], 1);
+			return;
+		}
+
+		e2lfan_curr = edge_to_loops[mlfan_curr->e];
+
+		if (IS_EDGE_SHARP(e2lfan_curr)) {
+			/* Sharp loop/edge, so not a cyclic smooth fan, its entry is tagged as sharp loop. */
+			return;
+		}
+		if (!loop_split_fan_owner_claim(common_data, mlfan_vert_index, ml_curr_index)) {
+			/* An earlier walk handles the rest of this fan. */
+			return;
+		}
+		if (loop_split_loop_order_lt(common_data, mlfan_vert_index, ml_entry_index)) {
+			ml_entry_index = mlfan_vert_index;
+		}
+	}
+}
+
+typedef struct LoopSplitTLS {
+	/* Temp edge vectors stack, only used when computing lnor spacearr, created on first use. */
+	BLI_Stack *edge_vectors;
+} LoopSplitTLS;
+
+static void loop_split_tag_entries_task(
+        void *__restrict userdata, const int mp_index, const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	LoopSplitTaskDataCommon *common_data = userdata;
+	char *loop_is_entry = common_data->loop_is_entry;
+
+	const MLoop *mloops = common_data->mloops;
+	const MPoly *mp = &common_data->mpolys[mp_index];
+	const int (*edge_to_loops)[2] = (const int (*)[2])common_data->edge_to_loops;
+
+	const int ml_last_index = (mp->loopstart + mp->totloop) - 1;
+	int ml_curr_index = mp->loopstart;
+	int ml_prev_index = ml_last_index;
+
+	for (; ml_curr_index <= ml_last_index; ml_prev_index = ml_curr_index++) {
+		const MLoop *ml_curr = &mloops[ml_curr_index];
+		const MLoop *ml_prev = &mloops[ml_prev_index];
+		const int *e2l_curr = edge_to_loops[ml_curr->e];
+		const int *e2l_prev = edge_to_loops[ml_prev->e];
+
+		if (IS_EDGE_SHARP(e2l_curr)) {
+			/* Other threads only ever set the entries of cyclic fans, which have no sharp loops. */
+			loop_is_entry[ml_curr_index] = 1;
+		}
+		else {
+			loop_split_cyclic_fan_tag_entry(
+			        common_data, e2l_prev, ml_curr, ml_prev, ml_curr_index, ml_prev_index, mp_index);
+		}
+	}
+}
+
+static void loop_split_compute_task(
+        void *__restrict userdata, const int mp_index, const ParallelRangeTLS *__restrict tls)
+{
+	LoopSplitTaskDataCommon *common_data = userdata;
+	LoopSplitTLS *tls_data = tls->userdata_chunk;
+	MLoopNorSpaceArray *lnors_spacearr = common_data->lnors_spacearr;
+	const char *loop_is_entry = common_data->loop_is_entry;
+
+	const MLoop *mloops = common_data->mloops;
+	const MPoly *mp = &common_data->mpolys[mp_index];
+	const int (*edge_to_loops)[2] = (const int (*)[2])common_data->edge_to_loops;
+
+	const int ml_last_index = (mp->loopstart + mp->totloop) - 1;
+	int ml_curr_index = mp->loopstart;
+	int ml_prev_index = ml_last_index;
+
+	for (; ml_curr_index <= ml_last_index; ml_prev_index = ml_curr_index++) {
+		if (loop_is_entry[ml_curr_index]) {
+			const MLoop *ml_curr = &mloops[ml_curr_index];
+			const MLoop *ml_prev = &mloops[ml_prev_index];
+			const int *e2l_curr = edge_to_loops[ml_curr->e];
+			const int *e2l_prev = edge_to_loops[ml_prev->e];
+			LoopSplitTaskData data = {NULL};
+
+			data.ml_curr = ml_curr;
+			data.ml_prev = ml_prev;
+			data.ml_curr_index = ml_curr_index;
+			data.mp_index = mp_index;
+			if (lnors_spacearr) {
+				/* Only this task writes that item, when adding the entry loop to its own space. */
+				data.lnor_space = lnors_spacearr->lspacearr[ml_curr_index];
+			}
+
+			if (IS_EDGE_SHARP(e2l_curr) && IS_EDGE_SHARP(e2l_prev)) {
+				data.lnor = &common_data->loopnors[ml_curr_index];
+			}
+			else {
+				data.ml_prev_index = ml_prev_index;
+				data.e2l_prev = e2l_prev;  /* Also tag as 'fan' task. */
+				if (lnors_spacearr && tls_data->edge_vectors == NULL) {
+					tls_data->edge_vectors = BLI_stack_new(sizeof(float[3]), __func__);
+				}
+			}
+
+			loop_split_worker_do(common_data, &data, tls_data->edge_vectors);
+		}
+	}
+}
+
+static void loop_split_compute_finalize(void *__restrict UNUSED(userdata), void *__restrict userdata_chunk)
+{
+	LoopSplitTLS *tls_data = userdata_chunk;
+
+	if (tls_data->edge_vectors) {
+		BLI_stack_free(tls_data->edge_vectors);
+	}
+}
+
+static void loop_split_generator_threaded(LoopSplitTaskDataCommon *common_data)
+{
+	MLoopNorSpaceArray *lnors_spacearr = common_data->lnors_spacearr;
+	const int numLoops = common_data->numLoops;
+	const int numPolys = common_data->numPolys;
+
+	LoopSplitTLS tls_data = {NULL};
+	ParallelRangeSettings settings;
+
+#ifdef DEBUG_TIME
+	TIMEIT_START_AVERAGED(loop_split_generator_threaded);
+#endif
+
+	common_data->loop_is_entry = MEM_calloc_arrayN((size_t)numLoops, sizeof(*common_data->loop_is_entry), __func__);
+	common_data->loop_fan_owner = MEM_malloc_arrayN((size_t)numLoops, sizeof(*common_data->loop_fan_owner), __func__);
+	copy_vn_i(common_data->loop_fan_owner, numLoops, -1);
+
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.min_iter_per_thread = LOOP_SPLIT_TASK_BLOCK_SIZE;
+
+	BLI_task_parallel_range(0, numPolys, common_data, loop_split_tag_entries_task, &settings);
+
+	MEM_freeN(common_data->loop_fan_owner);
+	common_data->loop_fan_owner = NULL;
+
+	if (lnors_spacearr) {
+		int ml_index;
+
+		for (ml_index = 0; ml_index < numLoops; ml_index++) {
+			if (common_data->loop_is_entry[ml_index]) {
+				lnors_spacearr->lspacearr[ml_index] = BKE_lnor_space_create(lnors_spacearr);
+			}
+		}
+	}
+
+	/* Fans have very different sizes. */
+	settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+	settings.userdata_chunk = &tls_data;
+	settings.userdata_chunk_size = sizeof(tls_data);
+	settings.func_finalize = loop_split_compute_finalize;
+
+	BLI_task_parallel_range(0, numPolys, common_data, loop_split_compute_task, &settings);
+
+	MEM_freeN(common_data->loop_is_entry);
+	common_data->loop_is_entry = NULL;
+
+#ifdef DEBUG_TIME
+	TIMEIT_END_AVERAGED(loop_split_generator_threaded);
+#endif
+}
+
 /**
  * Compute split normals, i.e. vertex normals associated with each poly (hence 'loop normals').
  * Useful to materialize sharp edges (or non-smooth faces) without actually modifying the geometry (splitting edges).
@@ -1522,20 +1813,10 @@ void BKE_mesh_normals_loop_split(
 
 	if (numLoops < LOOP_SPLIT_TASK_BLOCK_SIZE * 8) {
 		/* Not enough loops to be worth the whole threading overhead... */
-		loop_split_generator(NULL, &common_data);
+		loop_split_generator(&common_data);
 	}
 	else {
-		TaskScheduler *task_scheduler;
-		TaskPool *task_pool;
-
-		task_scheduler = BLI_task_scheduler_get();
-		task_pool = BLI_task_pool_create(task_scheduler, &common_data);
-
-		loop_split_generator(task_pool, &common_data);
-
-		BLI_task_pool_work_and_wait(task_pool);
-
-		BLI_task_pool_free(task_pool);
+		loop_split_generator_threaded(&common_data);
 	}
 
 	MEM_freeN(edge_to_loops);
@@ -3018,145 +3299,228 @@ int BKE_mesh_recalc_tessellation(
 
 }
 
+/* use this to avoid locking pthread for _every_ polygon
+ * and calling the fill function */
+#define USE_TESSFACE_SPEEDUP
+
 /**
- * Calculate tessellation into #MLoopTri which exist only for this purpose.
+ * Tessellate a single polygon into \a mlooptri (its first triangle).
+ * \a r_arena is created on demand, for ngons.
  */
-void BKE_mesh_recalc_looptri(
-        const MLoop *mloop, const MPoly *mpoly,
-        const MVert *mvert,
-        int totloop, int totpoly,
-        MLoopTri *mlooptri)
+static void mesh_recalc_looptri__single_poly(
+        const MLoop *mloop, const MPoly *mp, const MVert *mvert, const int poly_index,
+        MLoopTri *mlooptri, MemArena **r_arena)
 {
-	/* use this to avoid locking pthread for _every_ polygon
-	 * and calling the fill function */
-
-#define USE_TESSFACE_SPEEDUP
-
-	const MPoly *mp;
+	const unsigned int mp_loopstart = (unsigned int)mp->loopstart;
+	const unsigned int mp_totloop = (unsigned int)mp->totloop;
 	const MLoop *ml;
 	MLoopTri *mlt;
-	MemArena *arena = NULL;
-	int poly_index, mlooptri_index;
+	unsigned int l1, l2, l3;
 	unsigned int j;
 
-	mlooptri_index = 0;
-	mp = mpoly;
-	for (poly_index = 0; poly_index < totpoly; poly_index++, mp++) {
-		const unsigned int mp_loopstart = (unsigned int)mp->loopstart;
-		const unsigned int mp_totloop = (unsigned int)mp->totloop;
-		unsigned int l1, l2, l3;
-		if (mp_totloop < 3) {
-			/* do nothing */
-		}
+	if (mp_totloop < 3) {
+		/* do nothing */
+	}
 
 #ifdef USE_TESSFACE_SPEEDUP
 
-#define ML_TO_MLT(i1, i2, i3)  { \
-			mlt = &mlooptri[mlooptri_index]; \
-			l1 = mp_loopstart + i1; \
-			l2 = mp_loopstart + i2; \
-			l3 = mp_loopstart + i3; \
-			ARRAY_SET_ITEMS(mlt->tri, l1, l2, l3); \
-			mlt->poly = (unsigned int)poly_index; \
-		} ((void)0)
+#define ML_TO_MLT(tri_index, i1, i2, i3)  { \
+		mlt = &mlooptri[tri_index]; \
+		l1 = mp_loopstart + i1; \
+		l2 = mp_loopstart + i2; \
+		l3 = mp_loopstart + i3; \
+		ARRAY_SET_ITEMS(mlt->tri, l1, l2, l3); \
+		mlt->poly = (unsigned int)poly_index; \
+	} ((void)0)
+
+	else if (mp_totloop == 3) {
+		ML_TO_MLT(0, 0, 1, 2);
+	}
+	else if (mp_totloop == 4) {
+		ML_TO_MLT(0, 0, 1, 2);
+		MLoopTri *mlt_a = mlt;
+		ML_TO_MLT(1, 0, 2, 3);
+		MLoopTri *mlt_b = mlt;
+
+		if (UNLIKELY(is_quad_flip_v3_first_third_fast(
+		                     mvert[mloop[mlt_a->tri[0]].v].co,
+		                     mvert[mloop[mlt_a->tri[1]].v].co,
+		                     mvert[mloop[mlt_a->tri[2]].v].co,
+		                     mvert[mloop[mlt_b->tri[2]].v].co)))
+		{
+			/* flip out of degenerate 0-2 state. */
+			mlt_a->tri[2] = mlt_b->tri[2];
+			mlt_b->tri[0] = mlt_a->tri[1];
+		}
+	}
+#endif /* USE_TESSFACE_SPEEDUP */
+	else {
+		const float *co_curr, *co_prev;
 
-		else if (mp_totloop == 3) {
-			ML_TO_MLT(0, 1, 2);
-			mlooptri_index++;
+		float normal[3];
+
+		float axis_mat[3][3];
+		float (*projverts)[2];
+		unsigned int (*tris)[3];
+
+		const unsigned int totfilltri = mp_totloop - 2;
+
+		MemArena *arena = *r_arena;
+		if (UNLIKELY(arena == NULL)) {
+			*r_arena = arena = BLI_memarena_new(BLI_MEMARENA_STD_BUFSIZE, __func__);
 		}
-		else if (mp_totloop == 4) {
-			ML_TO_MLT(0, 1, 2);
-			MLoopTri *mlt_a = mlt;
-			mlooptri_index++;
-			ML_TO_MLT(0, 2, 3);
-			MLoopTri *mlt_b = mlt;
-			mlooptri_index++;
-
-			if (UNLIKELY(is_quad_flip_v3_first_third_fast(
-			                     mvert[mloop[mlt_a->tri[0]].v].co,
-			                     mvert[mloop[mlt_a->tri[1]].v].co,
-			                     mvert[mloop[mlt_a->tri[2]].v].co,
-			                     mvert[mloop[mlt_b->tri[2]].v].co)))
-			{
-				/* flip out of degenerate 0-2 state. */
-				mlt_a->tri[2] = mlt_b->tri[2];
-				mlt_b->tri[0] = mlt_a->tri[1];
-			}
+
+		tris = BLI_memarena_alloc(arena, sizeof(*tris) * (size_t)totfilltri);
+		projverts = BLI_memarena_alloc(arena, sizeof(*projverts) * (size_t)mp_totloop);
+
+		zero_v3(normal);
+
+		/* calc normal, flipped: to get a positive 2d cross product */
+		ml = mloop + mp_loopstart;
+		co_prev = mvert[ml[mp_totloop - 1].v].co;
+		for (j = 0; j < mp_totloop; j++, ml++) {
+			co_curr = mvert[ml->v].co;
+			add_newell_cross_v3_v3v3(normal, co_prev, co_curr);
+			co_prev = co_curr;
+		}
+		if (UNLIKELY(normalize_v3(normal) == 0.0f)) {
+			normal[2] = 1.0f;
 		}
-#endif /* USE_TESSFACE_SPEEDUP */
-		else {
-			const float *co_curr, *co_prev;
 
-			float normal[3];
+		/* project verts to 2d */
+		axis_dominant_v3_to_m3_negate(axis_mat, normal);
 
-			float axis_mat[3][3];
-			float (*projverts)[2];
-			unsigned int (*tris)[3];
+		ml = mloop + mp_loopstart;
+		for (j = 0; j < mp_totloop; j++, ml++) {
+			mul_v2_m3v3(projverts[j], axis_mat, mvert[ml->v].co);
+		}
 
-			const unsigned int totfilltri = mp_totloop - 2;
+		BLI_polyfill_calc_arena(projverts, mp_totloop, 1, tris, arena);
 
-			if (UNLIKELY(arena == NULL)) {
-				arena = BLI_memarena_new(BLI_MEMARENA_STD_BUFSIZE, __func__);
-			}
+		/* apply fill */
+		for (j = 0; j < totfilltri; j++) {
+			unsigned int *tri = tris[j];
 
-			tris = BLI_memarena_alloc(arena, sizeof(*tris) * (size_t)totfilltri);
-			projverts = BLI_memarena_alloc(arena, sizeof(*projverts) * (size_t)mp_totloop);
+			mlt = &mlooptri[j];
 
-			zero_v3(normal);
+			/* set loop indices, transformed to vert indices later */
+			l1 = mp_loopstart + tri[0];
+			l2 = mp_loopstart + tri[1];
+			l3 = mp_loopstart + tri[2];
 
-			/* calc normal, flipped: to get a positive 2d cross product */
-			ml = mloop + mp_loopstart;
-			co_prev = mvert[ml[mp_totloop - 1].v].co;
-			for (j = 0; j < mp_totloop; j++, ml++) {
-				co_curr = mvert[ml->v].co;
-				add_newell_cross_v3_v3v3(normal, co_prev, co_curr);
-				co_prev = co_curr;
-			}
-			if (UNLIKELY(normalize_v3(normal) == 0.0f)) {
-				normal[2] = 1.0f;
-			}
+			ARRAY_SET_ITEMS(mlt->tri, l1, l2, l3);
+			mlt->poly = (unsigned int)poly_index;
+		}
 
-			/* project verts to 2d */
-			axis_dominant_v3_to_m3_negate(axis_mat, normal);
+		BLI_memarena_clear(arena);
+	}
 
-			ml = mloop + mp_loopstart;
-			for (j = 0; j < mp_totloop; j++, ml++) {
-				mul_v2_m3v3(projverts[j], axis_mat, mvert[ml->v].co);
-			}
+#undef ML_TO_MLT
+}
 
-			BLI_polyfill_calc_arena(projverts, mp_totloop, 1, tris, arena);
+#undef USE_TESSFACE_SPEEDUP
 
-			/* apply fill */
-			for (j = 0; j < totfilltri; j++) {
-				unsigned int *tri = tris[j];
+BLI_INLINE int mesh_poly_tri_count(const MPoly *mp)
+{
+	return (mp->totloop >= 3) ? mp->totloop - 2 : 0;
+}
 
-				mlt = &mlooptri[mlooptri_index];
+typedef struct MeshRecalcLoopTriData {
+	const MLoop *mloop;
+	const MPoly *mpoly;
+	const MVert *mvert;
+	MLoopTri *mlooptri;
+	/* Index of the first triangle of each polygon. */
+	int *tri_offsets;
+} MeshRecalcLoopTriData;
 
-				/* set loop indices, transformed to vert indices later */
-				l1 = mp_loopstart + tri[0];
-				l2 = mp_loopstart + tri[1];
-				l3 = mp_loopstart + tri[2];
+typedef struct MeshRecalcLoopTriTLS {
+	MemArena *arena;
+} MeshRecalcLoopTriTLS;
 
-				ARRAY_SET_ITEMS(mlt->tri, l1, l2, l3);
-				mlt->poly = (unsigned int)poly_index;
+static void mesh_recalc_looptri_count_cb(
+        void *__restrict userdata,
+        const int poly_index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshRecalcLoopTriData *data = userdata;
 
-				mlooptri_index++;
-			}
+	data->tri_offsets[poly_index] = mesh_poly_tri_count(&data->mpoly[poly_index]);
+}
 
-			BLI_memarena_clear(arena);
+static void mesh_recalc_looptri_fill_cb(
+        void *__restrict userdata,
+        const int poly_index,
+        const ParallelRangeTLS *__restrict tls)
+{
+	MeshRecalcLoopTriData *data = userdata;
+	MeshRecalcLoopTriTLS *tls_data = tls->userdata_chunk;
+
+	mesh_recalc_looptri__single_poly(
+	        data->mloop, &data->mpoly[poly_index], data->mvert, poly_index,
+	        &data->mlooptri[data->tri_offsets[poly_index]], &tls_data->arena);
+}
+
+static void mesh_recalc_looptri_finalize(void *__restrict UNUSED(userdata), void *__restrict userdata_chunk)
+{
+	MeshRecalcLoopTriTLS *tls_data = userdata_chunk;
+
+	if (tls_data->arena) {
+		BLI_memarena_free(tls_data->arena);
+	}
+}
+
+/**
+ * Calculate tessellation into #MLoopTri which exist only for this purpose.
+ */
+void BKE_mesh_recalc_looptri(
+        const MLoop *mloop, const MPoly *mpoly,
+        const MVert *mvert,
+        int totloop, int totpoly,
+        MLoopTri *mlooptri)
+{
+	if (totloop < BKE_MESH_OMP_LIMIT) {
+		MemArena *arena = NULL;
+		int mlooptri_index = 0;
+
+		for (int poly_index = 0; poly_index < totpoly; poly_index++) {
+			const MPoly *mp = &mpoly[poly_index];
+			mesh_recalc_looptri__single_poly(mloop, mp, mvert, poly_index, &mlooptri[mlooptri_index], &arena);
+			mlooptri_index += mesh_poly_tri_count(mp);
+		}
+
+		if (arena) {
+			BLI_memarena_free(arena);
 		}
+
+		BLI_assert(mlooptri_index == poly_to_tri_count(totpoly, totloop));
 	}
+	else {
+		/* Triangles are stored in polygon order, get the offset of each polygon first. */
+		MeshRecalcLoopTriData data = {
+		    .mloop = mloop, .mpoly = mpoly, .mvert = mvert, .mlooptri = mlooptri,
+		    .tri_offsets = MEM_malloc_arrayN((size_t)totpoly, sizeof(int), __func__),
+		};
+		MeshRecalcLoopTriTLS tls_data = {NULL};
 
-	if (arena) {
-		BLI_memarena_free(arena);
-		arena = NULL;
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.min_iter_per_thread = 1024;
+
+		BLI_task_parallel_range(0, totpoly, &data, mesh_recalc_looptri_count_cb, &settings);
+		const int tottri = BLI_task_parallel_scan_i(data.tri_offsets, data.tri_offsets, totpoly, false, true);
+		BLI_assert(tottri == poly_to_tri_count(totpoly, totloop));
+		UNUSED_VARS_NDEBUG(tottri);
+
+		settings.userdata_chunk = &tls_data;
+		settings.userdata_chunk_size = sizeof(tls_data);
+		settings.func_finalize = mesh_recalc_looptri_finalize;
+		BLI_task_parallel_range(0, totpoly, &data, mesh_recalc_looptri_fill_cb, &settings);
+
+		MEM_freeN(data.tri_offsets);
 	}
 
-	BLI_assert(mlooptri_index == poly_to_tri_count(totpoly, totloop));
 	UNUSED_VARS_NDEBUG(totloop);
-
-#undef USE_TESSFACE_SPEEDUP
-#undef ML_TO_MLT
 }
 
 /* -------------------------------------------------------------------- */
@@ -41,6 +41,7 @@
 #include "BLI_edgehash.h"
 #include "BLI_math_base.h"
 #include "BLI_math_vector.h"
+#include "BLI_task.h"
 
 #include "BKE_deform.h"
 #include "BKE_depsgraph.h"
@@ -1438,6 +1439,89 @@ void BKE_mesh_calc_edges_legacy(Mesh *me, const bool use_old)
 }
 
 
+typedef struct MeshCalcEdgesData {
+	const MPoly *mpoly;
+	MLoop *mloop;
+	/* Index of the edge of each loop in 'edges' (excluding the edges of the mesh). */
+	int *loop_edge_index;
+	unsigned int (*edges)[2];
+	const unsigned int *edge_map;
+	const MEdge *medge_orig;
+	const unsigned int *edge_first;
+	MEdge *medge;
+	int totedge_orig;
+	short ed_flag;
+} MeshCalcEdgesData;
+
+static void mesh_calc_edges_loop_count_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcEdgesData *data = userdata;
+	const MPoly *mp = &data->mpoly[i];
+	const MLoop *ml = &data->mloop[mp->loopstart];
+	int *loop_edge_index = &data->loop_edge_index[mp->loopstart];
+	for (int j = 0; j < mp->totloop; j++) {
+		loop_edge_index[j] = (ml[j].v != ml[(j + 1) % mp->totloop].v);
+	}
+}
+
+static void mesh_calc_edges_loop_fill_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcEdgesData *data = userdata;
+	const MPoly *mp = &data->mpoly[i];
+	const MLoop *ml = &data->mloop[mp->loopstart];
+	const int *loop_edge_index = &data->loop_edge_index[mp->loopstart];
+	unsigned int (*edges)[2] = &data->edges[data->totedge_orig];
+	for (int j = 0; j < mp->totloop; j++) {
+		const unsigned int v_next = ml[(j + 1) % mp->totloop].v;
+		if (ml[j].v != v_next) {
+			edges[loop_edge_index[j]][0] = ml[j].v;
+			edges[loop_edge_index[j]][1] = v_next;
+		}
+	}
+}
+
+static void mesh_calc_edges_edge_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcEdgesData *data = userdata;
+	const unsigned int index = data->edge_first[i];
+	MEdge *med = &data->medge[i];
+
+	if ((int)index < data->totedge_orig) {
+		*med = data->medge_orig[index]; /* copy from the original */
+	}
+	else {
+		med->v1 = MIN2(data->edges[index][0], data->edges[index][1]);
+		med->v2 = MAX2(data->edges[index][0], data->edges[index][1]);
+		med->flag = data->ed_flag;
+	}
+}
+
+static void mesh_calc_edges_loop_assign_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	MeshCalcEdgesData *data = userdata;
+	const MPoly *mp = &data->mpoly[i];
+	MLoop *ml = &data->mloop[mp->loopstart];
+	const int *loop_edge_index = &data->loop_edge_index[mp->loopstart];
+	for (int j = 0; j < mp->totloop; j++) {
+		const unsigned int v_next = ml[(j + 1) % mp->totloop].v;
+		/* degenerate loops have no edge */
+		ml[j].e = (ml[j].v != v_next) ?
+		          data->edge_map[data->totedge_orig + loop_edge_index[j]] : 0;
+	}
+}
+
 /**
  * Calculate edges from polygons
  *
@@ -1447,84 +1531,62 @@ void BKE_mesh_calc_edges_legacy(Mesh *me, const bool use_old)
 void BKE_mesh_calc_edges(Mesh *mesh, bool update, const bool select)
 {
 	CustomData edata;
-	EdgeHashIterator *ehi;
-	MPoly *mp;
-	MEdge *med, *med_orig;
-	EdgeHash *eh;
-	unsigned int eh_reserve;
-	int i, totedge, totpoly = mesh->totpoly;
-	int med_index;
+	const int totpoly = mesh->totpoly;
+	const int totloop = mesh->totloop;
+	int totedge_orig, totedge_loop, totedge;
 	/* select for newly created meshes which are selected [#25595] */
 	const short ed_flag = (ME_EDGEDRAW | ME_EDGERENDER) | (select ? SELECT : 0);
+	const bool use_threading = (totloop > BKE_MESH_OMP_LIMIT);
 
 	if (mesh->totedge == 0)
 		update = false;
 
-	eh_reserve = max_ii(update ? mesh->totedge : 0, BLI_EDGEHASH_SIZE_GUESS_FROM_POLYS(totpoly));
-	eh = BLI_edgehash_new_ex(__func__, eh_reserve);
-
-	if (update) {
-		/* assume existing edges are valid
-		 * useful when adding more faces and generating edges from them */
-		med = mesh->medge;
-		for (i = 0; i < mesh->totedge; i++, med++)
-			BLI_edgehash_insert(eh, med->v1, med->v2, med);
-	}
-
-	/* mesh loops (bmesh only) */
-	for (mp = mesh->mpoly, i = 0; i < totpoly; mp++, i++) {
-		MLoop *l = &mesh->mloop[mp->loopstart];
-		int j, v_prev = (l + (mp->totloop - 1))->v;
-		for (j = 0; j < mp->totloop; j++, l++) {
-			if (v_prev != l->v) {
-				void **val_p;
-				if (!BLI_edgehash_ensure_p(eh, v_prev, l->v, &val_p)) {
-					*val_p = NULL;
-				}
-			}
-			v_prev = l->v;
-		}
-	}
-
-	totedge = BLI_edgehash_len(eh);
+	totedge_orig = update ? mesh->totedge : 0;
+
+	MeshCalcEdgesData data = {
+		.mpoly = mesh->mpoly,
+		.mloop = mesh->mloop,
+		.loop_edge_index = MEM_mallocN(sizeof(int) * (size_t)totloop, __func__),
+		.medge_orig = mesh->medge,
+		.totedge_orig = totedge_orig,
+		.ed_flag = ed_flag,
+	};
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading;
+	settings.min_iter_per_thread = 1024;
+
+	/* Index the edges of (non degenerate) loops. */
+	BLI_task_parallel_range(0, totpoly, &data, mesh_calc_edges_loop_count_cb, &settings);
+	totedge_loop = BLI_task_parallel_scan_i(data.loop_edge_index, data.loop_edge_index, totloop, false, use_threading);
+
+	/* assume existing edges are valid
+	 * useful when adding more faces and generating edges from them,
+	 * these are added first so they keep their index. */
+	data.edges = MEM_mallocN(sizeof(*data.edges) * (size_t)(totedge_orig + totedge_loop), __func__);
+	for (int i = 0; i < totedge_orig; i++) {
+		data.edges[i][0] = mesh->medge[i].v1;
+		data.edges[i][1] = mesh->medge[i].v2;
+	}
+	BLI_task_parallel_range(0, totpoly, &data, mesh_calc_edges_loop_fill_cb, &settings);
+
+	unsigned int *edge_map = MEM_mallocN(sizeof(*edge_map) * (size_t)(totedge_orig + totedge_loop), __func__);
+	unsigned int *edge_first = MEM_mallocN(sizeof(*edge_first) * (size_t)(totedge_orig + totedge_loop), __func__);
+	totedge = (int)BLI_edges_dedup(
+	        (const unsigned int (*)[2])data.edges, (unsigned int)(totedge_orig + totedge_loop), (unsigned int)mesh->totvert,
+	        edge_map, edge_first, use_threading);
+	data.edge_map = edge_map;
+	data.edge_first = edge_first;
 
 	/* write new edges into a temporary CustomData */
 	CustomData_reset(&edata);
 	CustomData_add_layer(&edata, CD_MEDGE, CD_CALLOC, NULL, totedge);
+	data.medge = CustomData_get_layer(&edata, CD_MEDGE);
+	BLI_task_parallel_range(0, totedge, &data, mesh_calc_edges_edge_cb, &settings);
 
-	med = CustomData_get_layer(&edata, CD_MEDGE);
-	for (ehi = BLI_edgehashIterator_new(eh), i = 0;
-	     BLI_edgehashIterator_isDone(ehi) == false;
-	     BLI_edgehashIterator_step(ehi), ++i, ++med)
-	{
-		if (update && (med_orig = BLI_edgehashIterator_getValue(ehi))) {
-			*med = *med_orig; /* copy from the original */
-		}
-		else {
-			BLI_edgehashIterator_getKey(ehi, &med->v1, &med->v2);
-			med->flag = ed_flag;
-		}
-
-		/* store the new edge index in the hash value */
-		BLI_edgehashIterator_setValue(ehi, SET_INT_IN_POINTER(i));
-	}
-	BLI_edgehashIterator_free(ehi);
-
-	if (mesh->totpoly) {
-		/* second pass, iterate through all loops again and assign
-		 * the newly created edges to them. */
-		for (mp = mesh->mpoly, i = 0; i < mesh->totpoly; mp++, i++) {
-			MLoop *l = &mesh->mloop[mp->loopstart];
-			MLoop *l_prev = (l + (mp->totloop - 1));
-			int j;
-			for (j = 0; j < mp->totloop; j++, l++) {
-				/* lookup hashed edge index */
-				med_index = GET_INT_FROM_POINTER(BLI_edgehash_lookup(eh, l_prev->v, l->v));
-				l_prev->e = med_index;
-				l_prev = l;
-			}
-		}
-	}
+	/* second pass, assign the newly created edges to the loops. */
+	BLI_task_parallel_range(0, totpoly, &data, mesh_calc_edges_loop_assign_cb, &settings);
 
 	/* free old CustomData and assign new one */
 	CustomData_free(&mesh->edata, mesh->totedge);
@@ -1533,6 +1595,9 @@ void BKE_mesh_calc_edges(Mesh *mesh, bool update, const bool select)
 
 	mesh->medge = CustomData_get_layer(&mesh->edata, CD_MEDGE);
 
-	BLI_edgehash_free(eh, NULL);
+	MEM_freeN(data.loop_edge_index);
+	MEM_freeN(data.edges);
+	MEM_freeN(edge_map);
+	MEM_freeN(edge_first);
 }
 /** \} */
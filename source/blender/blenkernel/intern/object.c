@@ -377,6 +377,9 @@ void BKE_object_free_caches(Object *object)
 		}
 	}
 
+	/* Free results kept by modifiers using eModifierMode_CacheResult. */
+	mesh_modifier_stack_cache_free(object);
+
 	/* Free memory used by cached derived meshes in the particle system modifiers. */
 	for (md = object->modifiers.first; md != NULL; md = md->next) {
 		if (md->type == eModifierType_ParticleSystem) {
@@ -410,6 +413,7 @@ void BKE_object_free(Object *ob)
 {
 	BKE_animdata_free((ID *)ob, false);
 
+	mesh_modifier_stack_cache_free(ob);
 	BKE_object_free_modifiers(ob);
 
 	MEM_SAFE_FREE(ob->mat);
@@ -1167,6 +1171,7 @@ void BKE_object_copy_data(Main *UNUSED(bmain), Object *ob_dst, const Object *ob_
 	
 	ob_dst->derivedDeform = NULL;
 	ob_dst->derivedFinal = NULL;
+	ob_dst->modifier_stack_cache = NULL;
 
 	BLI_listbase_clear(&ob_dst->gpulamp);
 	BLI_listbase_clear(&ob_dst->pc_ids);
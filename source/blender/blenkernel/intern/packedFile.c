@@ -59,6 +59,8 @@
 #include "BKE_report.h"
 #include "BKE_sound.h"
 
+#include "BLO_readfile.h"
+
 int seekPackedFile(PackedFile *pf, int offset, int whence)
 {
 	int oldseek = -1, seek = 0;
@@ -145,7 +147,13 @@ int countPackedFiles(Main *bmain)
 void freePackedFile(PackedFile *pf)
 {
 	if (pf) {
-		MEM_freeN(pf->data);
+		if (pf->mapping) {
+			/* data references the loaded .blend file */
+			BLO_file_mapping_release(pf->mapping);
+		}
+		else {
+			MEM_freeN(pf->data);
+		}
 		MEM_freeN(pf);
 	}
 	else
@@ -157,7 +165,15 @@ PackedFile *dupPackedFile(const PackedFile *pf_src)
 	PackedFile *pf_dst;
 
 	pf_dst       = MEM_dupallocN(pf_src);
-	pf_dst->data = MEM_dupallocN(pf_src->data);
+
+	if (pf_src->mapping) {
+		pf_dst->data = MEM_mallocN((size_t)pf_src->size, "packFile");
+		memcpy(pf_dst->data, pf_src->data, (size_t)pf_src->size);
+		pf_dst->mapping = NULL;
+	}
+	else {
+		pf_dst->data = MEM_dupallocN(pf_src->data);
+	}
 
 	return pf_dst;
 }
@@ -119,6 +119,12 @@ BLI_INLINE void BLI_edgesetIterator_getKey(EdgeSetIterator *esi, unsigned int *r
 BLI_INLINE void BLI_edgesetIterator_step(EdgeSetIterator *esi) { BLI_edgehashIterator_step((EdgeHashIterator *)esi); }
 BLI_INLINE bool BLI_edgesetIterator_isDone(EdgeSetIterator *esi) { return BLI_edgehashIterator_isDone((EdgeHashIterator *)esi); }
 
+/* *** Edge De-Duplication *** */
+
+unsigned int BLI_edges_dedup(
+        const unsigned int (*edges)[2], const unsigned int edges_len, const unsigned int verts_len,
+        unsigned int *r_edge_map, unsigned int *r_edge_first, const bool use_threading);
+
 #ifdef DEBUG
 double          BLI_edgehash_calc_quality(EdgeHash *eh);
 double          BLI_edgeset_calc_quality(EdgeSet *es);
@@ -0,0 +1,90 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+#ifndef __BLI_FLATHASH_H__
+#define __BLI_FLATHASH_H__
+
+/** \file BLI_flathash.h
+ *  \ingroup bli
+ *
+ * An open-addressing (pointer -> pointer) hash table,
+ * using the same hashing & comparison callbacks as #GHash.
+ *
+ * Keys and values are stored inline in a single array, with a separate array of one byte per slot
+ * holding 7 bits of each key's hash. Lookups compare a whole group of these bytes at once
+ * (using SSE2 when available), so most probes touch a single cache-line and never call the
+ * comparison function for keys which don't match.
+ *
+ * Unlike #GHash, pointers to values (#BLI_flathash_lookup_p and friends)
+ * are only valid until the next insertion.
+ */
+
+#include "BLI_compiler_attrs.h"
+#include "BLI_ghash.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FlatHash FlatHash;
+
+typedef struct FlatHashIterator {
+	FlatHash *fh;
+	unsigned int slot;
+} FlatHashIterator;
+
+FlatHash *BLI_flathash_new_ex(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+        const unsigned int nentries_reserve) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+FlatHash *BLI_flathash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info) ATTR_MALLOC ATTR_WARN_UNUSED_RESULT;
+void   BLI_flathash_free(FlatHash *fh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void   BLI_flathash_reserve(FlatHash *fh, const unsigned int nentries_reserve);
+void   BLI_flathash_insert(FlatHash *fh, void *key, void *val);
+bool   BLI_flathash_reinsert(FlatHash *fh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+bool   BLI_flathash_add(FlatHash *fh, void *key, void *val);
+void  *BLI_flathash_lookup(FlatHash *fh, const void *key) ATTR_WARN_UNUSED_RESULT;
+void  *BLI_flathash_lookup_default(FlatHash *fh, const void *key, void *val_default) ATTR_WARN_UNUSED_RESULT;
+void **BLI_flathash_lookup_p(FlatHash *fh, const void *key) ATTR_WARN_UNUSED_RESULT;
+bool   BLI_flathash_ensure_p(FlatHash *fh, void *key, void ***r_val) ATTR_WARN_UNUSED_RESULT;
+bool   BLI_flathash_remove(FlatHash *fh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+void  *BLI_flathash_popkey(FlatHash *fh, const void *key, GHashKeyFreeFP keyfreefp) ATTR_WARN_UNUSED_RESULT;
+bool   BLI_flathash_haskey(FlatHash *fh, const void *key) ATTR_WARN_UNUSED_RESULT;
+void   BLI_flathash_clear(FlatHash *fh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp);
+unsigned int BLI_flathash_len(const FlatHash *fh) ATTR_WARN_UNUSED_RESULT;
+
+/* *** */
+
+void   BLI_flathashIterator_init(FlatHashIterator *fhi, FlatHash *fh);
+void   BLI_flathashIterator_step(FlatHashIterator *fhi);
+bool   BLI_flathashIterator_done(const FlatHashIterator *fhi) ATTR_WARN_UNUSED_RESULT;
+void  *BLI_flathashIterator_getKey(FlatHashIterator *fhi) ATTR_WARN_UNUSED_RESULT;
+void  *BLI_flathashIterator_getValue(FlatHashIterator *fhi) ATTR_WARN_UNUSED_RESULT;
+void **BLI_flathashIterator_getValue_p(FlatHashIterator *fhi) ATTR_WARN_UNUSED_RESULT;
+
+#define FLATHASH_ITER(fh_iter_, flathash_) \
+	for (BLI_flathashIterator_init(&fh_iter_, flathash_); \
+	     BLI_flathashIterator_done(&fh_iter_) == false; \
+	     BLI_flathashIterator_step(&fh_iter_))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BLI_FLATHASH_H__ */
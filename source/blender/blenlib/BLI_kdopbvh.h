@@ -138,6 +138,10 @@ float BLI_bvhtree_get_epsilon(const BVHTree *tree);
 int BLI_bvhtree_find_nearest(
         BVHTree *tree, const float co[3], BVHTreeNearest *nearest,
         BVHTree_NearestPointCallback callback, void *userdata);
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], const int co_len, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata,
+        const bool use_threading);
 
 int BLI_bvhtree_ray_cast_ex(
         BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
@@ -146,6 +150,10 @@ int BLI_bvhtree_ray_cast_ex(
 int BLI_bvhtree_ray_cast(
         BVHTree *tree, const float co[3], const float dir[3], float radius, BVHTreeRayHit *hit,
         BVHTree_RayCastCallback callback, void *userdata);
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int rays_len, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag, const bool use_threading);
 
 void BLI_bvhtree_ray_cast_all_ex(
         BVHTree *tree, const float co[3], const float dir[3], float radius, float hit_dist,
@@ -58,4 +58,6 @@ int BLI_sortutil_cmp_float_reverse(const void *a_, const void *b_);
 int BLI_sortutil_cmp_int(const void *a_, const void *b_);
 int BLI_sortutil_cmp_int_reverse(const void *a_, const void *b_);
 
+void BLI_sortutil_order_spatial_v3(const float (*co)[3], const int co_len, int *r_order);
+
 #endif  /* __BLI_SORT_UTILS_H__ */
@@ -41,8 +41,9 @@ struct BLI_mempool;
 
 /* Task Scheduler
  * 
- * Central scheduler that holds running threads ready to execute tasks. A single
- * queue holds the task from all pools.
+ * Central scheduler that holds running threads ready to execute tasks. Each
+ * thread has its own queue of tasks, idle threads steal tasks from the queues
+ * of busy ones. A single shared queue holds tasks pushed from other threads.
  *
  * Init/exit must be called before/after any task pools are created/freed, and
  * must be called from the main threads. All other scheduler and pool functions
@@ -60,6 +61,21 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler);
 
 int BLI_task_scheduler_num_threads(TaskScheduler *scheduler);
 
+/* Statistics accumulated by all threads of a scheduler. */
+typedef struct TaskSchedulerStats {
+	/* Number of tasks run by the scheduler threads (including the main thread,
+	 * tasks run from other threads waiting on a pool are not counted). */
+	uint64_t num_tasks_run;
+	/* Tasks taken from the shared queue. */
+	uint64_t num_tasks_from_queue;
+	/* Tasks stolen from the queue of another thread. */
+	uint64_t num_tasks_stolen;
+	/* Number of times a worker thread had to wait for new tasks. */
+	uint64_t num_sleeps;
+} TaskSchedulerStats;
+
+void BLI_task_scheduler_stats_get(TaskScheduler *scheduler, TaskSchedulerStats *r_stats);
+
 /* Task Pool
  *
  * Pool of tasks that will be executed by the central TaskScheduler. For each
@@ -110,9 +126,9 @@ void *BLI_task_pool_userdata(TaskPool *pool);
 /* optional mutex to use from run function */
 ThreadMutex *BLI_task_pool_user_mutex(TaskPool *pool);
 
-/* Delayed push, use that to reduce thread overhead by accumulating
- * all new tasks into local queue first and pushing it to scheduler
- * from within a single mutex lock.
+/* Delayed push, use that to reduce thread overhead when pushing many tasks
+ * from the same thread: other threads are only woken up once all new tasks
+ * are in the queue.
  */
 void BLI_task_pool_delayed_push_begin(TaskPool *pool, int thread_id);
 void BLI_task_pool_delayed_push_end(TaskPool *pool, int thread_id);
@@ -208,6 +224,46 @@ void BLI_task_parallel_mempool(
         TaskParallelMempoolFunc func,
         const bool use_threading);
 
+/* Parallel reduction
+ *
+ * The range is split in contiguous chunks, \a func accumulates the items of a
+ * chunk into its value (initialized as a copy of \a identity), chunk values are
+ * then joined in range order into \a r_value by the calling thread.
+ * Since the order is kept, \a join only needs to be associative.
+ *
+ * settings->min_iter_per_thread is the minimum size of a chunk,
+ * userdata_chunk and func_finalize are not used.
+ */
+typedef void (*TaskParallelReduceFunc)(void *__restrict userdata,
+                                       const int start, const int stop,
+                                       void *__restrict r_value);
+typedef void (*TaskParallelReduceJoinFunc)(void *__restrict userdata,
+                                           void *__restrict r_value,
+                                           const void *__restrict value);
+void BLI_task_parallel_reduce(
+        const int start, const int stop,
+        void *userdata,
+        const void *identity, const size_t value_size,
+        TaskParallelReduceFunc func,
+        TaskParallelReduceJoinFunc join,
+        void *r_value,
+        const ParallelRangeSettings *settings);
+
+/* Parallel prefix sums, \a dst may be the same array as \a src.
+ * Returns the sum of all items. */
+int BLI_task_parallel_scan_i(
+        const int *src, int *dst, const int len,
+        const bool inclusive, const bool use_threading);
+unsigned int BLI_task_parallel_scan_u(
+        const unsigned int *src, unsigned int *dst, const int len,
+        const bool inclusive, const bool use_threading);
+
+/* Parallel merge sort, same arguments as BLI_qsort_r (the sort is not stable). */
+void BLI_task_parallel_sort(
+        void *array, const size_t num, const size_t size,
+        int (*cmp)(const void *a, const void *b, void *thunk), void *thunk,
+        const bool use_threading);
+
 /* TODO(sergey): Think of a better place for this. */
 BLI_INLINE void BLI_parallel_range_settings_defaults(
         ParallelRangeSettings *settings)
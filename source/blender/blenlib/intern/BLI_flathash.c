@@ -0,0 +1,666 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/BLI_flathash.c
+ *  \ingroup bli
+ *
+ * An open-addressing (pointer -> pointer) hash table.
+ *
+ * Slots are split in groups of #FLATHASH_GROUP_SIZE, each slot having a control byte
+ * which is either #FLATHASH_CTRL_EMPTY, #FLATHASH_CTRL_DELETED,
+ * or the 7 top bits of the (mixed) hash of the key stored in it.
+ *
+ * A lookup computes its start group from the hash, and checks all control bytes of that group
+ * against the key's 7 bits in a single SIMD compare, only calling the comparison function
+ * on candidates. Probing stops at the first group containing an empty slot,
+ * visiting following groups in triangular order otherwise (which covers all groups,
+ * since their number is a power of two).
+ */
+
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_sys_types.h"
+#include "BLI_utildefines.h"
+#include "BLI_math_base.h"
+#include "BLI_math_bits.h"
+
+#include "BLI_flathash.h"  /* own include */
+
+#include "BLI_strict_flags.h"
+
+/* -------------------------------------------------------------------- */
+/** \name Structs & Constants
+ * \{ */
+
+#define FLATHASH_GROUP_SIZE 16
+
+#define FLATHASH_CTRL_EMPTY   0x80
+#define FLATHASH_CTRL_DELETED 0xfe
+/* Full slots use values in [0..127], so the high bit tells if a slot is free. */
+#define FLATHASH_CTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+/**
+ * Max load of 7/8th, counting deleted slots (they never stop a probe sequence).
+ * Since groups are fairly large, probe sequences stay short even at such a load.
+ */
+#define FLATHASH_LIMIT_GROW(_nslots) ((_nslots) - ((_nslots) / 8))
+
+typedef struct FlatHashEntry {
+	void *key;
+	void *val;
+} FlatHashEntry;
+
+struct FlatHash {
+	GHashHashFP hashfp;
+	GHashCmpFP cmpfp;
+
+	/* Both point into the same allocation, control bytes being stored after the entries. */
+	FlatHashEntry *entries;
+	uchar *ctrl;
+
+	uint nslots;
+	uint group_mask;
+	uint limit_grow;
+
+	uint nentries;
+	uint ndeleted;
+};
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Internal Utility API
+ * \{ */
+
+/**
+ * Hash functions used with #GHash are not always well distributed in their high bits
+ * (#BLI_ghashutil_ptrhash or #BLI_ghashutil_inthash_p e.g.), mix them with a multiplicative hash,
+ * group index and control byte then use different bits of the result.
+ */
+BLI_INLINE uint64_t flathash_keyhash(const FlatHash *fh, const void *key)
+{
+	return (uint64_t)fh->hashfp(key) * 0x9E3779B97F4A7C15ull;
+}
+
+BLI_INLINE uint flathash_hash_group(const FlatHash *fh, const uint64_t hash)
+{
+	return (uint)(hash >> 32) & fh->group_mask;
+}
+
+BLI_INLINE uchar flathash_hash_ctrl(const uint64_t hash)
+{
+	return (uchar)(hash >> 57);
+}
+
+/**
+ * Bit-mask of slots in the group at \a ctrl which have a control byte equal to \a c.
+ */
+BLI_INLINE uint flathash_group_match(const uchar *ctrl, const uchar c)
+{
+#ifdef __SSE2__
+	const __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+	return (uint)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)c)));
+#else
+	uint mask = 0;
+	for (uint i = 0; i < FLATHASH_GROUP_SIZE; i++) {
+		if (ctrl[i] == c) {
+			mask |= (1u << i);
+		}
+	}
+	return mask;
+#endif
+}
+
+/**
+ * Bit-mask of slots in the group at \a ctrl which are either empty or deleted.
+ */
+BLI_INLINE uint flathash_group_match_free(const uchar *ctrl)
+{
+#ifdef __SSE2__
+	return (uint)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+	uint mask = 0;
+	for (uint i = 0; i < FLATHASH_GROUP_SIZE; i++) {
+		if (!FLATHASH_CTRL_IS_FULL(ctrl[i])) {
+			mask |= (1u << i);
+		}
+	}
+	return mask;
+#endif
+}
+
+BLI_INLINE uint flathash_group_next(const FlatHash *fh, const uint group, const uint step)
+{
+	return (group + step) & fh->group_mask;
+}
+
+static uint flathash_nslots_for_reserve(const uint nentries_reserve)
+{
+	uint nslots = FLATHASH_GROUP_SIZE;
+	while (FLATHASH_LIMIT_GROW(nslots) <= nentries_reserve) {
+		nslots <<= 1;
+	}
+	return nslots;
+}
+
+static void flathash_buffer_alloc(FlatHash *fh, const uint nslots)
+{
+	BLI_assert(is_power_of_2_i((int)nslots) && nslots >= FLATHASH_GROUP_SIZE);
+
+	fh->entries = MEM_mallocN((sizeof(*fh->entries) + sizeof(*fh->ctrl)) * nslots, "FlatHash slots");
+	fh->ctrl = (uchar *)(fh->entries + nslots);
+	memset(fh->ctrl, FLATHASH_CTRL_EMPTY, sizeof(*fh->ctrl) * nslots);
+
+	fh->nslots = nslots;
+	fh->group_mask = (nslots / FLATHASH_GROUP_SIZE) - 1;
+	fh->limit_grow = FLATHASH_LIMIT_GROW(nslots);
+	fh->nentries = 0;
+	fh->ndeleted = 0;
+}
+
+/**
+ * Find a free slot for a key known not to be in \a fh yet.
+ */
+static uint flathash_find_free_slot(const FlatHash *fh, const uint64_t hash)
+{
+	uint group = flathash_hash_group(fh, hash);
+	for (uint step = 1; ; step++) {
+		const uint mask = flathash_group_match_free(&fh->ctrl[group * FLATHASH_GROUP_SIZE]);
+		if (mask) {
+			return (group * FLATHASH_GROUP_SIZE) + bitscan_forward_uint(mask);
+		}
+		group = flathash_group_next(fh, group, step);
+	}
+}
+
+/**
+ * Re-insert all entries into new storage of \a nslots, this also purges deleted slots.
+ */
+static void flathash_resize(FlatHash *fh, const uint nslots)
+{
+	FlatHashEntry *entries_src = fh->entries;
+	const uchar *ctrl_src = fh->ctrl;
+	const uint nslots_src = fh->nslots;
+	const uint nentries = fh->nentries;
+
+	flathash_buffer_alloc(fh, nslots);
+
+	for (uint i = 0; i < nslots_src; i++) {
+		if (FLATHASH_CTRL_IS_FULL(ctrl_src[i])) {
+			const uint64_t hash = flathash_keyhash(fh, entries_src[i].key);
+			const uint slot = flathash_find_free_slot(fh, hash);
+			fh->ctrl[slot] = flathash_hash_ctrl(hash);
+			fh->entries[slot] = entries_src[i];
+		}
+	}
+	fh->nentries = nentries;
+
+	MEM_freeN(entries_src);
+}
+
+/**
+ * Ensure there is room for one more entry.
+ */
+BLI_INLINE void flathash_ensure_space(FlatHash *fh)
+{
+	if (UNLIKELY(fh->nentries + fh->ndeleted >= fh->limit_grow)) {
+		/* When most used slots are deleted ones, rehashing in-place is enough. */
+		flathash_resize(
+		        fh, (fh->nentries >= fh->limit_grow / 2) ? fh->nslots << 1 : fh->nslots);
+	}
+}
+
+/**
+ * Internal lookup function, returns the slot index or -1 when \a key is not found.
+ */
+BLI_INLINE int flathash_lookup_slot_ex(const FlatHash *fh, const void *key, const uint64_t hash)
+{
+	const uchar c = flathash_hash_ctrl(hash);
+	uint group = flathash_hash_group(fh, hash);
+	for (uint step = 1; ; step++) {
+		const uchar *ctrl = &fh->ctrl[group * FLATHASH_GROUP_SIZE];
+		uint mask = flathash_group_match(ctrl, c);
+		while (mask) {
+			const uint slot = (group * FLATHASH_GROUP_SIZE) + bitscan_forward_clear_uint(&mask);
+			if (fh->cmpfp(key, fh->entries[slot].key) == false) {
+				return (int)slot;
+			}
+		}
+		if (flathash_group_match(ctrl, FLATHASH_CTRL_EMPTY)) {
+			return -1;
+		}
+		group = flathash_group_next(fh, group, step);
+	}
+}
+
+BLI_INLINE int flathash_lookup_slot(const FlatHash *fh, const void *key)
+{
+	return flathash_lookup_slot_ex(fh, key, flathash_keyhash(fh, key));
+}
+
+/**
+ * Insert a key which is known not to be in \a fh, returns its slot.
+ */
+BLI_INLINE uint flathash_insert_ex(FlatHash *fh, void *key, void *val, const uint64_t hash)
+{
+	uint slot;
+
+	flathash_ensure_space(fh);
+	slot = flathash_find_free_slot(fh, hash);
+
+	if (fh->ctrl[slot] == FLATHASH_CTRL_DELETED) {
+		fh->ndeleted--;
+	}
+	fh->ctrl[slot] = flathash_hash_ctrl(hash);
+	fh->entries[slot].key = key;
+	fh->entries[slot].val = val;
+	fh->nentries++;
+
+	return slot;
+}
+
+static void flathash_remove_slot(FlatHash *fh, const uint slot)
+{
+	const uint group = slot / FLATHASH_GROUP_SIZE;
+
+	/* When the group still has empty slots, no probe sequence ever continued past it,
+	 * so this slot can be marked as empty too (instead of leaving a tombstone). */
+	if (flathash_group_match(&fh->ctrl[group * FLATHASH_GROUP_SIZE], FLATHASH_CTRL_EMPTY)) {
+		fh->ctrl[slot] = FLATHASH_CTRL_EMPTY;
+	}
+	else {
+		fh->ctrl[slot] = FLATHASH_CTRL_DELETED;
+		fh->ndeleted++;
+	}
+	fh->nentries--;
+}
+
+static void flathash_free_cb(FlatHash *fh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	BLI_assert(keyfreefp || valfreefp);
+
+	for (uint i = 0; i < fh->nslots; i++) {
+		if (FLATHASH_CTRL_IS_FULL(fh->ctrl[i])) {
+			if (keyfreefp) {
+				keyfreefp(fh->entries[i].key);
+			}
+			if (valfreefp) {
+				valfreefp(fh->entries[i].val);
+			}
+		}
+	}
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Public API
+ * \{ */
+
+/**
+ * Creates a new, empty FlatHash.
+ *
+ * \param hashfp  Hash callback.
+ * \param cmpfp  Comparison callback.
+ * \param info  Identifier string for the FlatHash.
+ * \param nentries_reserve  Optionally reserve the number of members that the hash will hold.
+ * Use this to avoid resizing buckets if the size is known or can be closely approximated.
+ * \return  An empty FlatHash.
+ */
+FlatHash *BLI_flathash_new_ex(
+        GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info,
+        const uint nentries_reserve)
+{
+	FlatHash *fh = MEM_mallocN(sizeof(*fh), info);
+
+	fh->hashfp = hashfp;
+	fh->cmpfp = cmpfp;
+
+	flathash_buffer_alloc(fh, flathash_nslots_for_reserve(nentries_reserve));
+
+	return fh;
+}
+
+/**
+ * Wraps #BLI_flathash_new_ex with zero entries reserved.
+ */
+FlatHash *BLI_flathash_new(GHashHashFP hashfp, GHashCmpFP cmpfp, const char *info)
+{
+	return BLI_flathash_new_ex(hashfp, cmpfp, info, 0);
+}
+
+/**
+ * Frees the FlatHash and its members.
+ *
+ * \param fh  The FlatHash to free.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_flathash_free(FlatHash *fh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	if (keyfreefp || valfreefp) {
+		flathash_free_cb(fh, keyfreefp, valfreefp);
+	}
+
+	MEM_freeN(fh->entries);
+	MEM_freeN(fh);
+}
+
+/**
+ * Reserve given amount of entries (resize \a fh accordingly if needed).
+ */
+void BLI_flathash_reserve(FlatHash *fh, const uint nentries_reserve)
+{
+	const uint nslots = flathash_nslots_for_reserve(MAX2(nentries_reserve, fh->nentries));
+	if (nslots > fh->nslots) {
+		flathash_resize(fh, nslots);
+	}
+}
+
+/**
+ * Insert a key/value pair into the \a fh.
+ *
+ * \note Duplicates are not checked,
+ * the caller is expected to ensure elements are unique unless
+ * #BLI_flathash_reinsert or #BLI_flathash_add is used.
+ */
+void BLI_flathash_insert(FlatHash *fh, void *key, void *val)
+{
+	BLI_assert(flathash_lookup_slot(fh, key) == -1);
+	flathash_insert_ex(fh, key, val, flathash_keyhash(fh, key));
+}
+
+/**
+ * Inserts a new value to a key that may already be in the FlatHash.
+ *
+ * Avoids #BLI_flathash_remove, #BLI_flathash_insert calls (double lookups)
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_flathash_reinsert(
+        FlatHash *fh, void *key, void *val, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const uint64_t hash = flathash_keyhash(fh, key);
+	const int slot = flathash_lookup_slot_ex(fh, key, hash);
+	if (slot != -1) {
+		FlatHashEntry *e = &fh->entries[slot];
+		if (keyfreefp) {
+			keyfreefp(e->key);
+		}
+		if (valfreefp) {
+			valfreefp(e->val);
+		}
+		e->key = key;
+		e->val = val;
+		return false;
+	}
+	else {
+		flathash_insert_ex(fh, key, val, hash);
+		return true;
+	}
+}
+
+/**
+ * Add a key/value pair, only when the key isn't already in \a fh.
+ *
+ * \returns true if a new key has been added.
+ */
+bool BLI_flathash_add(FlatHash *fh, void *key, void *val)
+{
+	const uint64_t hash = flathash_keyhash(fh, key);
+	if (flathash_lookup_slot_ex(fh, key, hash) != -1) {
+		return false;
+	}
+	flathash_insert_ex(fh, key, val, hash);
+	return true;
+}
+
+/**
+ * Lookup the value of \a key in \a fh.
+ *
+ * \param key  The key to lookup.
+ * \returns the value for \a key or NULL.
+ *
+ * \note When NULL is a valid value, use #BLI_flathash_lookup_p to differentiate a missing key
+ * from a key with a NULL value. (Avoid calling #BLI_flathash_haskey before #BLI_flathash_lookup)
+ */
+void *BLI_flathash_lookup(FlatHash *fh, const void *key)
+{
+	const int slot = flathash_lookup_slot(fh, key);
+	return (slot != -1) ? fh->entries[slot].val : NULL;
+}
+
+/**
+ * A version of #BLI_flathash_lookup which accepts a fallback argument.
+ */
+void *BLI_flathash_lookup_default(FlatHash *fh, const void *key, void *val_default)
+{
+	const int slot = flathash_lookup_slot(fh, key);
+	return (slot != -1) ? fh->entries[slot].val : val_default;
+}
+
+/**
+ * Lookup a pointer to the value of \a key in \a fh.
+ *
+ * \param key  The key to lookup.
+ * \returns the pointer to value for \a key or NULL.
+ *
+ * \note This has 2 main benefits over #BLI_flathash_lookup.
+ * - A NULL return always means that \a key isn't in \a fh.
+ * - The value can be modified in-place without further function calls (faster).
+ *
+ * \warning The pointer is only valid until the next insertion in \a fh.
+ */
+void **BLI_flathash_lookup_p(FlatHash *fh, const void *key)
+{
+	const int slot = flathash_lookup_slot(fh, key);
+	return (slot != -1) ? &fh->entries[slot].val : NULL;
+}
+
+/**
+ * Ensure \a key is exists in \a fh.
+ *
+ * This handles the common situation where the caller needs ensure a key is added to \a fh,
+ * constructing a new value in the case the key isn't found.
+ * Otherwise use the existing value.
+ *
+ * Such situations typically incur multiple lookups, however this function
+ * avoids them by ensuring the key is added,
+ * returning a pointer to the value so it can be used or initialized by the caller.
+ *
+ * \returns true when the value didn't need to be added.
+ * (when false, the caller _must_ initialize the value).
+ */
+bool BLI_flathash_ensure_p(FlatHash *fh, void *key, void ***r_val)
+{
+	const uint64_t hash = flathash_keyhash(fh, key);
+	int slot = flathash_lookup_slot_ex(fh, key, hash);
+	const bool haskey = (slot != -1);
+	if (!haskey) {
+		slot = (int)flathash_insert_ex(fh, key, NULL, hash);
+	}
+	*r_val = &fh->entries[slot].val;
+	return haskey;
+}
+
+/**
+ * Remove \a key from \a fh, or return false if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ * \return true if \a key was removed from \a fh.
+ */
+bool BLI_flathash_remove(FlatHash *fh, const void *key, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	const int slot = flathash_lookup_slot(fh, key);
+	if (slot != -1) {
+		FlatHashEntry *e = &fh->entries[slot];
+		if (keyfreefp) {
+			keyfreefp(e->key);
+		}
+		if (valfreefp) {
+			valfreefp(e->val);
+		}
+		flathash_remove_slot(fh, (uint)slot);
+		return true;
+	}
+	else {
+		return false;
+	}
+}
+
+/**
+ * Remove \a key from \a fh, returning the value or NULL if the key wasn't found.
+ *
+ * \param key  The key to remove.
+ * \param keyfreefp  Optional callback to free the key.
+ * \return the value of \a key int \a fh or NULL.
+ */
+void *BLI_flathash_popkey(FlatHash *fh, const void *key, GHashKeyFreeFP keyfreefp)
+{
+	const int slot = flathash_lookup_slot(fh, key);
+	if (slot != -1) {
+		FlatHashEntry *e = &fh->entries[slot];
+		void *val = e->val;
+		if (keyfreefp) {
+			keyfreefp(e->key);
+		}
+		flathash_remove_slot(fh, (uint)slot);
+		return val;
+	}
+	else {
+		return NULL;
+	}
+}
+
+/**
+ * \return true if the \a key is in \a fh.
+ */
+bool BLI_flathash_haskey(FlatHash *fh, const void *key)
+{
+	return (flathash_lookup_slot(fh, key) != -1);
+}
+
+/**
+ * Reset \a fh clearing all entries, and shrinking its storage back to the minimum size.
+ *
+ * \param keyfreefp  Optional callback to free the key.
+ * \param valfreefp  Optional callback to free the value.
+ */
+void BLI_flathash_clear(FlatHash *fh, GHashKeyFreeFP keyfreefp, GHashValFreeFP valfreefp)
+{
+	if (keyfreefp || valfreefp) {
+		flathash_free_cb(fh, keyfreefp, valfreefp);
+	}
+
+	if (fh->nslots != FLATHASH_GROUP_SIZE) {
+		MEM_freeN(fh->entries);
+		flathash_buffer_alloc(fh, FLATHASH_GROUP_SIZE);
+	}
+	else {
+		memset(fh->ctrl, FLATHASH_CTRL_EMPTY, sizeof(*fh->ctrl) * fh->nslots);
+		fh->nentries = 0;
+		fh->ndeleted = 0;
+	}
+}
+
+/**
+ * \return size of the FlatHash.
+ */
+uint BLI_flathash_len(const FlatHash *fh)
+{
+	return fh->nentries;
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Iterator API
+ *
+ * Entries are visited in slot order, walking a single contiguous array.
+ * \{ */
+
+BLI_INLINE uint flathash_iter_find_full(const FlatHash *fh, uint slot)
+{
+	while ((slot < fh->nslots) && !FLATHASH_CTRL_IS_FULL(fh->ctrl[slot])) {
+		slot++;
+	}
+	return slot;
+}
+
+/**
+ * Init an already allocated FlatHashIterator.
+ *
+ * \param fhi  The FlatHashIterator to initialize.
+ * \param fh  The FlatHash to iterate over.
+ */
+void BLI_flathashIterator_init(FlatHashIterator *fhi, FlatHash *fh)
+{
+	fhi->fh = fh;
+	fhi->slot = flathash_iter_find_full(fh, 0);
+}
+
+/**
+ * Steps the iterator to the next index.
+ *
+ * \param fhi  The iterator.
+ */
+void BLI_flathashIterator_step(FlatHashIterator *fhi)
+{
+	BLI_assert(fhi->slot < fhi->fh->nslots);
+	fhi->slot = flathash_iter_find_full(fhi->fh, fhi->slot + 1);
+}
+
+/**
+ * Determine if an iterator is done (has reached the end of
+ * the hash table).
+ *
+ * \param fhi  The iterator.
+ * \return True if done, False otherwise.
+ */
+bool BLI_flathashIterator_done(const FlatHashIterator *fhi)
+{
+	return (fhi->slot >= fhi->fh->nslots);
+}
+
+void *BLI_flathashIterator_getKey(FlatHashIterator *fhi)
+{
+	return fhi->fh->entries[fhi->slot].key;
+}
+
+void *BLI_flathashIterator_getValue(FlatHashIterator *fhi)
+{
+	return fhi->fh->entries[fhi->slot].val;
+}
+
+void **BLI_flathashIterator_getValue_p(FlatHashIterator *fhi)
+{
+	return &fhi->fh->entries[fhi->slot].val;
+}
+
+/** \} */
@@ -24,6 +24,11 @@
  *  \ingroup bli
  *
  * A min-heap / priority queue ADT.
+ *
+ * Implemented as a 4-ary heap: the tree is shallower than a binary heap
+ * and the children of a node are contiguous in memory.
+ * The tree stores a copy of each node value, so moving nodes up & down
+ * only reads the tree array, nodes are only written to update their index.
  */
 
 #include <stdlib.h>
@@ -43,6 +48,12 @@ struct HeapNode {
 	uint  index;
 };
 
+/* Item of the heap tree, value is a copy of node->value. */
+typedef struct HeapTreeItem {
+	float value;
+	HeapNode *node;
+} HeapTreeItem;
+
 struct HeapNode_Chunk {
 	struct HeapNode_Chunk *prev;
 	uint size;
@@ -63,7 +74,7 @@ struct HeapNode_Chunk {
 struct Heap {
 	uint size;
 	uint bufsize;
-	HeapNode **tree;
+	HeapTreeItem *tree;
 
 	struct {
 		/* Always keep at least one chunk (never NULL) */
@@ -76,69 +87,66 @@ struct Heap {
 /** \name Internal Functions
  * \{ */
 
-#define HEAP_PARENT(i) (((i) - 1) >> 1)
-#define HEAP_LEFT(i)   (((i) << 1) + 1)
-#define HEAP_RIGHT(i)  (((i) << 1) + 2)
-#define HEAP_COMPARE(a, b) ((a)->value < (b)->value)
+#define HEAP_PARENT(i)       (((i) - 1) >> 2)
+#define HEAP_CHILD_FIRST(i)  (((i) << 2) + 1)
+#define HEAP_CHILD_NUM       4
 
-#if 0  /* UNUSED */
-#define HEAP_EQUALS(a, b) ((a)->value == (b)->value)
-#endif
-
-BLI_INLINE void heap_swap(Heap *heap, const uint i, const uint j)
+BLI_INLINE void heap_tree_set(HeapTreeItem *tree, const uint i, const HeapTreeItem item)
 {
-
-#if 0
-	SWAP(uint,  heap->tree[i]->index, heap->tree[j]->index);
-	SWAP(HeapNode *,    heap->tree[i],        heap->tree[j]);
-#else
-	HeapNode **tree = heap->tree;
-	union {
-		uint  index;
-		HeapNode     *node;
-	} tmp;
-	SWAP_TVAL(tmp.index, tree[i]->index, tree[j]->index);
-	SWAP_TVAL(tmp.node,  tree[i],        tree[j]);
-#endif
+	tree[i] = item;
+	item.node->index = i;
 }
 
 static void heap_down(Heap *heap, uint i)
 {
+	HeapTreeItem *tree = heap->tree;
 	/* size won't change in the loop */
 	const uint size = heap->size;
+	const HeapTreeItem item = tree[i];
 
 	while (1) {
-		const uint l = HEAP_LEFT(i);
-		const uint r = HEAP_RIGHT(i);
-		uint smallest = i;
+		const uint child_first = HEAP_CHILD_FIRST(i);
+		const uint child_end = MIN2(child_first + HEAP_CHILD_NUM, size);
+		uint smallest, j;
 
-		if ((l < size) && HEAP_COMPARE(heap->tree[l], heap->tree[smallest])) {
-			smallest = l;
+		if (child_first >= size) {
+			break;
 		}
-		if ((r < size) && HEAP_COMPARE(heap->tree[r], heap->tree[smallest])) {
-			smallest = r;
+
+		smallest = child_first;
+		for (j = child_first + 1; j < child_end; j++) {
+			if (tree[j].value < tree[smallest].value) {
+				smallest = j;
+			}
 		}
 
-		if (smallest == i) {
+		if (!(tree[smallest].value < item.value)) {
 			break;
 		}
 
-		heap_swap(heap, i, smallest);
+		heap_tree_set(tree, i, tree[smallest]);
 		i = smallest;
 	}
+
+	heap_tree_set(tree, i, item);
 }
 
 static void heap_up(Heap *heap, uint i)
 {
+	HeapTreeItem *tree = heap->tree;
+	const HeapTreeItem item = tree[i];
+
 	while (i > 0) {
 		const uint p = HEAP_PARENT(i);
 
-		if (HEAP_COMPARE(heap->tree[p], heap->tree[i])) {
+		if (!(item.value < tree[p].value)) {
 			break;
 		}
-		heap_swap(heap, p, i);
+		heap_tree_set(tree, i, tree[p]);
 		i = p;
 	}
+
+	heap_tree_set(tree, i, item);
 }
 
 /** \} */
@@ -200,7 +208,7 @@ Heap *BLI_heap_new_ex(uint tot_reserve)
 	/* ensure we have at least one so we can keep doubling it */
 	heap->size = 0;
 	heap->bufsize = MAX2(1u, tot_reserve);
-	heap->tree = MEM_mallocN(heap->bufsize * sizeof(HeapNode *), "BLIHeapTree");
+	heap->tree = MEM_mallocN(heap->bufsize * sizeof(*heap->tree), "BLIHeapTree");
 
 	heap->nodes.chunk = heap_node_alloc_chunk((tot_reserve > 1) ? tot_reserve : HEAP_CHUNK_DEFAULT_NUM, NULL);
 	heap->nodes.free = NULL;
@@ -219,7 +227,7 @@ void BLI_heap_free(Heap *heap, HeapFreeFP ptrfreefp)
 		uint i;
 
 		for (i = 0; i < heap->size; i++) {
-			ptrfreefp(heap->tree[i]->ptr);
+			ptrfreefp(heap->tree[i].node->ptr);
 		}
 	}
 
@@ -241,7 +249,7 @@ void BLI_heap_clear(Heap *heap, HeapFreeFP ptrfreefp)
 		uint i;
 
 		for (i = 0; i < heap->size; i++) {
-			ptrfreefp(heap->tree[i]->ptr);
+			ptrfreefp(heap->tree[i].node->ptr);
 		}
 	}
 	heap->size = 0;
@@ -275,7 +283,8 @@ HeapNode *BLI_heap_insert(Heap *heap, float value, void *ptr)
 	node->value = value;
 	node->index = heap->size;
 
-	heap->tree[node->index] = node;
+	heap->tree[node->index].value = value;
+	heap->tree[node->index].node = node;
 
 	heap->size++;
 
@@ -314,7 +323,7 @@ uint BLI_heap_len(const Heap *heap)
  */
 HeapNode *BLI_heap_top(const Heap *heap)
 {
-	return heap->tree[0];
+	return heap->tree[0].node;
 }
 
 /**
@@ -324,12 +333,12 @@ void *BLI_heap_pop_min(Heap *heap)
 {
 	BLI_assert(heap->size != 0);
 
-	void *ptr = heap->tree[0]->ptr;
+	void *ptr = heap->tree[0].node->ptr;
 
-	heap_node_free(heap, heap->tree[0]);
+	heap_node_free(heap, heap->tree[0].node);
 
 	if (--heap->size) {
-		heap_swap(heap, 0, heap->size);
+		heap_tree_set(heap->tree, 0, heap->tree[heap->size]);
 		heap_down(heap, 0);
 	}
 
@@ -340,13 +349,17 @@ void BLI_heap_remove(Heap *heap, HeapNode *node)
 {
 	BLI_assert(heap->size != 0);
 
+	HeapTreeItem *tree = heap->tree;
+	const HeapTreeItem item = tree[node->index];
 	uint i = node->index;
 
+	/* Move the node to the top, regardless of its value. */
 	while (i > 0) {
-		uint p = HEAP_PARENT(i);
-		heap_swap(heap, p, i);
+		const uint p = HEAP_PARENT(i);
+		heap_tree_set(tree, i, tree[p]);
 		i = p;
 	}
+	heap_tree_set(tree, 0, item);
 
 	BLI_heap_pop_min(heap);
 }
@@ -360,10 +373,12 @@ void BLI_heap_node_value_update(Heap *heap, HeapNode *node, float value)
 {
 	if (value < node->value) {
 		node->value = value;
+		heap->tree[node->index].value = value;
 		heap_up(heap, node->index);
 	}
 	else if (value > node->value) {
 		node->value = value;
+		heap->tree[node->index].value = value;
 		heap_down(heap, node->index);
 	}
 }
@@ -373,10 +388,12 @@ void BLI_heap_node_value_update_ptr(Heap *heap, HeapNode *node, float value, voi
 	node->ptr = ptr; /* only difference */
 	if (value < node->value) {
 		node->value = value;
+		heap->tree[node->index].value = value;
 		heap_up(heap, node->index);
 	}
 	else if (value > node->value) {
 		node->value = value;
+		heap->tree[node->index].value = value;
 		heap_down(heap, node->index);
 	}
 }
@@ -394,15 +411,13 @@ void *BLI_heap_node_ptr(const HeapNode *node)
 static bool heap_is_minheap(const Heap *heap, uint root)
 {
 	if (root < heap->size) {
-		const uint l = HEAP_LEFT(root);
-		if (l < heap->size) {
-			if (HEAP_COMPARE(heap->tree[l], heap->tree[root]) || !heap_is_minheap(heap, l)) {
-				return false;
-			}
+		const HeapTreeItem *item = &heap->tree[root];
+		const uint child_first = HEAP_CHILD_FIRST(root);
+		if ((item->node->index != root) || (item->node->value != item->value)) {
+			return false;
 		}
-		const uint r = HEAP_RIGHT(root);
-		if (r < heap->size) {
-			if (HEAP_COMPARE(heap->tree[r], heap->tree[root]) || !heap_is_minheap(heap, r)) {
+		for (uint i = child_first; i < child_first + HEAP_CHILD_NUM && i < heap->size; i++) {
+			if ((heap->tree[i].value < item->value) || !heap_is_minheap(heap, i)) {
 				return false;
 			}
 		}
@@ -48,6 +48,10 @@
 
 #include <assert.h>
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #include "MEM_guardedalloc.h"
 
 #include "BLI_utildefines.h"
@@ -55,6 +59,7 @@
 #include "BLI_stack.h"
 #include "BLI_kdopbvh.h"
 #include "BLI_math.h"
+#include "BLI_sort_utils.h"
 #include "BLI_task.h"
 
 #include "BLI_strict_flags.h"
@@ -80,6 +85,23 @@
 #  define KDOPBVH_THREAD_LEAF_THRESHOLD 1024
 #endif
 
+/* Nodes with more leafs than this also thread their own bounds and leafs partitioning,
+ * so the top levels of the tree (which have fewer nodes than threads) don't run serially. */
+#ifdef DEBUG
+#  define KDOPBVH_THREAD_NODE_THRESHOLD 64
+#else
+#  define KDOPBVH_THREAD_NODE_THRESHOLD 16384
+#endif
+
+/* Keep a transposed copy of the bounds of the children of each branch,
+ * so queries can test 4 children at once. */
+#ifdef __SSE2__
+#  define USE_KDOPBVH_SIMD
+#endif
+
+/* Number of children tested at once (SSE lanes). */
+#define KDOPBVH_SIMD_WIDTH 4
+
 
 /* -------------------------------------------------------------------- */
 
@@ -106,6 +128,7 @@ struct BVHTree {
 	BVHNode *nodearray;     /* pre-alloc branch nodes */
 	BVHNode **nodechild;    /* pre-alloc childs for nodes */
 	float   *nodebv;        /* pre-alloc bounding-volumes for nodes */
+	float   *nodechild_bv;  /* transposed children bounding-volumes of branches, see #bvhtree_simd_update */
 	float epsilon;          /* epslion is used for inflation of the k-dop	   */
 	int totleaf;            /* leafs */
 	int totbranch;
@@ -115,8 +138,8 @@ struct BVHTree {
 };
 
 /* optimization, ensure we stay small */
-BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 48) ||
-                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 32),
+BLI_STATIC_ASSERT((sizeof(void *) == 8 && sizeof(BVHTree) <= 56) ||
+                  (sizeof(void *) == 4 && sizeof(BVHTree) <= 36),
                   "over sized")
 
 /* avoid duplicating vars in BVHOverlapData_Thread */
@@ -500,18 +523,12 @@ static void create_kdop_hull(const BVHTree *tree, BVHNode *node, const float *co
 	}
 }
 
-/**
- * \note depends on the fact that the BVH's for each face is already build
- */
-static void refit_kdop_hull(const BVHTree *tree, BVHNode *node, int start, int end)
+static void refit_kdop_hull_range(const BVHTree *tree, float *bv, int start, int end)
 {
 	float newmin, newmax;
-	float *bv = node->bv;
 	int j;
 	axis_t axis_iter;
 
-	node_minmax_init(tree, node);
-
 	for (j = start; j < end; j++) {
 		/* for all Axes. */
 		for (axis_iter = tree->start_axis; axis_iter < tree->stop_axis; axis_iter++) {
@@ -524,7 +541,65 @@ static void refit_kdop_hull(const BVHTree *tree, BVHNode *node, int start, int e
 				bv[(2 * axis_iter) + 1] = newmax;
 		}
 	}
+}
+
+static void refit_kdop_hull_reduce_cb(
+        void *__restrict userdata,
+        const int start, const int stop,
+        void *__restrict r_value)
+{
+	refit_kdop_hull_range(userdata, r_value, start, stop);
+}
+
+static void refit_kdop_hull_join_cb(
+        void *__restrict userdata,
+        void *__restrict r_value,
+        const void *__restrict value)
+{
+	const BVHTree *tree = userdata;
+	float *bv = r_value;
+	const float *bv_other = value;
+	axis_t axis_iter;
+
+	for (axis_iter = tree->start_axis; axis_iter < tree->stop_axis; axis_iter++) {
+		if (bv_other[(2 * axis_iter)] < bv[(2 * axis_iter)])
+			bv[(2 * axis_iter)] = bv_other[(2 * axis_iter)];
+		if (bv_other[(2 * axis_iter) + 1] > bv[(2 * axis_iter) + 1])
+			bv[(2 * axis_iter) + 1] = bv_other[(2 * axis_iter) + 1];
+	}
+}
+
+/**
+ * \note depends on the fact that the BVH's for each face is already build
+ */
+static void refit_kdop_hull(const BVHTree *tree, BVHNode *node, int start, int end)
+{
+	node_minmax_init(tree, node);
+
+	if (end - start < KDOPBVH_THREAD_NODE_THRESHOLD) {
+		refit_kdop_hull_range(tree, node->bv, start, end);
+	}
+	else {
+		/* min/max are exact, so the result is the same as the serial loop. */
+		const size_t bv_size = sizeof(float) * (size_t)(2 * tree->stop_axis);
+		float bv_init[13][2], bv[13][2];
+		axis_t axis_iter;
+
+		for (axis_iter = 0; axis_iter != tree->stop_axis; axis_iter++) {
+			bv_init[axis_iter][0] =  FLT_MAX;
+			bv_init[axis_iter][1] = -FLT_MAX;
+		}
 
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.min_iter_per_thread = KDOPBVH_THREAD_NODE_THRESHOLD / 4;
+		BLI_task_parallel_reduce(
+		        start, end, (void *)tree, bv_init, bv_size,
+		        refit_kdop_hull_reduce_cb, refit_kdop_hull_join_cb, bv, &settings);
+
+		memcpy(&node->bv[2 * tree->start_axis], bv[tree->start_axis],
+		       sizeof(float) * (size_t)(2 * (tree->stop_axis - tree->start_axis)));
+	}
 }
 
 /**
@@ -760,6 +835,63 @@ static int implicit_needed_branches(int tree_type, int leafs)
 	return max_ii(1, (leafs + tree_type - 3) / (tree_type - 1));
 }
 
+typedef struct BVHSplitLeafsData {
+	BVHNode **leafs_array;
+	const int *nth;
+	int split_axis;
+	int part_begin, part_mid, part_end;
+} BVHSplitLeafsData;
+
+static void split_leafs_range(
+        BVHNode **leafs_array, const int nth[], const int part_begin, const int part_end, const int split_axis);
+
+static void split_leafs_range_task_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	const BVHSplitLeafsData *data = userdata;
+	if (i == 0) {
+		split_leafs_range(data->leafs_array, data->nth, data->part_begin, data->part_mid, data->split_axis);
+	}
+	else {
+		split_leafs_range(data->leafs_array, data->nth, data->part_mid, data->part_end, data->split_axis);
+	}
+}
+
+/**
+ * Partition on the middle split, then both halves independently.
+ */
+static void split_leafs_range(
+        BVHNode **leafs_array, const int nth[], const int part_begin, const int part_end, const int split_axis)
+{
+	const int begin = nth[part_begin];
+	const int end = nth[part_end];
+
+	if ((part_end - part_begin < 2) || (end - begin < 2)) {
+		return;
+	}
+
+	const int part_mid = (part_begin + part_end) / 2;
+	if (nth[part_mid] > begin && nth[part_mid] < end) {
+		partition_nth_element(leafs_array, begin, end, nth[part_mid], split_axis);
+	}
+
+	if (end - begin < KDOPBVH_THREAD_NODE_THRESHOLD) {
+		split_leafs_range(leafs_array, nth, part_begin, part_mid, split_axis);
+		split_leafs_range(leafs_array, nth, part_mid, part_end, split_axis);
+	}
+	else {
+		BVHSplitLeafsData data = {
+			.leafs_array = leafs_array, .nth = nth, .split_axis = split_axis,
+			.part_begin = part_begin, .part_mid = part_mid, .part_end = part_end,
+		};
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		BLI_task_parallel_range(0, 2, &data, split_leafs_range_task_cb, &settings);
+	}
+}
+
 /**
  * This function handles the problem of "sorting" the leafs (along the split_axis).
  *
@@ -770,17 +902,20 @@ static int implicit_needed_branches(int tree_type, int leafs)
  *
  * partition P is described as the elements in the range ( nth[P], nth[P+1] ]
  *
- * TODO: This can be optimized a bit by doing a specialized nth_element instead of K nth_elements
+ * Partitions are split recursively in halves (rather than one after the other),
+ * so big nodes can partition both halves in parallel.
  */
 static void split_leafs(BVHNode **leafs_array, const int nth[], const int partitions, const int split_axis)
 {
+	int nth_clamped[MAX_TREETYPE + 1];
 	int i;
-	for (i = 0; i < partitions - 1; i++) {
-		if (nth[i] >= nth[partitions])
-			break;
 
-		partition_nth_element(leafs_array, nth[i], nth[partitions], nth[i + 1], split_axis);
+	/* Positions past the end are empty partitions. */
+	for (i = 0; i <= partitions; i++) {
+		nth_clamped[i] = CLAMPIS(nth[i], nth[0], nth[partitions]);
 	}
+
+	split_leafs_range(leafs_array, nth_clamped, 0, partitions, split_axis);
 }
 
 typedef struct BVHDivNodesData {
@@ -947,6 +1082,101 @@ static void non_recursive_bvh_div_nodes(
 /** \} */
 
 
+/* -------------------------------------------------------------------- */
+
+/** \name SIMD Children Bounds
+ *
+ * For each branch, the bounds of its children are stored transposed (one row per bound,
+ * one lane per child), in groups of #KDOPBVH_SIMD_WIDTH children,
+ * so queries can test all children of a node at once.
+ *
+ * Rows only cover the axes used by the tree (from start_axis), unused lanes get empty bounds.
+ * \{ */
+
+#ifdef USE_KDOPBVH_SIMD
+
+BLI_INLINE int bvhtree_simd_rows(const BVHTree *tree)
+{
+	return 2 * (tree->stop_axis - tree->start_axis);
+}
+
+BLI_INLINE int bvhtree_simd_groups(const BVHTree *tree)
+{
+	return (tree->tree_type + KDOPBVH_SIMD_WIDTH - 1) / KDOPBVH_SIMD_WIDTH;
+}
+
+/* Children bounds of the branch \a node, `rows * KDOPBVH_SIMD_WIDTH` floats for each group. */
+BLI_INLINE const float *bvhtree_simd_children_bv(const BVHTree *tree, const BVHNode *node)
+{
+	const size_t branch_index = (size_t)(node - tree->nodearray - tree->totleaf);
+	BLI_assert(node->totnode != 0);
+	return tree->nodechild_bv +
+	       branch_index * (size_t)(bvhtree_simd_groups(tree) * bvhtree_simd_rows(tree) * KDOPBVH_SIMD_WIDTH);
+}
+
+static void bvhtree_simd_update_branch(const BVHTree *tree, const int branch_index)
+{
+	const BVHNode *node = &tree->nodearray[tree->totleaf + branch_index];
+	const int rows = bvhtree_simd_rows(tree);
+	const int lanes = bvhtree_simd_groups(tree) * KDOPBVH_SIMD_WIDTH;
+	float *block = tree->nodechild_bv + (size_t)branch_index * (size_t)(rows * lanes);
+	int i, r;
+
+	for (i = 0; i < lanes; i++) {
+		float *group = block + (i / KDOPBVH_SIMD_WIDTH) * rows * KDOPBVH_SIMD_WIDTH;
+		const int lane = i % KDOPBVH_SIMD_WIDTH;
+		if (i < node->totnode) {
+			const float *bv = &node->children[i]->bv[2 * tree->start_axis];
+			for (r = 0; r < rows; r++) {
+				group[r * KDOPBVH_SIMD_WIDTH + lane] = bv[r];
+			}
+		}
+		else {
+			for (r = 0; r < rows; r += 2) {
+				group[r * KDOPBVH_SIMD_WIDTH + lane] = FLT_MAX;
+				group[(r + 1) * KDOPBVH_SIMD_WIDTH + lane] = -FLT_MAX;
+			}
+		}
+	}
+}
+
+static void bvhtree_simd_update_task_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	bvhtree_simd_update_branch(userdata, i);
+}
+
+/**
+ * Copy the bounds of all branches children, needed after building or updating the tree.
+ */
+static void bvhtree_simd_update(BVHTree *tree)
+{
+	if (tree->nodechild_bv == NULL) {
+		const size_t len = (size_t)(tree->totbranch * bvhtree_simd_groups(tree) * bvhtree_simd_rows(tree)) *
+		                   KDOPBVH_SIMD_WIDTH;
+		tree->nodechild_bv = MEM_mallocN(sizeof(float) * len, __func__);
+	}
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (tree->totleaf > KDOPBVH_THREAD_LEAF_THRESHOLD);
+	settings.min_iter_per_thread = 256;
+	BLI_task_parallel_range(0, tree->totbranch, tree, bvhtree_simd_update_task_cb, &settings);
+}
+
+#else  /* USE_KDOPBVH_SIMD */
+
+static void bvhtree_simd_update(BVHTree *UNUSED(tree))
+{
+}
+
+#endif  /* USE_KDOPBVH_SIMD */
+
+/** \} */
+
+
 /* -------------------------------------------------------------------- */
 
 /** \name BLI_bvhtree API
@@ -1046,6 +1276,7 @@ void BLI_bvhtree_free(BVHTree *tree)
 		MEM_freeN(tree->nodearray);
 		MEM_freeN(tree->nodebv);
 		MEM_freeN(tree->nodechild);
+		MEM_SAFE_FREE(tree->nodechild_bv);
 		MEM_freeN(tree);
 	}
 }
@@ -1068,6 +1299,8 @@ void BLI_bvhtree_balance(BVHTree *tree)
 		tree->nodes[tree->totleaf + i] = &tree->nodearray[tree->totleaf + i];
 	}
 
+	bvhtree_simd_update(tree);
+
 #ifdef USE_SKIP_LINKS
 	build_skip_links(tree, tree->nodes[tree->totleaf], NULL, NULL);
 #endif
@@ -1142,6 +1375,8 @@ void BLI_bvhtree_update_tree(BVHTree *tree)
 
 	for (; index >= root; index--)
 		node_join(tree, *index);
+
+	bvhtree_simd_update(tree);
 }
 /**
  * Number of times #BLI_bvhtree_insert has been called.
@@ -1184,45 +1419,95 @@ static bool tree_overlap_test(const BVHNode *node1, const BVHNode *node2, axis_t
 	return 1;
 }
 
+/**
+ * Bit-mask of the children of \a parent (a branch of \a tree) which may collide with \a node.
+ */
+static unsigned int tree_overlap_test_children(
+        const BVHTree *tree, const BVHNode *parent, const BVHNode *node,
+        axis_t start_axis, axis_t stop_axis)
+{
+	const unsigned int mask_children = (parent->totnode < 32) ? (1u << parent->totnode) - 1 : ~0u;
+	unsigned int mask = 0;
+	int j;
+
+#ifdef USE_KDOPBVH_SIMD
+	if (start_axis >= tree->start_axis && stop_axis <= tree->stop_axis) {
+		const int rows = bvhtree_simd_rows(tree);
+		const float *group = bvhtree_simd_children_bv(tree, parent);
+		const float *bv = node->bv;
+		axis_t axis_iter;
+
+		for (j = 0; j < parent->totnode; j += KDOPBVH_SIMD_WIDTH, group += rows * KDOPBVH_SIMD_WIDTH) {
+			__m128 separated = _mm_setzero_ps();
+			for (axis_iter = start_axis; axis_iter != stop_axis; axis_iter++) {
+				const float *row = group + 2 * (axis_iter - tree->start_axis) * KDOPBVH_SIMD_WIDTH;
+				const __m128 child_min = _mm_loadu_ps(row);
+				const __m128 child_max = _mm_loadu_ps(row + KDOPBVH_SIMD_WIDTH);
+				separated = _mm_or_ps(
+				        separated,
+				        _mm_or_ps(_mm_cmpgt_ps(_mm_set1_ps(bv[2 * axis_iter]), child_max),
+				                  _mm_cmpgt_ps(child_min, _mm_set1_ps(bv[2 * axis_iter + 1]))));
+			}
+			mask |= (unsigned int)(~_mm_movemask_ps(separated) & 0xf) << j;
+		}
+		return mask & mask_children;
+	}
+#else
+	UNUSED_VARS(tree);
+#endif
+
+	for (j = 0; j < parent->totnode; j++) {
+		if (tree_overlap_test(parent->children[j], node, start_axis, stop_axis)) {
+			mask |= 1u << j;
+		}
+	}
+	return mask & mask_children;
+}
+
+/**
+ * \note \a node1 and \a node2 must be known to overlap already,
+ * the children are tested before traversing them.
+ */
 static void tree_overlap_traverse(
         BVHOverlapData_Thread *data_thread,
         const BVHNode *node1, const BVHNode *node2)
 {
 	BVHOverlapData_Shared *data = data_thread->shared;
+	unsigned int mask;
 	int j;
 
-	if (tree_overlap_test(node1, node2, data->start_axis, data->stop_axis)) {
-		/* check if node1 is a leaf */
-		if (!node1->totnode) {
-			/* check if node2 is a leaf */
-			if (!node2->totnode) {
-				BVHTreeOverlap *overlap;
+	/* check if node1 is a leaf */
+	if (!node1->totnode) {
+		/* check if node2 is a leaf */
+		if (!node2->totnode) {
+			BVHTreeOverlap *overlap;
 
-				if (UNLIKELY(node1 == node2)) {
-					return;
-				}
-
-				/* both leafs, insert overlap! */
-				overlap = BLI_stack_push_r(data_thread->overlap);
-				overlap->indexA = node1->index;
-				overlap->indexB = node2->index;
-			}
-			else {
-				for (j = 0; j < data->tree2->tree_type; j++) {
-					if (node2->children[j]) {
-						tree_overlap_traverse(data_thread, node1, node2->children[j]);
-					}
-				}
+			if (UNLIKELY(node1 == node2)) {
+				return;
 			}
+
+			/* both leafs, insert overlap! */
+			overlap = BLI_stack_push_r(data_thread->overlap);
+			overlap->indexA = node1->index;
+			overlap->indexB = node2->index;
 		}
 		else {
-			for (j = 0; j < data->tree2->tree_type; j++) {
-				if (node1->children[j]) {
-					tree_overlap_traverse(data_thread, node1->children[j], node2);
+			mask = tree_overlap_test_children(data->tree2, node2, node1, data->start_axis, data->stop_axis);
+			for (j = 0; mask; j++, mask >>= 1) {
+				if (mask & 1) {
+					tree_overlap_traverse(data_thread, node1, node2->children[j]);
 				}
 			}
 		}
 	}
+	else {
+		mask = tree_overlap_test_children(data->tree1, node1, node2, data->start_axis, data->stop_axis);
+		for (j = 0; mask; j++, mask >>= 1) {
+			if (mask & 1) {
+				tree_overlap_traverse(data_thread, node1->children[j], node2);
+			}
+		}
+	}
 }
 
 /**
@@ -1233,43 +1518,44 @@ static void tree_overlap_traverse_cb(
         const BVHNode *node1, const BVHNode *node2)
 {
 	BVHOverlapData_Shared *data = data_thread->shared;
+	unsigned int mask;
 	int j;
 
-	if (tree_overlap_test(node1, node2, data->start_axis, data->stop_axis)) {
-		/* check if node1 is a leaf */
-		if (!node1->totnode) {
-			/* check if node2 is a leaf */
-			if (!node2->totnode) {
-				BVHTreeOverlap *overlap;
+	/* check if node1 is a leaf */
+	if (!node1->totnode) {
+		/* check if node2 is a leaf */
+		if (!node2->totnode) {
+			BVHTreeOverlap *overlap;
 
-				if (UNLIKELY(node1 == node2)) {
-					return;
-				}
-
-				/* only difference to tree_overlap_traverse! */
-				if (data->callback(data->userdata, node1->index, node2->index, data_thread->thread)) {
-					/* both leafs, insert overlap! */
-					overlap = BLI_stack_push_r(data_thread->overlap);
-					overlap->indexA = node1->index;
-					overlap->indexB = node2->index;
-				}
+			if (UNLIKELY(node1 == node2)) {
+				return;
 			}
-			else {
-				for (j = 0; j < data->tree2->tree_type; j++) {
-					if (node2->children[j]) {
-						tree_overlap_traverse_cb(data_thread, node1, node2->children[j]);
-					}
-				}
+
+			/* only difference to tree_overlap_traverse! */
+			if (data->callback(data->userdata, node1->index, node2->index, data_thread->thread)) {
+				/* both leafs, insert overlap! */
+				overlap = BLI_stack_push_r(data_thread->overlap);
+				overlap->indexA = node1->index;
+				overlap->indexB = node2->index;
 			}
 		}
 		else {
-			for (j = 0; j < data->tree2->tree_type; j++) {
-				if (node1->children[j]) {
-					tree_overlap_traverse_cb(data_thread, node1->children[j], node2);
+			mask = tree_overlap_test_children(data->tree2, node2, node1, data->start_axis, data->stop_axis);
+			for (j = 0; mask; j++, mask >>= 1) {
+				if (mask & 1) {
+					tree_overlap_traverse_cb(data_thread, node1, node2->children[j]);
 				}
 			}
 		}
 	}
+	else {
+		mask = tree_overlap_test_children(data->tree1, node1, node2, data->start_axis, data->stop_axis);
+		for (j = 0; mask; j++, mask >>= 1) {
+			if (mask & 1) {
+				tree_overlap_traverse_cb(data_thread, node1->children[j], node2);
+			}
+		}
+	}
 }
 
 /**
@@ -1289,16 +1575,18 @@ static void bvhtree_overlap_task_cb(
 {
 	BVHOverlapData_Thread *data = &((BVHOverlapData_Thread *)userdata)[j];
 	BVHOverlapData_Shared *data_shared = data->shared;
+	const BVHNode *node1 = data_shared->tree1->nodes[data_shared->tree1->totleaf]->children[j];
+	const BVHNode *node2 = data_shared->tree2->nodes[data_shared->tree2->totleaf];
+
+	if (!tree_overlap_test(node1, node2, data_shared->start_axis, data_shared->stop_axis)) {
+		return;
+	}
 
 	if (data_shared->callback) {
-		tree_overlap_traverse_cb(
-		            data, data_shared->tree1->nodes[data_shared->tree1->totleaf]->children[j],
-		            data_shared->tree2->nodes[data_shared->tree2->totleaf]);
+		tree_overlap_traverse_cb(data, node1, node2);
 	}
 	else {
-		tree_overlap_traverse(
-		            data, data_shared->tree1->nodes[data_shared->tree1->totleaf]->children[j],
-		            data_shared->tree2->nodes[data_shared->tree2->totleaf]);
+		tree_overlap_traverse(data, node1, node2);
 	}
 }
 
@@ -1419,6 +1707,38 @@ static float calc_nearest_point_squared(const float proj[3], BVHNode *node, floa
 	return len_squared_v3v3(proj, nearest);
 }
 
+#ifdef USE_KDOPBVH_SIMD
+/**
+ * #calc_nearest_point_squared for all children of the branch \a node,
+ * giving the same results (operations are done in the same order).
+ */
+static void calc_nearest_point_squared_children(
+        const BVHTree *tree, const float proj[3], const BVHNode *node, float r_dist_sq[])
+{
+	const int rows = bvhtree_simd_rows(tree);
+	const float *group = bvhtree_simd_children_bv(tree, node);
+	int i, j;
+
+	for (j = 0; j < node->totnode; j += KDOPBVH_SIMD_WIDTH, group += rows * KDOPBVH_SIMD_WIDTH) {
+		__m128 dist_sq = _mm_setzero_ps();
+		for (i = 0; i != 3; i++) {
+			const __m128 co = _mm_set1_ps(proj[i]);
+			const __m128 bv_min = _mm_loadu_ps(group + (2 * i) * KDOPBVH_SIMD_WIDTH);
+			const __m128 bv_max = _mm_loadu_ps(group + (2 * i + 1) * KDOPBVH_SIMD_WIDTH);
+			/* Clamp to the bounds, min taking precedence. */
+			const __m128 above = _mm_cmplt_ps(bv_max, co);
+			const __m128 below = _mm_cmpgt_ps(bv_min, co);
+			__m128 nearest = _mm_or_ps(_mm_and_ps(above, bv_max), _mm_andnot_ps(above, co));
+			nearest = _mm_or_ps(_mm_and_ps(below, bv_min), _mm_andnot_ps(below, nearest));
+
+			const __m128 d = _mm_sub_ps(co, nearest);
+			dist_sq = (i == 0) ? _mm_mul_ps(d, d) : _mm_add_ps(dist_sq, _mm_mul_ps(d, d));
+		}
+		_mm_storeu_ps(&r_dist_sq[j], dist_sq);
+	}
+}
+#endif
+
 /* TODO: use a priority queue to reduce the number of nodes looked on */
 static void dfs_find_nearest_dfs(BVHNearestData *data, BVHNode *node)
 {
@@ -1435,6 +1755,30 @@ static void dfs_find_nearest_dfs(BVHNearestData *data, BVHNode *node)
 		int i;
 		float nearest[3];
 
+#ifdef USE_KDOPBVH_SIMD
+		if (data->tree->start_axis == 0) {
+			/* Distances don't depend on the current nearest, compute them all at once. */
+			float dist_sq[MAX_TREETYPE];
+			calc_nearest_point_squared_children(data->tree, data->proj, node, dist_sq);
+
+			if (data->proj[node->main_axis] <= node->children[0]->bv[node->main_axis * 2 + 1]) {
+				for (i = 0; i != node->totnode; i++) {
+					if (dist_sq[i] >= data->nearest.dist_sq)
+						continue;
+					dfs_find_nearest_dfs(data, node->children[i]);
+				}
+			}
+			else {
+				for (i = node->totnode - 1; i >= 0; i--) {
+					if (dist_sq[i] >= data->nearest.dist_sq)
+						continue;
+					dfs_find_nearest_dfs(data, node->children[i]);
+				}
+			}
+			return;
+		}
+#endif
+
 		if (data->proj[node->main_axis] <= node->children[0]->bv[node->main_axis * 2 + 1]) {
 
 			for (i = 0; i != node->totnode; i++) {
@@ -1598,6 +1942,66 @@ int BLI_bvhtree_find_nearest(
 	return data.nearest.index;
 }
 
+/* Minimum number of queries handled by each thread in batched queries. */
+#define BVH_BATCH_QUERIES_PER_THREAD 256
+
+typedef struct BVHNearestBatchData {
+	BVHTree *tree;
+	const float (*co)[3];
+	BVHTreeNearest *nearest;
+	const int *order;
+	BVHTree_NearestPointCallback callback;
+	void *userdata;
+} BVHNearestBatchData;
+
+static void bvhtree_find_nearest_batch_cb(
+        void *__restrict userdata,
+        const int iter,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BVHNearestBatchData *data = userdata;
+	const int i = data->order[iter];
+	BLI_bvhtree_find_nearest(data->tree, data->co[i], &data->nearest[i], data->callback, data->userdata);
+}
+
+/**
+ * Find the nearest node of many coordinates at once.
+ *
+ * Each item of \a r_nearest is used as the \a nearest argument of #BLI_bvhtree_find_nearest,
+ * so it must be initialized the same way (index & dist_sq).
+ * Queries are ordered spatially and run in parallel, the \a callback must be thread-safe.
+ */
+void BLI_bvhtree_find_nearest_batch(
+        BVHTree *tree, const float (*co)[3], const int co_len, BVHTreeNearest *r_nearest,
+        BVHTree_NearestPointCallback callback, void *userdata,
+        const bool use_threading)
+{
+	BVHNearestBatchData data;
+	int *order;
+
+	if (co_len <= 0) {
+		return;
+	}
+
+	order = MEM_mallocN(sizeof(*order) * (size_t)co_len, __func__);
+	BLI_sortutil_order_spatial_v3(co, co_len, order);
+
+	data.tree = tree;
+	data.co = co;
+	data.nearest = r_nearest;
+	data.order = order;
+	data.callback = callback;
+	data.userdata = userdata;
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading;
+	settings.min_iter_per_thread = BVH_BATCH_QUERIES_PER_THREAD;
+	BLI_task_parallel_range(0, co_len, &data, bvhtree_find_nearest_batch_cb, &settings);
+
+	MEM_freeN(order);
+}
+
 /** \} */
 
 
@@ -1673,17 +2077,86 @@ static float fast_ray_nearest_hit(const BVHRayCastData *data, const BVHNode *nod
 	}
 }
 
-static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
+#ifdef USE_KDOPBVH_SIMD
+
+typedef struct BVHRayChildrenHit {
+	/* Distance to the bounds of each child, valid when not missed. */
+	float dist[MAX_TREETYPE];
+	/* Entry distance along each axis. */
+	float t1[3][MAX_TREETYPE];
+	/* Bit-mask of children which bounds are missed (regardless of the current hit distance). */
+	unsigned int miss;
+} BVHRayChildrenHit;
+
+BLI_INLINE bool fast_ray_use_simd(const BVHRayCastData *data)
 {
-	int i;
+	/* XXX: same as #dfs_raycast, fast_ray_nearest_hit doesn't support ray.radius */
+	return (data->ray.radius == 0.0f) && (data->tree->start_axis == 0);
+}
 
-	/* ray-bv is really fast.. and simple tests revealed its worth to test it
-	 * before calling the ray-primitive functions */
-	/* XXX: temporary solution for particles until fast_ray_nearest_hit supports ray.radius */
-	float dist = (data->ray.radius == 0.0f) ? fast_ray_nearest_hit(data, node) : ray_nearest_hit(data, node->bv);
-	if (dist >= data->hit.dist) {
-		return;
+/**
+ * #fast_ray_nearest_hit for all children of the branch \a node,
+ * the parts depending on the current hit distance are done by #fast_ray_nearest_hit_child.
+ */
+static void fast_ray_nearest_hit_children(
+        const BVHRayCastData *data, const BVHNode *node, BVHRayChildrenHit *r_hit)
+{
+	const int rows = bvhtree_simd_rows(data->tree);
+	const float *group = bvhtree_simd_children_bv(data->tree, node);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 origin_x = _mm_set1_ps(data->ray.origin[0]);
+	const __m128 origin_y = _mm_set1_ps(data->ray.origin[1]);
+	const __m128 origin_z = _mm_set1_ps(data->ray.origin[2]);
+	const __m128 idot_x = _mm_set1_ps(data->idot_axis[0]);
+	const __m128 idot_y = _mm_set1_ps(data->idot_axis[1]);
+	const __m128 idot_z = _mm_set1_ps(data->idot_axis[2]);
+	int j;
+
+	r_hit->miss = 0;
+
+	for (j = 0; j < node->totnode; j += KDOPBVH_SIMD_WIDTH, group += rows * KDOPBVH_SIMD_WIDTH) {
+		const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[0] * KDOPBVH_SIMD_WIDTH), origin_x), idot_x);
+		const __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[1] * KDOPBVH_SIMD_WIDTH), origin_x), idot_x);
+		const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[2] * KDOPBVH_SIMD_WIDTH), origin_y), idot_y);
+		const __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[3] * KDOPBVH_SIMD_WIDTH), origin_y), idot_y);
+		const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[4] * KDOPBVH_SIMD_WIDTH), origin_z), idot_z);
+		const __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(group + data->index[5] * KDOPBVH_SIMD_WIDTH), origin_z), idot_z);
+
+		__m128 miss = _mm_or_ps(_mm_cmpgt_ps(t1x, t2y), _mm_cmplt_ps(t2x, t1y));
+		miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(t1x, t2z), _mm_cmplt_ps(t2x, t1z)));
+		miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmpgt_ps(t1y, t2z), _mm_cmplt_ps(t2y, t1z)));
+		miss = _mm_or_ps(miss, _mm_or_ps(_mm_cmplt_ps(t2x, zero), _mm_cmplt_ps(t2y, zero)));
+		miss = _mm_or_ps(miss, _mm_cmplt_ps(t2z, zero));
+
+		r_hit->miss |= (unsigned int)_mm_movemask_ps(miss) << j;
+		/* Same as max_fff(). */
+		_mm_storeu_ps(&r_hit->dist[j], _mm_max_ps(_mm_max_ps(t1x, t1y), t1z));
+		_mm_storeu_ps(&r_hit->t1[0][j], t1x);
+		_mm_storeu_ps(&r_hit->t1[1][j], t1y);
+		_mm_storeu_ps(&r_hit->t1[2][j], t1z);
+	}
+}
+
+/* Same result as #fast_ray_nearest_hit for the child \a i, with the current hit distance. */
+BLI_INLINE float fast_ray_nearest_hit_child(const BVHRayCastData *data, const BVHRayChildrenHit *hit, const int i)
+{
+	if ((hit->miss & (1u << i)) ||
+	    (hit->t1[0][i] > data->hit.dist || hit->t1[1][i] > data->hit.dist || hit->t1[2][i] > data->hit.dist))
+	{
+		return FLT_MAX;
 	}
+	return hit->dist[i];
+}
+
+#endif  /* USE_KDOPBVH_SIMD */
+
+static void dfs_raycast(BVHRayCastData *data, BVHNode *node);
+static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node);
+
+/* Traverse \a node, its bounds being hit at \a dist. */
+static void dfs_raycast_hit(BVHRayCastData *data, BVHNode *node, float dist)
+{
+	int i;
 
 	if (node->totnode == 0) {
 		if (data->callback) {
@@ -1697,7 +2170,25 @@ static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 	}
 	else {
 		/* pick loop direction to dive into the tree (based on ray direction and split axis) */
-		if (data->ray_dot_axis[node->main_axis] > 0.0f) {
+		const bool forward = (data->ray_dot_axis[node->main_axis] > 0.0f);
+
+#ifdef USE_KDOPBVH_SIMD
+		if (fast_ray_use_simd(data)) {
+			BVHRayChildrenHit hit;
+			fast_ray_nearest_hit_children(data, node, &hit);
+			for (int k = 0; k != node->totnode; k++) {
+				i = forward ? k : node->totnode - 1 - k;
+				dist = fast_ray_nearest_hit_child(data, &hit, i);
+				if (dist >= data->hit.dist) {
+					continue;
+				}
+				dfs_raycast_hit(data, node->children[i], dist);
+			}
+			return;
+		}
+#endif
+
+		if (forward) {
 			for (i = 0; i != node->totnode; i++) {
 				dfs_raycast(data, node->children[i]);
 			}
@@ -1710,13 +2201,8 @@ static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 	}
 }
 
-/**
- * A version of #dfs_raycast with minor changes to reset the index & dist each ray cast.
- */
-static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
+static void dfs_raycast(BVHRayCastData *data, BVHNode *node)
 {
-	int i;
-
 	/* ray-bv is really fast.. and simple tests revealed its worth to test it
 	 * before calling the ray-primitive functions */
 	/* XXX: temporary solution for particles until fast_ray_nearest_hit supports ray.radius */
@@ -1725,6 +2211,16 @@ static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
 		return;
 	}
 
+	dfs_raycast_hit(data, node, dist);
+}
+
+/**
+ * A version of #dfs_raycast_hit with minor changes to reset the index & dist each ray cast.
+ */
+static void dfs_raycast_all_hit(BVHRayCastData *data, BVHNode *node, float dist)
+{
+	int i;
+
 	if (node->totnode == 0) {
 		/* no need to check for 'data->callback' (using 'all' only makes sense with a callback). */
 		dist = data->hit.dist;
@@ -1734,7 +2230,25 @@ static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
 	}
 	else {
 		/* pick loop direction to dive into the tree (based on ray direction and split axis) */
-		if (data->ray_dot_axis[node->main_axis] > 0.0f) {
+		const bool forward = (data->ray_dot_axis[node->main_axis] > 0.0f);
+
+#ifdef USE_KDOPBVH_SIMD
+		if (fast_ray_use_simd(data)) {
+			BVHRayChildrenHit hit;
+			fast_ray_nearest_hit_children(data, node, &hit);
+			for (int k = 0; k != node->totnode; k++) {
+				i = forward ? k : node->totnode - 1 - k;
+				dist = fast_ray_nearest_hit_child(data, &hit, i);
+				if (dist >= data->hit.dist) {
+					continue;
+				}
+				dfs_raycast_all_hit(data, node->children[i], dist);
+			}
+			return;
+		}
+#endif
+
+		if (forward) {
 			for (i = 0; i != node->totnode; i++) {
 				dfs_raycast_all(data, node->children[i]);
 			}
@@ -1747,6 +2261,22 @@ static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
 	}
 }
 
+/**
+ * A version of #dfs_raycast with minor changes to reset the index & dist each ray cast.
+ */
+static void dfs_raycast_all(BVHRayCastData *data, BVHNode *node)
+{
+	/* ray-bv is really fast.. and simple tests revealed its worth to test it
+	 * before calling the ray-primitive functions */
+	/* XXX: temporary solution for particles until fast_ray_nearest_hit supports ray.radius */
+	float dist = (data->ray.radius == 0.0f) ? fast_ray_nearest_hit(data, node) : ray_nearest_hit(data, node->bv);
+	if (dist >= data->hit.dist) {
+		return;
+	}
+
+	dfs_raycast_all_hit(data, node, dist);
+}
+
 #if 0
 static void iterative_raycast(BVHRayCastData *data, BVHNode *node)
 {
@@ -1854,6 +2384,71 @@ int BLI_bvhtree_ray_cast(
 	return BLI_bvhtree_ray_cast_ex(tree, co, dir, radius, hit, callback, userdata, BVH_RAYCAST_DEFAULT);
 }
 
+typedef struct BVHRayCastBatchData {
+	BVHTree *tree;
+	const float (*co)[3];
+	const float (*dir)[3];
+	float radius;
+	BVHTreeRayHit *hit;
+	const int *order;
+	BVHTree_RayCastCallback callback;
+	void *userdata;
+	int flag;
+} BVHRayCastBatchData;
+
+static void bvhtree_ray_cast_batch_cb(
+        void *__restrict userdata,
+        const int iter,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BVHRayCastBatchData *data = userdata;
+	const int i = data->order[iter];
+	BLI_bvhtree_ray_cast_ex(
+	        data->tree, data->co[i], data->dir[i], data->radius, &data->hit[i],
+	        data->callback, data->userdata, data->flag);
+}
+
+/**
+ * Cast many rays at once.
+ *
+ * Each item of \a r_hit is used as the \a hit argument of #BLI_bvhtree_ray_cast_ex,
+ * so it must be initialized the same way (index & dist).
+ * Rays are ordered by origin and run in parallel, the \a callback must be thread-safe.
+ */
+void BLI_bvhtree_ray_cast_batch(
+        BVHTree *tree, const float (*co)[3], const float (*dir)[3], const int rays_len, float radius,
+        BVHTreeRayHit *r_hit, BVHTree_RayCastCallback callback, void *userdata,
+        int flag, const bool use_threading)
+{
+	BVHRayCastBatchData data;
+	int *order;
+
+	if (rays_len <= 0) {
+		return;
+	}
+
+	order = MEM_mallocN(sizeof(*order) * (size_t)rays_len, __func__);
+	BLI_sortutil_order_spatial_v3(co, rays_len, order);
+
+	data.tree = tree;
+	data.co = co;
+	data.dir = dir;
+	data.radius = radius;
+	data.hit = r_hit;
+	data.order = order;
+	data.callback = callback;
+	data.userdata = userdata;
+	data.flag = flag;
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading;
+	settings.min_iter_per_thread = BVH_BATCH_QUERIES_PER_THREAD;
+	BLI_task_parallel_range(0, rays_len, &data, bvhtree_ray_cast_batch_cb, &settings);
+
+	MEM_freeN(order);
+}
+
 float BLI_bvhtree_bb_raycast(const float bv[6], const float light_start[3], const float light_end[3], float pos[3])
 {
 	BVHRayCastData data;
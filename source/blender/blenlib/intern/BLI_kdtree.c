@@ -25,41 +25,62 @@
  *  \ingroup bli
  */
 
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
 #include "MEM_guardedalloc.h"
 
 #include "BLI_math.h"
 #include "BLI_kdtree.h"
+#include "BLI_sort_utils.h"
+#include "BLI_task.h"
 #include "BLI_utildefines.h"
 #include "BLI_strict_flags.h"
 
-typedef struct KDTreeNode_head {
-	uint left, right;
-	float co[3];
-	int index;
-} KDTreeNode_head;
-
 typedef struct KDTreeNode {
-	uint left, right;
 	float co[3];
 	int index;
-	uint d;  /* range is only (0-2) */
 } KDTreeNode;
 
+/**
+ * Branches split space in two along one axis, leaves reference a contiguous range of nodes.
+ * Stored depth first, the layout only depends on the number of nodes.
+ */
+typedef struct KDTreeBranch {
+	float split;
+	uint d;  /* range is only (0-2), or KD_BRANCH_LEAF */
+	uint left, right;  /* child branches, for leaves the range of nodes [left, right) */
+} KDTreeBranch;
+
 struct KDTree {
 	KDTreeNode *nodes;
 	uint totnode;
-	uint root;
+	KDTreeBranch *branches;
+	uint totbranch;
+	/* Copy of the nodes coordinates as 3 arrays (x, y & z, each co_soa_stride long),
+	 * so the distances to the nodes of a leaf can be computed 4 at a time. */
+	float *co_soa;
+	uint co_soa_stride;
 #ifdef DEBUG
 	bool is_balanced;  /* ensure we call balance first */
 	uint maxsize;   /* max size of the tree */
 #endif
 };
 
-#define KD_STACK_INIT 100      /* initial size for array (on the stack) */
-#define KD_NEAR_ALLOC_INC 100  /* alloc increment for collecting nearest */
+/* Leaves hold between half and all of this number of nodes (must be a multiple of 4). */
+#define KD_LEAF_SIZE 16
+#define KD_BRANCH_LEAF 3
 #define KD_FOUND_ALLOC_INC 50  /* alloc increment for collecting nearest */
 
-#define KD_NODE_UNSET ((uint)-1)
+/* Branches with more nodes than this balance their children in parallel. */
+#ifdef DEBUG
+#  define KD_THREAD_NODE_THRESHOLD 64
+#else
+#  define KD_THREAD_NODE_THRESHOLD 16384
+#endif
+
+BLI_STATIC_ASSERT((KD_LEAF_SIZE % 4) == 0, "leaf size must be a multiple of 4")
 
 /**
  * Creates or free a kdtree
@@ -71,7 +92,10 @@ KDTree *BLI_kdtree_new(uint maxsize)
 	tree = MEM_mallocN(sizeof(KDTree), "KDTree");
 	tree->nodes = MEM_mallocN(sizeof(KDTreeNode) * maxsize, "KDTreeNode");
 	tree->totnode = 0;
-	tree->root = KD_NODE_UNSET;
+	tree->branches = NULL;
+	tree->totbranch = 0;
+	tree->co_soa = NULL;
+	tree->co_soa_stride = 0;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
@@ -85,6 +109,8 @@ void BLI_kdtree_free(KDTree *tree)
 {
 	if (tree) {
 		MEM_freeN(tree->nodes);
+		MEM_SAFE_FREE(tree->branches);
+		MEM_SAFE_FREE(tree->co_soa);
 		MEM_freeN(tree);
 	}
 }
@@ -103,28 +129,26 @@ void BLI_kdtree_insert(KDTree *tree, int index, const float co[3])
 	/* note, array isn't calloc'd,
 	 * need to initialize all struct members */
 
-	node->left = node->right = KD_NODE_UNSET;
 	copy_v3_v3(node->co, co);
 	node->index = index;
-	node->d = 0;
 
 #ifdef DEBUG
 	tree->is_balanced = false;
 #endif
 }
 
-static uint kdtree_balance(KDTreeNode *nodes, uint totnode, uint axis, const uint ofs)
+/* -------------------------------------------------------------------- */
+/** \name Balance
+ * \{ */
+
+/**
+ * Quicksort style sorting around median, returns the median.
+ */
+static uint kdtree_nth_element(KDTreeNode *nodes, uint totnode, uint axis)
 {
-	KDTreeNode *node;
 	float co;
 	uint left, right, median, i, j;
 
-	if (totnode <= 0)
-		return KD_NODE_UNSET;
-	else if (totnode == 1)
-		return 0 + ofs;
-	
-	/* quicksort style sorting around median */
 	left = 0;
 	right = totnode - 1;
 	median = totnode / 2;
@@ -141,62 +165,235 @@ static uint kdtree_balance(KDTreeNode *nodes, uint totnode, uint axis, const uin
 			if (i >= j)
 				break;
 
-			SWAP(KDTreeNode_head, *(KDTreeNode_head *)&nodes[i], *(KDTreeNode_head *)&nodes[j]);
+			SWAP(KDTreeNode, nodes[i], nodes[j]);
 		}
 
-		SWAP(KDTreeNode_head, *(KDTreeNode_head *)&nodes[i], *(KDTreeNode_head *)&nodes[right]);
+		SWAP(KDTreeNode, nodes[i], nodes[right]);
 		if (i >= median)
 			right = i - 1;
 		if (i <= median)
 			left = i + 1;
 	}
 
-	/* set node and sort subnodes */
-	node = &nodes[median];
-	node->d = axis;
-	axis = (axis + 1) % 3;
-	node->left = kdtree_balance(nodes, median, axis, ofs);
-	node->right = kdtree_balance(nodes + median + 1, (totnode - (median + 1)), axis, (median + 1) + ofs);
+	return median;
+}
+
+static uint kdtree_branches_layout(KDTreeBranch *branches, uint *r_totbranch, const uint start, const uint end)
+{
+	const uint branch_index = (*r_totbranch)++;
+	KDTreeBranch *branch = &branches[branch_index];
+
+	if (end - start <= KD_LEAF_SIZE) {
+		branch->split = 0.0f;
+		branch->d = KD_BRANCH_LEAF;
+		branch->left = start;
+		branch->right = end;
+	}
+	else {
+		const uint mid = start + (end - start) / 2;
+		/* Set when balancing. */
+		branch->split = 0.0f;
+		branch->d = 0;
+		branch->left = kdtree_branches_layout(branches, r_totbranch, start, mid);
+		branch->right = kdtree_branches_layout(branches, r_totbranch, mid, end);
+	}
+
+	return branch_index;
+}
+
+static void kdtree_balance_branch(KDTree *tree, const uint branch_index, const uint start, const uint end);
+
+typedef struct KDTreeBalanceData {
+	KDTree *tree;
+	const KDTreeBranch *branch;
+	uint start, mid, end;
+} KDTreeBalanceData;
+
+static void kdtree_balance_branch_task_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	const KDTreeBalanceData *data = userdata;
+	if (i == 0) {
+		kdtree_balance_branch(data->tree, data->branch->left, data->start, data->mid);
+	}
+	else {
+		kdtree_balance_branch(data->tree, data->branch->right, data->mid, data->end);
+	}
+}
+
+/**
+ * Split the nodes of a branch on the median of its largest axis, then balance both children.
+ */
+static void kdtree_balance_branch(KDTree *tree, const uint branch_index, const uint start, const uint end)
+{
+	KDTreeBranch *branch = &tree->branches[branch_index];
+	KDTreeNode *nodes = tree->nodes + start;
+	const uint totnode = end - start;
+	float min[3], max[3], size[3];
+	uint i, axis, median;
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		return;
+	}
+
+	INIT_MINMAX(min, max);
+	for (i = 0; i < totnode; i++) {
+		minmax_v3v3_v3(min, max, nodes[i].co);
+	}
+	sub_v3_v3v3(size, max, min);
+	axis = (uint)max_axis_v3(size);
+
+	median = kdtree_nth_element(nodes, totnode, axis);
+	BLI_assert(start + median == start + (end - start) / 2);
+
+	branch->d = axis;
+	branch->split = nodes[median].co[axis];
 
-	return median + ofs;
+	if (totnode < KD_THREAD_NODE_THRESHOLD) {
+		kdtree_balance_branch(tree, branch->left, start, start + median);
+		kdtree_balance_branch(tree, branch->right, start + median, end);
+	}
+	else {
+		KDTreeBalanceData data = {
+			.tree = tree, .branch = branch,
+			.start = start, .mid = start + median, .end = end,
+		};
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		BLI_task_parallel_range(0, 2, &data, kdtree_balance_branch_task_cb, &settings);
+	}
 }
 
 void BLI_kdtree_balance(KDTree *tree)
 {
-	tree->root = kdtree_balance(tree->nodes, tree->totnode, 0, 0);
+	const uint totnode = tree->totnode;
+
+	MEM_SAFE_FREE(tree->branches);
+	MEM_SAFE_FREE(tree->co_soa);
+	tree->totbranch = 0;
+	tree->co_soa_stride = 0;
+
+	if (totnode != 0) {
+		/* Leaves hold at least (KD_LEAF_SIZE / 2) nodes, except for a single root leaf. */
+		const uint totbranch_max = 2 * (totnode / (KD_LEAF_SIZE / 2) + 1);
+		uint i;
+
+		tree->branches = MEM_mallocN(sizeof(*tree->branches) * totbranch_max, "KDTreeBranch");
+		kdtree_branches_layout(tree->branches, &tree->totbranch, 0, totnode);
+		BLI_assert(tree->totbranch <= totbranch_max);
+
+		kdtree_balance_branch(tree, 0, 0, totnode);
+
+		/* Leaves read up to 3 values past their last node. */
+		tree->co_soa_stride = (totnode + 3 + 3) & ~3u;
+		tree->co_soa = MEM_callocN(sizeof(float) * 3 * tree->co_soa_stride, "KDTree.co_soa");
+		for (i = 0; i < totnode; i++) {
+			tree->co_soa[i]                           = tree->nodes[i].co[0];
+			tree->co_soa[i + tree->co_soa_stride]     = tree->nodes[i].co[1];
+			tree->co_soa[i + tree->co_soa_stride * 2] = tree->nodes[i].co[2];
+		}
+	}
 
 #ifdef DEBUG
 	tree->is_balanced = true;
 #endif
 }
 
-static float squared_distance(const float v2[3], const float v1[3], const float n2[3])
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Queries
+ * \{ */
+
+/**
+ * Squared distances from \a co to every node of a leaf, in node order.
+ */
+static void kdtree_leaf_dist_sq(
+        const KDTree *tree, const KDTreeBranch *leaf, const float co[3],
+        float r_dist_sq[KD_LEAF_SIZE])
+{
+	const float *co_x = tree->co_soa + leaf->left;
+	const float *co_y = co_x + tree->co_soa_stride;
+	const float *co_z = co_y + tree->co_soa_stride;
+	const uint len = leaf->right - leaf->left;
+	uint i;
+
+#ifdef __SSE2__
+	const __m128 x = _mm_set1_ps(co[0]);
+	const __m128 y = _mm_set1_ps(co[1]);
+	const __m128 z = _mm_set1_ps(co[2]);
+
+	for (i = 0; i < len; i += 4) {
+		const __m128 dx = _mm_sub_ps(_mm_loadu_ps(co_x + i), x);
+		const __m128 dy = _mm_sub_ps(_mm_loadu_ps(co_y + i), y);
+		const __m128 dz = _mm_sub_ps(_mm_loadu_ps(co_z + i), z);
+		_mm_storeu_ps(
+		        r_dist_sq + i,
+		        _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+	}
+#else
+	for (i = 0; i < len; i++) {
+		const float dx = co_x[i] - co[0];
+		const float dy = co_y[i] - co[1];
+		const float dz = co_z[i] - co[2];
+		r_dist_sq[i] = dx * dx + dy * dy + dz * dz;
+	}
+#endif
+}
+
+/* Optionally weight the squared distance of nodes behind \a co (in the \a nor direction). */
+static float squared_distance_normal(const float dist_sq, const float co_node[3], const float co[3], const float nor[3])
 {
-	float d[3], dist;
+	float d[3];
 
-	d[0] = v2[0] - v1[0];
-	d[1] = v2[1] - v1[1];
-	d[2] = v2[2] - v1[2];
+	if (nor == NULL) {
+		return dist_sq;
+	}
 
-	dist = len_squared_v3(d);
+	sub_v3_v3v3(d, co_node, co);
 
 	/* can someone explain why this is done?*/
-	if (n2 && (dot_v3v3(d, n2) < 0.0f)) {
-		dist *= 10.0f;
+	if (dot_v3v3(d, nor) < 0.0f) {
+		return dist_sq * 10.0f;
 	}
 
-	return dist;
+	return dist_sq;
 }
 
-static uint *realloc_nodes(uint *stack, uint *totstack, const bool is_alloc)
+static void kdtree_find_nearest_recursive(
+        const KDTree *tree, const uint branch_index, const float co[3],
+        float *r_min_dist, const KDTreeNode **r_min_node)
 {
-	uint *stack_new = MEM_mallocN((*totstack + KD_NEAR_ALLOC_INC) * sizeof(uint), "KDTree.treestack");
-	memcpy(stack_new, stack, *totstack * sizeof(uint));
-	// memset(stack_new + *totstack, 0, sizeof(uint) * KD_NEAR_ALLOC_INC);
-	if (is_alloc)
-		MEM_freeN(stack);
-	*totstack += KD_NEAR_ALLOC_INC;
-	return stack_new;
+	const KDTreeBranch *branch = &tree->branches[branch_index];
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(tree, branch, co, dist_sq);
+		for (uint i = 0; i < len; i++) {
+			if (dist_sq[i] < *r_min_dist) {
+				*r_min_dist = dist_sq[i];
+				*r_min_node = &tree->nodes[branch->left + i];
+			}
+		}
+	}
+	else {
+		const float cur_dist = co[branch->d] - branch->split;
+		if (cur_dist < 0.0f) {
+			kdtree_find_nearest_recursive(tree, branch->left, co, r_min_dist, r_min_node);
+			if (cur_dist * cur_dist < *r_min_dist) {
+				kdtree_find_nearest_recursive(tree, branch->right, co, r_min_dist, r_min_node);
+			}
+		}
+		else {
+			kdtree_find_nearest_recursive(tree, branch->right, co, r_min_dist, r_min_node);
+			if (cur_dist * cur_dist < *r_min_dist) {
+				kdtree_find_nearest_recursive(tree, branch->left, co, r_min_dist, r_min_node);
+			}
+		}
+	}
 }
 
 /**
@@ -206,92 +403,141 @@ int BLI_kdtree_find_nearest(
         const KDTree *tree, const float co[3],
         KDTreeNearest *r_nearest)
 {
-	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *root, *min_node;
-	uint *stack, defaultstack[KD_STACK_INIT];
-	float min_dist, cur_dist;
-	uint totstack, cur = 0;
+	const KDTreeNode *min_node;
+	float min_dist;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(tree->root == KD_NODE_UNSET))
+	if (UNLIKELY(tree->totbranch == 0))
 		return -1;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
+	min_node = &tree->nodes[0];
+	min_dist = len_squared_v3v3(min_node->co, co);
 
-	root = &nodes[tree->root];
-	min_node = root;
-	min_dist = len_squared_v3v3(root->co, co);
+	kdtree_find_nearest_recursive(tree, 0, co, &min_dist, &min_node);
 
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
+	if (r_nearest) {
+		r_nearest->index = min_node->index;
+		r_nearest->dist = sqrtf(min_dist);
+		copy_v3_v3(r_nearest->co, min_node->co);
 	}
-	else {
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
+
+	return min_node->index;
+}
+
+/* Minimum number of queries handled by each thread in batched queries. */
+#define KD_BATCH_QUERIES_PER_THREAD 256
+
+typedef struct KDTreeNearestBatchData {
+	const KDTree *tree;
+	const float (*co)[3];
+	KDTreeNearest *nearest;
+	const int *order;
+} KDTreeNearestBatchData;
+
+static void kdtree_find_nearest_batch_cb(
+        void *__restrict userdata,
+        const int iter,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	KDTreeNearestBatchData *data = userdata;
+	const int i = data->order[iter];
+	if (BLI_kdtree_find_nearest(data->tree, data->co[i], &data->nearest[i]) == -1) {
+		data->nearest[i].index = -1;
+	}
+}
+
+/**
+ * Find the nearest point of many coordinates at once,
+ * \a r_nearest items are set as by #BLI_kdtree_find_nearest (index is -1 when the tree is empty).
+ *
+ * Queries are ordered spatially and run in parallel.
+ */
+void BLI_kdtree_find_nearest_batch(
+        const KDTree *tree, const float (*co)[3], const int co_len,
+        KDTreeNearest *r_nearest, const bool use_threading)
+{
+	KDTreeNearestBatchData data;
+	int *order;
+
+	if (co_len <= 0) {
+		return;
 	}
-	
-	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
 
-		cur_dist = node->co[node->d] - co[node->d];
+	order = MEM_mallocN(sizeof(*order) * (size_t)co_len, __func__);
+	BLI_sortutil_order_spatial_v3(co, co_len, order);
 
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
+	data.tree = tree;
+	data.co = co;
+	data.nearest = r_nearest;
+	data.order = order;
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading;
+	settings.min_iter_per_thread = KD_BATCH_QUERIES_PER_THREAD;
+	BLI_task_parallel_range(0, co_len, &data, kdtree_find_nearest_batch_cb, &settings);
+
+	MEM_freeN(order);
+}
 
-			if (-cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
-				}
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
-			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			cur_dist = cur_dist * cur_dist;
 
-			if (cur_dist < min_dist) {
-				cur_dist = len_squared_v3v3(node->co, co);
-				if (cur_dist < min_dist) {
-					min_dist = cur_dist;
-					min_node = node;
+struct FindNearestCbParams {
+	const KDTree *tree;
+	const float *co;
+	int (*filter_cb)(void *user_data, int index, const float co[3], float dist_sq);
+	void *user_data;
+
+	float min_dist;
+	const KDTreeNode *min_node;
+};
+
+/* Returns false for an immediate exit. */
+static bool kdtree_find_nearest_cb_recursive(struct FindNearestCbParams *p, const uint branch_index)
+{
+	const KDTreeBranch *branch = &p->tree->branches[branch_index];
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(p->tree, branch, p->co, dist_sq);
+		for (uint i = 0; i < len; i++) {
+			if (dist_sq[i] < p->min_dist) {
+				const KDTreeNode *node = &p->tree->nodes[branch->left + i];
+				const int result = p->filter_cb(p->user_data, node->index, node->co, dist_sq[i]);
+				if (result == 1) {
+					p->min_dist = dist_sq[i];
+					p->min_node = node;
+				}
+				else if (result == 0) {
+					/* pass */
+				}
+				else {
+					BLI_assert(result == -1);
+					return false;
 				}
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
 			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
 		}
 	}
-
-	if (r_nearest) {
-		r_nearest->index = min_node->index;
-		r_nearest->dist = sqrtf(min_dist);
-		copy_v3_v3(r_nearest->co, min_node->co);
+	else {
+		const float cur_dist = p->co[branch->d] - branch->split;
+		const uint near = (cur_dist < 0.0f) ? branch->left : branch->right;
+		const uint far = (cur_dist < 0.0f) ? branch->right : branch->left;
+		if (!kdtree_find_nearest_cb_recursive(p, near)) {
+			return false;
+		}
+		if (cur_dist * cur_dist < p->min_dist) {
+			if (!kdtree_find_nearest_cb_recursive(p, far)) {
+				return false;
+			}
+		}
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
-	return min_node->index;
+	return true;
 }
 
-
 /**
  * A version of #BLI_kdtree_find_nearest which runs a callback
  * to filter out values.
@@ -304,93 +550,32 @@ int BLI_kdtree_find_nearest_cb(
         int (*filter_cb)(void *user_data, int index, const float co[3], float dist_sq), void *user_data,
         KDTreeNearest *r_nearest)
 {
-	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *min_node = NULL;
-
-	uint *stack, defaultstack[KD_STACK_INIT];
-	float min_dist = FLT_MAX, cur_dist;
-	uint totstack, cur = 0;
+	struct FindNearestCbParams p = {
+		.tree = tree,
+		.co = co,
+		.filter_cb = filter_cb,
+		.user_data = user_data,
+		.min_dist = FLT_MAX,
+		.min_node = NULL,
+	};
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(tree->root == KD_NODE_UNSET))
+	if (UNLIKELY(tree->totbranch == 0))
 		return -1;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-#define NODE_TEST_NEAREST(node) \
-{ \
-	const float dist_sq = len_squared_v3v3((node)->co, co); \
-	if (dist_sq < min_dist) { \
-		const int result = filter_cb(user_data, (node)->index, (node)->co, dist_sq); \
-		if (result == 1) { \
-			min_dist = dist_sq; \
-			min_node = node; \
-		} \
-		else if (result == 0) { \
-			/* pass */ \
-		} \
-		else { \
-			BLI_assert(result == -1); \
-			goto finally; \
-		} \
-	} \
-} ((void)0)
-
-	stack[cur++] = tree->root;
-
-	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		cur_dist = node->co[node->d] - co[node->d];
-
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
-
-			if (-cur_dist < min_dist) {
-				NODE_TEST_NEAREST(node);
-
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
-			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (cur_dist < min_dist) {
-				NODE_TEST_NEAREST(node);
-
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
-			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
-	}
+	kdtree_find_nearest_cb_recursive(&p, 0);
 
-#undef NODE_TEST_NEAREST
-
-
-finally:
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
-	if (min_node) {
+	if (p.min_node) {
 		if (r_nearest) {
-			r_nearest->index = min_node->index;
-			r_nearest->dist = sqrtf(min_dist);
-			copy_v3_v3(r_nearest->co, min_node->co);
+			r_nearest->index = p.min_node->index;
+			r_nearest->dist = sqrtf(p.min_dist);
+			copy_v3_v3(r_nearest->co, p.min_node->co);
 		}
 
-		return min_node->index;
+		return p.min_node->index;
 	}
 	else {
 		return -1;
@@ -416,6 +601,43 @@ static void add_nearest(KDTreeNearest *ptn, uint *found, uint n, int index,
 	copy_v3_v3(ptn[i].co, co);
 }
 
+struct FindNearestNParams {
+	const KDTree *tree;
+	const float *co;
+	const float *nor;
+	KDTreeNearest *nearest;
+	uint n;
+
+	uint found;
+};
+
+static void kdtree_find_nearest_n_recursive(struct FindNearestNParams *p, const uint branch_index)
+{
+	const KDTreeBranch *branch = &p->tree->branches[branch_index];
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(p->tree, branch, p->co, dist_sq);
+		for (uint i = 0; i < len; i++) {
+			const KDTreeNode *node = &p->tree->nodes[branch->left + i];
+			const float cur_dist = squared_distance_normal(dist_sq[i], node->co, p->co, p->nor);
+			if (p->found < p->n || cur_dist < p->nearest[p->found - 1].dist) {
+				add_nearest(p->nearest, &p->found, p->n, node->index, cur_dist, node->co);
+			}
+		}
+	}
+	else {
+		const float cur_dist = p->co[branch->d] - branch->split;
+		const uint near = (cur_dist < 0.0f) ? branch->left : branch->right;
+		const uint far = (cur_dist < 0.0f) ? branch->right : branch->left;
+		kdtree_find_nearest_n_recursive(p, near);
+		if (p->found < p->n || cur_dist * cur_dist < p->nearest[p->found - 1].dist) {
+			kdtree_find_nearest_n_recursive(p, far);
+		}
+	}
+}
+
 /**
  * Find n nearest returns number of points found, with results in nearest.
  * Normal is optional, but if given will limit results to points in normal direction from co.
@@ -427,87 +649,29 @@ int BLI_kdtree_find_nearest_n__normal(
         KDTreeNearest r_nearest[],
         uint n)
 {
-	const KDTreeNode *nodes = tree->nodes;
-	const KDTreeNode *root;
-	uint *stack, defaultstack[KD_STACK_INIT];
-	float cur_dist;
-	uint totstack, cur = 0;
-	uint i, found = 0;
+	struct FindNearestNParams p = {
+		.tree = tree,
+		.co = co,
+		.nor = nor,
+		.nearest = r_nearest,
+		.n = n,
+		.found = 0,
+	};
+	uint i;
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY((tree->root == KD_NODE_UNSET) || n == 0))
+	if (UNLIKELY((tree->totbranch == 0) || n == 0))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-	root = &nodes[tree->root];
-
-	cur_dist = squared_distance(root->co, co, nor);
-	add_nearest(r_nearest, &found, n, root->index, cur_dist, root->co);
-	
-	if (co[root->d] < root->co[root->d]) {
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-	}
-	else {
-		if (root->left != KD_NODE_UNSET)
-			stack[cur++] = root->left;
-		if (root->right != KD_NODE_UNSET)
-			stack[cur++] = root->right;
-	}
-
-	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		cur_dist = node->co[node->d] - co[node->d];
-
-		if (cur_dist < 0.0f) {
-			cur_dist = -cur_dist * cur_dist;
-
-			if (found < n || -cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
-
-				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
+	kdtree_find_nearest_n_recursive(&p, 0);
 
-				if (node->left != KD_NODE_UNSET)
-					stack[cur++] = node->left;
-			}
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			cur_dist = cur_dist * cur_dist;
-
-			if (found < n || cur_dist < r_nearest[found - 1].dist) {
-				cur_dist = squared_distance(node->co, co, nor);
-				if (found < n || cur_dist < r_nearest[found - 1].dist)
-					add_nearest(r_nearest, &found, n, node->index, cur_dist, node->co);
-
-				if (node->right != KD_NODE_UNSET)
-					stack[cur++] = node->right;
-			}
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
-	}
-
-	for (i = 0; i < found; i++)
+	for (i = 0; i < p.found; i++)
 		r_nearest[i].dist = sqrtf(r_nearest[i].dist);
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
-	return (int)found;
+	return (int)p.found;
 }
 
 static int range_compare(const void *a, const void *b)
@@ -533,7 +697,7 @@ static void add_in_range(
 	if (UNLIKELY(found >= *r_foundstack_tot_alloc)) {
 		*r_foundstack = MEM_reallocN_id(
 		        *r_foundstack,
-		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNode),
+		        (*r_foundstack_tot_alloc += KD_FOUND_ALLOC_INC) * sizeof(KDTreeNearest),
 		        __func__);
 	}
 
@@ -544,6 +708,44 @@ static void add_in_range(
 	copy_v3_v3(to->co, co);
 }
 
+struct RangeSearchParams {
+	const KDTree *tree;
+	const float *co;
+	const float *nor;
+	float range;
+	float range_sq;
+
+	KDTreeNearest *foundstack;
+	uint totfoundstack;
+	uint found;
+};
+
+static void kdtree_range_search_recursive(struct RangeSearchParams *p, const uint branch_index)
+{
+	const KDTreeBranch *branch = &p->tree->branches[branch_index];
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(p->tree, branch, p->co, dist_sq);
+		for (uint i = 0; i < len; i++) {
+			const KDTreeNode *node = &p->tree->nodes[branch->left + i];
+			const float cur_dist = squared_distance_normal(dist_sq[i], node->co, p->co, p->nor);
+			if (cur_dist <= p->range_sq) {
+				add_in_range(&p->foundstack, &p->totfoundstack, p->found++, node->index, cur_dist, node->co);
+			}
+		}
+	}
+	else {
+		if (p->co[branch->d] + p->range >= branch->split) {
+			kdtree_range_search_recursive(p, branch->right);
+		}
+		if (p->co[branch->d] - p->range <= branch->split) {
+			kdtree_range_search_recursive(p, branch->left);
+		}
+	}
+}
+
 /**
  * Range search returns number of points found, with results in nearest
  * Normal is optional, but if given will limit results to points in normal direction from co.
@@ -553,61 +755,75 @@ int BLI_kdtree_range_search__normal(
         const KDTree *tree, const float co[3], const float nor[3],
         KDTreeNearest **r_nearest, float range)
 {
-	const KDTreeNode *nodes = tree->nodes;
-	uint *stack, defaultstack[KD_STACK_INIT];
-	KDTreeNearest *foundstack = NULL;
-	float range_sq = range * range, dist_sq;
-	uint totstack, cur = 0, found = 0, totfoundstack = 0;
+	struct RangeSearchParams p = {
+		.tree = tree,
+		.co = co,
+		.nor = nor,
+		.range = range,
+		.range_sq = range * range,
+		.foundstack = NULL,
+		.totfoundstack = 0,
+		.found = 0,
+	};
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(tree->root == KD_NODE_UNSET))
+	if (UNLIKELY(tree->totbranch == 0))
 		return 0;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
+	kdtree_range_search_recursive(&p, 0);
 
-	stack[cur++] = tree->root;
+	if (p.found)
+		qsort(p.foundstack, p.found, sizeof(KDTreeNearest), range_compare);
 
-	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
+	*r_nearest = p.foundstack;
 
-		if (co[node->d] + range < node->co[node->d]) {
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		else if (co[node->d] - range > node->co[node->d]) {
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
+	return (int)p.found;
+}
+
+struct RangeSearchCbParams {
+	const KDTree *tree;
+	const float *co;
+	float range;
+	float range_sq;
+	bool (*search_cb)(void *user_data, int index, const float co[3], float dist_sq);
+	void *user_data;
+};
+
+/* Returns false for an early exit. */
+static bool kdtree_range_search_cb_recursive(const struct RangeSearchCbParams *p, const uint branch_index)
+{
+	const KDTreeBranch *branch = &p->tree->branches[branch_index];
+
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(p->tree, branch, p->co, dist_sq);
+		for (uint i = 0; i < len; i++) {
+			if (dist_sq[i] <= p->range_sq) {
+				const KDTreeNode *node = &p->tree->nodes[branch->left + i];
+				if (p->search_cb(p->user_data, node->index, node->co, dist_sq[i]) == false) {
+					return false;
+				}
+			}
 		}
-		else {
-			dist_sq = squared_distance(node->co, co, nor);
-			if (dist_sq <= range_sq) {
-				add_in_range(&foundstack, &totfoundstack, found++, node->index, dist_sq, node->co);
+	}
+	else {
+		if (p->co[branch->d] + p->range >= branch->split) {
+			if (!kdtree_range_search_cb_recursive(p, branch->right)) {
+				return false;
 			}
-
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
 		}
-
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
+		if (p->co[branch->d] - p->range <= branch->split) {
+			if (!kdtree_range_search_cb_recursive(p, branch->left)) {
+				return false;
+			}
 		}
 	}
 
-	if (stack != defaultstack)
-		MEM_freeN(stack);
-
-	if (found)
-		qsort(foundstack, found, sizeof(KDTreeNearest), range_compare);
-
-	*r_nearest = foundstack;
-
-	return (int)found;
+	return true;
 }
 
 /**
@@ -622,59 +838,27 @@ void BLI_kdtree_range_search_cb(
         const KDTree *tree, const float co[3], float range,
         bool (*search_cb)(void *user_data, int index, const float co[3], float dist_sq), void *user_data)
 {
-	const KDTreeNode *nodes = tree->nodes;
-
-	uint *stack, defaultstack[KD_STACK_INIT];
-	float range_sq = range * range, dist_sq;
-	uint totstack, cur = 0;
+	const struct RangeSearchCbParams p = {
+		.tree = tree,
+		.co = co,
+		.range = range,
+		.range_sq = range * range,
+		.search_cb = search_cb,
+		.user_data = user_data,
+	};
 
 #ifdef DEBUG
 	BLI_assert(tree->is_balanced == true);
 #endif
 
-	if (UNLIKELY(tree->root == KD_NODE_UNSET))
+	if (UNLIKELY(tree->totbranch == 0))
 		return;
 
-	stack = defaultstack;
-	totstack = KD_STACK_INIT;
-
-	stack[cur++] = tree->root;
-
-	while (cur--) {
-		const KDTreeNode *node = &nodes[stack[cur]];
-
-		if (co[node->d] + range < node->co[node->d]) {
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-		}
-		else if (co[node->d] - range > node->co[node->d]) {
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-		else {
-			dist_sq = len_squared_v3v3(node->co, co);
-			if (dist_sq <= range_sq) {
-				if (search_cb(user_data, node->index, node->co, dist_sq) == false) {
-					goto finally;
-				}
-			}
-
-			if (node->left != KD_NODE_UNSET)
-				stack[cur++] = node->left;
-			if (node->right != KD_NODE_UNSET)
-				stack[cur++] = node->right;
-		}
-
-		if (UNLIKELY(cur + 3 > totstack)) {
-			stack = realloc_nodes(stack, &totstack, defaultstack != stack);
-		}
-	}
-
-finally:
-	if (stack != defaultstack)
-		MEM_freeN(stack);
+	kdtree_range_search_cb_recursive(&p, 0);
 }
 
+/** \} */
+
 /**
  * Use when we want to loop over nodes ordered by index.
  * Requires indices to be aligned with nodes.
@@ -695,7 +879,7 @@ static uint *kdtree_order(const KDTree *tree)
 
 struct DeDuplicateParams {
 	/* Static */
-	const KDTreeNode *nodes;
+	const KDTree *tree;
 	float range;
 	float range_sq;
 	int *duplicates;
@@ -708,33 +892,30 @@ struct DeDuplicateParams {
 
 static void deduplicate_recursive(const struct DeDuplicateParams *p, uint i)
 {
-	const KDTreeNode *node = &p->nodes[i];
-	if (p->search_co[node->d] + p->range <= node->co[node->d]) {
-		if (node->left != KD_NODE_UNSET) {
-			deduplicate_recursive(p, node->left);
-		}
-	}
-	else if (p->search_co[node->d] - p->range >= node->co[node->d]) {
-		if (node->right != KD_NODE_UNSET) {
-			deduplicate_recursive(p, node->right);
+	const KDTreeBranch *branch = &p->tree->branches[i];
+	if (branch->d == KD_BRANCH_LEAF) {
+		float dist_sq[KD_LEAF_SIZE];
+		const uint len = branch->right - branch->left;
+		kdtree_leaf_dist_sq(p->tree, branch, p->search_co, dist_sq);
+		for (uint j = 0; j < len; j++) {
+			const KDTreeNode *node = &p->tree->nodes[branch->left + j];
+			if ((p->search != node->index) && (p->duplicates[node->index] == -1)) {
+				if (dist_sq[j] <= p->range_sq) {
+					p->duplicates[node->index] = (int)p->search;
+					*p->duplicates_found += 1;
+				}
+			}
 		}
 	}
 	else {
-		if ((p->search != node->index) && (p->duplicates[node->index] == -1)) {
-			if (compare_len_squared_v3v3(node->co, p->search_co, p->range_sq)) {
-				p->duplicates[node->index] = (int)p->search;
-				*p->duplicates_found += 1;
-			}
-		}
-		if (node->left != KD_NODE_UNSET) {
-			deduplicate_recursive(p, node->left);
+		if (p->search_co[branch->d] - p->range <= branch->split) {
+			deduplicate_recursive(p, branch->left);
 		}
-		if (node->right != KD_NODE_UNSET) {
-			deduplicate_recursive(p, node->right);
+		if (p->search_co[branch->d] + p->range >= branch->split) {
+			deduplicate_recursive(p, branch->right);
 		}
 	}
 }
-
 /**
  * Find duplicate points in \a range.
  * Favors speed over quality since it doesn't find the best target vertex for merging.
@@ -759,13 +940,17 @@ int BLI_kdtree_calc_duplicates_fast(
 {
 	int found = 0;
 	struct DeDuplicateParams p = {
-		.nodes = tree->nodes,
+		.tree = tree,
 		.range = range,
 		.range_sq = range * range,
 		.duplicates = duplicates,
 		.duplicates_found = &found,
 	};
 
+	if (UNLIKELY(tree->totbranch == 0)) {
+		return found;
+	}
+
 	if (use_index_order) {
 		uint *order = kdtree_order(tree);
 		for (uint i = 0; i < tree->totnode; i++) {
@@ -774,7 +959,7 @@ int BLI_kdtree_calc_duplicates_fast(
 			if (ELEM(duplicates[index], -1, index)) {
 				p.search = index;
 				copy_v3_v3(p.search_co, tree->nodes[node_index].co);
-				deduplicate_recursive(&p, tree->root);
+				deduplicate_recursive(&p, 0);
 			}
 		}
 		MEM_freeN(order);
@@ -782,11 +967,11 @@ int BLI_kdtree_calc_duplicates_fast(
 	else {
 		for (uint i = 0; i < tree->totnode; i++) {
 			const uint node_index = i;
-			const int index = p.nodes[node_index].index;
+			const int index = tree->nodes[node_index].index;
 			if (ELEM(duplicates[index], -1, index)) {
 				p.search = index;
 				copy_v3_v3(p.search_co, tree->nodes[node_index].co);
-				deduplicate_recursive(&p, tree->root);
+				deduplicate_recursive(&p, 0);
 			}
 		}
 	}
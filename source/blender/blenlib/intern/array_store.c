@@ -112,6 +112,7 @@
 
 #include "BLI_listbase.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 
 #include "BLI_strict_flags.h"
 
@@ -161,6 +162,13 @@
  * so 4 -> 7, 5 -> 10, 6 -> 15... etc.
  */
 #  define BCHUNK_HASH_TABLE_ACCUMULATE_STEPS 4
+
+/* Hash arrays larger than this (in items) in parallel, split into blocks of this size. */
+#  ifdef DEBUG
+#    define BCHUNK_HASH_THREAD_BLOCK_LEN ((size_t)64)
+#  else
+#    define BCHUNK_HASH_THREAD_BLOCK_LEN ((size_t)65536)
+#  endif
 #else
 /* How many items to hash (multiplied by stride)
  */
@@ -845,6 +853,79 @@ static void hash_accum(hash_key *hash_array, const size_t hash_array_len, size_t
 	}
 }
 
+typedef struct HashArrayAccumData {
+	const BArrayInfo *info;
+	const uchar *data;
+	hash_key *hash_array;
+	size_t hash_array_len;
+} HashArrayAccumData;
+
+/**
+ * Hash and accumulate a block of the array, reading ahead into the following items
+ * so the result matches #hash_accum on the whole array.
+ */
+static void hash_array_from_data_accum_block_cb(
+        void *__restrict userdata,
+        const int block_index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	const HashArrayAccumData *data = userdata;
+	const BArrayInfo *info = data->info;
+	const size_t iter_steps = info->accum_steps;
+	/* Only items before this are accumulated (see #hash_accum). */
+	const size_t hash_array_search_len = data->hash_array_len - iter_steps;
+
+	const size_t block_start = (size_t)block_index * BCHUNK_HASH_THREAD_BLOCK_LEN;
+	const size_t block_len = MIN2(BCHUNK_HASH_THREAD_BLOCK_LEN, data->hash_array_len - block_start);
+	/* Items this block reads from its neighbor, a triangle number. */
+	const size_t read_ahead_len = MIN2(
+	        info->accum_read_ahead_len - 1, data->hash_array_len - (block_start + block_len));
+	const size_t hash_store_len = block_len + read_ahead_len;
+	const size_t search_len = (block_start < hash_array_search_len) ? hash_array_search_len - block_start : 0;
+
+	hash_key *hash_store = MEM_mallocN(sizeof(*hash_store) * hash_store_len, __func__);
+	hash_array_from_data(
+	        info, &data->data[block_start * info->chunk_stride], hash_store_len * info->chunk_stride, hash_store);
+
+	for (size_t step = iter_steps; step != 0; step--) {
+		const size_t hash_offset = step;
+		const size_t len = MIN2(search_len, hash_store_len - hash_offset);
+		for (size_t i = 0; i < len; i++) {
+			hash_store[i] += (hash_store[i + hash_offset]) * ((hash_store[i] & 0xff) + 1);
+		}
+	}
+
+	memcpy(&data->hash_array[block_start], hash_store, sizeof(*hash_store) * block_len);
+	MEM_freeN(hash_store);
+}
+
+/**
+ * Same as #hash_array_from_data followed by #hash_accum, multi-threaded for large arrays.
+ */
+static void hash_array_from_data_accum(
+        const BArrayInfo *info, const uchar *data_slice, const size_t data_slice_len,
+        hash_key *hash_array)
+{
+	const size_t hash_array_len = data_slice_len / info->chunk_stride;
+
+	if ((hash_array_len <= BCHUNK_HASH_THREAD_BLOCK_LEN) || (info->accum_steps >= hash_array_len)) {
+		hash_array_from_data(info, data_slice, data_slice_len, hash_array);
+		hash_accum(hash_array, hash_array_len, info->accum_steps);
+	}
+	else {
+		HashArrayAccumData data = {
+			.info = info,
+			.data = data_slice,
+			.hash_array = hash_array,
+			.hash_array_len = hash_array_len,
+		};
+		const size_t block_num = (hash_array_len + (BCHUNK_HASH_THREAD_BLOCK_LEN - 1)) / BCHUNK_HASH_THREAD_BLOCK_LEN;
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		BLI_task_parallel_range(0, (int)block_num, &data, hash_array_from_data_accum_block_cb, &settings);
+	}
+}
+
 /**
  * When we only need a single value, can use a small optimization.
  * we can avoid accumulating the tail of the array a little, each iteration.
@@ -1207,9 +1288,7 @@ static BChunkList *bchunk_list_from_data_merge(
 		size_t i_table_start = i_prev;
 		const size_t table_hash_array_len = (data_len - i_prev) / info->chunk_stride;
 		hash_key  *table_hash_array = MEM_mallocN(sizeof(*table_hash_array) * table_hash_array_len, __func__);
-		hash_array_from_data(info, &data[i_prev], data_len - i_prev, table_hash_array);
-
-		hash_accum(table_hash_array, table_hash_array_len, info->accum_steps);
+		hash_array_from_data_accum(info, &data[i_prev], data_len - i_prev, table_hash_array);
 #else
 		/* dummy vars */
 		uint i_table_start = 0;
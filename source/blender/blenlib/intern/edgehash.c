@@ -39,8 +39,11 @@
 #include "BLI_utildefines.h"
 #include "BLI_edgehash.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 #include "BLI_strict_flags.h"
 
+#include "atomic_ops.h"
+
 /**************inlined code************/
 static const uint _ehash_hashsizes[] = {
 	1, 3, 5, 11, 17, 37, 67, 131, 257, 521, 1031, 2053, 4099, 8209,
@@ -789,6 +792,207 @@ void BLI_edgeset_flag_clear(EdgeSet *es, uint flag)
 
 /** \} */
 
+/* -------------------------------------------------------------------- */
+/* Edge De-Duplication */
+
+/** \name Edge De-Duplication
+ *
+ * Bulk alternative to an #EdgeHash when all edges are known up-front.
+ * Edges are bucketed by their lowest vertex (a counting sort),
+ * each bucket is then sorted & de-duplicated on its own.
+ * All steps run in parallel for large arrays.
+ * \{ */
+
+#ifdef DEBUG
+#  define EDGE_DEDUP_THREAD_MIN 64
+#else
+#  define EDGE_DEDUP_THREAD_MIN 10000
+#endif
+
+/* Buckets larger than this are sorted with qsort, otherwise an insertion sort is used. */
+#define EDGE_DEDUP_BUCKET_SORT_MIN 16
+
+typedef struct EdgeDedupItem {
+	uint v_high;
+	uint index;
+} EdgeDedupItem;
+
+typedef struct EdgeDedupData {
+	const uint (*edges)[2];
+	/* Start of the items for each (lowest) vertex, verts_len + 1 items. */
+	uint *vert_offs;
+	uint *vert_cursor;
+	EdgeDedupItem *items;
+	uint *edge_map;
+	uint *edge_first;
+	uint *edge_uid;
+} EdgeDedupData;
+
+BLI_INLINE bool edge_dedup_item_lt(const EdgeDedupItem *a, const EdgeDedupItem *b)
+{
+	return (a->v_high < b->v_high) || ((a->v_high == b->v_high) && (a->index < b->index));
+}
+
+static int edge_dedup_item_cmp(const void *a_v, const void *b_v)
+{
+	const EdgeDedupItem *a = a_v, *b = b_v;
+	if (edge_dedup_item_lt(a, b)) {
+		return -1;
+	}
+	else if (edge_dedup_item_lt(b, a)) {
+		return 1;
+	}
+	return 0;
+}
+
+static void edge_dedup_count_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EdgeDedupData *data = userdata;
+	const uint *e = data->edges[i];
+	atomic_add_and_fetch_uint32(&data->vert_offs[MIN2(e[0], e[1])], 1);
+}
+
+static void edge_dedup_scatter_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EdgeDedupData *data = userdata;
+	uint v_low = data->edges[i][0], v_high = data->edges[i][1];
+	EDGE_ORD(v_low, v_high);
+	const uint item_index = atomic_fetch_and_add_uint32(&data->vert_cursor[v_low], 1);
+	data->items[item_index].v_high = v_high;
+	data->items[item_index].index = (uint)i;
+}
+
+/**
+ * Sort the edges sharing a lowest vertex, the first (lowest index) edge of each run
+ * of equal edges is the one all others map to.
+ */
+static void edge_dedup_bucket_cb(
+        void *__restrict userdata,
+        const int v,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EdgeDedupData *data = userdata;
+	EdgeDedupItem *items = &data->items[data->vert_offs[v]];
+	const uint items_len = data->vert_offs[v + 1] - data->vert_offs[v];
+
+	if (items_len > EDGE_DEDUP_BUCKET_SORT_MIN) {
+		qsort(items, items_len, sizeof(*items), edge_dedup_item_cmp);
+	}
+	else {
+		for (uint i = 1; i < items_len; i++) {
+			const EdgeDedupItem item = items[i];
+			uint j = i;
+			for (; j != 0 && edge_dedup_item_lt(&item, &items[j - 1]); j--) {
+				items[j] = items[j - 1];
+			}
+			items[j] = item;
+		}
+	}
+
+	for (uint i = 0; i < items_len; ) {
+		const uint index_first = items[i].index;
+		const uint v_high = items[i].v_high;
+		do {
+			data->edge_map[items[i].index] = index_first;
+		} while ((++i < items_len) && (items[i].v_high == v_high));
+	}
+}
+
+static void edge_dedup_uid_init_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EdgeDedupData *data = userdata;
+	data->edge_uid[i] = (data->edge_map[i] == (uint)i) ? 1 : 0;
+}
+
+static void edge_dedup_map_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	EdgeDedupData *data = userdata;
+	const uint index_first = data->edge_map[i];
+	if (index_first == (uint)i) {
+		data->edge_first[data->edge_uid[i]] = (uint)i;
+	}
+	data->edge_map[i] = data->edge_uid[index_first];
+}
+
+/**
+ * Find the unique edges of an array, without regard to the order of their vertices.
+ *
+ * Unique edges are numbered in the order of their first occurrence in \a edges,
+ * so the result doesn't depend on threading.
+ *
+ * \param verts_len: All vertex indices must be lower than this.
+ * \param r_edge_map: Unique edge index for each edge, \a edges_len items.
+ * \param r_edge_first: Index in \a edges of each unique edge, must be able to hold \a edges_len items.
+ * \return The number of unique edges.
+ */
+uint BLI_edges_dedup(
+        const uint (*edges)[2], const uint edges_len, const uint verts_len,
+        uint *r_edge_map, uint *r_edge_first, const bool use_threading)
+{
+	if (edges_len == 0) {
+		return 0;
+	}
+
+	BLI_assert(edges_len <= INT_MAX && verts_len < INT_MAX);
+
+	EdgeDedupData data = {
+		.edges = edges,
+		.vert_offs = MEM_callocN(sizeof(*data.vert_offs) * (verts_len + 1), __func__),
+		.vert_cursor = MEM_mallocN(sizeof(*data.vert_cursor) * verts_len, __func__),
+		.items = MEM_mallocN(sizeof(*data.items) * edges_len, __func__),
+		.edge_map = r_edge_map,
+		.edge_first = r_edge_first,
+		.edge_uid = MEM_mallocN(sizeof(*data.edge_uid) * edges_len, __func__),
+	};
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading && (edges_len > EDGE_DEDUP_THREAD_MIN);
+	settings.min_iter_per_thread = EDGE_DEDUP_THREAD_MIN;
+
+#ifndef NDEBUG
+	for (uint i = 0; i < edges_len; i++) {
+		BLI_assert(edges[i][0] < verts_len && edges[i][1] < verts_len);
+	}
+#endif
+
+	/* Bucket the edges by their lowest vertex. */
+	BLI_task_parallel_range(0, (int)edges_len, &data, edge_dedup_count_cb, &settings);
+	BLI_task_parallel_scan_u(data.vert_offs, data.vert_offs, (int)verts_len + 1, false, settings.use_threading);
+	memcpy(data.vert_cursor, data.vert_offs, sizeof(*data.vert_cursor) * verts_len);
+	BLI_task_parallel_range(0, (int)edges_len, &data, edge_dedup_scatter_cb, &settings);
+
+	/* Map each edge to the first of its duplicates. */
+	BLI_task_parallel_range(0, (int)verts_len, &data, edge_dedup_bucket_cb, &settings);
+
+	/* Number the first edges in order, then map all edges to these numbers. */
+	BLI_task_parallel_range(0, (int)edges_len, &data, edge_dedup_uid_init_cb, &settings);
+	const uint unique_len = BLI_task_parallel_scan_u(
+	        data.edge_uid, data.edge_uid, (int)edges_len, false, settings.use_threading);
+	BLI_task_parallel_range(0, (int)edges_len, &data, edge_dedup_map_cb, &settings);
+
+	MEM_freeN(data.vert_offs);
+	MEM_freeN(data.vert_cursor);
+	MEM_freeN(data.items);
+	MEM_freeN(data.edge_uid);
+
+	return unique_len;
+}
+
+/** \} */
+
 /** \name Debugging & Introspection
  * \{ */
 #ifdef DEBUG
@@ -27,6 +27,14 @@
  * Utility functions for sorting common types.
  */
 
+#include <stdlib.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_utildefines.h"
+#include "BLI_math_base.h"
+#include "BLI_math_vector.h"
+
 #include "BLI_sort_utils.h"  /* own include */
 
 struct SortAnyByFloat {
@@ -72,3 +80,81 @@ int BLI_sortutil_cmp_int_reverse(const void *a_, const void *b_)
 	else if (a->sort_value > b->sort_value) return -1;
 	else                                    return  0;
 }
+
+/* -------------------------------------------------------------------- */
+/** \name Spatial Order
+ * \{ */
+
+struct SortIntByUInt {
+	unsigned int sort_value;
+	int data;
+};
+
+static int sortutil_cmp_uint(const void *a_, const void *b_)
+{
+	const struct SortIntByUInt *a = a_;
+	const struct SortIntByUInt *b = b_;
+	if      (a->sort_value > b->sort_value) return  1;
+	else if (a->sort_value < b->sort_value) return -1;
+	else                                    return  0;
+}
+
+/* Spread the 10 low bits of \a v so there are two zero bits between each. */
+static unsigned int morton_expand_bits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+/**
+ * Fill \a r_order with the indices of \a co, ordered along a Z-order curve
+ * over the bounds of all points, so items next to each other in \a r_order are
+ * (mostly) close in space.
+ *
+ * Used to run batches of spatial queries coherently.
+ */
+void BLI_sortutil_order_spatial_v3(const float (*co)[3], const int co_len, int *r_order)
+{
+	struct SortIntByUInt *keys;
+	float min[3], max[3], scale[3];
+	int i, j;
+
+	if (co_len <= 0) {
+		return;
+	}
+
+	INIT_MINMAX(min, max);
+	for (i = 0; i < co_len; i++) {
+		minmax_v3v3_v3(min, max, co[i]);
+	}
+	for (j = 0; j < 3; j++) {
+		const float size = max[j] - min[j];
+		scale[j] = (size > 0.0f) ? 1023.0f / size : 0.0f;
+	}
+
+	keys = MEM_mallocN(sizeof(*keys) * (size_t)co_len, __func__);
+	for (i = 0; i < co_len; i++) {
+		unsigned int key = 0;
+		for (j = 0; j < 3; j++) {
+			const float f = (co[i][j] - min[j]) * scale[j];
+			/* Also handles NaN (goes first). */
+			const unsigned int q = (f > 0.0f) ? (unsigned int)min_ff(f, 1023.0f) : 0;
+			key |= morton_expand_bits(q) << j;
+		}
+		keys[i].sort_value = key;
+		keys[i].data = i;
+	}
+
+	qsort(keys, (size_t)co_len, sizeof(*keys), sortutil_cmp_uint);
+
+	for (i = 0; i < co_len; i++) {
+		r_order[i] = keys[i].data;
+	}
+
+	MEM_freeN(keys);
+}
+
+/** \} */
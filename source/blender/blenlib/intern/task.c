@@ -22,6 +22,11 @@
  *  \ingroup bli
  *
  * A generic task system which can be used for any task based subsystem.
+ *
+ * Each thread of the scheduler (including the main thread) owns a queue of tasks, tasks pushed
+ * from a known thread go to its queue, from which it runs them most recent first. Threads which
+ * run out of work steal the oldest tasks from the queues of other threads. Tasks pushed from
+ * unknown threads go to a single shared queue, which also handles priorities.
  */
 
 #include <stdlib.h>
@@ -49,18 +54,8 @@
  */
 #define MEMPOOL_SIZE 256
 
-/* Number of tasks which are pushed directly to local thread queue.
- *
- * This allows thread to fetch next task without locking the whole queue.
- */
-#define LOCAL_QUEUE_SIZE 1
-
-/* Number of tasks which are allowed to be scheduled in a delayed manner.
- *
- * This allows to use less locks per graph node children schedule. More details
- * could be found at TaskThreadLocalStorage::do_delayed_push.
- */
-#define DELAYED_QUEUE_SIZE 4096
+/* Initial number of tasks a thread's queue can hold, it grows as needed. */
+#define TASK_DEQUE_INIT_SIZE 64
 
 #ifndef NDEBUG
 #  define ASSERT_THREAD_ID(scheduler, thread_id)                              \
@@ -142,25 +137,35 @@ typedef struct TaskThreadLocalStorage {
 	 */
 	TaskMemPool task_mempool;
 
-	/* Local queue keeps thread alive by keeping small amount of tasks ready
-	 * to be picked up without causing global thread locks for synchronization.
-	 */
-	int num_local_queue;
-	Task *local_queue[LOCAL_QUEUE_SIZE];
-
 	/* Thread can be marked for delayed tasks push. This is helpful when it's
 	 * know that lots of subsequent task pushed will happen from the same thread
 	 * without "interrupting" for task execution.
 	 *
-	 * We try to accumulate as much tasks as possible in a local queue without
-	 * any locks first, and then we push all of them into a scheduler's queue
-	 * from within a single mutex lock.
+	 * Tasks are still added to the thread's queue, but sleeping threads are
+	 * only woken up once all of them have been pushed.
 	 */
 	bool do_delayed_push;
-	int num_delayed_queue;
-	Task *delayed_queue[DELAYED_QUEUE_SIZE];
 } TaskThreadLocalStorage;
 
+/* Double ended queue of tasks, owned by a single thread.
+ *
+ * The owner thread pushes and pops tasks at the bottom (most recent first,
+ * which keeps data of nested tasks hot in caches), while other threads steal
+ * from the top (oldest tasks, usually the biggest chunks of work).
+ *
+ * Operations are protected by a spin lock, which is rarely contended since
+ * stealing only happens when a thread ran out of work. This also allows to
+ * remove tasks of canceled pools, and to only take tasks of a given pool when
+ * waiting for it.
+ */
+typedef struct TaskDeque {
+	SpinLock lock;
+	Task **tasks;
+	/* Ring buffer indices (wrapping), `bottom - top` is the number of tasks. */
+	volatile unsigned int top, bottom;
+	unsigned int mask;
+} TaskDeque;
+
 struct TaskPool {
 	TaskScheduler *scheduler;
 
@@ -172,7 +177,6 @@ struct TaskPool {
 	ThreadMutex user_mutex;
 
 	volatile bool do_cancel;
-	volatile bool do_work;
 
 	volatile bool is_suspended;
 	ListBase suspended_queue;
@@ -210,10 +214,15 @@ struct TaskScheduler {
 	int num_threads;
 	bool background_thread_only;
 
+	/* Shared queue, for tasks pushed from threads which don't own a queue. */
 	ListBase queue;
 	ThreadMutex queue_mutex;
 	ThreadCondition queue_cond;
 
+	/* Number of threads waiting on queue_cond, pushing to a thread's queue
+	 * only needs to lock queue_mutex to wake them up when non-zero. */
+	unsigned int num_sleeping;
+
 	volatile bool do_exit;
 
 	/* NOTE: In pthread's TLS we store the whole TaskThread structure. */
@@ -224,6 +233,10 @@ typedef struct TaskThread {
 	TaskScheduler *scheduler;
 	int id;
 	TaskThreadLocalStorage tls;
+	TaskDeque deque;
+	/* Thread to try stealing from first, the last one we could steal from. */
+	int steal_thread_id;
+	TaskSchedulerStats stats;
 } TaskThread;
 
 /* Helper */
@@ -326,8 +339,160 @@ static void task_free(TaskPool *pool, Task *task, const int thread_id)
 	}
 }
 
+/* Task Deque */
+
+static void task_deque_init(TaskDeque *deque)
+{
+	BLI_spin_init(&deque->lock);
+	deque->tasks = MEM_mallocN(sizeof(*deque->tasks) * TASK_DEQUE_INIT_SIZE, "TaskDeque tasks");
+	deque->top = deque->bottom = 0;
+	deque->mask = TASK_DEQUE_INIT_SIZE - 1;
+}
+
+BLI_INLINE unsigned int task_deque_len(const TaskDeque *deque)
+{
+	return deque->bottom - deque->top;
+}
+
+static void task_deque_free(TaskDeque *deque)
+{
+	/* Delete leftover tasks. */
+	while (task_deque_len(deque) != 0) {
+		Task *task = deque->tasks[deque->top & deque->mask];
+		task_data_free(task, 0);
+		MEM_freeN(task);
+		deque->top++;
+	}
+	MEM_freeN(deque->tasks);
+	BLI_spin_end(&deque->lock);
+}
+
+/* High priority tasks are pushed to the bottom, where the owner thread takes the next task from,
+ * low priority ones to the top, so they run after all high priority tasks of this queue
+ * (stealing threads take them first, while the owner is busy). */
+static void task_deque_push(TaskDeque *deque, Task *task, TaskPriority priority)
+{
+	BLI_spin_lock(&deque->lock);
+	if (UNLIKELY(task_deque_len(deque) > deque->mask)) {
+		const unsigned int len = task_deque_len(deque);
+		Task **tasks = MEM_mallocN(sizeof(*tasks) * len * 2, "TaskDeque tasks");
+		for (unsigned int i = 0; i < len; i++) {
+			tasks[i] = deque->tasks[(deque->top + i) & deque->mask];
+		}
+		MEM_freeN(deque->tasks);
+		deque->tasks = tasks;
+		deque->top = 0;
+		deque->bottom = len;
+		deque->mask = len * 2 - 1;
+	}
+	if (priority == TASK_PRIORITY_HIGH) {
+		deque->tasks[deque->bottom & deque->mask] = task;
+		deque->bottom++;
+	}
+	else {
+		deque->top--;
+		deque->tasks[deque->top & deque->mask] = task;
+	}
+	BLI_spin_unlock(&deque->lock);
+}
+
+/* Remove the task at \a index (counted from the top), keeping the order of others. */
+static void task_deque_remove_index(TaskDeque *deque, const unsigned int index)
+{
+	const unsigned int len = task_deque_len(deque);
+	if (index == 0) {
+		deque->top++;
+		return;
+	}
+	for (unsigned int i = index; i + 1 < len; i++) {
+		deque->tasks[(deque->top + i) & deque->mask] = deque->tasks[(deque->top + i + 1) & deque->mask];
+	}
+	deque->bottom--;
+}
+
+BLI_INLINE bool task_is_runnable(const Task *task, const TaskPool *pool, const bool background_only)
+{
+	if (pool != NULL) {
+		return task->pool == pool;
+	}
+	return !background_only || task->pool->run_in_background;
+}
+
+/* Pop a task from the bottom (owner thread) or the top (stealing threads) of the queue.
+ *
+ * If \a pool is given, only its tasks are considered, otherwise \a background_only
+ * restricts to tasks of background pools.
+ */
+static Task *task_deque_pop(TaskDeque *deque,
+                            const bool from_top,
+                            const TaskPool *pool,
+                            const bool background_only)
+{
+	Task *task = NULL;
+
+	/* Unlocked check, avoids touching locks of all empty queues when looking for work. */
+	if (task_deque_len(deque) == 0) {
+		return NULL;
+	}
+
+	BLI_spin_lock(&deque->lock);
+	const unsigned int len = task_deque_len(deque);
+	for (unsigned int i = 0; i < len; i++) {
+		const unsigned int index = from_top ? i : len - 1 - i;
+		Task *current_task = deque->tasks[(deque->top + index) & deque->mask];
+		if (task_is_runnable(current_task, pool, background_only)) {
+			task = current_task;
+			task_deque_remove_index(deque, index);
+			break;
+		}
+	}
+	BLI_spin_unlock(&deque->lock);
+
+	return task;
+}
+
+/* Move all tasks of \a pool out of the queue, into \a r_tasks. */
+static size_t task_deque_clear(TaskDeque *deque, TaskPool *pool, ListBase *r_tasks)
+{
+	size_t done = 0;
+
+	if (task_deque_len(deque) == 0) {
+		return 0;
+	}
+
+	BLI_spin_lock(&deque->lock);
+	const unsigned int len = task_deque_len(deque);
+	unsigned int len_keep = 0;
+	for (unsigned int i = 0; i < len; i++) {
+		Task *task = deque->tasks[(deque->top + i) & deque->mask];
+		if (task->pool == pool) {
+			BLI_addtail(r_tasks, task);
+			done++;
+		}
+		else {
+			deque->tasks[(deque->top + len_keep) & deque->mask] = task;
+			len_keep++;
+		}
+	}
+	deque->bottom = deque->top + len_keep;
+	BLI_spin_unlock(&deque->lock);
+
+	return done;
+}
+
 /* Task Scheduler */
 
+/* Get the scheduler thread (and its queue) a task pushed with \a thread_id can go to,
+ * NULL when the calling thread is not known by the scheduler. */
+BLI_INLINE TaskThread *get_task_thread(TaskPool *pool, const int thread_id)
+{
+	if (thread_id == -1 || (thread_id == 0 && pool->use_local_tls)) {
+		return NULL;
+	}
+	BLI_assert(thread_id <= pool->scheduler->num_threads);
+	return &pool->scheduler->task_threads[thread_id];
+}
+
 static void task_pool_num_decrease(TaskPool *pool, size_t done)
 {
 	BLI_mutex_lock(&pool->num_mutex);
@@ -352,74 +517,134 @@ static void task_pool_num_increase(TaskPool *pool, size_t new)
 	BLI_mutex_unlock(&pool->num_mutex);
 }
 
-static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, Task **task)
+/* Pop a task from the shared queue, queue_mutex must be locked. */
+static Task *task_scheduler_queue_pop(TaskScheduler *scheduler,
+                                      const TaskPool *pool,
+                                      const bool background_only)
 {
-	bool found_task = false;
-	BLI_mutex_lock(&scheduler->queue_mutex);
+	for (Task *task = scheduler->queue.first; task != NULL; task = task->next) {
+		if (task_is_runnable(task, pool, background_only)) {
+			BLI_remlink(&scheduler->queue, task);
+			return task;
+		}
+	}
+	return NULL;
+}
 
-	while (!scheduler->queue.first && !scheduler->do_exit)
-		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
+/* Find a task to run.
+ *
+ * \param thread: The calling thread, NULL when not a thread of the scheduler.
+ * \param pool: Only look for tasks of this pool (when waiting for it),
+ * running tasks of other pools could deadlock.
+ * \param queue_locked: Whether the caller already holds queue_mutex.
+ */
+static Task *task_scheduler_find_task(TaskScheduler *scheduler,
+                                      TaskThread *thread,
+                                      TaskPool *pool,
+                                      const bool queue_locked)
+{
+	const bool background_only = scheduler->background_thread_only && (thread != NULL) && (thread->id != 0);
+	const int num_threads = scheduler->num_threads + 1;
+	Task *task;
 
-	do {
-		Task *current_task;
+	/* Own queue first, most recent tasks. */
+	if (thread != NULL) {
+		task = task_deque_pop(&thread->deque, false, pool, background_only);
+		if (task != NULL) {
+			return task;
+		}
+	}
 
-		/* Assuming we can only have a void queue in 'exit' case here seems logical (we should only be here after
-		 * our worker thread has been woken up from a condition_wait(), which only happens after a new task was
-		 * added to the queue), but it is wrong.
-		 * Waiting on condition may wake up the thread even if condition is not signaled (spurious wake-ups), and some
-		 * race condition may also empty the queue **after** condition has been signaled, but **before** awoken thread
-		 * reaches this point...
-		 * See http://stackoverflow.com/questions/8594591
-		 *
-		 * So we only abort here if do_exit is set.
-		 */
-		if (scheduler->do_exit) {
+	/* Shared queue, unlocked check to avoid locking when it's empty. */
+	if (queue_locked || scheduler->queue.first != NULL) {
+		if (!queue_locked) {
+			BLI_mutex_lock(&scheduler->queue_mutex);
+		}
+		task = task_scheduler_queue_pop(scheduler, pool, background_only);
+		if (!queue_locked) {
 			BLI_mutex_unlock(&scheduler->queue_mutex);
-			return false;
 		}
-
-		for (current_task = scheduler->queue.first;
-		     current_task != NULL;
-		     current_task = current_task->next)
-		{
-			TaskPool *pool = current_task->pool;
-
-			if (scheduler->background_thread_only && !pool->run_in_background) {
-				continue;
+		if (task != NULL) {
+			if (thread != NULL) {
+				thread->stats.num_tasks_from_queue++;
 			}
+			return task;
+		}
+	}
 
-			*task = current_task;
-			found_task = true;
-			BLI_remlink(&scheduler->queue, *task);
-			break;
+	/* Steal oldest tasks from other threads, starting with the last one we could steal from. */
+	const int steal_thread_id = (thread != NULL) ? thread->steal_thread_id : 0;
+	for (int i = 0; i < num_threads; i++) {
+		const int thread_id = (steal_thread_id + i) % num_threads;
+		if (thread != NULL && thread_id == thread->id) {
+			continue;
+		}
+		task = task_deque_pop(&scheduler->task_threads[thread_id].deque, true, pool, background_only);
+		if (task != NULL) {
+			if (thread != NULL) {
+				thread->steal_thread_id = thread_id;
+				thread->stats.num_tasks_stolen++;
+			}
+			return task;
 		}
-		if (!found_task)
-			BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
-	} while (!found_task);
+	}
 
-	BLI_mutex_unlock(&scheduler->queue_mutex);
+	return NULL;
+}
 
-	return true;
+/* Wake up threads waiting for tasks, after a push to a thread's queue. */
+static void task_scheduler_wake(TaskScheduler *scheduler, const bool all)
+{
+	/* NOTE: Atomic read acts as a full barrier, so either the pushed task is
+	 * seen by a thread about to sleep, or we see it's sleeping and notify it,
+	 * see task_scheduler_thread_wait_pop(). */
+	if (atomic_add_and_fetch_u(&scheduler->num_sleeping, 0) != 0) {
+		BLI_mutex_lock(&scheduler->queue_mutex);
+		if (all) {
+			BLI_condition_notify_all(&scheduler->queue_cond);
+		}
+		else {
+			BLI_condition_notify_one(&scheduler->queue_cond);
+		}
+		BLI_mutex_unlock(&scheduler->queue_mutex);
+	}
 }
 
-BLI_INLINE void handle_local_queue(TaskThreadLocalStorage *tls,
-                                   const int thread_id)
+static bool task_scheduler_thread_wait_pop(TaskScheduler *scheduler, TaskThread *thread, Task **task)
 {
-	BLI_assert(!tls->do_delayed_push);
-	while (tls->num_local_queue > 0) {
-		/* We pop task from queue before handling it so handler of the task can
-		 * push next job to the local queue.
-		 */
-		tls->num_local_queue--;
-		Task *local_task = tls->local_queue[tls->num_local_queue];
-		/* TODO(sergey): Double-check work_and_wait() doesn't handle other's
-		 * pool tasks.
-		 */
-		TaskPool *local_pool = local_task->pool;
-		local_task->run(local_pool, local_task->taskdata, thread_id);
-		task_free(local_pool, local_task, thread_id);
+	*task = task_scheduler_find_task(scheduler, thread, NULL, false);
+	if (*task != NULL) {
+		return true;
+	}
+
+	BLI_mutex_lock(&scheduler->queue_mutex);
+
+	/* Announce we are going to sleep before looking for tasks one last time,
+	 * pushes done after that will notify queue_cond (which can't be missed since
+	 * we hold queue_mutex until waiting on it). */
+	atomic_add_and_fetch_u(&scheduler->num_sleeping, 1);
+
+	/* Waiting on condition may wake up the thread even if condition is not
+	 * signaled (spurious wake-ups), and some race condition may also empty the
+	 * queue **after** condition has been signaled, but **before** awoken thread
+	 * reaches this point... See http://stackoverflow.com/questions/8594591
+	 *
+	 * So we only abort here if do_exit is set.
+	 */
+	while (!scheduler->do_exit) {
+		*task = task_scheduler_find_task(scheduler, thread, NULL, true);
+		if (*task != NULL) {
+			break;
+		}
+		thread->stats.num_sleeps++;
+		BLI_condition_wait(&scheduler->queue_cond, &scheduler->queue_mutex);
 	}
-	BLI_assert(!tls->do_delayed_push);
+
+	atomic_sub_and_fetch_u(&scheduler->num_sleeping, 1);
+
+	BLI_mutex_unlock(&scheduler->queue_mutex);
+
+	return (*task != NULL);
 }
 
 static void *task_scheduler_thread_run(void *thread_p)
@@ -433,7 +658,7 @@ static void *task_scheduler_thread_run(void *thread_p)
 	pthread_setspecific(scheduler->tls_id_key, thread);
 
 	/* keep popping off tasks */
-	while (task_scheduler_thread_wait_pop(scheduler, &task)) {
+	while (task_scheduler_thread_wait_pop(scheduler, thread, &task)) {
 		TaskPool *pool = task->pool;
 
 		/* run task */
@@ -443,14 +668,14 @@ static void *task_scheduler_thread_run(void *thread_p)
 
 		/* delete task */
 		task_free(pool, task, thread_id);
-
-		/* Handle all tasks from local queue. */
-		handle_local_queue(tls, thread_id);
+		thread->stats.num_tasks_run++;
 
 		/* notify pool task was done */
 		task_pool_num_decrease(pool, 1);
 	}
 
+	UNUSED_VARS_NDEBUG(tls);
+
 	return NULL;
 }
 
@@ -483,8 +708,13 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 	scheduler->task_threads = MEM_mallocN(sizeof(TaskThread) * (num_threads + 1),
 	                                      "TaskScheduler task threads");
 
-	/* Initialize TLS for main thread. */
+	/* Initialize TLS and queue for main thread. */
+	scheduler->task_threads[0].scheduler = scheduler;
+	scheduler->task_threads[0].id = 0;
+	scheduler->task_threads[0].steal_thread_id = 1;
 	initialize_task_tls(&scheduler->task_threads[0].tls);
+	task_deque_init(&scheduler->task_threads[0].deque);
+	memset(&scheduler->task_threads[0].stats, 0, sizeof(TaskSchedulerStats));
 
 	pthread_key_create(&scheduler->tls_id_key, NULL);
 
@@ -495,12 +725,20 @@ TaskScheduler *BLI_task_scheduler_create(int num_threads)
 		scheduler->num_threads = num_threads;
 		scheduler->threads = MEM_callocN(sizeof(pthread_t) * num_threads, "TaskScheduler threads");
 
+		/* Initialize all queues before launching any thread, threads look into
+		 * the queues of each other for work to steal. */
 		for (i = 0; i < num_threads; i++) {
 			TaskThread *thread = &scheduler->task_threads[i + 1];
 			thread->scheduler = scheduler;
 			thread->id = i + 1;
+			thread->steal_thread_id = (i + 2) % (num_threads + 1);
 			initialize_task_tls(&thread->tls);
+			task_deque_init(&thread->deque);
+			memset(&thread->stats, 0, sizeof(TaskSchedulerStats));
+		}
 
+		for (i = 0; i < num_threads; i++) {
+			TaskThread *thread = &scheduler->task_threads[i + 1];
 			if (pthread_create(&scheduler->threads[i], NULL, task_scheduler_thread_run, thread) != 0) {
 				fprintf(stderr, "TaskScheduler failed to launch thread %d/%d\n", i, num_threads);
 			}
@@ -534,11 +772,24 @@ void BLI_task_scheduler_free(TaskScheduler *scheduler)
 		MEM_freeN(scheduler->threads);
 	}
 
+#ifdef DEBUG_STATS
+	{
+		TaskSchedulerStats stats;
+		BLI_task_scheduler_stats_get(scheduler, &stats);
+		printf("Tasks run: %llu, from shared queue: %llu, stolen: %llu, worker sleeps: %llu\n",
+		       (unsigned long long)stats.num_tasks_run,
+		       (unsigned long long)stats.num_tasks_from_queue,
+		       (unsigned long long)stats.num_tasks_stolen,
+		       (unsigned long long)stats.num_sleeps);
+	}
+#endif
+
 	/* Delete task thread data */
 	if (scheduler->task_threads) {
 		for (int i = 0; i < scheduler->num_threads + 1; ++i) {
 			TaskThreadLocalStorage *tls = &scheduler->task_threads[i].tls;
 			free_task_tls(tls);
+			task_deque_free(&scheduler->task_threads[i].deque);
 		}
 
 		MEM_freeN(scheduler->task_threads);
@@ -562,6 +813,24 @@ int BLI_task_scheduler_num_threads(TaskScheduler *scheduler)
 	return scheduler->num_threads + 1;
 }
 
+/**
+ * Get statistics accumulated by all threads of the scheduler since its creation.
+ *
+ * \note Counters are updated without locks by their threads,
+ * so this is only accurate when no tasks are running.
+ */
+void BLI_task_scheduler_stats_get(TaskScheduler *scheduler, TaskSchedulerStats *r_stats)
+{
+	memset(r_stats, 0, sizeof(*r_stats));
+	for (int i = 0; i < scheduler->num_threads + 1; i++) {
+		const TaskSchedulerStats *stats = &scheduler->task_threads[i].stats;
+		r_stats->num_tasks_run += stats->num_tasks_run;
+		r_stats->num_tasks_from_queue += stats->num_tasks_from_queue;
+		r_stats->num_tasks_stolen += stats->num_tasks_stolen;
+		r_stats->num_sleeps += stats->num_sleeps;
+	}
+}
+
 static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriority priority)
 {
 	task_pool_num_increase(task->pool, 1);
@@ -578,30 +847,10 @@ static void task_scheduler_push(TaskScheduler *scheduler, Task *task, TaskPriori
 	BLI_mutex_unlock(&scheduler->queue_mutex);
 }
 
-static void task_scheduler_push_all(TaskScheduler *scheduler,
-                                    TaskPool *pool,
-                                    Task **tasks,
-                                    int num_tasks)
-{
-	if (num_tasks == 0) {
-		return;
-	}
-
-	task_pool_num_increase(pool, num_tasks);
-
-	BLI_mutex_lock(&scheduler->queue_mutex);
-
-	for (int i = 0; i < num_tasks; i++) {
-		BLI_addhead(&scheduler->queue, tasks[i]);
-	}
-
-	BLI_condition_notify_all(&scheduler->queue_cond);
-	BLI_mutex_unlock(&scheduler->queue_mutex);
-}
-
 static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 {
 	Task *task, *nexttask;
+	ListBase tasks = {NULL, NULL};
 	size_t done = 0;
 
 	BLI_mutex_lock(&scheduler->queue_mutex);
@@ -620,6 +869,16 @@ static void task_scheduler_clear(TaskScheduler *scheduler, TaskPool *pool)
 
 	BLI_mutex_unlock(&scheduler->queue_mutex);
 
+	/* and from queues of all threads */
+	for (int i = 0; i < scheduler->num_threads + 1; i++) {
+		done += task_deque_clear(&scheduler->task_threads[i].deque, pool, &tasks);
+	}
+	for (task = tasks.first; task; task = nexttask) {
+		nexttask = task->next;
+		task_data_free(task, pool->thread_id);
+		MEM_freeN(task);
+	}
+
 	/* notify done */
 	task_pool_num_decrease(pool, done);
 }
@@ -648,7 +907,6 @@ static TaskPool *task_pool_create_ex(TaskScheduler *scheduler,
 	pool->scheduler = scheduler;
 	pool->num = 0;
 	pool->do_cancel = false;
-	pool->do_work = false;
 	pool->is_suspended = is_suspended;
 	pool->num_suspended = 0;
 	pool->suspended_queue.first = pool->suspended_queue.last = NULL;
@@ -766,11 +1024,6 @@ void BLI_task_pool_free(TaskPool *pool)
 	BLI_threaded_malloc_end();
 }
 
-BLI_INLINE bool task_can_use_local_queues(TaskPool *pool, int thread_id)
-{
-	return (thread_id != -1 && (thread_id != pool->thread_id || pool->do_work));
-}
-
 static void task_pool_push(
         TaskPool *pool, TaskRunFunction run, void *taskdata,
         bool free_taskdata, TaskFreeFunction freedata, TaskPriority priority,
@@ -794,29 +1047,23 @@ static void task_pool_push(
 		atomic_fetch_and_add_z(&pool->num_suspended, 1);
 		return;
 	}
-	/* Populate to any local queue first, this is cheapest push ever. */
-	if (task_can_use_local_queues(pool, thread_id)) {
+	/* Push to the queue of the calling thread when it's known, this avoids
+	 * any global lock. It will be picked up next by this thread (after other high
+	 * priority tasks when it's low priority), unless other idle threads steal it first.
+	 */
+	TaskThread *thread = get_task_thread(pool, thread_id);
+	if (thread != NULL) {
 		ASSERT_THREAD_ID(pool->scheduler, thread_id);
 		TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
-		/* Try to push to a local execution queue.
-		 * These tasks will be picked up next.
-		 */
-		if (tls->num_local_queue < LOCAL_QUEUE_SIZE) {
-			tls->local_queue[tls->num_local_queue] = task;
-			tls->num_local_queue++;
-			return;
-		}
-		/* If we are in the delayed tasks push mode, we push tasks to a
-		 * temporary local queue first without any locks, and then move them
-		 * to global execution queue with a single lock.
-		 */
-		if (tls->do_delayed_push && tls->num_delayed_queue < DELAYED_QUEUE_SIZE) {
-			tls->delayed_queue[tls->num_delayed_queue] = task;
-			tls->num_delayed_queue++;
-			return;
+		task_pool_num_increase(pool, 1);
+		task_deque_push(&thread->deque, task, priority);
+		/* In delayed push mode, threads are woken up once all tasks are pushed. */
+		if (!tls->do_delayed_push) {
+			task_scheduler_wake(pool->scheduler, false);
 		}
+		return;
 	}
-	/* Do push to a global execution ppol, slowest possible method,
+	/* Do push to a global execution pool, slowest possible method,
 	 * causes quite reasonable amount of threading overhead.
 	 */
 	task_scheduler_push(pool->scheduler, task, priority);
@@ -844,60 +1091,59 @@ void BLI_task_pool_push_from_thread(TaskPool *pool, TaskRunFunction run,
 void BLI_task_pool_work_and_wait(TaskPool *pool)
 {
 	TaskThreadLocalStorage *tls = get_task_tls(pool, pool->thread_id);
+	TaskThread *thread = get_task_thread(pool, pool->thread_id);
 	TaskScheduler *scheduler = pool->scheduler;
 
 	if (atomic_fetch_and_and_uint8((uint8_t *)&pool->is_suspended, 0)) {
 		if (pool->num_suspended) {
 			task_pool_num_increase(pool, pool->num_suspended);
-			BLI_mutex_lock(&scheduler->queue_mutex);
 
-			BLI_movelisttolist(&scheduler->queue, &pool->suspended_queue);
+			if (thread != NULL) {
+				/* Other threads will steal from our queue. */
+				Task *task, *nexttask;
+				for (task = pool->suspended_queue.first; task; task = nexttask) {
+					nexttask = task->next;
+					task_deque_push(&thread->deque, task, TASK_PRIORITY_HIGH);
+				}
+				BLI_listbase_clear(&pool->suspended_queue);
+				task_scheduler_wake(scheduler, true);
+			}
+			else {
+				BLI_mutex_lock(&scheduler->queue_mutex);
+
+				BLI_movelisttolist(&scheduler->queue, &pool->suspended_queue);
 
-			BLI_condition_notify_all(&scheduler->queue_cond);
-			BLI_mutex_unlock(&scheduler->queue_mutex);
+				BLI_condition_notify_all(&scheduler->queue_cond);
+				BLI_mutex_unlock(&scheduler->queue_mutex);
+			}
 		}
 	}
 
-	pool->do_work = true;
-
 	ASSERT_THREAD_ID(pool->scheduler, pool->thread_id);
 
 	BLI_mutex_lock(&pool->num_mutex);
 
 	while (pool->num != 0) {
-		Task *task, *work_task = NULL;
-		bool found_task = false;
+		Task *task;
 
 		BLI_mutex_unlock(&pool->num_mutex);
 
-		BLI_mutex_lock(&scheduler->queue_mutex);
-
 		/* find task from this pool. if we get a task from another pool,
 		 * we can get into deadlock */
-
-		for (task = scheduler->queue.first; task; task = task->next) {
-			if (task->pool == pool) {
-				work_task = task;
-				found_task = true;
-				BLI_remlink(&scheduler->queue, task);
-				break;
-			}
-		}
-
-		BLI_mutex_unlock(&scheduler->queue_mutex);
+		task = task_scheduler_find_task(scheduler, thread, pool, false);
 
 		/* if found task, do it, otherwise wait until other tasks are done */
-		if (found_task) {
+		if (task != NULL) {
 			/* run task */
 			BLI_assert(!tls->do_delayed_push);
-			work_task->run(pool, work_task->taskdata, pool->thread_id);
+			task->run(pool, task->taskdata, pool->thread_id);
 			BLI_assert(!tls->do_delayed_push);
 
 			/* delete task */
 			task_free(pool, task, pool->thread_id);
-
-			/* Handle all tasks from local queue. */
-			handle_local_queue(tls, pool->thread_id);
+			if (thread != NULL) {
+				thread->stats.num_tasks_run++;
+			}
 
 			/* notify pool task was done */
 			task_pool_num_decrease(pool, 1);
@@ -907,13 +1153,13 @@ void BLI_task_pool_work_and_wait(TaskPool *pool)
 		if (pool->num == 0)
 			break;
 
-		if (!found_task)
+		if (task == NULL)
 			BLI_condition_wait(&pool->num_cond, &pool->num_mutex);
 	}
 
 	BLI_mutex_unlock(&pool->num_mutex);
 
-	handle_local_queue(tls, pool->thread_id);
+	UNUSED_VARS_NDEBUG(tls);
 }
 
 void BLI_task_pool_cancel(TaskPool *pool)
@@ -948,7 +1194,7 @@ ThreadMutex *BLI_task_pool_user_mutex(TaskPool *pool)
 
 void BLI_task_pool_delayed_push_begin(TaskPool *pool, int thread_id)
 {
-	if (task_can_use_local_queues(pool, thread_id)) {
+	if (get_task_thread(pool, thread_id) != NULL) {
 		ASSERT_THREAD_ID(pool->scheduler, thread_id);
 		TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
 		tls->do_delayed_push = true;
@@ -957,16 +1203,12 @@ void BLI_task_pool_delayed_push_begin(TaskPool *pool, int thread_id)
 
 void BLI_task_pool_delayed_push_end(TaskPool *pool, int thread_id)
 {
-	if (task_can_use_local_queues(pool, thread_id)) {
+	if (get_task_thread(pool, thread_id) != NULL) {
 		ASSERT_THREAD_ID(pool->scheduler, thread_id);
 		TaskThreadLocalStorage *tls = get_task_tls(pool, thread_id);
 		BLI_assert(tls->do_delayed_push);
-		task_scheduler_push_all(pool->scheduler,
-		                        pool,
-		                        tls->delayed_queue,
-		                        tls->num_delayed_queue);
 		tls->do_delayed_push = false;
-		tls->num_delayed_queue = 0;
+		task_scheduler_wake(pool->scheduler, true);
 	}
 }
 
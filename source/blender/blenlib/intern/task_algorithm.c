@@ -0,0 +1,452 @@
+/*
+ * ***** BEGIN GPL LICENSE BLOCK *****
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ * ***** END GPL LICENSE BLOCK *****
+ */
+
+/** \file blender/blenlib/intern/task_algorithm.c
+ *  \ingroup bli
+ *
+ * Parallel reduce, prefix sum and sort, built on top of #BLI_task_parallel_range.
+ *
+ * All of them split their input in contiguous chunks (a few per thread, for load balancing),
+ * and combine per-chunk results in chunk order, so results don't depend on scheduling.
+ */
+
+#include <limits.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "MEM_guardedalloc.h"
+
+#include "BLI_utildefines.h"
+#include "BLI_math_base.h"
+#include "BLI_sort.h"
+#include "BLI_task.h"
+
+#include "BLI_strict_flags.h"
+
+/* Number of chunks per thread, more gives better balancing when some chunks are slower. */
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+/* Below those sizes, prefix sums and sorting are done by the calling thread only. */
+#define PARALLEL_SCAN_CHUNK_MIN 4096
+#define PARALLEL_SORT_RUN_MIN 2048
+
+/**
+ * Split \a len items in chunks of at least \a chunk_min items.
+ * Returns the number of chunks, 1 when threading is not worth it.
+ */
+static int parallel_chunks_calc(const int len, const int chunk_min, const bool use_threading, int *r_chunk_size)
+{
+	if (!use_threading || len <= chunk_min) {
+		*r_chunk_size = len;
+		return 1;
+	}
+
+	const int num_threads = BLI_task_scheduler_num_threads(BLI_task_scheduler_get());
+	const int num_chunks_max = num_threads * PARALLEL_CHUNKS_PER_THREAD;
+	const int chunk_size = max_ii(chunk_min, (len + num_chunks_max - 1) / num_chunks_max);
+
+	*r_chunk_size = chunk_size;
+	return (len + chunk_size - 1) / chunk_size;
+}
+
+/* Run \a func for all chunks, one range iteration per chunk. */
+static void parallel_chunks_run(const int num_chunks, void *userdata, TaskParallelRangeFunc func)
+{
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (num_chunks > 1);
+	BLI_task_parallel_range(0, num_chunks, userdata, func, &settings);
+}
+
+/* -------------------------------------------------------------------- */
+/** \name Reduce
+ * \{ */
+
+typedef struct ParallelReduceState {
+	void *userdata;
+	TaskParallelReduceFunc func;
+	int start, stop;
+	int chunk_size;
+	const void *identity;
+	size_t value_size;
+	char *values;
+} ParallelReduceState;
+
+static void parallel_reduce_chunk_func(
+        void *__restrict userdata,
+        const int chunk,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ParallelReduceState *state = userdata;
+	void *value = state->values + state->value_size * (size_t)chunk;
+	const int start = state->start + chunk * state->chunk_size;
+	const int stop = min_ii(start + state->chunk_size, state->stop);
+
+	memcpy(value, state->identity, state->value_size);
+	state->func(state->userdata, start, stop, value);
+}
+
+/**
+ * Reduce [start, stop) range in parallel, see public API doc of #TaskParallelReduceFunc.
+ *
+ * \a r_value is initialized to \a identity, so it doesn't have to be set by the caller.
+ */
+void BLI_task_parallel_reduce(
+        const int start, const int stop,
+        void *userdata,
+        const void *identity, const size_t value_size,
+        TaskParallelReduceFunc func,
+        TaskParallelReduceJoinFunc join,
+        void *r_value,
+        const ParallelRangeSettings *settings)
+{
+	BLI_assert(start <= stop);
+
+	memcpy(r_value, identity, value_size);
+
+	if (start == stop) {
+		return;
+	}
+
+	ParallelReduceState state = {
+		.userdata = userdata,
+		.func = func,
+		.start = start,
+		.stop = stop,
+		.identity = identity,
+		.value_size = value_size,
+	};
+	const int num_chunks = parallel_chunks_calc(
+	        stop - start, max_ii(1, settings->min_iter_per_thread), settings->use_threading, &state.chunk_size);
+
+	if (num_chunks == 1) {
+		func(userdata, start, stop, r_value);
+		return;
+	}
+
+	state.values = MEM_mallocN(value_size * (size_t)num_chunks, __func__);
+	parallel_chunks_run(num_chunks, &state, parallel_reduce_chunk_func);
+
+	for (int i = 0; i < num_chunks; i++) {
+		join(userdata, r_value, state.values + value_size * (size_t)i);
+	}
+
+	MEM_freeN(state.values);
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Prefix Sum
+ *
+ * Two passes, first one sums every chunk, then each chunk is scanned starting
+ * from the (serial) prefix sum of the previous chunks.
+ *
+ * Signed integers are handled as unsigned ones, which gives the same bits.
+ * \{ */
+
+typedef struct ParallelScanState {
+	const unsigned int *src;
+	unsigned int *dst;
+	int len;
+	int chunk_size;
+	bool inclusive;
+	unsigned int *chunk_sums;
+} ParallelScanState;
+
+static unsigned int scan_chunk_sum(const unsigned int *src, const int len)
+{
+	unsigned int sum = 0;
+	for (int i = 0; i < len; i++) {
+		sum += src[i];
+	}
+	return sum;
+}
+
+/* Returns the offset plus the sum of the chunk. */
+static unsigned int scan_chunk(const unsigned int *src, unsigned int *dst, const int len,
+                               unsigned int offset, const bool inclusive)
+{
+	if (inclusive) {
+		for (int i = 0; i < len; i++) {
+			offset += src[i];
+			dst[i] = offset;
+		}
+	}
+	else {
+		for (int i = 0; i < len; i++) {
+			const unsigned int value = src[i];
+			dst[i] = offset;
+			offset += value;
+		}
+	}
+	return offset;
+}
+
+static void parallel_scan_sum_func(
+        void *__restrict userdata,
+        const int chunk,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ParallelScanState *state = userdata;
+	const int start = chunk * state->chunk_size;
+	const int len = min_ii(state->chunk_size, state->len - start);
+
+	state->chunk_sums[chunk] = scan_chunk_sum(state->src + start, len);
+}
+
+static void parallel_scan_func(
+        void *__restrict userdata,
+        const int chunk,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ParallelScanState *state = userdata;
+	const int start = chunk * state->chunk_size;
+	const int len = min_ii(state->chunk_size, state->len - start);
+
+	scan_chunk(state->src + start, state->dst + start, len, state->chunk_sums[chunk], state->inclusive);
+}
+
+unsigned int BLI_task_parallel_scan_u(
+        const unsigned int *src, unsigned int *dst, const int len,
+        const bool inclusive, const bool use_threading)
+{
+	ParallelScanState state = {
+		.src = src,
+		.dst = dst,
+		.len = len,
+		.inclusive = inclusive,
+	};
+	const int num_chunks = parallel_chunks_calc(len, PARALLEL_SCAN_CHUNK_MIN, use_threading, &state.chunk_size);
+
+	if (num_chunks == 1) {
+		return scan_chunk(src, dst, len, 0, inclusive);
+	}
+
+	state.chunk_sums = MEM_mallocN(sizeof(*state.chunk_sums) * (size_t)num_chunks, __func__);
+
+	parallel_chunks_run(num_chunks, &state, parallel_scan_sum_func);
+
+	/* Turn chunk sums into chunk offsets. */
+	unsigned int total = 0;
+	for (int i = 0; i < num_chunks; i++) {
+		const unsigned int sum = state.chunk_sums[i];
+		state.chunk_sums[i] = total;
+		total += sum;
+	}
+
+	parallel_chunks_run(num_chunks, &state, parallel_scan_func);
+
+	MEM_freeN(state.chunk_sums);
+
+	return total;
+}
+
+int BLI_task_parallel_scan_i(
+        const int *src, int *dst, const int len,
+        const bool inclusive, const bool use_threading)
+{
+	return (int)BLI_task_parallel_scan_u(
+	        (const unsigned int *)src, (unsigned int *)dst, len, inclusive, use_threading);
+}
+
+/** \} */
+
+/* -------------------------------------------------------------------- */
+/** \name Sort
+ *
+ * Runs are sorted in parallel with #BLI_qsort_r, then merged pairwise in rounds,
+ * ping-ponging with a temporary buffer. Every merge is split in several parts
+ * (finding the split points with a binary search along the 'merge path'),
+ * so the last rounds which merge few long runs still use all threads.
+ * \{ */
+
+typedef struct ParallelSortState {
+	char *array;
+	size_t num, size;
+	BLI_sort_cmp_t cmp;
+	void *thunk;
+	int num_runs;
+
+	/* Merge round data. */
+	char *src;
+	char *dst;
+	/* Width of the merged runs (in runs, not items). */
+	int width;
+	int num_parts;
+} ParallelSortState;
+
+BLI_INLINE size_t sort_run_start(const ParallelSortState *state, const int run)
+{
+	return (state->num * (size_t)run) / (size_t)state->num_runs;
+}
+
+static void parallel_sort_run_func(
+        void *__restrict userdata,
+        const int run,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ParallelSortState *state = userdata;
+	const size_t start = sort_run_start(state, run);
+	const size_t stop = sort_run_start(state, run + 1);
+
+	BLI_qsort_r(state->array + start * state->size, stop - start, state->size, state->cmp, state->thunk);
+}
+
+/**
+ * Number of items to take from \a a for the first \a k items of the merge of \a a and \a b,
+ * items of \a a going first on equality.
+ */
+static size_t sort_merge_path_search(const ParallelSortState *state,
+                                     const char *a, const size_t a_len,
+                                     const char *b, const size_t b_len,
+                                     const size_t k)
+{
+	const size_t size = state->size;
+	size_t lo = (k > b_len) ? k - b_len : 0;
+	size_t hi = MIN2(k, a_len);
+
+	while (lo < hi) {
+		const size_t mid = (lo + hi) / 2;
+		if (state->cmp(a + mid * size, b + (k - mid - 1) * size, state->thunk) <= 0) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void sort_merge(const ParallelSortState *state,
+                       const char *a, const char *a_end,
+                       const char *b, const char *b_end,
+                       char *dst)
+{
+	const size_t size = state->size;
+
+	while (a != a_end && b != b_end) {
+		if (state->cmp(a, b, state->thunk) <= 0) {
+			memcpy(dst, a, size);
+			a += size;
+		}
+		else {
+			memcpy(dst, b, size);
+			b += size;
+		}
+		dst += size;
+	}
+	if (a != a_end) {
+		memcpy(dst, a, (size_t)(a_end - a));
+	}
+	if (b != b_end) {
+		memcpy(dst, b, (size_t)(b_end - b));
+	}
+}
+
+static void parallel_sort_merge_func(
+        void *__restrict userdata,
+        const int iter,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ParallelSortState *state = userdata;
+	const size_t size = state->size;
+	const int merge = iter / state->num_parts;
+	const int part = iter % state->num_parts;
+
+	const int run = merge * state->width * 2;
+	const size_t a_start = sort_run_start(state, run);
+	const size_t b_start = sort_run_start(state, min_ii(run + state->width, state->num_runs));
+	const size_t b_stop = sort_run_start(state, min_ii(run + state->width * 2, state->num_runs));
+	const char *a = state->src + a_start * size;
+	const char *b = state->src + b_start * size;
+	const size_t a_len = b_start - a_start;
+	const size_t b_len = b_stop - b_start;
+	const size_t len = a_len + b_len;
+
+	/* Part of the merged output handled here. */
+	const size_t k_start = (len * (size_t)part) / (size_t)state->num_parts;
+	const size_t k_stop = (len * (size_t)(part + 1)) / (size_t)state->num_parts;
+	const size_t a_part_start = sort_merge_path_search(state, a, a_len, b, b_len, k_start);
+	const size_t a_part_stop = sort_merge_path_search(state, a, a_len, b, b_len, k_stop);
+	const size_t b_part_start = k_start - a_part_start;
+	const size_t b_part_stop = k_stop - a_part_stop;
+
+	sort_merge(state,
+	           a + a_part_start * size, a + a_part_stop * size,
+	           b + b_part_start * size, b + b_part_stop * size,
+	           state->dst + (a_start + k_start) * size);
+}
+
+/**
+ * Sort \a array in parallel, using the same arguments as #BLI_qsort_r.
+ *
+ * \note Uses a temporary buffer of the size of \a array.
+ */
+void BLI_task_parallel_sort(
+        void *array, const size_t num, const size_t size,
+        BLI_sort_cmp_t cmp, void *thunk,
+        const bool use_threading)
+{
+	if (!use_threading || num <= PARALLEL_SORT_RUN_MIN * 2 || num > INT_MAX) {
+		BLI_qsort_r(array, num, size, cmp, thunk);
+		return;
+	}
+
+	const int num_threads = BLI_task_scheduler_num_threads(BLI_task_scheduler_get());
+	int num_runs = power_of_2_max_i(num_threads);
+	while (num_runs > 2 && num / (size_t)num_runs < PARALLEL_SORT_RUN_MIN) {
+		num_runs /= 2;
+	}
+
+	ParallelSortState state = {
+		.array = array,
+		.num = num,
+		.size = size,
+		.cmp = cmp,
+		.thunk = thunk,
+		.num_runs = num_runs,
+	};
+
+	parallel_chunks_run(num_runs, &state, parallel_sort_run_func);
+
+	char *buffer = MEM_mallocN(num * size, __func__);
+	state.src = state.array;
+	state.dst = buffer;
+
+	for (state.width = 1; state.width < num_runs; state.width *= 2) {
+		const int num_merges = num_runs / (state.width * 2);
+		state.num_parts = max_ii(1, (num_threads * PARALLEL_CHUNKS_PER_THREAD) / num_merges);
+		/* Don't split merges in tiny parts. */
+		state.num_parts = min_ii(state.num_parts, max_ii(1, (int)(num / (size_t)num_merges / PARALLEL_SORT_RUN_MIN)));
+
+		parallel_chunks_run(num_merges * state.num_parts, &state, parallel_sort_merge_func);
+
+		SWAP(char *, state.src, state.dst);
+	}
+
+	if (state.src != array) {
+		memcpy(array, state.src, num * size);
+	}
+
+	MEM_freeN(buffer);
+}
+
+/** \} */
@@ -36,6 +36,7 @@
 extern "C" {
 #endif
 
+struct BlendFileMapping;
 struct BlendThumbnail;
 struct bScreen;
 struct LinkNode;
@@ -77,6 +78,9 @@ typedef enum eBLOReadSkip {
 	BLO_READ_SKIP_NONE          = 0,
 	BLO_READ_SKIP_USERDEF       = (1 << 0),
 	BLO_READ_SKIP_DATA          = (1 << 1),
+	/* Not a skip option, packed file data isn't read but references the memory mapped file,
+	 * so its pages are only loaded once accessed (see: PackedFile.mapping). */
+	BLO_READ_LAZY_PACKED        = (1 << 2),
 } eBLOReadSkip;
 #define BLO_READ_SKIP_ALL \
 	(BLO_READ_SKIP_USERDEF | BLO_READ_SKIP_DATA)
@@ -147,6 +151,9 @@ void BLO_update_defaults_startup_blend(struct Main *mainvar);
 
 struct BlendThumbnail *BLO_thumbnail_from_file(const char *filepath);
 
+void BLO_file_mapping_user_add(struct BlendFileMapping *mapping);
+void BLO_file_mapping_release(struct BlendFileMapping *mapping);
+
 #ifdef __cplusplus
 } 
 #endif
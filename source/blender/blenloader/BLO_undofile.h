@@ -36,13 +36,15 @@
 typedef struct {
 	void *next, *prev;
 	
+	/* shared by all chunks with the same content (read-only) */
 	char *buf;
-	unsigned int ident, size;
+	unsigned int size;
 	
 } MemFileChunk;
 
 typedef struct MemFile {
 	ListBase chunks;
+	/* size of the data added by this memfile, which wasn't stored by another memfile yet */
 	unsigned int size;
 } MemFile;
 
@@ -46,6 +46,8 @@
 #include "BLI_utildefines.h"
 #ifndef WIN32
 #  include <unistd.h> // for read close
+#  include <sys/mman.h> // for mmap munmap
+#  include <sys/stat.h> // for fstat
 #else
 #  include <io.h> // for open close read
 #  include "winsock2.h"
@@ -105,11 +107,14 @@
 
 #include "MEM_guardedalloc.h"
 
+#include "atomic_ops.h"
+
 #include "BLI_endian_switch.h"
 #include "BLI_blenlib.h"
 #include "BLI_math.h"
 #include "BLI_threads.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
 
 #include "BLT_translation.h"
 
@@ -220,6 +225,12 @@
 /* Use GHash for restoring pointers by name */
 #define USE_GHASH_RESTORE_POINTER
 
+/* Memory map uncompressed files, so block data doesn't need to be copied
+ * into a BHeadN allocation (only the final, possibly reconstructed struct is allocated). */
+#ifndef WIN32
+#  define USE_MMAP_READ
+#endif
+
 /* Define this to have verbose debug prints. */
 #define USE_DEBUG_PRINT
 
@@ -238,9 +249,12 @@ typedef struct OldNew {
 } OldNew;
 
 typedef struct OldNewMap {
+	/* entries in insertion order */
 	OldNew *entries;
-	int nentries, entriessize;
-	bool sorted;
+	int nentries;
+	/* open addressing hash table of indices into entries */
+	int *map;
+	int capacity_exp;
 	int lasthit;
 } OldNewMap;
 
@@ -284,49 +298,112 @@ static const char *library_parent_filepath(Library *lib)
 	return lib->parent ? lib->parent->filepath : "<direct>";
 }
 
-static OldNewMap *oldnewmap_new(void) 
+/**
+ * OldNewMap: maps addresses stored in the file to the newly allocated data.
+ *
+ * Entries are stored in insertion order (which is also the order data is linked in,
+ * so checking the entry after \a lasthit resolves most lookups),
+ * an open addressing hash table of indices into the entries handles all other lookups.
+ */
+
+/* The hash table has twice the capacity of the entries array, keeping the load factor below 0.5. */
+#define ENTRIES_CAPACITY(onm) (1 << (onm)->capacity_exp)
+#define MAP_CAPACITY(onm) (1 << ((onm)->capacity_exp + 1))
+#define SLOT_MASK(onm) (MAP_CAPACITY(onm) - 1)
+#define DEFAULT_SIZE_EXP 6
+#define MAP_SLOT_EMPTY -1
+
+BLI_INLINE unsigned int oldnewmap_hash(const void *addr)
 {
-	OldNewMap *onm= MEM_callocN(sizeof(*onm), "OldNewMap");
-	
-	onm->entriessize = 1024;
-	onm->entries = MEM_malloc_arrayN(onm->entriessize, sizeof(*onm->entries), "OldNewMap.entries");
-	
-	return onm;
+	/* Addresses are from aligned allocations, drop the low bits which are nearly always zero,
+	 * then use a multiplicative hash so nearby addresses spread over the table. */
+	const uint64_t key = (uint64_t)(uintptr_t)addr >> 3;
+	return (unsigned int)((key * 0x9E3779B97F4A7C15ull) >> 32);
 }
 
-static int verg_oldnewmap(const void *v1, const void *v2)
+static int oldnewmap_lookup_index(const OldNewMap *onm, const void *addr)
 {
-	const struct OldNew *x1=v1, *x2=v2;
-	
-	if (x1->old > x2->old) return 1;
-	else if (x1->old < x2->old) return -1;
-	return 0;
+	const unsigned int mask = SLOT_MASK(onm);
+	unsigned int slot = oldnewmap_hash(addr) & mask;
+
+	/* linear probing, there is always an empty slot since the table is never more than half full */
+	while (true) {
+		const int index = onm->map[slot];
+		if (index == MAP_SLOT_EMPTY) {
+			return -1;
+		}
+		if (onm->entries[index].old == addr) {
+			return index;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+static void oldnewmap_insert_index_in_map(OldNewMap *onm, const void *addr, int index)
+{
+	const unsigned int mask = SLOT_MASK(onm);
+	unsigned int slot = oldnewmap_hash(addr) & mask;
+
+	while (onm->map[slot] != MAP_SLOT_EMPTY) {
+		slot = (slot + 1) & mask;
+	}
+	onm->map[slot] = index;
+}
+
+static void oldnewmap_rebuild_map(OldNewMap *onm)
+{
+	int i;
+
+	/* all bits set: MAP_SLOT_EMPTY */
+	memset(onm->map, 0xff, sizeof(*onm->map) * (size_t)MAP_CAPACITY(onm));
+	for (i = 0; i < onm->nentries; i++) {
+		oldnewmap_insert_index_in_map(onm, onm->entries[i].old, i);
+	}
 }
 
+static void oldnewmap_resize(OldNewMap *onm, int capacity_exp)
+{
+	onm->capacity_exp = capacity_exp;
+	onm->entries = MEM_reallocN(onm->entries, sizeof(*onm->entries) * (size_t)ENTRIES_CAPACITY(onm));
+	onm->map = MEM_reallocN(onm->map, sizeof(*onm->map) * (size_t)MAP_CAPACITY(onm));
+	oldnewmap_rebuild_map(onm);
+}
 
-static void oldnewmap_sort(FileData *fd) 
+static OldNewMap *oldnewmap_new(void) 
 {
-	BLI_assert(fd->libmap->sorted == false);
-	qsort(fd->libmap->entries, fd->libmap->nentries, sizeof(OldNew), verg_oldnewmap);
-	fd->libmap->sorted = 1;
+	OldNewMap *onm = MEM_callocN(sizeof(*onm), "OldNewMap");
+	
+	onm->capacity_exp = DEFAULT_SIZE_EXP;
+	onm->entries = MEM_malloc_arrayN(ENTRIES_CAPACITY(onm), sizeof(*onm->entries), "OldNewMap.entries");
+	onm->map = MEM_malloc_arrayN(MAP_CAPACITY(onm), sizeof(*onm->map), "OldNewMap.map");
+	oldnewmap_rebuild_map(onm);
+	
+	return onm;
 }
 
 /* nr is zero for data, and ID code for libdata */
 static void oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
 {
 	OldNew *entry;
+	int index;
 	
 	if (oldaddr==NULL || newaddr==NULL) return;
 	
-	if (UNLIKELY(onm->nentries == onm->entriessize)) {
-		onm->entriessize *= 2;
-		onm->entries = MEM_reallocN(onm->entries, sizeof(*onm->entries) * onm->entriessize);
+	/* the same address may be written twice (corrupt files), the last one is used */
+	index = oldnewmap_lookup_index(onm, oldaddr);
+	if (index == -1) {
+		index = onm->nentries++;
+		oldnewmap_insert_index_in_map(onm, oldaddr, index);
 	}
 
-	entry = &onm->entries[onm->nentries++];
+	entry = &onm->entries[index];
 	entry->old = oldaddr;
 	entry->newp = newaddr;
 	entry->nr = nr;
+
+	if (UNLIKELY(onm->nentries == ENTRIES_CAPACITY(onm))) {
+		oldnewmap_resize(onm, onm->capacity_exp + 1);
+	}
 }
 
 void blo_do_versions_oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void *newaddr, int nr)
@@ -334,114 +411,51 @@ void blo_do_versions_oldnewmap_insert(OldNewMap *onm, const void *oldaddr, void
 	oldnewmap_insert(onm, oldaddr, newaddr, nr);
 }
 
-/**
- * Do a full search (no state).
- *
- * \param lasthit: Use as a reference position to avoid a full search
- * from either end of the array, giving more efficient lookups.
- *
- * \note This would seem an ideal case for hash or btree lookups.
- * However the data is written in-order, using the \a lasthit will normally avoid calling this function.
- * Creating a btree/hash structure adds overhead for the common-case to optimize the corner-case
- * (since most entries will never be retrieved).
- * So just keep full lookups as a fall-back.
- */
-static int oldnewmap_lookup_entry_full(const OldNewMap *onm, const void *addr, int lasthit)
-{
-	const int nentries = onm->nentries;
-	const OldNew *entries = onm->entries;
-	int i;
-
-	/* search relative to lasthit where possible */
-	if (lasthit >= 0 && lasthit < nentries) {
-
-		/* search forwards */
-		i = lasthit;
-		while (++i != nentries) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-
-		/* search backwards */
-		i = lasthit + 1;
-		while (i--) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-	}
-	else {
-		/* search backwards (full) */
-		i = nentries;
-		while (i--) {
-			if (entries[i].old == addr) {
-				return i;
-			}
-		}
-	}
-
-	return -1;
-}
-
 static void *oldnewmap_lookup_and_inc(OldNewMap *onm, const void *addr, bool increase_users)
 {
+	OldNew *entry;
 	int i;
 	
 	if (addr == NULL) return NULL;
 	
+	/* data is linked in the same order it's written, so this is the common case */
 	if (onm->lasthit < onm->nentries-1) {
-		OldNew *entry = &onm->entries[++onm->lasthit];
+		entry = &onm->entries[onm->lasthit + 1];
 		
 		if (entry->old == addr) {
+			onm->lasthit++;
 			if (increase_users)
 				entry->nr++;
 			return entry->newp;
 		}
 	}
 	
-	i = oldnewmap_lookup_entry_full(onm, addr, onm->lasthit);
-	if (i != -1) {
-		OldNew *entry = &onm->entries[i];
-		BLI_assert(entry->old == addr);
-		onm->lasthit = i;
-		if (increase_users)
-			entry->nr++;
-		return entry->newp;
+	i = oldnewmap_lookup_index(onm, addr);
+	if (i == -1) {
+		return NULL;
 	}
-	
-	return NULL;
+
+	entry = &onm->entries[i];
+	onm->lasthit = i;
+	if (increase_users)
+		entry->nr++;
+	return entry->newp;
 }
 
 /* for libdata, nr has ID code, no increment */
 static void *oldnewmap_liblookup(OldNewMap *onm, const void *addr, const void *lib)
 {
+	int i;
+
 	if (addr == NULL) {
 		return NULL;
 	}
 
-	/* lasthit works fine for non-libdata, linking there is done in same sequence as writing */
-	if (onm->sorted) {
-		const OldNew entry_s = {.old = addr};
-		OldNew *entry = bsearch(&entry_s, onm->entries, onm->nentries, sizeof(OldNew), verg_oldnewmap);
-		if (entry) {
-			ID *id = entry->newp;
-
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
-		}
-	}
-	else {
-		/* note, this can be a bottle neck when loading some files */
-		const int i = oldnewmap_lookup_entry_full(onm, addr, -1);
-		if (i != -1) {
-			OldNew *entry = &onm->entries[i];
-			ID *id = entry->newp;
-			BLI_assert(entry->old == addr);
-			if (id && (!lib || id->lib)) {
-				return id;
-			}
+	i = oldnewmap_lookup_index(onm, addr);
+	if (i != -1) {
+		ID *id = onm->entries[i].newp;
+		if (id && (!lib || id->lib)) {
+			return id;
 		}
 	}
 
@@ -465,14 +479,45 @@ static void oldnewmap_clear(OldNewMap *onm)
 {
 	onm->nentries = 0;
 	onm->lasthit = 0;
+
+	/* called for every ID, don't keep clearing a table sized for the largest one */
+	if (onm->capacity_exp != DEFAULT_SIZE_EXP) {
+		oldnewmap_resize(onm, DEFAULT_SIZE_EXP);
+	}
+	else {
+		oldnewmap_rebuild_map(onm);
+	}
 }
 
 static void oldnewmap_free(OldNewMap *onm) 
 {
 	MEM_freeN(onm->entries);
+	MEM_freeN(onm->map);
 	MEM_freeN(onm);
 }
 
+/* exposed for tests */
+OldNewMap *blo_oldnewmap_new(void)
+{
+	return oldnewmap_new();
+}
+
+void blo_oldnewmap_free(OldNewMap *onm)
+{
+	oldnewmap_free(onm);
+}
+
+void *blo_oldnewmap_lookup(OldNewMap *onm, const void *addr)
+{
+	return oldnewmap_lookup_and_inc(onm, addr, false);
+}
+
+#undef ENTRIES_CAPACITY
+#undef MAP_CAPACITY
+#undef SLOT_MASK
+#undef DEFAULT_SIZE_EXP
+#undef MAP_SLOT_EMPTY
+
 /***/
 
 static void read_libraries(FileData *basefd, ListBase *mainlist);
@@ -798,21 +843,39 @@ static BHeadN *get_bhead(FileData *fd)
 			 * the associated data and put everything in a BHeadN (creative naming !)
 			 */
 			if (!fd->eof) {
-				new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
-				if (new_bhead) {
-					new_bhead->next = new_bhead->prev = NULL;
-					new_bhead->bhead = bhead;
-					
-					readsize = fd->read(fd, new_bhead + 1, bhead.len);
-					
-					if (readsize != bhead.len) {
+				if (fd->flags & FD_FLAGS_FILE_MMAP) {
+					/* reference the data in the mapped file, it's only copied once by read_struct */
+					if ((size_t)bhead.len <= fd->mmap_size - fd->mmap_seek) {
+						new_bhead = MEM_mallocN(sizeof(BHeadN), "new_bhead");
+						new_bhead->next = new_bhead->prev = NULL;
+						new_bhead->data = fd->mmap_buffer + fd->mmap_seek;
+						new_bhead->bhead = bhead;
+
+						fd->mmap_seek += (size_t)bhead.len;
+						fd->seek += bhead.len;
+					}
+					else {
 						fd->eof = 1;
-						MEM_freeN(new_bhead);
-						new_bhead = NULL;
 					}
 				}
 				else {
-					fd->eof = 1;
+					new_bhead = MEM_mallocN(sizeof(BHeadN) + bhead.len, "new_bhead");
+					if (new_bhead) {
+						new_bhead->next = new_bhead->prev = NULL;
+						new_bhead->data = new_bhead + 1;
+						new_bhead->bhead = bhead;
+
+						readsize = fd->read(fd, new_bhead->data, bhead.len);
+
+						if (readsize != bhead.len) {
+							fd->eof = 1;
+							MEM_freeN(new_bhead);
+							new_bhead = NULL;
+						}
+					}
+					else {
+						fd->eof = 1;
+					}
 				}
 			}
 		}
@@ -882,10 +945,17 @@ BHead *blo_nextbhead(FileData *fd, BHead *thisblock)
 	return(bhead);
 }
 
+/* Use instead of (bhead + 1), since the data may not be stored directly after the BHead. */
+void *blo_bhead_data(const BHead *bhead)
+{
+	const BHeadN *bheadn = (const BHeadN *)POINTER_OFFSET(bhead, -offsetof(BHeadN, bhead));
+	return bheadn->data;
+}
+
 /* Warning! Caller's responsibility to ensure given bhead **is** and ID one! */
 const char *bhead_id_name(const FileData *fd, const BHead *bhead)
 {
-	return (const char *)POINTER_OFFSET(bhead, sizeof(*bhead) + fd->id_name_offs);
+	return (const char *)POINTER_OFFSET(blo_bhead_data(bhead), fd->id_name_offs);
 }
 
 static void decode_blender_header(FileData *fd)
@@ -942,10 +1012,10 @@ static bool read_file_dna(FileData *fd, const char **r_error_message)
 		if (bhead->code == DNA1) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
 			
-			fd->filesdna = DNA_sdna_from_data(&bhead[1], bhead->len, do_endian_swap, true, r_error_message);
+			fd->filesdna = DNA_sdna_from_data(blo_bhead_data(bhead), bhead->len, do_endian_swap, true, r_error_message);
 			if (fd->filesdna) {
 				fd->compflags = DNA_struct_get_compareflags(fd->filesdna, fd->memsdna);
-				/* used to retrieve ID names from (bhead+1) */
+				/* used to retrieve ID names from blo_bhead_data() */
 				fd->id_name_offs = DNA_elem_offset(fd->filesdna, "ID", "char", "name[]");
 
 				return true;
@@ -971,7 +1041,7 @@ static int *read_file_thumbnail(FileData *fd)
 	for (bhead = blo_firstbhead(fd); bhead; bhead = blo_nextbhead(fd, bhead)) {
 		if (bhead->code == TEST) {
 			const bool do_endian_swap = (fd->flags & FD_FLAGS_SWITCH_ENDIAN) != 0;
-			int *data = (int *)(bhead + 1);
+			int *data = blo_bhead_data(bhead);
 
 			if (bhead->len < (2 * sizeof(int))) {
 				break;
@@ -1032,6 +1102,256 @@ static int fd_read_gzip_from_file(FileData *filedata, void *buffer, unsigned int
 	return (readsize);
 }
 
+#ifdef USE_MMAP_READ
+static int fd_read_from_mmap(FileData *filedata, void *buffer, unsigned int size)
+{
+	/* don't read more bytes then there are available in the mapping */
+	const size_t readsize = MIN2((size_t)size, filedata->mmap_size - filedata->mmap_seek);
+
+	memcpy(buffer, filedata->mmap_buffer + filedata->mmap_seek, readsize);
+	filedata->mmap_seek += readsize;
+	filedata->seek += (int)readsize;
+
+	return (int)readsize;
+}
+
+typedef struct GzipMember {
+	const unsigned char *src;
+	unsigned int src_len;
+	unsigned char *dst;
+	unsigned int dst_len;
+	unsigned int crc;
+} GzipMember;
+
+typedef struct GzipMembersInflateData {
+	GzipMember *members;
+	bool error;
+} GzipMembersInflateData;
+
+static unsigned int gzip_read_uint32(const unsigned char *data)
+{
+	return ((unsigned int)data[0]) | ((unsigned int)data[1] << 8) |
+	       ((unsigned int)data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+static void gzip_member_inflate_cb(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	GzipMembersInflateData *data = userdata;
+	GzipMember *member = &data->members[index];
+	z_stream strm = {NULL};
+
+	/* raw inflate, the gzip header and trailer have been parsed already */
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK) {
+		data->error = true;
+		return;
+	}
+
+	strm.next_in = (Bytef *)member->src;
+	strm.avail_in = member->src_len;
+	strm.next_out = member->dst;
+	strm.avail_out = member->dst_len;
+
+	if ((inflate(&strm, Z_FINISH) != Z_STREAM_END) ||
+	    (strm.avail_out != 0) ||
+	    (crc32(0, member->dst, member->dst_len) != member->crc))
+	{
+		data->error = true;
+	}
+
+	inflateEnd(&strm);
+}
+
+/**
+ * Inflate a file written as a series of gzip members (see: BLEND_GZIP_MEMBER_SIZE) in parallel,
+ * into an anonymous mapping, so it's read and freed the same way as an uncompressed file.
+ *
+ * \return false for other gzip files, which are read with gzread.
+ */
+static bool fd_inflate_gzip_members(FileData *fd, const unsigned char *mem, size_t mem_size)
+{
+	GzipMembersInflateData data = {NULL};
+	int members_num = 0, members_alloc = 0;
+	size_t offset = 0, size = 0;
+	unsigned char *buf;
+	bool ok = true;
+	int i;
+
+	while (ok && offset < mem_size) {
+		const unsigned char *header = mem + offset;
+		GzipMember *member;
+		size_t member_len;
+
+		if ((mem_size - offset < BLEND_GZIP_HEADER_SIZE + 8) ||
+		    (header[0] != 0x1f || header[1] != 0x8b || header[2] != Z_DEFLATED || header[3] != 4) ||
+		    (header[10] != 8 || header[11] != 0) ||
+		    (header[12] != BLEND_GZIP_SUBFIELD_ID1 || header[13] != BLEND_GZIP_SUBFIELD_ID2) ||
+		    (header[14] != 4 || header[15] != 0))
+		{
+			ok = false;
+			break;
+		}
+
+		member_len = gzip_read_uint32(header + 16);
+		if ((member_len < BLEND_GZIP_HEADER_SIZE + 8) || (member_len > mem_size - offset)) {
+			ok = false;
+			break;
+		}
+
+		if (members_num == members_alloc) {
+			members_alloc = members_alloc ? members_alloc * 2 : 256;
+			data.members = MEM_reallocN(data.members, sizeof(*data.members) * (size_t)members_alloc);
+		}
+
+		member = &data.members[members_num++];
+		member->src = header + BLEND_GZIP_HEADER_SIZE;
+		member->src_len = (unsigned int)(member_len - BLEND_GZIP_HEADER_SIZE - 8);
+		member->crc = gzip_read_uint32(header + member_len - 8);
+		member->dst_len = gzip_read_uint32(header + member_len - 4);
+
+		if (member->dst_len > BLEND_GZIP_MEMBER_SIZE) {
+			ok = false;
+		}
+
+		size += member->dst_len;
+		offset += member_len;
+	}
+
+	if (!ok || size < SIZEOFBLENDERHEADER) {
+		MEM_SAFE_FREE(data.members);
+		return false;
+	}
+
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		MEM_freeN(data.members);
+		return false;
+	}
+
+	offset = 0;
+	for (i = 0; i < members_num; i++) {
+		data.members[i].dst = buf + offset;
+		offset += data.members[i].dst_len;
+	}
+
+	{
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.use_threading = (members_num > 1);
+		settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+		BLI_task_parallel_range(0, members_num, &data, gzip_member_inflate_cb, &settings);
+	}
+
+	MEM_freeN(data.members);
+
+	if (data.error) {
+		munmap(buf, size);
+		return false;
+	}
+
+	fd->mmap_buffer = (char *)buf;
+	fd->mmap_size = size;
+	return true;
+}
+
+/**
+ * Map an uncompressed file into memory (copy-on-write, since endian switching is done in-place).
+ * Compressed files written in parallel are inflated into memory instead.
+ *
+ * \return false when the file can't be mapped or is compressed otherwise,
+ * the caller falls back to reading it.
+ */
+static bool fd_mmap_file(FileData *fd, const char *filepath)
+{
+	struct stat st;
+	char *mem;
+	int file;
+
+	file = BLI_open(filepath, O_BINARY | O_RDONLY, 0);
+	if (file == -1) {
+		return false;
+	}
+
+	if (fstat(file, &st) == -1 || st.st_size < SIZEOFBLENDERHEADER) {
+		close(file);
+		return false;
+	}
+
+	mem = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+	/* the mapping stays valid after closing */
+	close(file);
+
+	if (mem == MAP_FAILED) {
+		return false;
+	}
+
+	/* test if gzip */
+	if (mem[0] == 0x1f && (unsigned char)mem[1] == 0x8b) {
+		const bool ok = fd_inflate_gzip_members(fd, (const unsigned char *)mem, (size_t)st.st_size);
+		munmap(mem, (size_t)st.st_size);
+		if (!ok) {
+			return false;
+		}
+		fd->flags |= FD_FLAGS_FILE_MMAP_INFLATED;
+	}
+	else {
+		fd->mmap_buffer = mem;
+		fd->mmap_size = (size_t)st.st_size;
+	}
+
+	fd->mmap_seek = 0;
+	fd->read = fd_read_from_mmap;
+	fd->flags |= FD_FLAGS_FILE_MMAP;
+
+	return true;
+}
+#endif  /* USE_MMAP_READ */
+
+/**
+ * The memory mapped file, once packed files reference their data in it (see: BLO_READ_LAZY_PACKED).
+ * It's unmapped when the FileData and all those packed files are freed.
+ */
+typedef struct BlendFileMapping {
+	char *buffer;
+	size_t size;
+	int users;
+} BlendFileMapping;
+
+#ifdef USE_MMAP_READ
+static BlendFileMapping *fd_mmap_share(FileData *fd)
+{
+	BLI_assert(fd->flags & FD_FLAGS_FILE_MMAP);
+
+	if (fd->mmap_shared == NULL) {
+		fd->mmap_shared = MEM_mallocN(sizeof(*fd->mmap_shared), __func__);
+		fd->mmap_shared->buffer = fd->mmap_buffer;
+		fd->mmap_shared->size = fd->mmap_size;
+		fd->mmap_shared->users = 1;
+	}
+
+	return fd->mmap_shared;
+}
+#endif
+
+void BLO_file_mapping_user_add(BlendFileMapping *mapping)
+{
+	atomic_add_and_fetch_int32(&mapping->users, 1);
+}
+
+void BLO_file_mapping_release(BlendFileMapping *mapping)
+{
+	if (atomic_sub_and_fetch_int32(&mapping->users, 1) == 0) {
+#ifdef USE_MMAP_READ
+		munmap(mapping->buffer, mapping->size);
+#else
+		BLI_assert(0);
+#endif
+		MEM_freeN(mapping);
+	}
+}
+
 static int fd_read_from_memory(FileData *filedata, void *buffer, unsigned int size)
 {
 	/* don't read more bytes then there are available in the buffer */
@@ -1146,6 +1466,20 @@ static FileData *blo_decode_and_check(FileData *fd, ReportList *reports)
 FileData *blo_openblenderfile(const char *filepath, ReportList *reports)
 {
 	gzFile gzfile;
+
+#ifdef USE_MMAP_READ
+	{
+		FileData *fd = filedata_new();
+		if (fd_mmap_file(fd, filepath)) {
+			/* needed for library_append and read_libraries */
+			BLI_strncpy(fd->relabase, filepath, sizeof(fd->relabase));
+
+			return blo_decode_and_check(fd, reports);
+		}
+		blo_freefiledata(fd);
+	}
+#endif
+
 	errno = 0;
 	gzfile = BLI_gzopen(filepath, "rb");
 	
@@ -1203,6 +1537,14 @@ static int fd_read_gzip_from_memory(FileData *filedata, void *buffer, unsigned i
 	// Inflate another chunk.
 	err = inflate (&filedata->strm, Z_SYNC_FLUSH);
 
+	/* compressed files may consist of multiple gzip members (see: BLEND_GZIP_MEMBER_SIZE) */
+	while ((err == Z_STREAM_END) && (filedata->strm.avail_in != 0)) {
+		if (inflateReset(&filedata->strm) != Z_OK) {
+			break;
+		}
+		err = (filedata->strm.avail_out != 0) ? inflate(&filedata->strm, Z_SYNC_FLUSH) : Z_OK;
+	}
+
 	if (err == Z_STREAM_END) {
 		return 0;
 	}
@@ -1290,6 +1632,16 @@ void blo_freefiledata(FileData *fd)
 		if (fd->gzfiledes != NULL) {
 			gzclose(fd->gzfiledes);
 		}
+
+#ifdef USE_MMAP_READ
+		if (fd->mmap_shared) {
+			/* packed files may still reference it */
+			BLO_file_mapping_release(fd->mmap_shared);
+		}
+		else if (fd->flags & FD_FLAGS_FILE_MMAP) {
+			munmap(fd->mmap_buffer, fd->mmap_size);
+		}
+#endif
 		
 		if (fd->strm.next_in) {
 			if (inflateEnd(&fd->strm) != Z_OK) {
@@ -1322,6 +1674,8 @@ void blo_freefiledata(FileData *fd)
 			oldnewmap_free(fd->soundmap);
 		if (fd->packedmap)
 			oldnewmap_free(fd->packedmap);
+		if (fd->packeddatamap)
+			oldnewmap_free(fd->packeddatamap);
 		if (fd->libmap && !(fd->flags & FD_FLAGS_NOT_MY_LIBMAP))
 			oldnewmap_free(fd->libmap);
 		if (fd->bheadmap)
@@ -1565,9 +1919,6 @@ static void change_idid_adr_fd(FileData *fd, const void *old, void *new)
 {
 	int i;
 	
-	/* use a binary search if we have a sorted libmap, for now it's not needed. */
-	BLI_assert(fd->libmap->sorted == false);
-
 	for (i = 0; i < fd->libmap->nentries; i++) {
 		OldNew *entry = &fd->libmap->entries[i];
 		
@@ -1887,7 +2238,7 @@ static void switch_endian_structs(const struct SDNA *filesdna, BHead *bhead)
 	int blocksize, nblocks;
 	char *data;
 	
-	data = (char *)(bhead+1);
+	data = blo_bhead_data(bhead);
 	blocksize = filesdna->typelens[ filesdna->structs[bhead->SDNAnr][0] ];
 	
 	nblocks = bhead->nr;
@@ -1909,12 +2260,12 @@ static void *read_struct(FileData *fd, BHead *bh, const char *blockname)
 		
 		if (fd->compflags[bh->SDNAnr] != SDNA_CMP_REMOVED) {
 			if (fd->compflags[bh->SDNAnr] == SDNA_CMP_NOT_EQUAL) {
-				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, (bh+1));
+				temp = DNA_struct_reconstruct(fd->memsdna, fd->filesdna, fd->compflags, bh->SDNAnr, bh->nr, blo_bhead_data(bh));
 			}
 			else {
 				/* SDNA_CMP_EQUAL */
 				temp = MEM_mallocN(bh->len, blockname);
-				memcpy(temp, (bh+1), bh->len);
+				memcpy(temp, blo_bhead_data(bh), bh->len);
 			}
 		}
 	}
@@ -2332,12 +2683,44 @@ static void direct_link_paint_curve(FileData *fd, PaintCurve *pc)
 
 static PackedFile *direct_link_packedfile(FileData *fd, PackedFile *oldpf)
 {
-	PackedFile *pf = newpackedadr(fd, oldpf);
+	PackedFile *pf;
+	BHead *bhead;
 
-	if (pf) {
+	/* undo, packed files of the current main are restored as they are (with their file mapping) */
+	if (fd->packedmap && oldpf) {
+		pf = oldnewmap_lookup_and_inc(fd->packedmap, oldpf, true);
+		if (pf) {
+			pf->data = newpackedadr(fd, pf->data);
+			return pf;
+		}
+	}
+
+	pf = newdataadr(fd, oldpf);
+	if (pf == NULL) {
+		return NULL;
+	}
+
+	pf->mapping = NULL;
+
+	/* data which wasn't read, see: read_data_into_oldnewmap */
+	bhead = fd->packeddatamap ? oldnewmap_lookup_and_inc(fd->packeddatamap, pf->data, true) : NULL;
+	if (bhead) {
+#ifdef USE_MMAP_READ
+		if (pf->size >= 0 && pf->size <= bhead->len) {
+			pf->data = blo_bhead_data(bhead);
+			pf->mapping = fd_mmap_share(fd);
+			BLO_file_mapping_user_add(pf->mapping);
+		}
+		else
+#endif
+		{
+			pf->data = read_struct(fd, bhead, "PackedFile data");
+		}
+	}
+	else {
 		pf->data = newpackedadr(fd, pf->data);
 	}
-	
+
 	return pf;
 }
 
@@ -4612,6 +4995,7 @@ static void direct_link_customdata(FileData *fd, CustomData *data, int count)
 			layer->flag &= ~CD_FLAG_IN_MEMORY;
 
 		layer->flag &= ~CD_FLAG_NOFREE;
+		layer->shared = NULL;
 		
 		if (CustomData_verify_versions(data, i)) {
 			layer->data = newdataadr(fd, layer->data);
@@ -5659,6 +6043,7 @@ static void direct_link_object(FileData *fd, Object *ob)
 	ob->bb = NULL;
 	ob->derivedDeform = NULL;
 	ob->derivedFinal = NULL;
+	ob->modifier_stack_cache = NULL;
 	BLI_listbase_clear(&ob->gpulamp);
 	link_list(fd, &ob->pc_ids);
 
@@ -8125,10 +8510,24 @@ static const char *dataname(short id_code)
 
 static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *allocname)
 {
+	/* data of the PackedFile read last, only set when packed data isn't read (see: BLO_READ_LAZY_PACKED) */
+	const void *packed_data_old = NULL;
+
 	bhead = blo_nextbhead(fd, bhead);
 	
 	while (bhead && bhead->code==DATA) {
 		void *data;
+
+		/* packed data is written right after its PackedFile,
+		 * keep its block so the data can reference the mapped file, see: direct_link_packedfile */
+		if (packed_data_old && bhead->old == packed_data_old) {
+			oldnewmap_insert(fd->packeddatamap, bhead->old, bhead, 0);
+			packed_data_old = NULL;
+			bhead = blo_nextbhead(fd, bhead);
+			continue;
+		}
+		packed_data_old = NULL;
+
 #if 0
 		/* XXX DUMB DEBUGGING OPTION TO GIVE NAMES for guarded malloc errors */
 		short *sp = fd->filesdna->structs[bhead->SDNAnr];
@@ -8142,6 +8541,10 @@ static BHead *read_data_into_oldnewmap(FileData *fd, BHead *bhead, const char *a
 		
 		if (data) {
 			oldnewmap_insert(fd->datamap, bhead->old, data, 0);
+
+			if (fd->packeddatamap && bhead->SDNAnr == fd->packedfile_sdna_nr) {
+				packed_data_old = ((PackedFile *)data)->data;
+			}
 		}
 		
 		bhead = blo_nextbhead(fd, bhead);
@@ -8366,6 +8769,9 @@ static BHead *read_libblock(FileData *fd, Main *main, BHead *bhead, const short
 	
 	oldnewmap_free_unused(fd->datamap);
 	oldnewmap_clear(fd->datamap);
+	if (fd->packeddatamap && fd->packeddatamap->nentries) {
+		oldnewmap_clear(fd->packeddatamap);
+	}
 	
 	if (wrong_id) {
 		BKE_libblock_free(main, id);
@@ -8517,8 +8923,6 @@ static void do_versions_after_linking(Main *main)
 
 static void lib_link_all(FileData *fd, Main *main)
 {
-	oldnewmap_sort(fd);
-	
 	/* No load UI for undo memfiles */
 	if (fd->memfile == NULL) {
 		lib_link_windowmanager(fd, main);
@@ -8651,6 +9055,18 @@ BlendFileData *blo_read_file_internal(FileData *fd, const char *filepath)
 	bfd->type = BLENFILETYPE_BLEND;
 	BLI_strncpy(bfd->main->name, filepath, sizeof(bfd->main->name));
 
+#ifdef USE_MMAP_READ
+	/* packed data of inflated files isn't referenced, since that would keep the whole file in memory */
+	if ((fd->skip_flags & BLO_READ_LAZY_PACKED) &&
+	    (fd->flags & (FD_FLAGS_FILE_MMAP | FD_FLAGS_FILE_MMAP_INFLATED)) == FD_FLAGS_FILE_MMAP)
+	{
+		fd->packedfile_sdna_nr = DNA_struct_find_nr(fd->filesdna, "PackedFile");
+		if (fd->packedfile_sdna_nr != -1) {
+			fd->packeddatamap = oldnewmap_new();
+		}
+	}
+#endif
+
 	if (G.background) {
 		/* We only read & store .blend thumbnail in background mode
 		 * (because we cannot re-generate it, no OpenGL available).
@@ -62,6 +62,13 @@ typedef struct FileData {
 	int filedes;
 	gzFile gzfiledes;
 
+	// variables needed for reading from a memory mapped file (see: USE_MMAP_READ)
+	char *mmap_buffer;
+	size_t mmap_size;
+	size_t mmap_seek;
+	/* the mapping when packed files reference it (see: BLO_READ_LAZY_PACKED) */
+	struct BlendFileMapping *mmap_shared;
+
 	// now only in use for library appending
 	char relabase[FILE_MAX];
 	
@@ -90,6 +97,9 @@ typedef struct FileData {
 	struct OldNewMap *movieclipmap;
 	struct OldNewMap *soundmap;
 	struct OldNewMap *packedmap;
+	/* packed file data which isn't read, but referenced in the mapped file (see: BLO_READ_LAZY_PACKED) */
+	struct OldNewMap *packeddatamap;
+	int packedfile_sdna_nr;
 	
 	struct BHeadSort *bheadmap;
 	int tot_bheadmap;
@@ -109,6 +119,9 @@ typedef struct FileData {
 
 typedef struct BHeadN {
 	struct BHeadN *next, *prev;
+	/* Block data, either stored directly after this struct
+	 * or referencing the memory mapped file (see: FD_FLAGS_FILE_MMAP). */
+	void *data;
 	struct BHead bhead;
 } BHeadN;
 
@@ -120,10 +133,23 @@ enum {
 	FD_FLAGS_FILE_OK               = 1 << 3,
 	FD_FLAGS_NOT_MY_BUFFER         = 1 << 4,
 	FD_FLAGS_NOT_MY_LIBMAP         = 1 << 5,  /* XXX Unused in practice (checked once but never set). */
+	FD_FLAGS_FILE_MMAP             = 1 << 6,  /* Block data references FileData.mmap_buffer. */
+	FD_FLAGS_FILE_MMAP_INFLATED    = 1 << 7,  /* FileData.mmap_buffer is anonymous memory (inflated from gzip). */
 };
 
 #define SIZEOFBLENDERHEADER 12
 
+/* Compressed files are written as a series of gzip members (each compressing up to
+ * BLEND_GZIP_MEMBER_SIZE bytes), so they can be compressed and decompressed in parallel.
+ * The header of each member has an extra sub-field storing the total size of the member,
+ * used to locate them without decompressing.
+ * Other readers see the members as a single gzip stream. */
+#define BLEND_GZIP_MEMBER_SIZE (1 << 20)
+#define BLEND_GZIP_SUBFIELD_ID1 'B'
+#define BLEND_GZIP_SUBFIELD_ID2 'L'
+/* fixed gzip header (10) + XLEN (2) + sub-field header (4) + member size (4) */
+#define BLEND_GZIP_HEADER_SIZE 20
+
 /***/
 struct Main;
 void blo_join_main(ListBase *mainlist);
@@ -152,6 +178,7 @@ BHead *blo_firstbhead(FileData *fd);
 BHead *blo_nextbhead(FileData *fd, BHead *thisblock);
 BHead *blo_prevbhead(FileData *fd, BHead *thisblock);
 
+void *blo_bhead_data(const BHead *bhead);
 const char *bhead_id_name(const FileData *fd, const BHead *bhead);
 
 /* do versions stuff */
@@ -162,6 +189,11 @@ void blo_do_versions_oldnewmap_insert(struct OldNewMap *onm, const void *oldaddr
 void *blo_do_versions_newlibadr(struct FileData *fd, const void *lib, const void *adr);
 void *blo_do_versions_newlibadr_us(struct FileData *fd, const void *lib, const void *adr);
 
+/* exposed for tests */
+struct OldNewMap *blo_oldnewmap_new(void);
+void blo_oldnewmap_free(struct OldNewMap *onm);
+void *blo_oldnewmap_lookup(struct OldNewMap *onm, const void *addr);
+
 struct PartEff *blo_do_version_give_parteff_245(struct Object *ob);
 void blo_do_version_old_trackto_to_constraints(struct Object *ob);
 void blo_do_versions_view3d_split_250(struct View3D *v3d, struct ListBase *regions);
@@ -40,19 +40,128 @@
 #include "DNA_listBase.h"
 
 #include "BLI_blenlib.h"
+#include "BLI_utildefines.h"
+#include "BLI_ghash.h"
+#include "BLI_hash_mm2a.h"
+#include "BLI_threads.h"
 
 #include "BLO_undofile.h"
 
 /* **************** support for memory-write, for undo buffers *************** */
 
+/**
+ * Chunk data is shared by all memfiles with the same content (not only the previous step),
+ * so reordered or inserted data doesn't cause unrelated chunks to be duplicated.
+ *
+ * The data of a #MemFileChunk is stored directly after this header,
+ * which is referenced by every chunk using it.
+ *
+ * The set and the user counts are global (shared between undo stacks),
+ * so they're protected by #memfile_shared_bufs_lock.
+ */
+typedef struct MemFileSharedBuf {
+	/* the content, directly after this struct (or the data being looked up) */
+	const char *buf;
+	unsigned int size;
+	unsigned int hash;
+	unsigned int users;
+} MemFileSharedBuf;
+
+static GSet *memfile_shared_bufs = NULL;
+static ThreadMutex memfile_shared_bufs_lock = BLI_MUTEX_INITIALIZER;
+
+#define SHARED_BUF_FROM_CHUNK(chunk) \
+	((MemFileSharedBuf *)((chunk)->buf - sizeof(MemFileSharedBuf)))
+
+static unsigned int memfile_shared_buf_hash(const void *key)
+{
+	const MemFileSharedBuf *sbuf = key;
+	return sbuf->hash;
+}
+
+static bool memfile_shared_buf_cmp(const void *a, const void *b)
+{
+	const MemFileSharedBuf *sbuf_a = a;
+	const MemFileSharedBuf *sbuf_b = b;
+	return !((sbuf_a->hash == sbuf_b->hash) &&
+	         (sbuf_a->size == sbuf_b->size) &&
+	         (memcmp(sbuf_a->buf, sbuf_b->buf, sbuf_a->size) == 0));
+}
+
+/**
+ * \return Shared data matching \a buf, creating it when it's not stored yet.
+ */
+static MemFileSharedBuf *memfile_shared_buf_ensure(const char *buf, unsigned int size, bool *r_created)
+{
+	MemFileSharedBuf key = {
+		.buf = buf,
+		.size = size,
+		.hash = BLI_hash_mm2((const unsigned char *)buf, size, 0),
+	};
+	MemFileSharedBuf *sbuf;
+
+	BLI_mutex_lock(&memfile_shared_bufs_lock);
+
+	if (memfile_shared_bufs == NULL) {
+		memfile_shared_bufs = BLI_gset_new(memfile_shared_buf_hash, memfile_shared_buf_cmp, __func__);
+	}
+
+	sbuf = BLI_gset_lookup(memfile_shared_bufs, &key);
+	if (sbuf) {
+		*r_created = false;
+	}
+	else {
+		sbuf = MEM_mallocN(sizeof(*sbuf) + size, "Chunk buffer");
+		memcpy(sbuf + 1, buf, size);
+		sbuf->buf = (const char *)(sbuf + 1);
+		sbuf->size = size;
+		sbuf->hash = key.hash;
+		sbuf->users = 0;
+		BLI_gset_insert(memfile_shared_bufs, sbuf);
+		*r_created = true;
+	}
+
+	sbuf->users++;
+
+	BLI_mutex_unlock(&memfile_shared_bufs_lock);
+
+	return sbuf;
+}
+
+static void memfile_shared_buf_add_user(MemFileSharedBuf *sbuf)
+{
+	BLI_mutex_lock(&memfile_shared_bufs_lock);
+	BLI_assert(sbuf->users != 0);
+	sbuf->users++;
+	BLI_mutex_unlock(&memfile_shared_bufs_lock);
+}
+
+static void memfile_shared_buf_release(MemFileSharedBuf *sbuf)
+{
+	BLI_mutex_lock(&memfile_shared_bufs_lock);
+
+	BLI_assert(sbuf->users != 0);
+
+	if (--sbuf->users == 0) {
+		BLI_gset_remove(memfile_shared_bufs, sbuf, NULL);
+		MEM_freeN(sbuf);
+
+		if (BLI_gset_len(memfile_shared_bufs) == 0) {
+			BLI_gset_free(memfile_shared_bufs, NULL);
+			memfile_shared_bufs = NULL;
+		}
+	}
+
+	BLI_mutex_unlock(&memfile_shared_bufs_lock);
+}
+
 /* not memfile itself */
 void BLO_memfile_free(MemFile *memfile)
 {
 	MemFileChunk *chunk;
 	
 	while ((chunk = BLI_pophead(&memfile->chunks))) {
-		if (chunk->ident == 0)
-			MEM_freeN(chunk->buf);
+		memfile_shared_buf_release(SHARED_BUF_FROM_CHUNK(chunk));
 		MEM_freeN(chunk);
 	}
 	memfile->size = 0;
@@ -60,23 +169,9 @@ void BLO_memfile_free(MemFile *memfile)
 
 /* to keep list of memfiles consistent, 'first' is always first in list */
 /* result is that 'first' is being freed */
-void BLO_memfile_merge(MemFile *first, MemFile *second)
+void BLO_memfile_merge(MemFile *first, MemFile *UNUSED(second))
 {
-	MemFileChunk *fc, *sc;
-	
-	fc = first->chunks.first;
-	sc = second->chunks.first;
-	while (fc || sc) {
-		if (fc && sc) {
-			if (sc->ident) {
-				sc->ident = 0;
-				fc->ident = 1;
-			}
-		}
-		if (fc) fc = fc->next;
-		if (sc) sc = sc->next;
-	}
-	
+	/* chunk data is reference counted, data still used by 'second' isn't freed */
 	BLO_memfile_free(first);
 }
 
@@ -84,6 +179,7 @@ void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsi
 {
 	static MemFileChunk *compchunk = NULL;
 	MemFileChunk *curchunk;
+	MemFileSharedBuf *sbuf = NULL;
 	
 	/* this function inits when compare != NULL or when current == NULL  */
 	if (compare) {
@@ -95,28 +191,28 @@ void memfile_chunk_add(MemFile *compare, MemFile *current, const char *buf, unsi
 		return;
 	}
 	
-	curchunk = MEM_mallocN(sizeof(MemFileChunk), "MemFileChunk");
-	curchunk->size = size;
-	curchunk->buf = NULL;
-	curchunk->ident = 0;
-	BLI_addtail(&current->chunks, curchunk);
-	
-	/* we compare compchunk with buf */
+	/* we compare compchunk with buf, data is usually unchanged and in the same order */
 	if (compchunk) {
-		if (compchunk->size == curchunk->size) {
+		if (compchunk->size == size) {
 			if (memcmp(compchunk->buf, buf, size) == 0) {
-				curchunk->buf = compchunk->buf;
-				curchunk->ident = 1;
+				sbuf = SHARED_BUF_FROM_CHUNK(compchunk);
+				memfile_shared_buf_add_user(sbuf);
 			}
 		}
 		compchunk = compchunk->next;
 	}
 	
-	/* not equal... */
-	if (curchunk->buf == NULL) {
-		curchunk->buf = MEM_mallocN(size, "Chunk buffer");
-		memcpy(curchunk->buf, buf, size);
-		current->size += size;
+	/* not equal, look for the same data in any other memfile */
+	if (sbuf == NULL) {
+		bool created;
+		sbuf = memfile_shared_buf_ensure(buf, size, &created);
+		if (created) {
+			current->size += size;
+		}
 	}
-}
 
+	curchunk = MEM_mallocN(sizeof(MemFileChunk), "MemFileChunk");
+	curchunk->buf = (char *)sbuf->buf;
+	curchunk->size = size;
+	BLI_addtail(&current->chunks, curchunk);
+}
@@ -154,6 +154,8 @@
 #include "BLI_blenlib.h"
 #include "BLI_linklist.h"
 #include "BLI_mempool.h"
+#include "BLI_task.h"
+#include "BLI_threads.h"
 
 #include "BKE_action.h"
 #include "BKE_blender_version.h"
@@ -215,7 +217,7 @@ struct WriteWrap {
 	/* internal */
 	union {
 		int file_handle;
-		gzFile gz_handle;
+		struct WriteWrapZlib *zlib;
 	} _user_data;
 };
 
@@ -247,33 +249,209 @@ static size_t ww_write_none(WriteWrap *ww, const char *buf, size_t buf_len)
 }
 #undef FILE_HANDLE
 
-/* zlib */
-#define FILE_HANDLE(ww) \
-	(ww)->_user_data.gz_handle
+/* zlib
+ *
+ * Data is split into BLEND_GZIP_MEMBER_SIZE pieces, each written as its own gzip member.
+ * Members are compressed in parallel, a batch at a time, and written in order.
+ * See: BLEND_GZIP_HEADER_SIZE for the file layout. */
+
+/* Members per batch, a few per worker thread so threads don't wait on each other at the end of a batch.
+ * Capped since each member needs an input and an output buffer (~2mb together). */
+#define WW_ZLIB_MEMBERS_PER_THREAD 4
+#define WW_ZLIB_MEMBERS_MAX 32
+
+typedef struct WriteWrapZlib {
+	int file_handle;
+
+	/* uncompressed data of the current batch */
+	char *buf;
+	size_t buf_len, buf_used;
+
+	/* compressed members of the current batch */
+	char *members;
+	size_t *members_len;
+	int members_num;
+	size_t member_bound;
+} WriteWrapZlib;
+
+typedef struct WriteWrapZlibTaskData {
+	WriteWrapZlib *zlib;
+	int members_num;
+	bool error;
+} WriteWrapZlibTaskData;
 
-static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+#define FILE_ZLIB(ww) \
+	(ww)->_user_data.zlib
+
+static void ww_zlib_member_header(unsigned char *header, size_t member_len)
 {
-	gzFile file;
+	memset(header, 0, BLEND_GZIP_HEADER_SIZE);
+	header[0] = 0x1f;
+	header[1] = 0x8b;
+	header[2] = Z_DEFLATED;
+	header[3] = 4;  /* FEXTRA */
+	header[8] = 4;  /* XFL: fastest compression */
+	header[9] = 255;  /* OS: unknown */
+	/* XLEN */
+	header[10] = 8;
+	/* sub-field */
+	header[12] = BLEND_GZIP_SUBFIELD_ID1;
+	header[13] = BLEND_GZIP_SUBFIELD_ID2;
+	header[14] = 4;
+	/* total size of this member */
+	header[16] = (unsigned char)(member_len);
+	header[17] = (unsigned char)(member_len >> 8);
+	header[18] = (unsigned char)(member_len >> 16);
+	header[19] = (unsigned char)(member_len >> 24);
+}
 
-	file = BLI_gzopen(filepath, "wb1");
+static void ww_zlib_member_trailer(unsigned char *trailer, unsigned int crc, unsigned int len)
+{
+	int i;
+	for (i = 0; i < 4; i++) {
+		trailer[i] = (unsigned char)(crc >> (i * 8));
+		trailer[i + 4] = (unsigned char)(len >> (i * 8));
+	}
+}
 
-	if (file != Z_NULL) {
-		FILE_HANDLE(ww) = file;
-		return true;
+static void ww_zlib_member_compress_cb(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	WriteWrapZlibTaskData *data = userdata;
+	WriteWrapZlib *zlib = data->zlib;
+	const size_t src_offset = (size_t)index * BLEND_GZIP_MEMBER_SIZE;
+	const unsigned int src_len = (unsigned int)MIN2(zlib->buf_used - src_offset, BLEND_GZIP_MEMBER_SIZE);
+	const Bytef *src = (const Bytef *)zlib->buf + src_offset;
+	unsigned char *dst = (unsigned char *)zlib->members + (size_t)index * zlib->member_bound;
+	z_stream strm = {NULL};
+	size_t member_len;
+
+	/* raw deflate, the gzip header and trailer are written here */
+	if (deflateInit2(&strm, 1, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		data->error = true;
+		return;
+	}
+
+	strm.next_in = (Bytef *)src;
+	strm.avail_in = src_len;
+	strm.next_out = dst + BLEND_GZIP_HEADER_SIZE;
+	strm.avail_out = (unsigned int)(zlib->member_bound - BLEND_GZIP_HEADER_SIZE - 8);
+
+	if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+		data->error = true;
 	}
 	else {
+		member_len = BLEND_GZIP_HEADER_SIZE + strm.total_out + 8;
+		ww_zlib_member_header(dst, member_len);
+		ww_zlib_member_trailer(dst + member_len - 8, (unsigned int)crc32(0, src, src_len), src_len);
+		zlib->members_len[index] = member_len;
+	}
+
+	deflateEnd(&strm);
+}
+
+/* Compress the pending batch in parallel, then write it out. */
+static bool ww_zlib_flush(WriteWrapZlib *zlib)
+{
+	WriteWrapZlibTaskData data = {
+		.zlib = zlib,
+		.members_num = (int)((zlib->buf_used + BLEND_GZIP_MEMBER_SIZE - 1) / BLEND_GZIP_MEMBER_SIZE),
+		.error = false,
+	};
+	ParallelRangeSettings settings;
+	int i;
+
+	if (data.members_num == 0) {
+		return true;
+	}
+
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (data.members_num > 1);
+	settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+	BLI_task_parallel_range(0, data.members_num, &data, ww_zlib_member_compress_cb, &settings);
+
+	zlib->buf_used = 0;
+
+	if (data.error) {
 		return false;
 	}
+
+	for (i = 0; i < data.members_num; i++) {
+		const char *member = zlib->members + (size_t)i * zlib->member_bound;
+		if ((size_t)write(zlib->file_handle, member, zlib->members_len[i]) != zlib->members_len[i]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool ww_open_zlib(WriteWrap *ww, const char *filepath)
+{
+	WriteWrapZlib *zlib;
+	int file;
+
+	file = BLI_open(filepath, O_BINARY + O_WRONLY + O_CREAT + O_TRUNC, 0666);
+
+	if (file == -1) {
+		return false;
+	}
+
+	zlib = MEM_callocN(sizeof(*zlib), __func__);
+	zlib->file_handle = file;
+	zlib->members_num = BLI_task_scheduler_num_threads(BLI_task_scheduler_get()) * WW_ZLIB_MEMBERS_PER_THREAD;
+	CLAMP(zlib->members_num, 1, WW_ZLIB_MEMBERS_MAX);
+	zlib->member_bound = BLEND_GZIP_HEADER_SIZE + compressBound(BLEND_GZIP_MEMBER_SIZE) + 8;
+	zlib->buf_len = (size_t)zlib->members_num * BLEND_GZIP_MEMBER_SIZE;
+	zlib->buf = MEM_mallocN(zlib->buf_len, "WriteWrapZlib.buf");
+	zlib->members = MEM_mallocN((size_t)zlib->members_num * zlib->member_bound, "WriteWrapZlib.members");
+	zlib->members_len = MEM_malloc_arrayN((size_t)zlib->members_num, sizeof(*zlib->members_len), __func__);
+
+	FILE_ZLIB(ww) = zlib;
+	return true;
 }
 static bool ww_close_zlib(WriteWrap *ww)
 {
-	return (gzclose(FILE_HANDLE(ww)) == Z_OK);
+	WriteWrapZlib *zlib = FILE_ZLIB(ww);
+	bool ok = ww_zlib_flush(zlib);
+
+	if (close(zlib->file_handle) == -1) {
+		ok = false;
+	}
+
+	MEM_freeN(zlib->buf);
+	MEM_freeN(zlib->members);
+	MEM_freeN(zlib->members_len);
+	MEM_freeN(zlib);
+
+	return ok;
 }
 static size_t ww_write_zlib(WriteWrap *ww, const char *buf, size_t buf_len)
 {
-	return gzwrite(FILE_HANDLE(ww), buf, buf_len);
+	WriteWrapZlib *zlib = FILE_ZLIB(ww);
+	size_t written = 0;
+
+	while (written != buf_len) {
+		const size_t len = MIN2(buf_len - written, zlib->buf_len - zlib->buf_used);
+
+		memcpy(zlib->buf + zlib->buf_used, buf + written, len);
+		zlib->buf_used += len;
+		written += len;
+
+		if (zlib->buf_used == zlib->buf_len) {
+			if (!ww_zlib_flush(zlib)) {
+				return 0;
+			}
+		}
+	}
+
+	return written;
 }
-#undef FILE_HANDLE
+#undef FILE_ZLIB
+#undef WW_ZLIB_MEMBERS_PER_THREAD
+#undef WW_ZLIB_MEMBERS_MAX
 
 /* --- end compression types --- */
 
@@ -4098,9 +4276,12 @@ bool BLO_write_file(
 	}
 
 	/* actual file writing */
-	const bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
+	bool err = write_file_handle(mainvar, &ww, NULL, NULL, write_flags, thumb);
 
-	ww.close(&ww);
+	/* compressed data may still be written on close */
+	if (ww.close(&ww) == false) {
+		err = true;
+	}
 
 	if (UNLIKELY(path_list_backup)) {
 		BKE_bpath_list_restore(mainvar, path_list_flag, path_list_backup);
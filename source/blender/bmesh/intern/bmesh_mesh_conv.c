@@ -86,6 +86,7 @@
 #include "BLI_listbase.h"
 #include "BLI_alloca.h"
 #include "BLI_math_vector.h"
+#include "BLI_task.h"
 
 #include "BKE_mesh.h"
 #include "BKE_customdata.h"
@@ -216,6 +217,110 @@ static BMFace *bm_face_create_from_mpoly(
 	return BM_face_create(bm, verts, edges, mp->totloop, NULL, BM_CREATE_SKIP_CD);
 }
 
+/* Elements are created serially (the element pools and topology are not thread-safe),
+ * their custom-data blocks are only allocated at that point,
+ * the data itself is then copied from the mesh in parallel. */
+typedef struct BMFromMeshData {
+	BMesh *bm;
+	Mesh *me;
+	BMVert **vtable;
+	BMEdge **etable;
+	BMFace **ftable;
+
+	const float (**shape_key_table)[3];
+	int tot_shape_keys;
+
+	int cd_vert_bweight_offset;
+	int cd_edge_bweight_offset;
+	int cd_edge_crease_offset;
+	int cd_shape_key_offset;
+	int cd_shape_keyindex_offset;
+
+	bool calc_face_normal;
+} BMFromMeshData;
+
+static void bm_from_me_verts_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMFromMeshData *data = userdata;
+	Mesh *me = data->me;
+	BMVert *v = data->vtable[i];
+	const MVert *mvert = &me->mvert[i];
+
+	normal_short_to_float_v3(v->no, mvert->no);
+
+	/* Copy Custom Data */
+	CustomData_to_bmesh_block(&me->vdata, &data->bm->vdata, i, &v->head.data, true);
+
+	if (data->cd_vert_bweight_offset != -1) {
+		BM_ELEM_CD_SET_FLOAT(v, data->cd_vert_bweight_offset, (float)mvert->bweight / 255.0f);
+	}
+
+	/* set shape key original index */
+	if (data->cd_shape_keyindex_offset != -1) {
+		BM_ELEM_CD_SET_INT(v, data->cd_shape_keyindex_offset, i);
+	}
+
+	/* set shapekey data */
+	if (data->tot_shape_keys) {
+		float (*co_dst)[3] = BM_ELEM_CD_GET_VOID_P(v, data->cd_shape_key_offset);
+		for (int j = 0; j < data->tot_shape_keys; j++, co_dst++) {
+			copy_v3_v3(*co_dst, data->shape_key_table[j][i]);
+		}
+	}
+}
+
+static void bm_from_me_edges_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMFromMeshData *data = userdata;
+	Mesh *me = data->me;
+	BMEdge *e = data->etable[i];
+	const MEdge *medge = &me->medge[i];
+
+	/* Copy Custom Data */
+	CustomData_to_bmesh_block(&me->edata, &data->bm->edata, i, &e->head.data, true);
+
+	if (data->cd_edge_bweight_offset != -1) {
+		BM_ELEM_CD_SET_FLOAT(e, data->cd_edge_bweight_offset, (float)medge->bweight / 255.0f);
+	}
+	if (data->cd_edge_crease_offset != -1) {
+		BM_ELEM_CD_SET_FLOAT(e, data->cd_edge_crease_offset, (float)medge->crease / 255.0f);
+	}
+}
+
+static void bm_from_me_faces_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMFromMeshData *data = userdata;
+	Mesh *me = data->me;
+	BMesh *bm = data->bm;
+	BMFace *f = data->ftable[i];
+	BMLoop *l_iter, *l_first;
+
+	if (UNLIKELY(f == NULL)) {
+		return;
+	}
+
+	int j = me->mpoly[i].loopstart;
+	l_iter = l_first = BM_FACE_FIRST_LOOP(f);
+	do {
+		CustomData_to_bmesh_block(&me->ldata, &bm->ldata, j++, &l_iter->head.data, true);
+	} while ((l_iter = l_iter->next) != l_first);
+
+	/* Copy Custom Data */
+	CustomData_to_bmesh_block(&me->pdata, &bm->pdata, i, &f->head.data, true);
+
+	if (data->calc_face_normal) {
+		BM_face_normal_update(f);
+	}
+}
 
 /**
  * \brief Mesh -> BMesh
@@ -361,23 +466,8 @@ void BM_mesh_bm_from_me(
 			BM_vert_select_set(bm, v, true);
 		}
 
-		normal_short_to_float_v3(v->no, mvert->no);
-
-		/* Copy Custom Data */
-		CustomData_to_bmesh_block(&me->vdata, &bm->vdata, i, &v->head.data, true);
-
-		if (cd_vert_bweight_offset != -1) BM_ELEM_CD_SET_FLOAT(v, cd_vert_bweight_offset, (float)mvert->bweight / 255.0f);
-
-		/* set shape key original index */
-		if (cd_shape_keyindex_offset != -1) BM_ELEM_CD_SET_INT(v, cd_shape_keyindex_offset, i);
-
-		/* set shapekey data */
-		if (tot_shape_keys) {
-			float (*co_dst)[3] = BM_ELEM_CD_GET_VOID_P(v, cd_shape_key_offset);
-			for (int j = 0; j < tot_shape_keys; j++, co_dst++) {
-				copy_v3_v3(*co_dst, shape_key_table[j][i]);
-			}
-		}
+		/* Custom Data is copied in bm_from_me_verts_cb */
+		CustomData_bmesh_alloc_block(&bm->vdata, &v->head.data);
 	}
 	if (is_new) {
 		bm->elem_index_dirty &= ~BM_VERT; /* added in order, clear dirty flag */
@@ -398,21 +488,14 @@ void BM_mesh_bm_from_me(
 			BM_edge_select_set(bm, e, true);
 		}
 
-		/* Copy Custom Data */
-		CustomData_to_bmesh_block(&me->edata, &bm->edata, i, &e->head.data, true);
-
-		if (cd_edge_bweight_offset != -1) BM_ELEM_CD_SET_FLOAT(e, cd_edge_bweight_offset, (float)medge->bweight / 255.0f);
-		if (cd_edge_crease_offset  != -1) BM_ELEM_CD_SET_FLOAT(e, cd_edge_crease_offset,  (float)medge->crease  / 255.0f);
-
+		/* Custom Data is copied in bm_from_me_edges_cb */
+		CustomData_bmesh_alloc_block(&bm->edata, &e->head.data);
 	}
 	if (is_new) {
 		bm->elem_index_dirty &= ~BM_EDGE; /* added in order, clear dirty flag */
 	}
 
-	/* only needed for selection. */
-	if (me->mselect && me->totselect != 0) {
-		ftable = MEM_mallocN(sizeof(BMFace **) * me->totpoly, __func__);
-	}
+	ftable = MEM_mallocN(sizeof(BMFace **) * me->totpoly, __func__);
 
 	mloop = me->mloop;
 	mp = me->mpoly;
@@ -420,11 +503,7 @@ void BM_mesh_bm_from_me(
 		BMLoop *l_iter;
 		BMLoop *l_first;
 
-		f = bm_face_create_from_mpoly(mp, mloop + mp->loopstart,
-		                              bm, vtable, etable);
-		if (ftable != NULL) {
-			ftable[i] = f;
-		}
+		f = ftable[i] = bm_face_create_from_mpoly(mp, mloop + mp->loopstart, bm, vtable, etable);
 
 		if (UNLIKELY(f == NULL)) {
 			printf("%s: Warning! Bad face in mesh"
@@ -447,27 +526,47 @@ void BM_mesh_bm_from_me(
 		f->mat_nr = mp->mat_nr;
 		if (i == me->act_face) bm->act_face = f;
 
-		int j = mp->loopstart;
 		l_iter = l_first = BM_FACE_FIRST_LOOP(f);
 		do {
-			/* don't use 'j' since we may have skipped some faces, hence some loops. */
+			/* don't use the MLoop index since we may have skipped some faces, hence some loops. */
 			BM_elem_index_set(l_iter, totloops++); /* set_ok */
 
-			/* Save index of correspsonding MLoop */
-			CustomData_to_bmesh_block(&me->ldata, &bm->ldata, j++, &l_iter->head.data, true);
+			/* Custom Data is copied in bm_from_me_faces_cb */
+			CustomData_bmesh_alloc_block(&bm->ldata, &l_iter->head.data);
 		} while ((l_iter = l_iter->next) != l_first);
 
-		/* Copy Custom Data */
-		CustomData_to_bmesh_block(&me->pdata, &bm->pdata, i, &f->head.data, true);
-
-		if (params->calc_face_normal) {
-			BM_face_normal_update(f);
-		}
+		CustomData_bmesh_alloc_block(&bm->pdata, &f->head.data);
 	}
 	if (is_new) {
 		bm->elem_index_dirty &= ~(BM_FACE | BM_LOOP); /* added in order, clear dirty flag */
 	}
 
+	/* -------------------------------------------------------------------- */
+	/* Custom Data (and remaining per element data) */
+
+	{
+		BMFromMeshData data = {
+		    .bm = bm, .me = me, .vtable = vtable, .etable = etable, .ftable = ftable,
+		    .shape_key_table = shape_key_table, .tot_shape_keys = tot_shape_keys,
+		    .cd_vert_bweight_offset = cd_vert_bweight_offset,
+		    .cd_edge_bweight_offset = cd_edge_bweight_offset,
+		    .cd_edge_crease_offset = cd_edge_crease_offset,
+		    .cd_shape_key_offset = cd_shape_key_offset,
+		    .cd_shape_keyindex_offset = cd_shape_keyindex_offset,
+		    .calc_face_normal = params->calc_face_normal,
+		};
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.min_iter_per_thread = 1024;
+
+		settings.use_threading = (me->totvert >= BM_OMP_LIMIT);
+		BLI_task_parallel_range(0, me->totvert, &data, bm_from_me_verts_cb, &settings);
+		settings.use_threading = (me->totedge >= BM_OMP_LIMIT);
+		BLI_task_parallel_range(0, me->totedge, &data, bm_from_me_edges_cb, &settings);
+		settings.use_threading = (me->totpoly >= BM_OMP_LIMIT);
+		BLI_task_parallel_range(0, me->totpoly, &data, bm_from_me_faces_cb, &settings);
+	}
+
 	/* -------------------------------------------------------------------- */
 	/* MSelect clears the array elements (avoid adding multiple times).
 	 *
@@ -504,9 +603,7 @@ void BM_mesh_bm_from_me(
 
 	MEM_freeN(vtable);
 	MEM_freeN(etable);
-	if (ftable) {
-		MEM_freeN(ftable);
-	}
+	MEM_freeN(ftable);
 }
 
 
@@ -590,6 +687,118 @@ BLI_INLINE void bmesh_quick_edgedraw_flag(MEdge *med, BMEdge *e)
 	}
 }
 
+typedef struct BMToMeshData {
+	BMesh *bm;
+	Mesh *me;
+	/* First loop of each face. */
+	int *loopstart;
+
+	int cd_vert_bweight_offset;
+	int cd_edge_bweight_offset;
+	int cd_edge_crease_offset;
+} BMToMeshData;
+
+static void bm_to_me_verts_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMToMeshData *data = userdata;
+	BMVert *v = data->bm->vtable[i];
+	MVert *mvert = &data->me->mvert[i];
+
+	copy_v3_v3(mvert->co, v->co);
+	normal_float_to_short_v3(mvert->no, v->no);
+
+	mvert->flag = BM_vert_flag_to_mflag(v);
+
+	/* copy over customdat */
+	CustomData_from_bmesh_block(&data->bm->vdata, &data->me->vdata, v->head.data, i);
+
+	if (data->cd_vert_bweight_offset != -1) {
+		mvert->bweight = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(v, data->cd_vert_bweight_offset);
+	}
+
+	BM_CHECK_ELEMENT(v);
+}
+
+static void bm_to_me_edges_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMToMeshData *data = userdata;
+	BMEdge *e = data->bm->etable[i];
+	MEdge *med = &data->me->medge[i];
+
+	med->v1 = BM_elem_index_get(e->v1);
+	med->v2 = BM_elem_index_get(e->v2);
+
+	med->flag = BM_edge_flag_to_mflag(e);
+
+	/* copy over customdata */
+	CustomData_from_bmesh_block(&data->bm->edata, &data->me->edata, e->head.data, i);
+
+	bmesh_quick_edgedraw_flag(med, e);
+
+	if (data->cd_edge_crease_offset != -1) {
+		med->crease = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(e, data->cd_edge_crease_offset);
+	}
+	if (data->cd_edge_bweight_offset != -1) {
+		med->bweight = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(e, data->cd_edge_bweight_offset);
+	}
+
+	BM_CHECK_ELEMENT(e);
+}
+
+static void bm_to_me_faces_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMToMeshData *data = userdata;
+	BMFace *f = data->bm->ftable[i];
+	MPoly *mpoly = &data->me->mpoly[i];
+	BMLoop *l_iter, *l_first;
+	int j = data->loopstart[i];
+	MLoop *mloop = &data->me->mloop[j];
+
+	mpoly->loopstart = j;
+	mpoly->totloop = f->len;
+	mpoly->mat_nr = f->mat_nr;
+	mpoly->flag = BM_face_flag_to_mflag(f);
+
+	l_iter = l_first = BM_FACE_FIRST_LOOP(f);
+	do {
+		mloop->e = BM_elem_index_get(l_iter->e);
+		mloop->v = BM_elem_index_get(l_iter->v);
+
+		/* copy over customdata */
+		CustomData_from_bmesh_block(&data->bm->ldata, &data->me->ldata, l_iter->head.data, j);
+
+		j++;
+		mloop++;
+		BM_CHECK_ELEMENT(l_iter);
+		BM_CHECK_ELEMENT(l_iter->e);
+		BM_CHECK_ELEMENT(l_iter->v);
+	} while ((l_iter = l_iter->next) != l_first);
+
+	/* copy over customdata */
+	CustomData_from_bmesh_block(&data->bm->pdata, &data->me->pdata, f->head.data, i);
+
+	BM_CHECK_ELEMENT(f);
+}
+
+static void bm_to_me_face_len_cb(
+        void *__restrict userdata,
+        const int i,
+        const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	BMToMeshData *data = userdata;
+
+	data->loopstart[i] = data->bm->ftable[i]->len;
+}
+
 void BM_mesh_bm_to_me(
         BMesh *bm, Mesh *me,
         const struct BMeshToMeshParams *params)
@@ -597,10 +806,8 @@ void BM_mesh_bm_to_me(
 	MLoop *mloop;
 	MPoly *mpoly;
 	MVert *mvert, *oldverts;
-	MEdge *med, *medge;
-	BMVert *v, *eve;
-	BMEdge *e;
-	BMFace *f;
+	MEdge *medge;
+	BMVert *eve;
 	BMIter iter;
 	int i, j, ototvert;
 
@@ -671,83 +878,37 @@ void BM_mesh_bm_to_me(
 	/* this is called again, 'dotess' arg is used there */
 	BKE_mesh_update_customdata_pointers(me, 0);
 
-	i = 0;
-	BM_ITER_MESH (v, &iter, bm, BM_VERTS_OF_MESH) {
-		copy_v3_v3(mvert->co, v->co);
-		normal_float_to_short_v3(mvert->no, v->no);
+	/* Elements are written in parallel, in the order of the element tables (which is the iterator order). */
+	BM_mesh_elem_index_ensure(bm, BM_VERT | BM_EDGE | BM_FACE);
+	BM_mesh_elem_table_ensure(bm, BM_VERT | BM_EDGE | BM_FACE);
 
-		mvert->flag = BM_vert_flag_to_mflag(v);
-
-		BM_elem_index_set(v, i); /* set_inline */
-
-		/* copy over customdat */
-		CustomData_from_bmesh_block(&bm->vdata, &me->vdata, v->head.data, i);
-
-		if (cd_vert_bweight_offset != -1) mvert->bweight = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(v, cd_vert_bweight_offset);
-
-		i++;
-		mvert++;
-
-		BM_CHECK_ELEMENT(v);
-	}
-	bm->elem_index_dirty &= ~BM_VERT;
-
-	med = medge;
-	i = 0;
-	BM_ITER_MESH (e, &iter, bm, BM_EDGES_OF_MESH) {
-		med->v1 = BM_elem_index_get(e->v1);
-		med->v2 = BM_elem_index_get(e->v2);
-
-		med->flag = BM_edge_flag_to_mflag(e);
-
-		BM_elem_index_set(e, i); /* set_inline */
-
-		/* copy over customdata */
-		CustomData_from_bmesh_block(&bm->edata, &me->edata, e->head.data, i);
-
-		bmesh_quick_edgedraw_flag(med, e);
-
-		if (cd_edge_crease_offset  != -1) med->crease  = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_crease_offset);
-		if (cd_edge_bweight_offset != -1) med->bweight = BM_ELEM_CD_GET_FLOAT_AS_UCHAR(e, cd_edge_bweight_offset);
-
-		i++;
-		med++;
-		BM_CHECK_ELEMENT(e);
+	{
+		BMToMeshData data = {
+		    .bm = bm, .me = me,
+		    .cd_vert_bweight_offset = cd_vert_bweight_offset,
+		    .cd_edge_bweight_offset = cd_edge_bweight_offset,
+		    .cd_edge_crease_offset = cd_edge_crease_offset,
+		};
+		ParallelRangeSettings settings;
+		BLI_parallel_range_settings_defaults(&settings);
+		settings.min_iter_per_thread = 1024;
+
+		settings.use_threading = (bm->totvert >= BM_OMP_LIMIT);
+		BLI_task_parallel_range(0, bm->totvert, &data, bm_to_me_verts_cb, &settings);
+		settings.use_threading = (bm->totedge >= BM_OMP_LIMIT);
+		BLI_task_parallel_range(0, bm->totedge, &data, bm_to_me_edges_cb, &settings);
+
+		/* Loops are stored in face order. */
+		settings.use_threading = (bm->totface >= BM_OMP_LIMIT);
+		data.loopstart = MEM_mallocN(sizeof(*data.loopstart) * (size_t)bm->totface, __func__);
+		BLI_task_parallel_range(0, bm->totface, &data, bm_to_me_face_len_cb, &settings);
+		BLI_task_parallel_scan_i(data.loopstart, data.loopstart, bm->totface, false, settings.use_threading);
+		BLI_task_parallel_range(0, bm->totface, &data, bm_to_me_faces_cb, &settings);
+		MEM_freeN(data.loopstart);
 	}
-	bm->elem_index_dirty &= ~BM_EDGE;
-
-	i = 0;
-	j = 0;
-	BM_ITER_MESH (f, &iter, bm, BM_FACES_OF_MESH) {
-		BMLoop *l_iter, *l_first;
-		mpoly->loopstart = j;
-		mpoly->totloop = f->len;
-		mpoly->mat_nr = f->mat_nr;
-		mpoly->flag = BM_face_flag_to_mflag(f);
-
-		l_iter = l_first = BM_FACE_FIRST_LOOP(f);
-		do {
-			mloop->e = BM_elem_index_get(l_iter->e);
-			mloop->v = BM_elem_index_get(l_iter->v);
-
-			/* copy over customdata */
-			CustomData_from_bmesh_block(&bm->ldata, &me->ldata, l_iter->head.data, j);
-
-			j++;
-			mloop++;
-			BM_CHECK_ELEMENT(l_iter);
-			BM_CHECK_ELEMENT(l_iter->e);
-			BM_CHECK_ELEMENT(l_iter->v);
-		} while ((l_iter = l_iter->next) != l_first);
-
-		if (f == bm->act_face) me->act_face = i;
-
-		/* copy over customdata */
-		CustomData_from_bmesh_block(&bm->pdata, &me->pdata, f->head.data, i);
 
-		i++;
-		mpoly++;
-		BM_CHECK_ELEMENT(f);
+	if (bm->act_face) {
+		me->act_face = BM_elem_index_get(bm->act_face);
 	}
 
 	/* patch hook indices and vertex parents */
@@ -568,6 +568,39 @@ bool  BMO_iter_map_value_bool(BMOIter *iter);
 	     ele; \
 	     BM_CHECK_TYPE_ELEM_ASSIGN(ele) = BMO_iter_step(iter), i_++)
 
+/**
+ * Operators can split their work into a compute phase, which reads the mesh
+ * and writes results per element (so it can run in parallel),
+ * followed by a serial phase which applies the results, changing topology.
+ *
+ * \code{.c}
+ *
+ *    BMFace **faces = BMO_slot_as_arrayN(op->slots_in, "faces", &faces_len);
+ *    FaceResult *results = MEM_mallocN(sizeof(*results) * faces_len, __func__);
+ *
+ *    BMO_elem_array_compute_parallel(bm, (BMElem **)faces, faces_len, results, face_compute_cb, NULL, 0, NULL);
+ *
+ *    for (i = 0; i < faces_len; i++) {
+ *        //apply results[i] to faces[i]
+ *    }
+ * \endcode
+ *
+ * \param func: Called for every element, with its index in \a elems.
+ * It must not modify the mesh, besides data owned by the element it's passed.
+ * \param userdata_chunk: Optional thread local storage, copied for every thread
+ * (see #ParallelRangeSettings.userdata_chunk), freed by \a func_finalize.
+ */
+typedef void (*BMOElemComputeFunc)(
+        void *__restrict userdata, BMElem *ele, const int index, void *__restrict userdata_chunk);
+typedef void (*BMOElemComputeFinalizeFunc)(
+        void *__restrict userdata, void *__restrict userdata_chunk);
+
+void BMO_elem_array_compute_parallel(
+        BMesh *bm, BMElem **elems, const int elems_len,
+        void *userdata, BMOElemComputeFunc func,
+        void *userdata_chunk, const size_t userdata_chunk_size,
+        BMOElemComputeFinalizeFunc func_finalize);
+
 extern const int BMO_OPSLOT_TYPEINFO[BMO_OP_SLOT_TOTAL_TYPES];
 
 int BMO_opcode_from_opname(const char *opname);
@@ -34,6 +34,7 @@
 #include "BLI_memarena.h"
 #include "BLI_mempool.h"
 #include "BLI_listbase.h"
+#include "BLI_task.h"
 
 #include "BLT_translation.h"
 
@@ -1372,6 +1373,71 @@ void *BMO_slot_buffer_get_first(BMOpSlot slot_args[BMO_OP_MAX_SLOTS], const char
 	return slot->data.buf ? *slot->data.buf : NULL;
 }
 
+typedef struct BMOElemComputeData {
+	BMElem **elems;
+	void *userdata;
+	BMOElemComputeFunc func;
+	BMOElemComputeFinalizeFunc func_finalize;
+} BMOElemComputeData;
+
+static void bmo_elem_compute_cb(
+        void *__restrict userdata,
+        const int index,
+        const ParallelRangeTLS *__restrict tls)
+{
+	BMOElemComputeData *data = userdata;
+	data->func(data->userdata, data->elems[index], index, tls->userdata_chunk);
+}
+
+static void bmo_elem_compute_finalize(
+        void *__restrict userdata,
+        void *__restrict userdata_chunk)
+{
+	BMOElemComputeData *data = userdata;
+	data->func_finalize(data->userdata, userdata_chunk);
+}
+
+/**
+ * Run the read-only part of an operator over \a elems, threaded for large arrays,
+ * see #BMOElemComputeFunc.
+ */
+void BMO_elem_array_compute_parallel(
+        BMesh *bm, BMElem **elems, const int elems_len,
+        void *userdata, BMOElemComputeFunc func,
+        void *userdata_chunk, const size_t userdata_chunk_size,
+        BMOElemComputeFinalizeFunc func_finalize)
+{
+#ifndef NDEBUG
+	const int totvert = bm->totvert, totedge = bm->totedge, totloop = bm->totloop, totface = bm->totface;
+#else
+	UNUSED_VARS(bm);
+#endif
+
+	BMOElemComputeData data = {
+		.elems = elems,
+		.userdata = userdata,
+		.func = func,
+		.func_finalize = func_finalize,
+	};
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = (elems_len >= BM_OMP_LIMIT);
+	/* Cost per element is often uneven (ngons for example). */
+	settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+	settings.userdata_chunk = userdata_chunk;
+	settings.userdata_chunk_size = userdata_chunk_size;
+	if (func_finalize) {
+		settings.func_finalize = bmo_elem_compute_finalize;
+	}
+
+	BLI_task_parallel_range(0, elems_len, &data, bmo_elem_compute_cb, &settings);
+
+	/* The compute phase must not change topology. */
+	BLI_assert(totvert == bm->totvert && totedge == bm->totedge &&
+	           totloop == bm->totloop && totface == bm->totface);
+}
+
 /**
  * \brief New Iterator
  *
@@ -900,6 +900,121 @@ bool BM_face_point_inside_test(const BMFace *f, const float co[3])
 	return isect_point_poly_v2(co_2d, projverts, f->len, false);
 }
 
+/**
+ * Calculate the triangles #BM_face_triangulate would create, without changing the mesh,
+ * so this can run from multiple threads (using their own \a pf_arena and \a pf_heap).
+ *
+ * \param r_tris: (f->len - 2) triangles, as indices of the face loops
+ * (starting from #BM_FACE_FIRST_LOOP).
+ */
+void BM_face_calc_triangulate_tris(
+        const BMFace *f,
+        const int quad_method,
+        const int ngon_method,
+        uint (*r_tris)[3],
+        /* use for ngons only! */
+        MemArena *pf_arena,
+
+        /* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
+        struct Heap *pf_heap)
+{
+	const bool use_beauty = (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY);
+
+	BLI_assert(BM_face_is_normal_valid(f));
+	BLI_assert(f->len > 3);
+
+	if (f->len == 4) {
+		/* even though we're not using BLI_polyfill, fill in 'r_tris'
+		 * so we can share code to handle face creation afterwards. */
+		uint i_v1, i_v2;
+
+		switch (quad_method) {
+			case MOD_TRIANGULATE_QUAD_FIXED:
+			{
+				i_v1 = 0;
+				i_v2 = 2;
+				break;
+			}
+			case MOD_TRIANGULATE_QUAD_ALTERNATE:
+			{
+				i_v1 = 1;
+				i_v2 = 3;
+				break;
+			}
+			case MOD_TRIANGULATE_QUAD_SHORTEDGE:
+			case MOD_TRIANGULATE_QUAD_BEAUTY:
+			default:
+			{
+				BMLoop *l_first = BM_FACE_FIRST_LOOP(f);
+				BMLoop *l_v1, *l_v2, *l_v3, *l_v4;
+				bool split_24;
+
+				l_v1 = l_first->next;
+				l_v2 = l_first->next->next;
+				l_v3 = l_first->prev;
+				l_v4 = l_first;
+
+				if (quad_method == MOD_TRIANGULATE_QUAD_SHORTEDGE) {
+					float d1, d2;
+					d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
+					d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
+					split_24 = ((d2 - d1) > 0.0f);
+				}
+				else {
+					/* first check if the quad is concave on either diagonal */
+					const int flip_flag = is_quad_flip_v3(l_v1->v->co, l_v2->v->co, l_v3->v->co, l_v4->v->co);
+					if (UNLIKELY(flip_flag & (1 << 0))) {
+						split_24 = true;
+					}
+					else if (UNLIKELY(flip_flag & (1 << 1))) {
+						split_24 = false;
+					}
+					else {
+						split_24 = (BM_verts_calc_rotate_beauty(l_v1->v, l_v2->v, l_v3->v, l_v4->v, 0, 0) > 0.0f);
+					}
+				}
+
+				/* named confusingly, l_v1 is in fact the second vertex */
+				if (split_24) {
+					i_v1 = 0;  /* l_v4 */
+					i_v2 = 2;  /* l_v2 */
+				}
+				else {
+					i_v1 = 1;  /* l_v1 */
+					i_v2 = 3;  /* l_v3 */
+				}
+				break;
+			}
+		}
+
+		ARRAY_SET_ITEMS(r_tris[0], i_v1, i_v1 + 1, i_v2);
+		ARRAY_SET_ITEMS(r_tris[1], i_v1, i_v2, (i_v2 + 1) % 4);
+	}
+	else {
+		BMLoop *l_iter;
+		float axis_mat[3][3];
+		float (*projverts)[2] = BLI_array_alloca(projverts, f->len);
+		int i;
+
+		axis_dominant_v3_to_m3_negate(axis_mat, f->no);
+
+		for (i = 0, l_iter = BM_FACE_FIRST_LOOP(f); i < f->len; i++, l_iter = l_iter->next) {
+			mul_v2_m3v3(projverts[i], axis_mat, l_iter->v->co);
+		}
+
+		BLI_polyfill_calc_arena(projverts, f->len, 1, r_tris,
+		                        pf_arena);
+
+		if (use_beauty) {
+			BLI_polyfill_beautify(
+			        projverts, f->len, r_tris,
+			        pf_arena, pf_heap);
+		}
+
+		BLI_memarena_clear(pf_arena);
+	}
+}
+
 /**
  * \brief BMESH TRIANGULATE FACE
  *
@@ -938,16 +1053,37 @@ void BM_face_triangulate(
 
         /* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
         struct Heap *pf_heap)
+{
+	uint (*tris)[3] = BLI_array_alloca(tris, f->len);
+
+	BM_face_calc_triangulate_tris(f, quad_method, ngon_method, tris, pf_arena, pf_heap);
+
+	BM_face_triangulate_from_tris(
+	        bm, f, (const uint (*)[3])tris,
+	        r_faces_new, r_faces_new_tot,
+	        r_edges_new, r_edges_new_tot,
+	        r_faces_double, use_tag);
+}
+
+/**
+ * Second half of #BM_face_triangulate, split \a f into the triangles
+ * calculated by #BM_face_calc_triangulate_tris.
+ */
+void BM_face_triangulate_from_tris(
+        BMesh *bm, BMFace *f, const uint (*tris)[3],
+        BMFace **r_faces_new,
+        int     *r_faces_new_tot,
+        BMEdge **r_edges_new,
+        int     *r_edges_new_tot,
+        LinkNode **r_faces_double,
+        const bool use_tag)
 {
 	const int cd_loop_mdisp_offset = CustomData_get_offset(&bm->ldata, CD_MDISPS);
-	const bool use_beauty = (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY);
 	BMLoop *l_first, *l_new;
 	BMFace *f_new;
 	int nf_i = 0;
 	int ne_i = 0;
 
-	BLI_assert(BM_face_is_normal_valid(f));
-
 	/* ensure both are valid or NULL */
 	BLI_assert((r_faces_new == NULL) == (r_faces_new_tot == NULL));
 
@@ -955,109 +1091,13 @@ void BM_face_triangulate(
 
 	{
 		BMLoop **loops = BLI_array_alloca(loops, f->len);
-		uint (*tris)[3] = BLI_array_alloca(tris, f->len);
 		const int totfilltri = f->len - 2;
 		const int last_tri = f->len - 3;
 		int i;
 		/* for mdisps */
 		float f_center[3];
 
-		if (f->len == 4) {
-			/* even though we're not using BLI_polyfill, fill in 'tris' and 'loops'
-			 * so we can share code to handle face creation afterwards. */
-			BMLoop *l_v1, *l_v2;
-
-			l_first = BM_FACE_FIRST_LOOP(f);
-
-			switch (quad_method) {
-				case MOD_TRIANGULATE_QUAD_FIXED:
-				{
-					l_v1 = l_first;
-					l_v2 = l_first->next->next;
-					break;
-				}
-				case MOD_TRIANGULATE_QUAD_ALTERNATE:
-				{
-					l_v1 = l_first->next;
-					l_v2 = l_first->prev;
-					break;
-				}
-				case MOD_TRIANGULATE_QUAD_SHORTEDGE:
-				case MOD_TRIANGULATE_QUAD_BEAUTY:
-				default:
-				{
-					BMLoop *l_v3, *l_v4;
-					bool split_24;
-
-					l_v1 = l_first->next;
-					l_v2 = l_first->next->next;
-					l_v3 = l_first->prev;
-					l_v4 = l_first;
-
-					if (quad_method == MOD_TRIANGULATE_QUAD_SHORTEDGE) {
-						float d1, d2;
-						d1 = len_squared_v3v3(l_v4->v->co, l_v2->v->co);
-						d2 = len_squared_v3v3(l_v1->v->co, l_v3->v->co);
-						split_24 = ((d2 - d1) > 0.0f);
-					}
-					else {
-						/* first check if the quad is concave on either diagonal */
-						const int flip_flag = is_quad_flip_v3(l_v1->v->co, l_v2->v->co, l_v3->v->co, l_v4->v->co);
-						if (UNLIKELY(flip_flag & (1 << 0))) {
-							split_24 = true;
-						}
-						else if (UNLIKELY(flip_flag & (1 << 1))) {
-							split_24 = false;
-						}
-						else {
-							split_24 = (BM_verts_calc_rotate_beauty(l_v1->v, l_v2->v, l_v3->v, l_v4->v, 0, 0) > 0.0f);
-						}
-					}
-
-					/* named confusingly, l_v1 is in fact the second vertex */
-					if (split_24) {
-						l_v1 = l_v4;
-						//l_v2 = l_v2;
-					}
-					else {
-						//l_v1 = l_v1;
-						l_v2 = l_v3;
-					}
-					break;
-				}
-			}
-
-			loops[0] = l_v1;
-			loops[1] = l_v1->next;
-			loops[2] = l_v2;
-			loops[3] = l_v2->next;
-
-			ARRAY_SET_ITEMS(tris[0], 0, 1, 2);
-			ARRAY_SET_ITEMS(tris[1], 0, 2, 3);
-		}
-		else {
-			BMLoop *l_iter;
-			float axis_mat[3][3];
-			float (*projverts)[2] = BLI_array_alloca(projverts, f->len);
-
-			axis_dominant_v3_to_m3_negate(axis_mat, f->no);
-
-			for (i = 0, l_iter = BM_FACE_FIRST_LOOP(f); i < f->len; i++, l_iter = l_iter->next) {
-				loops[i] = l_iter;
-				mul_v2_m3v3(projverts[i], axis_mat, l_iter->v->co);
-			}
-
-			BLI_polyfill_calc_arena(projverts, f->len, 1, tris,
-			                        pf_arena);
-
-			if (use_beauty) {
-				BLI_polyfill_beautify(
-				        projverts, f->len, tris,
-				        pf_arena, pf_heap);
-			}
-
-			BLI_memarena_clear(pf_arena);
-		}
+		BM_iter_as_array(bm, BM_LOOPS_OF_FACE, f, (void **)loops, f->len);
 
 		if (cd_loop_mdisp_offset != -1) {
 			BM_face_calc_center_mean(f, f_center);
@@ -1348,143 +1388,162 @@ void BM_face_as_array_loop_quad(BMFace *f, BMLoop *r_loops[4])
 }
 
 
+/* use this to avoid locking pthread for _every_ polygon
+ * and calling the fill function */
+#define USE_TESSFACE_SPEEDUP
+
 /**
- * \brief BM_mesh_calc_tessellation get the looptris and its number from a certain bmesh
- * \param looptris
+ * Calculate the looptris of a single face, as done by #BM_mesh_calc_tessellation.
  *
- * \note \a looptris  Must be pre-allocated to at least the size of given by: poly_to_tri_count
+ * \param looptris: Must be large enough for (efa->len - 2) triangles.
+ * \param pf_arena_p: Arena used for ngons, created on demand (caller must free).
+ * \return the number of triangles written.
  */
-void BM_mesh_calc_tessellation(BMesh *bm, BMLoop *(*looptris)[3], int *r_looptris_tot)
+int BM_face_calc_looptris(BMFace *efa, BMLoop *(*looptris)[3], MemArena **pf_arena_p)
 {
-	/* use this to avoid locking pthread for _every_ polygon
-	 * and calling the fill function */
-#define USE_TESSFACE_SPEEDUP
-
-	/* this assumes all faces can be scan-filled, which isn't always true,
-	 * worst case we over alloc a little which is acceptable */
-#ifndef NDEBUG
-	const int looptris_tot = poly_to_tri_count(bm->totface, bm->totloop);
-#endif
-
-	BMIter iter;
-	BMFace *efa;
 	int i = 0;
 
-	MemArena *arena = NULL;
-
-	BM_ITER_MESH (efa, &iter, bm, BM_FACES_OF_MESH) {
-		/* don't consider two-edged faces */
-		if (UNLIKELY(efa->len < 3)) {
-			/* do nothing */
-		}
+	/* don't consider two-edged faces */
+	if (UNLIKELY(efa->len < 3)) {
+		/* do nothing */
+	}
 
 #ifdef USE_TESSFACE_SPEEDUP
 
-		/* no need to ensure the loop order, we know its ok */
+	/* no need to ensure the loop order, we know its ok */
 
-		else if (efa->len == 3) {
+	else if (efa->len == 3) {
 #if 0
-			int j;
-			BM_ITER_ELEM_INDEX (l, &liter, efa, BM_LOOPS_OF_FACE, j) {
-				looptris[i][j] = l;
-			}
-			i += 1;
+		int j;
+		BM_ITER_ELEM_INDEX (l, &liter, efa, BM_LOOPS_OF_FACE, j) {
+			looptris[i][j] = l;
+		}
+		i += 1;
 #else
-			/* more cryptic but faster */
-			BMLoop *l;
-			BMLoop **l_ptr = looptris[i++];
-			l_ptr[0] = l = BM_FACE_FIRST_LOOP(efa);
-			l_ptr[1] = l = l->next;
-			l_ptr[2] = l->next;
+		/* more cryptic but faster */
+		BMLoop *l;
+		BMLoop **l_ptr = looptris[i++];
+		l_ptr[0] = l = BM_FACE_FIRST_LOOP(efa);
+		l_ptr[1] = l = l->next;
+		l_ptr[2] = l->next;
 #endif
-		}
-		else if (efa->len == 4) {
+	}
+	else if (efa->len == 4) {
 #if 0
-			BMLoop *ltmp[4];
-			int j;
-			BLI_array_grow_items(looptris, 2);
-			BM_ITER_ELEM_INDEX (l, &liter, efa, BM_LOOPS_OF_FACE, j) {
-				ltmp[j] = l;
-			}
+		BMLoop *ltmp[4];
+		int j;
+		BLI_array_grow_items(looptris, 2);
+		BM_ITER_ELEM_INDEX (l, &liter, efa, BM_LOOPS_OF_FACE, j) {
+			ltmp[j] = l;
+		}
 
-			looptris[i][0] = ltmp[0];
-			looptris[i][1] = ltmp[1];
-			looptris[i][2] = ltmp[2];
-			i += 1;
+		looptris[i][0] = ltmp[0];
+		looptris[i][1] = ltmp[1];
+		looptris[i][2] = ltmp[2];
+		i += 1;
 
-			looptris[i][0] = ltmp[0];
-			looptris[i][1] = ltmp[2];
-			looptris[i][2] = ltmp[3];
-			i += 1;
+		looptris[i][0] = ltmp[0];
+		looptris[i][1] = ltmp[2];
+		looptris[i][2] = ltmp[3];
+		i += 1;
 #else
-			/* more cryptic but faster */
-			BMLoop *l;
-			BMLoop **l_ptr_a = looptris[i++];
-			BMLoop **l_ptr_b = looptris[i++];
-			(l_ptr_a[0] = l_ptr_b[0] = l = BM_FACE_FIRST_LOOP(efa));
-			(l_ptr_a[1]              = l = l->next);
-			(l_ptr_a[2] = l_ptr_b[1] = l = l->next);
-			(             l_ptr_b[2] = l->next);
+		/* more cryptic but faster */
+		BMLoop *l;
+		BMLoop **l_ptr_a = looptris[i++];
+		BMLoop **l_ptr_b = looptris[i++];
+		(l_ptr_a[0] = l_ptr_b[0] = l = BM_FACE_FIRST_LOOP(efa));
+		(l_ptr_a[1]              = l = l->next);
+		(l_ptr_a[2] = l_ptr_b[1] = l = l->next);
+		(             l_ptr_b[2] = l->next);
 #endif
 
-			if (UNLIKELY(is_quad_flip_v3_first_third_fast(
-			                     l_ptr_a[0]->v->co,
-			                     l_ptr_a[1]->v->co,
-			                     l_ptr_a[2]->v->co,
-			                     l_ptr_b[2]->v->co)))
-			{
-				/* flip out of degenerate 0-2 state. */
-				l_ptr_a[2] = l_ptr_b[2];
-				l_ptr_b[0] = l_ptr_a[1];
-			}
+		if (UNLIKELY(is_quad_flip_v3_first_third_fast(
+		                     l_ptr_a[0]->v->co,
+		                     l_ptr_a[1]->v->co,
+		                     l_ptr_a[2]->v->co,
+		                     l_ptr_b[2]->v->co)))
+		{
+			/* flip out of degenerate 0-2 state. */
+			l_ptr_a[2] = l_ptr_b[2];
+			l_ptr_b[0] = l_ptr_a[1];
 		}
+	}
 
 #endif /* USE_TESSFACE_SPEEDUP */
 
-		else {
-			int j;
+	else {
+		int j;
 
-			BMLoop *l_iter;
-			BMLoop *l_first;
-			BMLoop **l_arr;
+		BMLoop *l_iter;
+		BMLoop *l_first;
+		BMLoop **l_arr;
 
-			float axis_mat[3][3];
-			float (*projverts)[2];
-			uint (*tris)[3];
+		float axis_mat[3][3];
+		float (*projverts)[2];
+		uint (*tris)[3];
 
-			const int totfilltri = efa->len - 2;
+		const int totfilltri = efa->len - 2;
 
-			if (UNLIKELY(arena == NULL)) {
-				arena = BLI_memarena_new(BLI_MEMARENA_STD_BUFSIZE, __func__);
-			}
+		MemArena *arena;
 
-			tris = BLI_memarena_alloc(arena, sizeof(*tris) * totfilltri);
-			l_arr = BLI_memarena_alloc(arena, sizeof(*l_arr) * efa->len);
-			projverts = BLI_memarena_alloc(arena, sizeof(*projverts) * efa->len);
+		if (UNLIKELY(*pf_arena_p == NULL)) {
+			*pf_arena_p = BLI_memarena_new(BLI_MEMARENA_STD_BUFSIZE, __func__);
+		}
+		arena = *pf_arena_p;
 
-			axis_dominant_v3_to_m3_negate(axis_mat, efa->no);
+		tris = BLI_memarena_alloc(arena, sizeof(*tris) * totfilltri);
+		l_arr = BLI_memarena_alloc(arena, sizeof(*l_arr) * efa->len);
+		projverts = BLI_memarena_alloc(arena, sizeof(*projverts) * efa->len);
 
-			j = 0;
-			l_iter = l_first = BM_FACE_FIRST_LOOP(efa);
-			do {
-				l_arr[j] = l_iter;
-				mul_v2_m3v3(projverts[j], axis_mat, l_iter->v->co);
-				j++;
-			} while ((l_iter = l_iter->next) != l_first);
+		axis_dominant_v3_to_m3_negate(axis_mat, efa->no);
 
-			BLI_polyfill_calc_arena(projverts, efa->len, 1, tris, arena);
+		j = 0;
+		l_iter = l_first = BM_FACE_FIRST_LOOP(efa);
+		do {
+			l_arr[j] = l_iter;
+			mul_v2_m3v3(projverts[j], axis_mat, l_iter->v->co);
+			j++;
+		} while ((l_iter = l_iter->next) != l_first);
 
-			for (j = 0; j < totfilltri; j++) {
-				BMLoop **l_ptr = looptris[i++];
-				uint *tri = tris[j];
+		BLI_polyfill_calc_arena(projverts, efa->len, 1, tris, arena);
 
-				l_ptr[0] = l_arr[tri[0]];
-				l_ptr[1] = l_arr[tri[1]];
-				l_ptr[2] = l_arr[tri[2]];
-			}
+		for (j = 0; j < totfilltri; j++) {
+			BMLoop **l_ptr = looptris[i++];
+			uint *tri = tris[j];
 
-			BLI_memarena_clear(arena);
+			l_ptr[0] = l_arr[tri[0]];
+			l_ptr[1] = l_arr[tri[1]];
+			l_ptr[2] = l_arr[tri[2]];
 		}
+
+		BLI_memarena_clear(arena);
+	}
+
+	return i;
+}
+
+/**
+ * \brief BM_mesh_calc_tessellation get the looptris and its number from a certain bmesh
+ * \param looptris
+ *
+ * \note \a looptris  Must be pre-allocated to at least the size of given by: poly_to_tri_count
+ */
+void BM_mesh_calc_tessellation(BMesh *bm, BMLoop *(*looptris)[3], int *r_looptris_tot)
+{
+	/* this assumes all faces can be scan-filled, which isn't always true,
+	 * worst case we over alloc a little which is acceptable */
+#ifndef NDEBUG
+	const int looptris_tot = poly_to_tri_count(bm->totface, bm->totloop);
+#endif
+
+	BMIter iter;
+	BMFace *efa;
+	int i = 0;
+
+	MemArena *arena = NULL;
+
+	BM_ITER_MESH (efa, &iter, bm, BM_FACES_OF_MESH) {
+		i += BM_face_calc_looptris(efa, &looptris[i], &arena);
 	}
 
 	if (arena) {
@@ -1495,11 +1554,10 @@ void BM_mesh_calc_tessellation(BMesh *bm, BMLoop *(*looptris)[3], int *r_looptri
 	*r_looptris_tot = i;
 
 	BLI_assert(i <= looptris_tot);
+}
 
 #undef USE_TESSFACE_SPEEDUP
 
-}
-
 
 /**
  * A version of #BM_mesh_calc_tessellation that avoids degenerate triangles.
@@ -31,6 +31,7 @@ struct Heap;
 
 #include "BLI_compiler_attrs.h"
 
+int   BM_face_calc_looptris(BMFace *efa, BMLoop *(*looptris)[3], struct MemArena **pf_arena_p);
 void  BM_mesh_calc_tessellation(BMesh *bm, BMLoop *(*looptris)[3], int *r_looptris_tot);
 void  BM_mesh_calc_tessellation_beauty(BMesh *bm, BMLoop *(*looptris)[3], int *r_looptris_tot);
 
@@ -86,6 +87,22 @@ void  BM_face_triangulate(
         struct MemArena *pf_arena,
         struct Heap *pf_heap
         ) ATTR_NONNULL(1, 2);
+void  BM_face_calc_triangulate_tris(
+        const BMFace *f,
+        const int quad_method, const int ngon_method,
+        uint (*r_tris)[3],
+        struct MemArena *pf_arena,
+        struct Heap *pf_heap
+        ) ATTR_NONNULL(1, 4);
+void  BM_face_triangulate_from_tris(
+        BMesh *bm, BMFace *f, const uint (*tris)[3],
+        BMFace **r_faces_new,
+        int     *r_faces_new_tot,
+        BMEdge **r_edges_new,
+        int     *r_edges_new_tot,
+        struct LinkNode **r_faces_double,
+        const bool use_tag
+        ) ATTR_NONNULL(1, 2, 3);
 
 void  BM_face_splits_check_legal(BMesh *bm, BMFace *f, BMLoop *(*loops)[2], int len) ATTR_NONNULL();
 void  BM_face_splits_check_optimal(BMFace *f, BMLoop *(*loops)[2], int len) ATTR_NONNULL();
@@ -30,6 +30,7 @@
 
 #include "BLI_math.h"
 #include "BLI_rand.h"
+#include "BLI_alloca.h"
 #include "BLI_array.h"
 #include "BLI_noise.h"
 #include "BLI_stack.h"
@@ -885,17 +886,142 @@ typedef struct SubDFaceData {
 	BMFace *face;
 } SubDFaceData;
 
+typedef struct SubDFaceMatchData {
+	BMesh *bm;
+	BMOpSlot *slot_custom_patterns;
+	bool use_only_quads;
+	/* result for each face, 'face' is NULL when it isn't split */
+	SubDFaceData *facedata;
+} SubDFaceMatchData;
+
+/**
+ * Figure out which pattern to use for \a ele,
+ * only reads the mesh so faces can be matched in parallel.
+ */
+static void bmo_subd_face_match_cb(
+        void *__restrict userdata, BMElem *ele, const int index, void *__restrict UNUSED(userdata_chunk))
+{
+	SubDFaceMatchData *data = userdata;
+	BMesh *bm = data->bm;
+	BMFace *face = (BMFace *)ele;
+	SubDFaceData *fd = &data->facedata[index];
+	const SubDPattern *pat;
+	BMEdge *e1 = NULL, *e2 = NULL;
+	BMEdge **edges;
+	BMVert **verts;
+	BMLoop *l_iter;
+	BMIter liter;
+	float vec1[3], vec2[3];
+	bool matched = false;
+	int totesel, i, j, a, b;
+
+	fd->face = NULL;
+
+	/* skip non-quads if requested */
+	if (data->use_only_quads && face->len != 4)
+		return;
+
+	edges = BLI_array_alloca(edges, face->len);
+	verts = BLI_array_alloca(verts, face->len);
+
+	totesel = 0;
+	BM_ITER_ELEM_INDEX (l_iter, &liter, face, BM_LOOPS_OF_FACE, i) {
+		edges[i] = l_iter->e;
+		verts[i] = l_iter->v;
+
+		if (BMO_edge_flag_test(bm, edges[i], SUBD_SPLIT)) {
+			if (!e1) e1 = edges[i];
+			else     e2 = edges[i];
+
+			totesel++;
+		}
+	}
+
+	/* make sure the two edges have a valid angle to each other */
+	if (totesel == 2 && BM_edge_share_vert_check(e1, e2)) {
+		sub_v3_v3v3(vec1, e1->v2->co, e1->v1->co);
+		sub_v3_v3v3(vec2, e2->v2->co, e2->v1->co);
+		normalize_v3(vec1);
+		normalize_v3(vec2);
+
+		if (fabsf(dot_v3v3(vec1, vec2)) > 1.0f - FLT_FACE_SPLIT_EPSILON) {
+			totesel = 0;
+		}
+	}
+
+	if (BMO_face_flag_test(bm, face, FACE_CUSTOMFILL)) {
+		pat = *BMO_slot_map_data_get(data->slot_custom_patterns, face);
+		for (i = 0; i < pat->len; i++) {
+			matched = 1;
+			for (j = 0; j < pat->len; j++) {
+				a = (j + i) % pat->len;
+				if ((!!BMO_edge_flag_test(bm, edges[a], SUBD_SPLIT)) != (!!pat->seledges[j])) {
+					matched = 0;
+					break;
+				}
+			}
+			if (matched) {
+				fd->pat = pat;
+				fd->start = verts[i];
+				fd->face = face;
+				fd->totedgesel = totesel;
+				break;
+			}
+		}
+
+		/* obvously don't test for other patterns matching */
+		return;
+	}
+
+	for (i = 0; i < PATTERNS_TOT; i++) {
+		pat = patterns[i];
+		if (!pat) {
+			continue;
+		}
+
+		if (pat->len == face->len) {
+			for (a = 0; a < pat->len; a++) {
+				matched = 1;
+				for (b = 0; b < pat->len; b++) {
+					j = (b + a) % pat->len;
+					if ((!!BMO_edge_flag_test(bm, edges[j], SUBD_SPLIT)) != (!!pat->seledges[b])) {
+						matched = 0;
+						break;
+					}
+				}
+				if (matched) {
+					break;
+				}
+			}
+			if (matched) {
+				fd->pat = pat;
+				fd->start = verts[a];
+				fd->face = face;
+				fd->totedgesel = totesel;
+				break;
+			}
+		}
+
+	}
+
+	if (!matched && totesel) {
+		/* must initialize all members here */
+		fd->start = NULL;
+		fd->pat = NULL;
+		fd->totedgesel = totesel;
+		fd->face = face;
+	}
+}
+
 void bmo_subdivide_edges_exec(BMesh *bm, BMOperator *op)
 {
 	BMOpSlot *einput;
 	const SubDPattern *pat;
 	SubDParams params;
 	BLI_Stack *facedata;
-	BMIter viter, fiter, liter;
+	BMIter viter, liter;
 	BMVert *v, **verts = NULL;
 	BMEdge *edge;
-	BMEdge **edges = NULL;
-	BLI_array_declare(edges);
 	BMLoop *(*loops_split)[2] = NULL;
 	BLI_array_declare(loops_split);
 	BMLoop **loops = NULL;
@@ -905,7 +1031,7 @@ void bmo_subdivide_edges_exec(BMesh *bm, BMOperator *op)
 	BLI_array_declare(verts);
 	float smooth, fractal, along_normal;
 	bool use_sphere, use_single_edge, use_grid_fill, use_only_quads;
-	int cornertype, seed, i, j, a, b, numcuts, totesel, smooth_falloff;
+	int cornertype, seed, i, j, a, b, numcuts, smooth_falloff;
 	
 	BMO_slot_buffer_flag_enable(bm, op->slots_in, "edges", BM_EDGE, SUBD_SPLIT);
 	
@@ -1000,123 +1126,35 @@ void bmo_subdivide_edges_exec(BMesh *bm, BMOperator *op)
 
 	facedata = BLI_stack_new(sizeof(SubDFaceData), __func__);
 
-	BM_ITER_MESH (face, &fiter, bm, BM_FACES_OF_MESH) {
-		BMEdge *e1 = NULL, *e2 = NULL;
-		float vec1[3], vec2[3];
-		bool matched = false;
-
-		/* skip non-quads if requested */
-		if (use_only_quads && face->len != 4)
-			continue;
-
-		/* figure out which pattern to use */
-
-		BLI_array_clear(edges);
-		BLI_array_clear(verts);
-
-		BLI_array_grow_items(edges, face->len);
-		BLI_array_grow_items(verts, face->len);
-
-		totesel = 0;
-		BM_ITER_ELEM_INDEX (l_new, &liter, face, BM_LOOPS_OF_FACE, i) {
-			edges[i] = l_new->e;
-			verts[i] = l_new->v;
-
-			if (BMO_edge_flag_test(bm, edges[i], SUBD_SPLIT)) {
-				if (!e1) e1 = edges[i];
-				else     e2 = edges[i];
-
-				totesel++;
-			}
-		}
-
-		/* make sure the two edges have a valid angle to each other */
-		if (totesel == 2 && BM_edge_share_vert_check(e1, e2)) {
-			sub_v3_v3v3(vec1, e1->v2->co, e1->v1->co);
-			sub_v3_v3v3(vec2, e2->v2->co, e2->v1->co);
-			normalize_v3(vec1);
-			normalize_v3(vec2);
-
-			if (fabsf(dot_v3v3(vec1, vec2)) > 1.0f - FLT_FACE_SPLIT_EPSILON) {
-				totesel = 0;
-			}
-		}
-
-		if (BMO_face_flag_test(bm, face, FACE_CUSTOMFILL)) {
-			pat = *BMO_slot_map_data_get(params.slot_custom_patterns, face);
-			for (i = 0; i < pat->len; i++) {
-				matched = 1;
-				for (j = 0; j < pat->len; j++) {
-					a = (j + i) % pat->len;
-					if ((!!BMO_edge_flag_test(bm, edges[a], SUBD_SPLIT)) != (!!pat->seledges[j])) {
-						matched = 0;
-						break;
-					}
-				}
-				if (matched) {
-					SubDFaceData *fd;
-
-					fd = BLI_stack_push_r(facedata);
-					fd->pat = pat;
-					fd->start = verts[i];
-					fd->face = face;
-					fd->totedgesel = totesel;
-					BMO_face_flag_enable(bm, face, SUBD_SPLIT);
-					break;
-				}
+	/* find the pattern used by each face (doesn't change the mesh) */
+	{
+		SubDFaceMatchData match_data;
+		BMFace **faces;
+		SubDFaceData *fd;
+		int faces_len;
+
+		faces = BM_iter_as_arrayN(bm, BM_FACES_OF_MESH, NULL, &faces_len, NULL, 0);
+
+		match_data.bm = bm;
+		match_data.slot_custom_patterns = params.slot_custom_patterns;
+		match_data.use_only_quads = use_only_quads;
+		match_data.facedata = MEM_mallocN(sizeof(*match_data.facedata) * (size_t)faces_len, __func__);
+
+		BMO_elem_array_compute_parallel(
+		        bm, (BMElem **)faces, faces_len,
+		        &match_data, bmo_subd_face_match_cb,
+		        NULL, 0, NULL);
+
+		for (i = 0, fd = match_data.facedata; i < faces_len; i++, fd++) {
+			if (fd->face) {
+				BMO_face_flag_enable(bm, fd->face, SUBD_SPLIT);
+				BLI_stack_push(facedata, fd);
 			}
-
-			/* obvously don't test for other patterns matching */
-			continue;
 		}
 
-		for (i = 0; i < PATTERNS_TOT; i++) {
-			pat = patterns[i];
-			if (!pat) {
-				continue;
-			}
-
-			if (pat->len == face->len) {
-				for (a = 0; a < pat->len; a++) {
-					matched = 1;
-					for (b = 0; b < pat->len; b++) {
-						j = (b + a) % pat->len;
-						if ((!!BMO_edge_flag_test(bm, edges[j], SUBD_SPLIT)) != (!!pat->seledges[b])) {
-							matched = 0;
-							break;
-						}
-					}
-					if (matched) {
-						break;
-					}
-				}
-				if (matched) {
-					SubDFaceData *fd;
-
-					BMO_face_flag_enable(bm, face, SUBD_SPLIT);
-
-					fd = BLI_stack_push_r(facedata);
-					fd->pat = pat;
-					fd->start = verts[a];
-					fd->face = face;
-					fd->totedgesel = totesel;
-					break;
-				}
-			}
-
-		}
-		
-		if (!matched && totesel) {
-			SubDFaceData *fd;
-			
-			BMO_face_flag_enable(bm, face, SUBD_SPLIT);
-
-			/* must initialize all members here */
-			fd = BLI_stack_push_r(facedata);
-			fd->start = NULL;
-			fd->pat = NULL;
-			fd->totedgesel = totesel;
-			fd->face = face;
+		MEM_freeN(match_data.facedata);
+		if (faces) {
+			MEM_freeN(faces);
 		}
 	}
 
@@ -1283,7 +1321,6 @@ void bmo_subdivide_edges_exec(BMesh *bm, BMOperator *op)
 	BM_data_layer_free_n(bm, &bm->vdata, CD_SHAPEKEY, params.shape_info.tmpkey);
 	
 	BLI_stack_free(facedata);
-	if (edges) BLI_array_free(edges);
 	if (verts) BLI_array_free(verts);
 	BLI_array_free(loops_split);
 	BLI_array_free(loops);
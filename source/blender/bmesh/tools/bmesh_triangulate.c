@@ -46,31 +46,24 @@
 #include "bmesh_triangulate.h"  /* own include */
 
 /**
- * a version of #BM_face_triangulate that maps to #BMOpSlot
+ * a version of #BM_face_triangulate_from_tris that maps to #BMOpSlot
  */
 static void bm_face_triangulate_mapping(
-        BMesh *bm, BMFace *face,
-        const int quad_method, const int ngon_method,
+        BMesh *bm, BMFace *face, const uint (*tris)[3],
         const bool use_tag,
-        BMOperator *op, BMOpSlot *slot_facemap_out, BMOpSlot *slot_facemap_double_out,
-
-        MemArena *pf_arena,
-        /* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
-        struct Heap *pf_heap)
+        BMOperator *op, BMOpSlot *slot_facemap_out, BMOpSlot *slot_facemap_double_out)
 {
 	int faces_array_tot = face->len - 3;
 	BMFace  **faces_array = BLI_array_alloca(faces_array, faces_array_tot);
 	LinkNode *faces_double = NULL;
 	BLI_assert(face->len > 3);
 
-	BM_face_triangulate(
-	        bm, face,
+	BM_face_triangulate_from_tris(
+	        bm, face, tris,
 	        faces_array, &faces_array_tot,
 	        NULL, NULL,
 	        &faces_double,
-	        quad_method, ngon_method, use_tag,
-	        pf_arena,
-	        pf_heap);
+	        use_tag);
 
 	if (faces_array_tot) {
 		int i;
@@ -88,67 +81,134 @@ static void bm_face_triangulate_mapping(
 	}
 }
 
+typedef struct TriangulateData {
+	const int *tris_offset;
+	uint (*tris)[3];
+	int quad_method;
+	int ngon_method;
+} TriangulateData;
 
-void BM_mesh_triangulate(
-        BMesh *bm, const int quad_method, const int ngon_method, const bool tag_only,
-        BMOperator *op, BMOpSlot *slot_facemap_out, BMOpSlot *slot_facemap_double_out)
-{
-	BMIter iter;
-	BMFace *face;
+typedef struct TriangulateTLS {
+	/* Created on demand, quads don't need them. */
 	MemArena *pf_arena;
+	/* use for MOD_TRIANGULATE_NGON_BEAUTY only! */
 	Heap *pf_heap;
+} TriangulateTLS;
+
+static void bm_face_triangulate_calc_cb(
+        void *__restrict userdata, BMElem *ele, const int index, void *__restrict userdata_chunk)
+{
+	TriangulateData *data = userdata;
+	TriangulateTLS *tls = userdata_chunk;
+	BMFace *face = (BMFace *)ele;
+
+	if ((face->len != 4) && (tls->pf_arena == NULL)) {
+		tls->pf_arena = BLI_memarena_new(BLI_POLYFILL_ARENA_SIZE, __func__);
+		if (data->ngon_method == MOD_TRIANGULATE_NGON_BEAUTY) {
+			tls->pf_heap = BLI_heap_new_ex(BLI_POLYFILL_ALLOC_NGON_RESERVE);
+		}
+	}
 
-	pf_arena = BLI_memarena_new(BLI_POLYFILL_ARENA_SIZE, __func__);
+	BM_face_calc_triangulate_tris(
+	        face, data->quad_method, data->ngon_method,
+	        &data->tris[data->tris_offset[index]],
+	        tls->pf_arena, tls->pf_heap);
+}
 
-	if (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY) {
-		pf_heap = BLI_heap_new_ex(BLI_POLYFILL_ALLOC_NGON_RESERVE);
+static void bm_face_triangulate_calc_finalize(
+        void *__restrict UNUSED(userdata), void *__restrict userdata_chunk)
+{
+	TriangulateTLS *tls = userdata_chunk;
+
+	if (tls->pf_arena) {
+		BLI_memarena_free(tls->pf_arena);
 	}
-	else {
-		pf_heap = NULL;
+	if (tls->pf_heap) {
+		BLI_heap_free(tls->pf_heap, NULL);
 	}
+}
 
-	if (slot_facemap_out) {
-		/* same as below but call: bm_face_triangulate_mapping() */
-		BM_ITER_MESH (face, &iter, bm, BM_FACES_OF_MESH) {
-			if (face->len > 3) {
-				if (tag_only == false || BM_elem_flag_test(face, BM_ELEM_TAG)) {
-					bm_face_triangulate_mapping(
-					        bm, face,
-					        quad_method, ngon_method, tag_only,
-					        op, slot_facemap_out, slot_facemap_double_out,
-					        pf_arena, pf_heap);
-				}
+/**
+ * Triangulation of the faces is calculated in parallel (it only reads the mesh),
+ * then applied to the mesh in the same order as the faces are stored.
+ */
+void BM_mesh_triangulate(
+        BMesh *bm, const int quad_method, const int ngon_method, const bool tag_only,
+        BMOperator *op, BMOpSlot *slot_facemap_out, BMOpSlot *slot_facemap_double_out)
+{
+	BMIter iter;
+	BMFace *face;
+	BMFace **faces;
+	int *tris_offset;
+	int faces_len = 0, tris_len = 0;
+	int i;
+
+	faces = MEM_mallocN(sizeof(*faces) * (size_t)bm->totface, __func__);
+	tris_offset = MEM_mallocN(sizeof(*tris_offset) * (size_t)bm->totface, __func__);
+
+	BM_ITER_MESH (face, &iter, bm, BM_FACES_OF_MESH) {
+		if (face->len > 3) {
+			if (tag_only == false || BM_elem_flag_test(face, BM_ELEM_TAG)) {
+				faces[faces_len] = face;
+				tris_offset[faces_len] = tris_len;
+				tris_len += face->len - 2;
+				faces_len++;
 			}
 		}
 	}
-	else {
-		LinkNode *faces_double = NULL;
-
-		BM_ITER_MESH (face, &iter, bm, BM_FACES_OF_MESH) {
-			if (face->len > 3) {
-				if (tag_only == false || BM_elem_flag_test(face, BM_ELEM_TAG)) {
-					BM_face_triangulate(
-					        bm, face,
-					        NULL, NULL,
-					        NULL, NULL,
-					        &faces_double,
-					        quad_method, ngon_method, tag_only,
-					        pf_arena, pf_heap);
-				}
+
+	if (faces_len == 0) {
+		MEM_freeN(faces);
+		MEM_freeN(tris_offset);
+		return;
+	}
+
+	{
+		TriangulateData data = {
+			.tris_offset = tris_offset,
+			.tris = MEM_mallocN(sizeof(*data.tris) * (size_t)tris_len, __func__),
+			.quad_method = quad_method,
+			.ngon_method = ngon_method,
+		};
+		TriangulateTLS tls = {NULL};
+
+		BMO_elem_array_compute_parallel(
+		        bm, (BMElem **)faces, faces_len,
+		        &data, bm_face_triangulate_calc_cb,
+		        &tls, sizeof(tls), bm_face_triangulate_calc_finalize);
+
+		if (slot_facemap_out) {
+			/* same as below but call: bm_face_triangulate_mapping() */
+			for (i = 0; i < faces_len; i++) {
+				bm_face_triangulate_mapping(
+				        bm, faces[i], (const uint (*)[3])&data.tris[tris_offset[i]],
+				        tag_only,
+				        op, slot_facemap_out, slot_facemap_double_out);
 			}
 		}
+		else {
+			LinkNode *faces_double = NULL;
+
+			for (i = 0; i < faces_len; i++) {
+				BM_face_triangulate_from_tris(
+				        bm, faces[i], (const uint (*)[3])&data.tris[tris_offset[i]],
+				        NULL, NULL,
+				        NULL, NULL,
+				        &faces_double,
+				        tag_only);
+			}
 
-		while (faces_double) {
-			LinkNode *next = faces_double->next;
-			BM_face_kill(bm, faces_double->link);
-			MEM_freeN(faces_double);
-			faces_double = next;
+			while (faces_double) {
+				LinkNode *next = faces_double->next;
+				BM_face_kill(bm, faces_double->link);
+				MEM_freeN(faces_double);
+				faces_double = next;
+			}
 		}
-	}
 
-	BLI_memarena_free(pf_arena);
-
-	if (ngon_method == MOD_TRIANGULATE_NGON_BEAUTY) {
-		BLI_heap_free(pf_heap, NULL);
+		MEM_freeN(data.tris);
 	}
+
+	MEM_freeN(faces);
+	MEM_freeN(tris_offset);
 }
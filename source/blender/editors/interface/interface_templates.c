@@ -1075,6 +1075,10 @@ static uiLayout *draw_modifier(
 				uiItemO(row, CTX_IFACE_(BLT_I18NCONTEXT_OPERATOR_DEFAULT, "Copy"), ICON_NONE,
 				        "OBJECT_OT_modifier_copy");
 			}
+
+			if (ob->type == OB_MESH && mti->type != eModifierTypeType_OnlyDeform) {
+				uiItemR(row, &ptr, "use_cache_result", 0, IFACE_("Cache"), ICON_NONE);
+			}
 		}
 		
 		/* result is the layout block inside the box, that we return so that modifier settings can be drawn */
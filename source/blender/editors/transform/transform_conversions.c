@@ -2497,6 +2497,9 @@ static void createTransEditVerts(TransInfo *t)
 	/* Original index of our connected vertex when connected distances are calculated.
 	 * Optional, allocate if needed. */
 	int *dists_index = NULL;
+	/* Vertices which may move (including mirrored), for partial updates. */
+	BMVert **verts_partial = NULL;
+	int verts_partial_len = 0;
 
 	if (t->flag & T_MIRROR) {
 		EDBM_verts_mirror_cache_begin(em, 0, false, (t->flag & T_PROP_EDIT) == 0, use_topology);
@@ -2550,6 +2553,11 @@ static void createTransEditVerts(TransInfo *t)
 		                          "TransObData ext");
 	}
 
+	/* when all vertices move, updating everything is just as fast */
+	if (t->total != bm->totvert) {
+		verts_partial = MEM_mallocN(sizeof(*verts_partial) * t->total * (mirror ? 2 : 1), __func__);
+	}
+
 	copy_m3_m4(mtx, t->obedit->obmat);
 	/* we use a pseudoinverse so that when one of the axes is scaled to 0,
 	 * matrix inversion still works and we can still moving along the other */
@@ -2630,6 +2638,10 @@ static void createTransEditVerts(TransInfo *t)
 				if (tx)
 					tx++;
 
+				if (verts_partial) {
+					verts_partial[verts_partial_len++] = eve;
+				}
+
 				/* selected */
 				if (BM_elem_flag_test(eve, BM_ELEM_SELECT))
 					tob->flag |= TD_SELECTED;
@@ -2675,6 +2687,9 @@ static void createTransEditVerts(TransInfo *t)
 					BMVert *vmir = EDBM_verts_mirror_get(em, eve); //t->obedit, em, eve, tob->iloc, a);
 					if (vmir && vmir != eve) {
 						tob->extra = vmir;
+						if (verts_partial) {
+							verts_partial[verts_partial_len++] = vmir;
+						}
 					}
 				}
 				tob++;
@@ -2687,6 +2702,11 @@ static void createTransEditVerts(TransInfo *t)
 		MEM_freeN(island_vert_map);
 	}
 
+	if (verts_partial) {
+		BKE_editmesh_partial_begin(em, verts_partial, verts_partial_len);
+		MEM_freeN(verts_partial);
+	}
+
 	if (mirror != 0) {
 		tob = t->data;
 		for (a = 0; a < t->total; a++, tob++) {
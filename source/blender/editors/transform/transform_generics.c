@@ -769,8 +769,8 @@ static void recalcData_objects(TransInfo *t)
 
 			DAG_id_tag_update(t->obedit->data, 0);  /* sets recalc flags */
 			
-			EDBM_mesh_normals_update(em);
-			BKE_editmesh_tessface_calc(em);
+			/* normals & tessellation, only for faces around transformed verts when possible */
+			BKE_editmesh_partial_update(em);
 		}
 		else if (t->obedit->type == OB_ARMATURE) { /* no recalc flag, does pose */
 			bArmature *arm = t->obedit->data;
@@ -1475,6 +1475,10 @@ void postTrans(bContext *C, TransInfo *t)
 		}
 	}
 
+	if (t->obedit && (t->obedit->type == OB_MESH)) {
+		BKE_editmesh_partial_end(BKE_editmesh_from_object(t->obedit));
+	}
+
 	/* postTrans can be called when nothing is selected, so data is NULL already */
 	if (t->data) {
 		
@@ -98,6 +98,8 @@ typedef enum ModifierMode {
 	eModifierMode_Expanded          = (1 << 4),
 	eModifierMode_Virtual           = (1 << 5),
 	eModifierMode_ApplyOnSpline     = (1 << 6),
+	/* Keep the result of this modifier, to skip re-evaluating the stack up to it. */
+	eModifierMode_CacheResult       = (1 << 7),
 	eModifierMode_DisableTemporary  = (1u << 31)
 } ModifierMode;
 
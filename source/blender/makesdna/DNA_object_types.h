@@ -296,7 +296,7 @@ typedef struct Object {
 
 	float ima_ofs[2];		/* offset for image empties */
 	ImageUser *iuser;		/* must be non-null when oject is an empty image */
-	void *pad3;
+	struct ModifierStackCache *modifier_stack_cache;  /* runtime, results of modifiers using eModifierMode_CacheResult */
 
 	ListBase lodlevels;		/* contains data for levels of detail */
 	LodLevel *currentlod;
@@ -38,6 +38,8 @@ typedef struct PackedFile {
 	int   size;
 	int   seek;
 	void *data;
+	/* runtime, when set data isn't allocated but references the memory mapped .blend file */
+	struct BlendFileMapping *mapping;
 } PackedFile;
 
 enum ePF_FileStatus {
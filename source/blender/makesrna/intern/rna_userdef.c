@@ -4543,6 +4543,12 @@ static void rna_def_userdef_filepaths(BlenderRNA *brna)
 	RNA_def_property_ui_text(prop, "Load UI", "Load user interface setup when loading .blend files");
 	RNA_def_property_update(prop, 0, "rna_userdef_load_ui_update");
 
+	prop = RNA_def_property(srna, "use_lazy_packed_data", PROP_BOOLEAN, PROP_NONE);
+	RNA_def_property_boolean_sdna(prop, NULL, "flag", USER_FILE_LAZY_PACKED);
+	RNA_def_property_ui_text(prop, "Lazy Packed Data",
+	                         "Don't read packed files when loading uncompressed .blend files, "
+	                         "their data is only loaded from the file once it's used");
+
 	prop = RNA_def_property(srna, "font_directory", PROP_STRING, PROP_DIRPATH);
 	RNA_def_property_string_sdna(prop, NULL, "fontdir");
 	RNA_def_property_ui_text(prop, "Fonts Directory", "The default directory to search for loading fonts");
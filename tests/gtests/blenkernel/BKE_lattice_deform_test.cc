@@ -0,0 +1,307 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_listbase.h"
+#include "BLI_math.h"
+#include "BLI_string.h"
+#include "BLI_threads.h"
+#include "DNA_curve_types.h"
+#include "DNA_lattice_types.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "DNA_object_types.h"
+#include "DNA_scene_types.h"
+#include "BKE_anim.h"
+#include "BKE_curve.h"
+#include "BKE_customdata.h"
+#include "BKE_deform.h"
+#include "BKE_lattice.h"
+#include "BKE_library.h"
+#include "BKE_main.h"
+#include "BKE_mesh.h"
+#include "BKE_object.h"
+#include "BKE_object_deform.h"
+}
+
+/* Below and above the minimum number of points deformed by a thread (DEFORM_THREAD_MIN_ITER). */
+#define POINTS_LEN_SMALL 10
+#define POINTS_LEN_LARGE 20000
+
+#define TARGET_VGROUP "Target Group"
+#define LATTICE_VGROUP "Lattice Group"
+
+class LatticeDeformTest : public testing::Test
+{
+protected:
+	Main *bmain;
+	Object *target;
+
+	static void SetUpTestCase()
+	{
+		/* Deform in parallel, also on single core machines. */
+		BLI_system_num_threads_override_set(4);
+	}
+
+	virtual void SetUp()
+	{
+		bmain = BKE_main_new();
+
+		target = BKE_object_add_only_object(bmain, OB_MESH, "Target");
+		target->data = BKE_mesh_add(bmain, "Target");
+		/* Deform along the X axis, as used by curve_deform_vector(). */
+		target->trackflag = 0;
+		BKE_object_defgroup_add_name(target, TARGET_VGROUP);
+
+		/* Not aligned with the lattice and curve objects. */
+		unit_m4(target->obmat);
+		copy_v3_fl3(target->obmat[3], 0.25f, -0.5f, 0.125f);
+	}
+
+	virtual void TearDown()
+	{
+		BKE_main_free(bmain);
+	}
+
+	/* Points of a grid in [-1, 1], weighted 0, 0.25, .. 1 by the target vertex group. */
+	float (*points_grid(const int points_len))[3]
+	{
+		float (*cos)[3] = (float (*)[3])MEM_mallocN(sizeof(*cos) * points_len, __func__);
+		const int side = (int)ceilf(cbrtf((float)points_len));
+		Mesh *me = (Mesh *)target->data;
+
+		for (int i = 0; i < points_len; i++) {
+			cos[i][0] = 2.0f * (float)(i % side) / (float)side - 1.0f;
+			cos[i][1] = 2.0f * (float)((i / side) % side) / (float)side - 1.0f;
+			cos[i][2] = 2.0f * (float)(i / (side * side)) / (float)side - 1.0f;
+		}
+
+		if (me->dvert) {
+			CustomData_free_layers(&me->vdata, CD_MDEFORMVERT, me->totvert);
+		}
+		me->totvert = points_len;
+		me->dvert = (MDeformVert *)CustomData_add_layer(&me->vdata, CD_MDEFORMVERT, CD_CALLOC, NULL, points_len);
+		for (int i = 0; i < points_len; i++) {
+			defvert_add_index_notest(&me->dvert[i], 0, (float)(i % 5) / 4.0f);
+		}
+
+		return cos;
+	}
+
+	/* A 3x3x3 lattice with displaced points, weighted by its own vertex group. */
+	Object *lattice_object()
+	{
+		Object *ob = BKE_object_add_only_object(bmain, OB_LATTICE, "Lattice");
+		Lattice *lt = BKE_lattice_add(bmain, "Lattice");
+		ob->data = lt;
+		unit_m4(ob->obmat);
+		mul_v3_fl(ob->obmat[0], 2.0f);
+
+		BKE_lattice_resize(lt, 3, 3, 3, NULL);
+		const int tot = lt->pntsu * lt->pntsv * lt->pntsw;
+		for (int i = 0; i < tot; i++) {
+			lt->def[i].vec[0] += 0.1f * sinf((float)i);
+			lt->def[i].vec[1] += 0.1f * cosf((float)i);
+			lt->def[i].vec[2] -= 0.05f * (float)(i % 3);
+		}
+
+		BKE_object_defgroup_add_name(ob, LATTICE_VGROUP);
+		BLI_strncpy(lt->vgroup, LATTICE_VGROUP, sizeof(lt->vgroup));
+		lt->dvert = (MDeformVert *)MEM_callocN(sizeof(*lt->dvert) * tot, __func__);
+		for (int i = 0; i < tot; i++) {
+			defvert_add_index_notest(&lt->dvert[i], 0, (float)(i % 3) / 2.0f);
+		}
+
+		return ob;
+	}
+
+	/* A poly curve with its path, a circle when cyclic, a helix otherwise. */
+	Object *curve_object(const bool use_cyclic)
+	{
+		const int bp_len = 16;
+		Object *ob = BKE_object_add_only_object(bmain, OB_CURVE, "Curve");
+		Curve *cu = BKE_curve_add(bmain, "Curve", OB_CURVE);
+		ob->data = cu;
+		unit_m4(ob->obmat);
+		copy_v3_fl3(ob->obmat[3], -0.5f, 0.0f, 0.25f);
+		cu->flag |= CU_PATH | CU_3D;
+
+		Nurb *nu = (Nurb *)MEM_callocN(sizeof(*nu), __func__);
+		nu->type = CU_POLY;
+		nu->pntsu = bp_len;
+		nu->pntsv = 1;
+		nu->orderu = nu->orderv = 4;
+		nu->resolu = cu->resolu;
+		nu->flagu = use_cyclic ? CU_NURB_CYCLIC : 0;
+		nu->bp = (BPoint *)MEM_callocN(sizeof(*nu->bp) * bp_len, __func__);
+		for (int i = 0; i < bp_len; i++) {
+			const float angle = (float)(2.0 * M_PI) * (float)i / (float)bp_len;
+			copy_v4_fl4(nu->bp[i].vec, 2.0f * cosf(angle), 2.0f * sinf(angle), use_cyclic ? 0.0f : 0.25f * (float)i, 1.0f);
+			nu->bp[i].radius = 1.0f;
+			nu->bp[i].weight = 1.0f;
+		}
+		BLI_addtail(&cu->nurb, nu);
+
+		ob->curve_cache = (CurveCache *)MEM_callocN(sizeof(*ob->curve_cache), __func__);
+		BKE_curve_bevelList_make(ob, &cu->nurb, false);
+		calc_curvepath(ob, &cu->nurb);
+
+		return ob;
+	}
+
+	/* Serial per point lattice deform, as done by lattice_deform_verts(). */
+	void lattice_deform_serial(Object *ob_lattice, float (*cos)[3], const int points_len, const bool use_vgroup, const float fac)
+	{
+		const MDeformVert *dvert = use_vgroup ? ((Mesh *)target->data)->dvert : NULL;
+		LatticeDeformData *lattice_deform_data = init_latt_deform(ob_lattice, target);
+
+		for (int i = 0; i < points_len; i++) {
+			const float weight = dvert ? defvert_find_weight(&dvert[i], 0) : 1.0f;
+			if (weight > 0.0f) {
+				calc_latt_deform(lattice_deform_data, cos[i], weight * fac);
+			}
+		}
+
+		end_latt_deform(lattice_deform_data);
+	}
+
+	/* Serial per point curve deform, using the bounds curve_deform_verts() calculates. */
+	void curve_deform_serial(Object *ob_curve, float (*cos)[3], const int points_len, const bool use_vgroup)
+	{
+		const MDeformVert *dvert = use_vgroup ? ((Mesh *)target->data)->dvert : NULL;
+		float dmin[3] = {0.0f, 0.0f, 0.0f}, dmax[3], mat[3][3];
+
+		if ((((Curve *)ob_curve->data)->flag & CU_DEFORM_BOUNDS_OFF) == 0) {
+			float imat[4][4], curvespace[4][4], co[3];
+
+			invert_m4_m4(imat, ob_curve->obmat);
+			mul_m4_m4m4(curvespace, imat, target->obmat);
+
+			INIT_MINMAX(dmin, dmax);
+			for (int i = 0; i < points_len; i++) {
+				if (!dvert || defvert_find_weight(&dvert[i], 0) > 0.0f) {
+					mul_v3_m4v3(co, curvespace, cos[i]);
+					minmax_v3v3_v3(dmin, dmax, co);
+				}
+			}
+		}
+
+		for (int i = 0; i < points_len; i++) {
+			const float weight = dvert ? defvert_find_weight(&dvert[i], 0) : 1.0f;
+			if (weight > 0.0f) {
+				float vec[3];
+				copy_v3_v3(vec, cos[i]);
+				curve_deform_vector(NULL, ob_curve, target, dmin, vec, mat, 0);
+				interp_v3_v3v3(cos[i], cos[i], vec, weight);
+			}
+		}
+	}
+
+	static void expect_points_near(
+	        float (*cos_expect)[3], float (*cos)[3], float (*cos_orig)[3], const int points_len, const float eps)
+	{
+		int moved = 0;
+
+		for (int i = 0; i < points_len; i++) {
+			EXPECT_V3_NEAR(cos_expect[i], cos[i], eps);
+			if (len_squared_v3v3(cos[i], cos_orig[i]) > 1e-6f) {
+				moved++;
+			}
+		}
+
+		/* all points but the ones with zero weight */
+		EXPECT_GE(moved, points_len / 2);
+	}
+};
+
+TEST_F(LatticeDeformTest, Lattice)
+{
+	const int points_lens[] = {POINTS_LEN_SMALL, POINTS_LEN_LARGE};
+	Object *ob_lattice = lattice_object();
+
+	for (size_t i = 0; i < ARRAY_SIZE(points_lens); i++) {
+		const int points_len = points_lens[i];
+		float (*cos)[3] = points_grid(points_len);
+		float (*cos_orig)[3] = (float (*)[3])MEM_dupallocN(cos);
+		float (*cos_expect)[3] = (float (*)[3])MEM_dupallocN(cos);
+
+		lattice_deform_serial(ob_lattice, cos_expect, points_len, false, 1.0f);
+		lattice_deform_verts(ob_lattice, target, NULL, cos, points_len, NULL, 1.0f);
+		expect_points_near(cos_expect, cos, cos_orig, points_len, 1e-6f);
+
+		MEM_freeN(cos);
+		MEM_freeN(cos_orig);
+		MEM_freeN(cos_expect);
+	}
+}
+
+TEST_F(LatticeDeformTest, LatticeVertexGroups)
+{
+	const int points_lens[] = {POINTS_LEN_SMALL, POINTS_LEN_LARGE};
+	Object *ob_lattice = lattice_object();
+
+	for (size_t i = 0; i < ARRAY_SIZE(points_lens); i++) {
+		const int points_len = points_lens[i];
+		float (*cos)[3] = points_grid(points_len);
+		float (*cos_orig)[3] = (float (*)[3])MEM_dupallocN(cos);
+		float (*cos_expect)[3] = (float (*)[3])MEM_dupallocN(cos);
+
+		lattice_deform_serial(ob_lattice, cos_expect, points_len, true, 0.75f);
+		lattice_deform_verts(ob_lattice, target, NULL, cos, points_len, TARGET_VGROUP, 0.75f);
+		expect_points_near(cos_expect, cos, cos_orig, points_len, 1e-6f);
+
+		MEM_freeN(cos);
+		MEM_freeN(cos_orig);
+		MEM_freeN(cos_expect);
+	}
+}
+
+TEST_F(LatticeDeformTest, CurveCyclicVertexGroups)
+{
+	const int points_lens[] = {POINTS_LEN_SMALL, POINTS_LEN_LARGE};
+	Object *ob_curve = curve_object(true);
+
+	/* use the bounds of the deformed points */
+	((Curve *)ob_curve->data)->flag &= ~CU_DEFORM_BOUNDS_OFF;
+
+	for (size_t i = 0; i < ARRAY_SIZE(points_lens); i++) {
+		const int points_len = points_lens[i];
+		float (*cos)[3] = points_grid(points_len);
+		float (*cos_orig)[3] = (float (*)[3])MEM_dupallocN(cos);
+		float (*cos_expect)[3] = (float (*)[3])MEM_dupallocN(cos);
+
+		curve_deform_serial(ob_curve, cos_expect, points_len, true);
+		curve_deform_verts(NULL, ob_curve, target, NULL, cos, points_len, TARGET_VGROUP, 0);
+		expect_points_near(cos_expect, cos, cos_orig, points_len, 1e-4f);
+
+		MEM_freeN(cos);
+		MEM_freeN(cos_orig);
+		MEM_freeN(cos_expect);
+	}
+}
+
+TEST_F(LatticeDeformTest, CurveBoundsOff)
+{
+	const int points_lens[] = {POINTS_LEN_SMALL, POINTS_LEN_LARGE};
+	Object *ob_curve = curve_object(false);
+
+	EXPECT_TRUE(((Curve *)ob_curve->data)->flag & CU_DEFORM_BOUNDS_OFF);
+
+	for (size_t i = 0; i < ARRAY_SIZE(points_lens); i++) {
+		const int points_len = points_lens[i];
+		float (*cos)[3] = points_grid(points_len);
+		float (*cos_orig)[3] = (float (*)[3])MEM_dupallocN(cos);
+		float (*cos_expect)[3] = (float (*)[3])MEM_dupallocN(cos);
+
+		curve_deform_serial(ob_curve, cos_expect, points_len, false);
+		curve_deform_verts(NULL, ob_curve, target, NULL, cos, points_len, NULL, 0);
+		expect_points_near(cos_expect, cos, cos_orig, points_len, 1e-4f);
+
+		MEM_freeN(cos);
+		MEM_freeN(cos_orig);
+		MEM_freeN(cos_expect);
+	}
+}
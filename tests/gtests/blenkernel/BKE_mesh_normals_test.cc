@@ -0,0 +1,253 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_linklist.h"
+#include "BLI_math.h"
+#include "DNA_meshdata_types.h"
+#include "BKE_mesh.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Run the longest tests! */
+//#define MESH_NORMALS_RUN_BIG
+
+#ifdef MESH_NORMALS_RUN_BIG
+#  define BENCHMARK_TORUS_SIZE 2000
+#  define BENCHMARK_CONE_SIZE 200000
+#else
+#  define BENCHMARK_TORUS_SIZE 1000
+#  define BENCHMARK_CONE_SIZE 50000
+#endif
+
+typedef struct TestMesh {
+	MVert *mverts;
+	MEdge *medges;
+	MLoop *mloops;
+	MPoly *mpolys;
+	float (*polynors)[3];
+	int totvert, totedge, totloop, totpoly;
+} TestMesh;
+
+static void test_mesh_alloc(TestMesh *mesh, int totvert, int totedge, int totloop, int totpoly)
+{
+	mesh->totvert = totvert;
+	mesh->totedge = totedge;
+	mesh->totloop = totloop;
+	mesh->totpoly = totpoly;
+	mesh->mverts = (MVert *)MEM_callocN(sizeof(*mesh->mverts) * totvert, __func__);
+	mesh->medges = (MEdge *)MEM_callocN(sizeof(*mesh->medges) * totedge, __func__);
+	mesh->mloops = (MLoop *)MEM_callocN(sizeof(*mesh->mloops) * totloop, __func__);
+	mesh->mpolys = (MPoly *)MEM_callocN(sizeof(*mesh->mpolys) * totpoly, __func__);
+	mesh->polynors = (float (*)[3])MEM_mallocN(sizeof(*mesh->polynors) * totpoly, __func__);
+}
+
+static void test_mesh_calc_normals(TestMesh *mesh)
+{
+	BKE_mesh_calc_normals_poly(
+	        mesh->mverts, NULL, mesh->totvert, mesh->mloops, mesh->mpolys,
+	        mesh->totloop, mesh->totpoly, mesh->polynors, false);
+}
+
+static void test_mesh_free(TestMesh *mesh)
+{
+	MEM_freeN(mesh->mverts);
+	MEM_freeN(mesh->medges);
+	MEM_freeN(mesh->mloops);
+	MEM_freeN(mesh->mpolys);
+	MEM_freeN(mesh->polynors);
+}
+
+/* Closed torus of size * size smooth quads, every vertex has a cyclic smooth fan of 4 loops. */
+static void test_mesh_torus(TestMesh *mesh, const int size)
+{
+	test_mesh_alloc(mesh, size * size, size * size * 2, size * size * 4, size * size);
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			const float u = (float)(2.0 * M_PI) * (float)x / (float)size;
+			const float v = (float)(2.0 * M_PI) * (float)y / (float)size;
+			MVert *mv = &mesh->mverts[y * size + x];
+			MEdge *me = &mesh->medges[(y * size + x) * 2];
+
+			mv->co[0] = (2.0f + cosf(v)) * cosf(u);
+			mv->co[1] = (2.0f + cosf(v)) * sinf(u);
+			mv->co[2] = sinf(v);
+
+			me[0].v1 = (unsigned int)(y * size + x);
+			me[0].v2 = (unsigned int)(y * size + (x + 1) % size);
+			me[1].v1 = (unsigned int)(y * size + x);
+			me[1].v2 = (unsigned int)(((y + 1) % size) * size + x);
+		}
+	}
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			const int x_next = (x + 1) % size, y_next = (y + 1) % size;
+			MPoly *mp = &mesh->mpolys[y * size + x];
+			MLoop *ml = &mesh->mloops[(y * size + x) * 4];
+
+			mp->loopstart = (y * size + x) * 4;
+			mp->totloop = 4;
+			mp->flag = ME_SMOOTH;
+
+			ml[0].v = (unsigned int)(y * size + x);
+			ml[0].e = (unsigned int)((y * size + x) * 2);
+			ml[1].v = (unsigned int)(y * size + x_next);
+			ml[1].e = (unsigned int)((y * size + x_next) * 2 + 1);
+			ml[2].v = (unsigned int)(y_next * size + x_next);
+			ml[2].e = (unsigned int)((y_next * size + x) * 2);
+			ml[3].v = (unsigned int)(y_next * size + x);
+			ml[3].e = (unsigned int)((y * size + x) * 2 + 1);
+		}
+	}
+
+	test_mesh_calc_normals(mesh);
+}
+
+/* Open cone of size smooth triangles, its apex is a single cyclic smooth fan of size loops. */
+static void test_mesh_cone(TestMesh *mesh, const int size)
+{
+	test_mesh_alloc(mesh, size + 1, size * 2, size * 3, size);
+
+	mesh->mverts[0].co[2] = 1.0f;
+	for (int i = 0; i < size; i++) {
+		const float u = (float)(2.0 * M_PI) * (float)i / (float)size;
+		mesh->mverts[i + 1].co[0] = cosf(u);
+		mesh->mverts[i + 1].co[1] = sinf(u);
+
+		/* spoke, then rim */
+		mesh->medges[i].v1 = 0;
+		mesh->medges[i].v2 = (unsigned int)(i + 1);
+		mesh->medges[size + i].v1 = (unsigned int)(i + 1);
+		mesh->medges[size + i].v2 = (unsigned int)((i + 1) % size + 1);
+	}
+
+	for (int i = 0; i < size; i++) {
+		MPoly *mp = &mesh->mpolys[i];
+		MLoop *ml = &mesh->mloops[i * 3];
+
+		mp->loopstart = i * 3;
+		mp->totloop = 3;
+		mp->flag = ME_SMOOTH;
+
+		ml[0].v = 0;
+		ml[0].e = (unsigned int)i;
+		ml[1].v = (unsigned int)(i + 1);
+		ml[1].e = (unsigned int)(size + i);
+		ml[2].v = (unsigned int)((i + 1) % size + 1);
+		ml[2].e = (unsigned int)((i + 1) % size);
+	}
+
+	test_mesh_calc_normals(mesh);
+}
+
+static float (*test_mesh_normals_loop_split(TestMesh *mesh, MLoopNorSpaceArray *r_lnors_spacearr))[3]
+{
+	float (*loopnors)[3] = (float (*)[3])MEM_mallocN(sizeof(*loopnors) * mesh->totloop, __func__);
+
+	BKE_mesh_normals_loop_split(
+	        mesh->mverts, mesh->totvert, mesh->medges, mesh->totedge,
+	        mesh->mloops, loopnors, mesh->totloop,
+	        mesh->mpolys, (const float (*)[3])mesh->polynors, mesh->totpoly,
+	        true, (float)M_PI, r_lnors_spacearr, NULL, NULL);
+
+	return loopnors;
+}
+
+static int lnor_space_loops_len(const MLoopNorSpace *lnor_space)
+{
+	return (lnor_space->flags & MLNOR_SPACE_IS_SINGLE) ? 1 : BLI_linklist_count(lnor_space->loops);
+}
+
+TEST(mesh_normals, LoopSplitTorus)
+{
+	TestMesh mesh;
+	MLoopNorSpaceArray lnors_spacearr = {NULL};
+
+	/* Large enough to use threading. */
+	test_mesh_torus(&mesh, 100);
+	float (*loopnors)[3] = test_mesh_normals_loop_split(&mesh, &lnors_spacearr);
+
+	/* All smooth, each vertex has a single fan (and lnor space) of all its loops. */
+	for (int i = 0; i < mesh.totloop; i++) {
+		float vnor[3];
+		normal_short_to_float_v3(vnor, mesh.mverts[mesh.mloops[i].v].no);
+		EXPECT_V3_NEAR(vnor, loopnors[i], 1e-3f);
+
+		const MLoopNorSpace *lnor_space = lnors_spacearr.lspacearr[i];
+		ASSERT_TRUE(lnor_space != NULL);
+		EXPECT_EQ(4, lnor_space_loops_len(lnor_space));
+	}
+
+	BKE_lnor_spacearr_free(&lnors_spacearr);
+	MEM_freeN(loopnors);
+	test_mesh_free(&mesh);
+}
+
+TEST(mesh_normals, LoopSplitCone)
+{
+	TestMesh mesh;
+	MLoopNorSpaceArray lnors_spacearr = {NULL};
+	const float apex_nor[3] = {0.0f, 0.0f, 1.0f};
+
+	test_mesh_cone(&mesh, 10000);
+	float (*loopnors)[3] = test_mesh_normals_loop_split(&mesh, &lnors_spacearr);
+
+	/* One fan around the apex, walked once. */
+	const MLoopNorSpace *lnor_space = lnors_spacearr.lspacearr[0];
+	EXPECT_EQ(mesh.totpoly, lnor_space_loops_len(lnor_space));
+	for (int i = 0; i < mesh.totpoly; i++) {
+		EXPECT_EQ(lnor_space, lnors_spacearr.lspacearr[i * 3]);
+		EXPECT_V3_NEAR(apex_nor, loopnors[i * 3], 1e-2f);
+	}
+
+	BKE_lnor_spacearr_free(&lnors_spacearr);
+	MEM_freeN(loopnors);
+	test_mesh_free(&mesh);
+}
+
+TEST(mesh_normals, LoopSplitBenchmark)
+{
+	TestMesh mesh;
+	MLoopNorSpaceArray lnors_spacearr = {NULL};
+	float (*loopnors)[3];
+
+	test_mesh_torus(&mesh, BENCHMARK_TORUS_SIZE);
+
+	printf("\n========== STARTING loop split normals benchmark (%d loops) ==========\n", mesh.totloop);
+
+	{
+		TIMEIT_START(loop_split_torus);
+		loopnors = test_mesh_normals_loop_split(&mesh, NULL);
+		TIMEIT_END(loop_split_torus);
+		MEM_freeN(loopnors);
+	}
+
+	{
+		TIMEIT_START(loop_split_torus_lnor_spaces);
+		loopnors = test_mesh_normals_loop_split(&mesh, &lnors_spacearr);
+		TIMEIT_END(loop_split_torus_lnor_spaces);
+		BKE_lnor_spacearr_free(&lnors_spacearr);
+		MEM_freeN(loopnors);
+	}
+
+	test_mesh_free(&mesh);
+
+	/* A single large cyclic fan. */
+	test_mesh_cone(&mesh, BENCHMARK_CONE_SIZE);
+
+	printf("\n========== STARTING loop split normals cone benchmark (%d loops in a fan) ==========\n", mesh.totpoly);
+
+	{
+		TIMEIT_START(loop_split_cone);
+		loopnors = test_mesh_normals_loop_split(&mesh, NULL);
+		TIMEIT_END(loop_split_cone);
+		MEM_freeN(loopnors);
+	}
+
+	test_mesh_free(&mesh);
+}
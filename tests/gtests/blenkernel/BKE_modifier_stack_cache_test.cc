@@ -0,0 +1,125 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "DNA_color_types.h"
+#include "DNA_modifier_types.h"
+#include "DNA_object_types.h"
+#include "DNA_scene_types.h"
+#include "BKE_colortools.h"
+#include "BKE_DerivedMesh.h"
+#include "BKE_modifier.h"
+}
+
+class ModifierStackCacheTest : public testing::Test
+{
+protected:
+	Scene *scene;
+	Object *ob;
+
+	static void SetUpTestCase()
+	{
+		BKE_modifier_init();
+	}
+
+	virtual void SetUp()
+	{
+		scene = (Scene *)MEM_callocN(sizeof(*scene), __func__);
+		ob = (Object *)MEM_callocN(sizeof(*ob), __func__);
+	}
+
+	virtual void TearDown()
+	{
+		MEM_freeN(scene);
+		MEM_freeN(ob);
+	}
+
+	uint64_t hash(ModifierData *md, const int required_mode = eModifierMode_Realtime)
+	{
+		uint64_t h;
+		EXPECT_TRUE(mesh_modifier_stack_cache_modifier_hash(scene, ob, md, required_mode, &h));
+		return h;
+	}
+};
+
+TEST_F(ModifierStackCacheTest, SubsurfRuntimeCache)
+{
+	SubsurfModifierData *smd = (SubsurfModifierData *)modifier_new(eModifierType_Subsurf);
+	const uint64_t h = hash(&smd->modifier);
+
+	/* runtime data, not hashed */
+	smd->mCache = smd->emCache = (void *)smd;
+	EXPECT_EQ(h, hash(&smd->modifier));
+	smd->mCache = smd->emCache = NULL;
+
+	smd->levels++;
+	EXPECT_NE(h, hash(&smd->modifier));
+
+	modifier_free(&smd->modifier);
+}
+
+TEST_F(ModifierStackCacheTest, SubsurfSimplify)
+{
+	SubsurfModifierData *smd = (SubsurfModifierData *)modifier_new(eModifierType_Subsurf);
+	const uint64_t h = hash(&smd->modifier);
+
+	scene->r.mode |= R_SIMPLIFY;
+	scene->r.simplify_subsurf = 0;
+	scene->r.simplify_subsurf_render = 0;
+	const uint64_t h_simplify = hash(&smd->modifier);
+	EXPECT_NE(h, h_simplify);
+
+	scene->r.simplify_subsurf = 1;
+	EXPECT_NE(h_simplify, hash(&smd->modifier));
+
+	/* render levels only change render results */
+	const uint64_t h_render = hash(&smd->modifier, eModifierMode_Render);
+	scene->r.simplify_subsurf_render = 2;
+	EXPECT_NE(h_render, hash(&smd->modifier, eModifierMode_Render));
+
+	modifier_free(&smd->modifier);
+}
+
+TEST_F(ModifierStackCacheTest, CurveMapping)
+{
+	WeightVGEditModifierData *wmd = (WeightVGEditModifierData *)modifier_new(eModifierType_WeightVGEdit);
+	WeightVGEditModifierData *wmd_copy = (WeightVGEditModifierData *)modifier_new(eModifierType_WeightVGEdit);
+	CurveMap *cuma = &wmd->cmap_curve->cm[0];
+
+	wmd->falloff_type = MOD_WVG_MAPPING_CURVE;
+	const uint64_t h = hash(&wmd->modifier);
+
+	/* the curve is hashed, not its pointer,
+	 * the copy already has its own curve which copying replaces */
+	curvemapping_free(wmd_copy->cmap_curve);
+	modifier_copyData(&wmd->modifier, &wmd_copy->modifier);
+	EXPECT_EQ(h, hash(&wmd_copy->modifier));
+
+	/* selection is UI only */
+	cuma->curve[0].flag ^= CUMA_SELECT;
+	EXPECT_EQ(h, hash(&wmd->modifier));
+
+	cuma->curve[1].y = 0.5f;
+	curvemapping_changed(wmd->cmap_curve, false);
+	EXPECT_NE(h, hash(&wmd->modifier));
+
+	curvemap_insert(cuma, 0.5f, 0.5f);
+	curvemapping_changed(wmd->cmap_curve, false);
+	EXPECT_NE(h, hash(&wmd->modifier));
+
+	modifier_free(&wmd->modifier);
+	modifier_free(&wmd_copy->modifier);
+}
+
+TEST_F(ModifierStackCacheTest, BindingNotCached)
+{
+	ModifierData *md = modifier_new(eModifierType_MeshDeform);
+	uint64_t h;
+
+	EXPECT_FALSE(mesh_modifier_stack_cache_modifier_hash(scene, ob, md, eModifierMode_Realtime, &h));
+
+	modifier_free(md);
+}
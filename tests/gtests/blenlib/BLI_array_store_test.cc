@@ -13,6 +13,7 @@ extern "C" {
 #include "BLI_string.h"
 #include "BLI_rand.h"
 #include "BLI_ressource_strings.h"
+#include "PIL_time_utildefines.h"
 }
 
 /* print memory savings */
@@ -722,6 +723,101 @@ TEST(array_store, TestChunk_Rand64_Stride8_Chunk32)  { random_chunk_mutate_helpe
 TEST(array_store, TestChunk_Rand31_Stride11_Chunk21) { random_chunk_mutate_helper(31, 100, 11, 21, 7117); }
 
 
+
+/* -------------------------------------------------------------------- */
+/* Benchmark, edit-mesh undo like changes to vertex coordinates */
+
+/* Run the longest benchmark! */
+//#define ARRAY_STORE_RUN_BIG
+
+#ifdef ARRAY_STORE_RUN_BIG
+#  define BENCHMARK_VERTS_NUM 10000000
+#else
+#  define BENCHMARK_VERTS_NUM 1000000
+#endif
+
+/* Matches edit-mesh undo. */
+#define BENCHMARK_CHUNK_SIZE 256
+
+static void mesh_edit_state_add(
+        BArrayStore *bs, ListBase *lb,
+        float (*verts)[3], const int verts_num, const char *id)
+{
+	TestBuffer *tb_prev = (TestBuffer *)lb->last;
+	TestBuffer *tb = testbuffer_list_add_copydata(lb, verts, sizeof(*verts) * (size_t)verts_num);
+
+	TIMEIT_START(state_add);
+	tb->state = BLI_array_store_state_add(bs, tb->data, tb->data_len, tb_prev ? tb_prev->state : NULL);
+	TIMEIT_END(state_add);
+	printf("  (%s)\n", id);
+}
+
+TEST(array_store, BenchmarkMeshEdit)
+{
+	const int verts_num_max = BENCHMARK_VERTS_NUM + BENCHMARK_VERTS_NUM / 10;
+	int verts_num = BENCHMARK_VERTS_NUM;
+	float (*verts)[3] = (float (*)[3])MEM_mallocN(sizeof(*verts) * (size_t)verts_num_max, __func__);
+	RNG *rng = BLI_rng_new(0);
+	BArrayStore *bs = BLI_array_store_create(sizeof(*verts), BENCHMARK_CHUNK_SIZE);
+	ListBase lb = {NULL, NULL};
+
+	printf("\n========== STARTING array-store benchmark (%d verts) ==========\n", verts_num);
+
+	for (int i = 0; i < verts_num; i++) {
+		BLI_rng_get_float_unit_v3(rng, verts[i]);
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "initial");
+
+	/* Move a contiguous selection. */
+	for (int i = verts_num / 3; i < verts_num / 2; i++) {
+		verts[i][2] += 0.1f;
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "move range");
+
+	/* Move scattered vertices. */
+	for (int i = 0; i < verts_num / 1000; i++) {
+		verts[BLI_rng_get_uint(rng) % (unsigned int)verts_num][0] += 0.1f;
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "move scattered");
+
+	/* Delete vertices from the middle. */
+	{
+		const int del_start = verts_num / 4, del_len = verts_num / 20;
+		memmove(&verts[del_start], &verts[del_start + del_len], sizeof(*verts) * (size_t)(verts_num - (del_start + del_len)));
+		verts_num -= del_len;
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "delete");
+
+	/* Add vertices at the end (extrude, duplicate). */
+	{
+		const int add_len = verts_num / 10;
+		memcpy(&verts[verts_num], &verts[verts_num / 2], sizeof(*verts) * (size_t)add_len);
+		for (int i = verts_num; i < verts_num + add_len; i++) {
+			verts[i][1] += 0.1f;
+		}
+		verts_num += add_len;
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "add");
+
+	/* Move everything. */
+	for (int i = 0; i < verts_num; i++) {
+		verts[i][0] *= 2.0f;
+	}
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "move all");
+
+	/* No change. */
+	mesh_edit_state_add(bs, &lb, verts, verts_num, "no change");
+
+	EXPECT_TRUE(testbuffer_list_validate(&lb));
+	EXPECT_TRUE(BLI_array_store_is_valid(bs));
+
+	testbuffer_list_store_clear(bs, &lb);
+	testbuffer_list_free(&lb);
+	BLI_array_store_destroy(bs);
+	BLI_rng_free(rng);
+	MEM_freeN(verts);
+}
+
 #if 0
 /* -------------------------------------------------------------------- */
 
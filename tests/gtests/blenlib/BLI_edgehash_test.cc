@@ -0,0 +1,209 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_edgehash.h"
+#include "BLI_rand.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Run the longest tests! */
+//#define EDGEHASH_RUN_BIG
+
+#ifdef EDGEHASH_RUN_BIG
+#  define BENCHMARK_GRID_SIZE 4000
+#else
+#  define BENCHMARK_GRID_SIZE 1000
+#endif
+
+/* -------------------------------------------------------------------- */
+/* Edge De-Duplication */
+
+/* Check the result of #BLI_edges_dedup against an #EdgeHash.
+ * Degenerate edges (which the #EdgeHash doesn't support) are checked against a per vertex array. */
+static void edges_dedup_validate(
+        const unsigned int (*edges)[2], const unsigned int edges_len, const unsigned int verts_len,
+        const unsigned int *edge_map, const unsigned int *edge_first, const unsigned int unique_len)
+{
+	EdgeHash *eh = BLI_edgehash_new_ex(__func__, edges_len);
+	void **degenerate_map = (void **)MEM_callocN(sizeof(*degenerate_map) * verts_len, __func__);
+	unsigned int unique_len_test = 0;
+
+	for (unsigned int i = 0; i < edges_len; i++) {
+		void **val_p;
+		bool found;
+		if (edges[i][0] == edges[i][1]) {
+			val_p = &degenerate_map[edges[i][0]];
+			found = (*val_p != NULL);
+		}
+		else {
+			found = BLI_edgehash_ensure_p(eh, edges[i][0], edges[i][1], &val_p);
+		}
+
+		if (!found) {
+			/* First occurrence, numbered in order. */
+			EXPECT_EQ(unique_len_test, edge_map[i]);
+			EXPECT_EQ(i, edge_first[unique_len_test]);
+			/* Offset by one, so NULL means unset. */
+			*val_p = SET_UINT_IN_POINTER(unique_len_test + 1);
+			unique_len_test++;
+		}
+		else {
+			EXPECT_EQ(GET_UINT_FROM_POINTER(*val_p) - 1, edge_map[i]);
+		}
+	}
+	EXPECT_EQ(unique_len_test, unique_len);
+
+	BLI_edgehash_free(eh, NULL);
+	MEM_freeN(degenerate_map);
+}
+
+static void edges_dedup_random_test(
+        const unsigned int edges_len, const unsigned int verts_len, const bool use_threading)
+{
+	unsigned int (*edges)[2] = (unsigned int (*)[2])MEM_mallocN(sizeof(*edges) * edges_len, __func__);
+	unsigned int *edge_map = (unsigned int *)MEM_mallocN(sizeof(*edge_map) * edges_len, __func__);
+	unsigned int *edge_first = (unsigned int *)MEM_mallocN(sizeof(*edge_first) * edges_len, __func__);
+	RNG *rng = BLI_rng_new(edges_len);
+
+	for (unsigned int i = 0; i < edges_len; i++) {
+		edges[i][0] = BLI_rng_get_uint(rng) % verts_len;
+		edges[i][1] = BLI_rng_get_uint(rng) % verts_len;
+	}
+
+	const unsigned int unique_len = BLI_edges_dedup(edges, edges_len, verts_len, edge_map, edge_first, use_threading);
+	edges_dedup_validate(edges, edges_len, verts_len, edge_map, edge_first, unique_len);
+
+	BLI_rng_free(rng);
+	MEM_freeN(edges);
+	MEM_freeN(edge_map);
+	MEM_freeN(edge_first);
+}
+
+TEST(edgehash, EdgesDedupEmpty)
+{
+	EXPECT_EQ(0, BLI_edges_dedup(NULL, 0, 0, NULL, NULL, true));
+}
+
+TEST(edgehash, EdgesDedupSimple)
+{
+	const unsigned int edges[][2] = {{0, 1}, {1, 2}, {1, 0}, {2, 0}, {2, 1}, {3, 3}, {3, 3}};
+	unsigned int edge_map[ARRAY_SIZE(edges)];
+	unsigned int edge_first[ARRAY_SIZE(edges)];
+	const unsigned int edge_map_test[] = {0, 1, 0, 2, 1, 3, 3};
+	const unsigned int edge_first_test[] = {0, 1, 3, 5};
+
+	const unsigned int unique_len = BLI_edges_dedup(edges, ARRAY_SIZE(edges), 4, edge_map, edge_first, true);
+	EXPECT_EQ(ARRAY_SIZE(edge_first_test), unique_len);
+	for (unsigned int i = 0; i < ARRAY_SIZE(edges); i++) {
+		EXPECT_EQ(edge_map_test[i], edge_map[i]);
+	}
+	for (unsigned int i = 0; i < unique_len; i++) {
+		EXPECT_EQ(edge_first_test[i], edge_first[i]);
+	}
+}
+
+TEST(edgehash, EdgesDedupRandom_Few)
+{
+	edges_dedup_random_test(100000, 10, true);
+}
+
+TEST(edgehash, EdgesDedupRandom_Many)
+{
+	edges_dedup_random_test(100000, 1000, true);
+}
+
+TEST(edgehash, EdgesDedupRandom_Serial)
+{
+	edges_dedup_random_test(100000, 1000, false);
+}
+
+/* Edges of a grid of quads, as found in the loops of a mesh. */
+static unsigned int grid_loop_edges(const unsigned int size, unsigned int (**r_edges)[2])
+{
+	const unsigned int edges_len = (size - 1) * (size - 1) * 4;
+	unsigned int (*edges)[2] = (unsigned int (*)[2])MEM_mallocN(sizeof(*edges) * edges_len, __func__);
+	unsigned int (*e)[2] = edges;
+
+	for (unsigned int y = 0; y < size - 1; y++) {
+		for (unsigned int x = 0; x < size - 1; x++) {
+			const unsigned int quad[4] = {
+				y * size + x, y * size + x + 1, (y + 1) * size + x + 1, (y + 1) * size + x};
+			for (unsigned int j = 0; j < 4; j++, e++) {
+				(*e)[0] = quad[j];
+				(*e)[1] = quad[(j + 1) % 4];
+			}
+		}
+	}
+	*r_edges = edges;
+	return edges_len;
+}
+
+TEST(edgehash, EdgesDedupGrid)
+{
+	const unsigned int size = 100;
+	unsigned int (*edges)[2];
+	const unsigned int edges_len = grid_loop_edges(size, &edges);
+	unsigned int *edge_map = (unsigned int *)MEM_mallocN(sizeof(*edge_map) * edges_len, __func__);
+	unsigned int *edge_first = (unsigned int *)MEM_mallocN(sizeof(*edge_first) * edges_len, __func__);
+
+	const unsigned int unique_len = BLI_edges_dedup(edges, edges_len, size * size, edge_map, edge_first, true);
+	EXPECT_EQ(2 * size * (size - 1), unique_len);
+	edges_dedup_validate(edges, edges_len, size * size, edge_map, edge_first, unique_len);
+
+	MEM_freeN(edges);
+	MEM_freeN(edge_map);
+	MEM_freeN(edge_first);
+}
+
+TEST(edgehash, EdgesDedupBenchmark)
+{
+	const unsigned int size = BENCHMARK_GRID_SIZE;
+	unsigned int (*edges)[2];
+	const unsigned int edges_len = grid_loop_edges(size, &edges);
+	unsigned int *edge_map = (unsigned int *)MEM_mallocN(sizeof(*edge_map) * edges_len, __func__);
+	unsigned int *edge_first = (unsigned int *)MEM_mallocN(sizeof(*edge_first) * edges_len, __func__);
+	unsigned int unique_len;
+
+	printf("\n========== STARTING edges de-duplication benchmark (%u edges) ==========\n", edges_len);
+
+	{
+		/* Same as mesh edge calculation: ensure each edge, then lookup the index of each. */
+		EdgeHash *eh;
+		TIMEIT_START(edgehash);
+		eh = BLI_edgehash_new_ex(__func__, BLI_EDGEHASH_SIZE_GUESS_FROM_LOOPS(edges_len));
+		for (unsigned int i = 0; i < edges_len; i++) {
+			void **val_p;
+			if (!BLI_edgehash_ensure_p(eh, edges[i][0], edges[i][1], &val_p)) {
+				*val_p = SET_UINT_IN_POINTER((unsigned int)BLI_edgehash_len(eh) - 1);
+			}
+		}
+		for (unsigned int i = 0; i < edges_len; i++) {
+			edge_map[i] = GET_UINT_FROM_POINTER(BLI_edgehash_lookup(eh, edges[i][0], edges[i][1]));
+		}
+		TIMEIT_END(edgehash);
+		unique_len = (unsigned int)BLI_edgehash_len(eh);
+		BLI_edgehash_free(eh, NULL);
+	}
+
+	EXPECT_EQ(2 * size * (size - 1), unique_len);
+
+	TIMEIT_START(edges_dedup_serial);
+	unique_len = BLI_edges_dedup(edges, edges_len, size * size, edge_map, edge_first, false);
+	TIMEIT_END(edges_dedup_serial);
+
+	EXPECT_EQ(2 * size * (size - 1), unique_len);
+
+	TIMEIT_START(edges_dedup_parallel);
+	unique_len = BLI_edges_dedup(edges, edges_len, size * size, edge_map, edge_first, true);
+	TIMEIT_END(edges_dedup_parallel);
+
+	EXPECT_EQ(2 * size * (size - 1), unique_len);
+
+	MEM_freeN(edges);
+	MEM_freeN(edge_map);
+	MEM_freeN(edge_first);
+}
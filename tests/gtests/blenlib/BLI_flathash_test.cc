@@ -0,0 +1,154 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_flathash.h"
+#include "BLI_rand.h"
+}
+
+#define TESTCASE_SIZE 10000
+
+/* Multiplying by an odd number is a bijection on unsigned integers, so keys are unique,
+ * while still being well spread. */
+static void init_keys(unsigned int keys[TESTCASE_SIZE], const unsigned int seed)
+{
+	for (unsigned int i = 0; i < TESTCASE_SIZE; i++) {
+		keys[i] = (i + seed * TESTCASE_SIZE) * 2654435761u;
+	}
+}
+
+TEST(flathash, InsertLookup)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], *k;
+	int i;
+
+	init_keys(keys, 0);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		BLI_flathash_insert(fh, SET_UINT_IN_POINTER(*k), SET_UINT_IN_POINTER(*k));
+	}
+
+	EXPECT_EQ(BLI_flathash_len(fh), TESTCASE_SIZE);
+
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		void *v = BLI_flathash_lookup(fh, SET_UINT_IN_POINTER(*k));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), *k);
+	}
+
+	/* Keys which were never added. */
+	init_keys(keys, 1);
+	for (i = TESTCASE_SIZE, k = keys; i--; k++) {
+		EXPECT_FALSE(BLI_flathash_haskey(fh, SET_UINT_IN_POINTER(*k)));
+	}
+
+	BLI_flathash_free(fh, NULL, NULL);
+}
+
+/* Insert and remove all keys, interleaving removals with insertions of new keys,
+ * so that deleted slots get reused. */
+TEST(flathash, InsertRemove)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	unsigned int keys[TESTCASE_SIZE], keys_other[TESTCASE_SIZE];
+	int i;
+
+	init_keys(keys, 2);
+	init_keys(keys_other, 3);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_flathash_insert(fh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]));
+	}
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void *v = BLI_flathash_popkey(fh, SET_UINT_IN_POINTER(keys[i]), NULL);
+		EXPECT_EQ(GET_UINT_FROM_POINTER(v), keys[i]);
+		EXPECT_TRUE(BLI_flathash_add(fh, SET_UINT_IN_POINTER(keys_other[i]), SET_UINT_IN_POINTER(keys_other[i])));
+		EXPECT_FALSE(BLI_flathash_add(fh, SET_UINT_IN_POINTER(keys_other[i]), NULL));
+	}
+
+	EXPECT_EQ(BLI_flathash_len(fh), TESTCASE_SIZE);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		EXPECT_FALSE(BLI_flathash_haskey(fh, SET_UINT_IN_POINTER(keys[i])));
+		EXPECT_TRUE(BLI_flathash_remove(fh, SET_UINT_IN_POINTER(keys_other[i]), NULL, NULL));
+		EXPECT_FALSE(BLI_flathash_remove(fh, SET_UINT_IN_POINTER(keys_other[i]), NULL, NULL));
+	}
+
+	EXPECT_EQ(BLI_flathash_len(fh), 0);
+
+	BLI_flathash_free(fh, NULL, NULL);
+}
+
+/* Check ensure_p & reinsert only add missing keys. */
+TEST(flathash, EnsureReinsert)
+{
+	FlatHash *fh = BLI_flathash_new_ex(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__, TESTCASE_SIZE);
+	unsigned int keys[TESTCASE_SIZE];
+	int i;
+
+	init_keys(keys, 4);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p;
+		EXPECT_FALSE(BLI_flathash_ensure_p(fh, SET_UINT_IN_POINTER(keys[i]), &val_p));
+		*val_p = SET_UINT_IN_POINTER(i);
+	}
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p;
+		EXPECT_TRUE(BLI_flathash_ensure_p(fh, SET_UINT_IN_POINTER(keys[i]), &val_p));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(*val_p), (unsigned int)i);
+		EXPECT_FALSE(BLI_flathash_reinsert(fh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(keys[i]), NULL, NULL));
+	}
+
+	EXPECT_EQ(BLI_flathash_len(fh), TESTCASE_SIZE);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		void **val_p = BLI_flathash_lookup_p(fh, SET_UINT_IN_POINTER(keys[i]));
+		EXPECT_EQ(GET_UINT_FROM_POINTER(*val_p), keys[i]);
+	}
+
+	BLI_flathash_clear(fh, NULL, NULL);
+	EXPECT_EQ(BLI_flathash_len(fh), 0);
+	EXPECT_EQ(BLI_flathash_lookup_default(fh, SET_UINT_IN_POINTER(keys[0]), fh), fh);
+
+	BLI_flathash_free(fh, NULL, NULL);
+}
+
+/* Iteration must visit each entry exactly once. */
+TEST(flathash, Iterator)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+	FlatHashIterator fh_iter;
+	unsigned int keys[TESTCASE_SIZE];
+	int i;
+
+	init_keys(keys, 5);
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		BLI_flathash_insert(fh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(0));
+	}
+	/* Leave some deleted slots behind. */
+	for (i = 0; i < TESTCASE_SIZE; i += 3) {
+		BLI_flathash_remove(fh, SET_UINT_IN_POINTER(keys[i]), NULL, NULL);
+	}
+
+	i = 0;
+	FLATHASH_ITER (fh_iter, fh) {
+		void **val_p = BLI_flathashIterator_getValue_p(&fh_iter);
+		EXPECT_EQ(GET_UINT_FROM_POINTER(*val_p), 0);
+		*val_p = SET_UINT_IN_POINTER(1);
+		i++;
+	}
+	EXPECT_EQ(i, (int)BLI_flathash_len(fh));
+
+	for (i = 0; i < TESTCASE_SIZE; i++) {
+		EXPECT_EQ(BLI_flathash_lookup_default(fh, SET_UINT_IN_POINTER(keys[i]), SET_UINT_IN_POINTER(2)),
+		          SET_UINT_IN_POINTER((i % 3) ? 1 : 2));
+	}
+
+	BLI_flathash_free(fh, NULL, NULL);
+}
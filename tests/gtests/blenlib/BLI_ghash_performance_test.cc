@@ -9,6 +9,7 @@ extern "C" {
 #include "MEM_guardedalloc.h"
 #include "BLI_utildefines.h"
 #include "BLI_ghash.h"
+#include "BLI_flathash.h"
 #include "BLI_rand.h"
 #include "BLI_string.h"
 #include "PIL_time_utildefines.h"
@@ -534,3 +535,180 @@ TEST(ghash, MultiRandIntMurmur2a200000)
 
 	multi_small_ghash_tests(ghash, "MultiSmall RandIntGHash - Murmur2a - 200000", 200000);
 }
+
+
+/* FlatHash: same int tests as above, to compare open-addressing with GHash's chaining. */
+
+static void int_flathash_tests(FlatHash *fh, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_insert);
+
+#ifdef GHASH_RESERVE
+		BLI_flathash_reserve(fh, nbr);
+#endif
+
+		while (i--) {
+			BLI_flathash_insert(fh, SET_UINT_IN_POINTER(i), SET_UINT_IN_POINTER(i));
+		}
+
+		TIMEIT_END(int_insert);
+	}
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_lookup);
+
+		while (i--) {
+			void *v = BLI_flathash_lookup(fh, SET_UINT_IN_POINTER(i));
+			EXPECT_EQ(GET_UINT_FROM_POINTER(v), i);
+		}
+
+		TIMEIT_END(int_lookup);
+	}
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_lookup_miss);
+
+		while (i--) {
+			EXPECT_FALSE(BLI_flathash_haskey(fh, SET_UINT_IN_POINTER(i + nbr)));
+		}
+
+		TIMEIT_END(int_lookup_miss);
+	}
+
+	{
+		unsigned int i = nbr;
+
+		TIMEIT_START(int_remove);
+
+		while (i--) {
+			EXPECT_TRUE(BLI_flathash_remove(fh, SET_UINT_IN_POINTER(i), NULL, NULL));
+		}
+
+		TIMEIT_END(int_remove);
+	}
+	EXPECT_EQ(BLI_flathash_len(fh), 0);
+
+	BLI_flathash_free(fh, NULL, NULL);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(ghash, IntFlatHash12000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_flathash_tests(fh, "IntFlatHash - GHash - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntFlatHash100000000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	int_flathash_tests(fh, "IntFlatHash - GHash - 100000000", 100000000);
+}
+#endif
+
+TEST(ghash, IntFlatHashMurmur2a12000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
+
+	int_flathash_tests(fh, "IntFlatHash - Murmur - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntFlatHashMurmur2a100000000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
+
+	int_flathash_tests(fh, "IntFlatHash - Murmur - 100000000", 100000000);
+}
+#endif
+
+static void randint_flathash_tests(FlatHash *fh, const char *id, const unsigned int nbr)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	unsigned int *data = (unsigned int *)MEM_mallocN(sizeof(*data) * (size_t)nbr, __func__);
+	unsigned int *dt;
+	unsigned int i;
+
+	{
+		RNG *rng = BLI_rng_new(0);
+		for (i = nbr, dt = data; i--; dt++) {
+			*dt = BLI_rng_get_uint(rng);
+		}
+		BLI_rng_free(rng);
+	}
+
+	{
+		TIMEIT_START(int_insert);
+
+#ifdef GHASH_RESERVE
+		BLI_flathash_reserve(fh, nbr);
+#endif
+
+		for (i = nbr, dt = data; i--; dt++) {
+			BLI_flathash_reinsert(fh, SET_UINT_IN_POINTER(*dt), SET_UINT_IN_POINTER(*dt), NULL, NULL);
+		}
+
+		TIMEIT_END(int_insert);
+	}
+
+	{
+		TIMEIT_START(int_lookup);
+
+		for (i = nbr, dt = data; i--; dt++) {
+			void *v = BLI_flathash_lookup(fh, SET_UINT_IN_POINTER(*dt));
+			EXPECT_EQ(GET_UINT_FROM_POINTER(v), *dt);
+		}
+
+		TIMEIT_END(int_lookup);
+	}
+
+	BLI_flathash_free(fh, NULL, NULL);
+	MEM_freeN(data);
+
+	printf("========== ENDED %s ==========\n\n", id);
+}
+
+TEST(ghash, IntRandFlatHash12000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_flathash_tests(fh, "RandIntFlatHash - GHash - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntRandFlatHash50000000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p, BLI_ghashutil_intcmp, __func__);
+
+	randint_flathash_tests(fh, "RandIntFlatHash - GHash - 50000000", 50000000);
+}
+#endif
+
+TEST(ghash, IntRandFlatHashMurmur2a12000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
+
+	randint_flathash_tests(fh, "RandIntFlatHash - Murmur - 12000", 12000);
+}
+
+#ifdef GHASH_RUN_BIG
+TEST(ghash, IntRandFlatHashMurmur2a50000000)
+{
+	FlatHash *fh = BLI_flathash_new(BLI_ghashutil_inthash_p_murmur, BLI_ghashutil_intcmp, __func__);
+
+	randint_flathash_tests(fh, "RandIntFlatHash - Murmur - 50000000", 50000000);
+}
+#endif
@@ -10,6 +10,7 @@ extern "C" {
 #include "BLI_rand.h"
 
 #include "MEM_guardedalloc.h"
+#include "PIL_time_utildefines.h"
 };
 
 #define SIZE 1024
@@ -189,3 +190,93 @@ TEST(heap, ReInsertRandom2)       { random_heap_reinsert_helper(2, 1234); }
 TEST(heap, ReInsertRandom100)     { random_heap_reinsert_helper(100, 4321); }
 TEST(heap, ReInsertRandom1024)     { random_heap_reinsert_helper(1024, 9876); }
 TEST(heap, ReInsertRandom2048)     { random_heap_reinsert_helper(2048, 5321); }
+
+static void random_heap_remove_update_helper(
+        const int items_total,
+        const int random_seed)
+{
+	RNG *rng = BLI_rng_new(random_seed);
+	Heap *heap = BLI_heap_new();
+	HeapNode **nodes = (HeapNode **)MEM_mallocN(sizeof(HeapNode *) * items_total, __func__);
+	for (int in = 0; in < items_total; in++) {
+		nodes[in] = BLI_heap_insert(heap, BLI_rng_get_float(rng), SET_INT_IN_POINTER(in));
+	}
+	for (int i = 0; i < items_total; i++) {
+		const int index = (int)(BLI_rng_get_uint(rng) % (uint)items_total);
+		if (nodes[index] == NULL) {
+			continue;
+		}
+		if (i % 4 == 0) {
+			BLI_heap_remove(heap, nodes[index]);
+			nodes[index] = NULL;
+		}
+		else {
+			BLI_heap_node_value_update(heap, nodes[index], BLI_rng_get_float(rng));
+		}
+	}
+	EXPECT_TRUE(BLI_heap_is_valid(heap));
+
+	float value_prev = -1.0f;
+	while (!BLI_heap_is_empty(heap)) {
+		const float value = BLI_heap_node_value(BLI_heap_top(heap));
+		EXPECT_LE(value_prev, value);
+		value_prev = value;
+		BLI_heap_pop_min(heap);
+	}
+	BLI_heap_free(heap, NULL);
+	BLI_rng_free(rng);
+	MEM_freeN(nodes);
+}
+
+TEST(heap, RemoveUpdateRandom1)       { random_heap_remove_update_helper(1, 1234); }
+TEST(heap, RemoveUpdateRandom100)     { random_heap_remove_update_helper(100, 4321); }
+TEST(heap, RemoveUpdateRandom2048)    { random_heap_remove_update_helper(2048, 5321); }
+
+
+/* -------------------------------------------------------------------- */
+/* Benchmark, a decimate-like workload (pop the cheapest, update the cost of a few others). */
+
+/* Run the longest benchmark! */
+//#define HEAP_RUN_BIG
+
+#ifdef HEAP_RUN_BIG
+#  define BENCHMARK_SIZE 10000000
+#else
+#  define BENCHMARK_SIZE 500000
+#endif
+
+TEST(heap, BenchmarkDecreaseKey)
+{
+	const int items_total = BENCHMARK_SIZE;
+	RNG *rng = BLI_rng_new(0);
+	Heap *heap = BLI_heap_new_ex((uint)items_total);
+	HeapNode **nodes = (HeapNode **)MEM_mallocN(sizeof(HeapNode *) * items_total, __func__);
+
+	printf("\n========== STARTING heap benchmark (%d items) ==========\n", items_total);
+
+	TIMEIT_START(insert);
+	for (int in = 0; in < items_total; in++) {
+		nodes[in] = BLI_heap_insert(heap, BLI_rng_get_float(rng), SET_INT_IN_POINTER(in));
+	}
+	TIMEIT_END(insert);
+
+	TIMEIT_START(pop_and_update);
+	while (!BLI_heap_is_empty(heap)) {
+		const float value_min = BLI_heap_node_value(BLI_heap_top(heap));
+		const int index = GET_INT_FROM_POINTER(BLI_heap_pop_min(heap));
+		nodes[index] = NULL;
+		/* Update the cost of neighbors, both increased and decreased (not below the popped value). */
+		for (int j = 1; j <= 4; j++) {
+			HeapNode *node = nodes[(index + j * 7919) % items_total];
+			if (node) {
+				const float value = BLI_heap_node_value(node);
+				BLI_heap_node_value_update(heap, node, value_min + (value - value_min) * (float)j * 0.4f);
+			}
+		}
+	}
+	TIMEIT_END(pop_and_update);
+
+	BLI_heap_free(heap, NULL);
+	BLI_rng_free(rng);
+	MEM_freeN(nodes);
+}
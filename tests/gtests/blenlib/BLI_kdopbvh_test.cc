@@ -2,14 +2,14 @@
 
 #include "testing/testing.h"
 
-/* TODO: ray intersection, overlap ... etc.*/
-
 extern "C" {
 #include "BLI_compiler_attrs.h"
 #include "BLI_kdopbvh.h"
 #include "BLI_rand.h"
 #include "BLI_math_vector.h"
+#include "BLI_math_geom.h"
 #include "MEM_guardedalloc.h"
+#include "PIL_time_utildefines.h"
 }
 
 #include "stubs/bf_intern_eigen_stubs.h"
@@ -95,3 +95,271 @@ static void find_nearest_points_test(int points_len, float scale, int round, int
 TEST(kdopbvh, FindNearest_1)		{ find_nearest_points_test(1, 1.0, 1000, 1234); }
 TEST(kdopbvh, FindNearest_2)		{ find_nearest_points_test(2, 1.0, 1000, 123); }
 TEST(kdopbvh, FindNearest_500)		{ find_nearest_points_test(500, 1.0, 1000, 12); }
+
+/* -------------------------------------------------------------------- */
+/* Ray-cast & overlap against brute force */
+
+static void rng_tris(float (*tris)[3][3], int tris_len, struct RNG *rng, float size)
+{
+	for (int i = 0; i < tris_len; i++) {
+		float center[3];
+		rng_v3_round(center, 3, rng, 100, 1.0f);
+		for (int j = 0; j < 3; j++) {
+			rng_v3_round(tris[i][j], 3, rng, 1000, size);
+			add_v3_v3(tris[i][j], center);
+		}
+	}
+}
+
+static BVHTree *tris_tree_new(float (*tris)[3][3], int tris_len, char tree_type, char axis)
+{
+	BVHTree *tree = BLI_bvhtree_new(tris_len, 0.0f, tree_type, axis);
+	for (int i = 0; i < tris_len; i++) {
+		BLI_bvhtree_insert(tree, i, &tris[i][0][0], 3);
+	}
+	BLI_bvhtree_balance(tree);
+	return tree;
+}
+
+static void raycast_tris_cb(void *userdata, int index, const BVHTreeRay *ray, BVHTreeRayHit *hit)
+{
+	float (*tris)[3][3] = (float (*)[3][3])userdata;
+	float dist;
+	if (isect_ray_tri_v3(ray->origin, ray->direction, UNPACK3(tris[index]), &dist, NULL) && (dist < hit->dist)) {
+		hit->index = index;
+		hit->dist = dist;
+	}
+}
+
+static void raycast_tris_test(int tris_len, char tree_type, char axis, int random_seed)
+{
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * tris_len, __func__);
+	rng_tris(tris, tris_len, rng, 0.1f);
+	BVHTree *tree = tris_tree_new(tris, tris_len, tree_type, axis);
+
+	for (int i = 0; i < 1000; i++) {
+		float co[3], dir[3];
+		rng_v3_round(co, 3, rng, 1000, 1.5f);
+		if (i % 4 == 0) {
+			/* Axis aligned rays. */
+			zero_v3(dir);
+			dir[i % 3] = (i % 8) ? 1.0f : -1.0f;
+		}
+		else {
+			BLI_rng_get_float_unit_v3(rng, dir);
+		}
+
+		BVHTreeRayHit hit = {-1};
+		hit.dist = BVH_RAYCAST_DIST_MAX;
+		BLI_bvhtree_ray_cast(tree, co, dir, 0.0f, &hit, raycast_tris_cb, tris);
+
+		BVHTreeRayHit hit_expect = {-1};
+		hit_expect.dist = BVH_RAYCAST_DIST_MAX;
+		BVHTreeRay ray;
+		copy_v3_v3(ray.origin, co);
+		copy_v3_v3(ray.direction, dir);
+		for (int j = 0; j < tris_len; j++) {
+			raycast_tris_cb(tris, j, &ray, &hit_expect);
+		}
+
+		EXPECT_EQ(hit.dist, hit_expect.dist);
+	}
+
+	BLI_bvhtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(tris);
+}
+
+TEST(kdopbvh, RayCast_Binary)		{ raycast_tris_test(1000, 2, 6, 1); }
+TEST(kdopbvh, RayCast_Quad)			{ raycast_tris_test(1000, 4, 6, 2); }
+TEST(kdopbvh, RayCast_Oct)			{ raycast_tris_test(1000, 8, 8, 3); }
+TEST(kdopbvh, RayCast_Oct_26DOP)	{ raycast_tris_test(1000, 8, 26, 4); }
+
+static void overlap_tris_test(int tris_len, char tree_type, char axis, int random_seed)
+{
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*tris_a)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris_a) * tris_len, __func__);
+	float (*tris_b)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris_b) * tris_len, __func__);
+	rng_tris(tris_a, tris_len, rng, 0.05f);
+	rng_tris(tris_b, tris_len, rng, 0.05f);
+	BVHTree *tree_a = tris_tree_new(tris_a, tris_len, tree_type, axis);
+	BVHTree *tree_b = tris_tree_new(tris_b, tris_len, tree_type, axis);
+
+	/* Bounds overlap, brute force. */
+	uint overlap_expect = 0;
+	for (int i = 0; i < tris_len; i++) {
+		float min_a[3], max_a[3];
+		INIT_MINMAX(min_a, max_a);
+		minmax_v3v3_v3_array(min_a, max_a, tris_a[i], 3);
+		for (int j = 0; j < tris_len; j++) {
+			float min_b[3], max_b[3];
+			INIT_MINMAX(min_b, max_b);
+			minmax_v3v3_v3_array(min_b, max_b, tris_b[j], 3);
+			/* Touching bounds overlap too. */
+			if (!(min_a[0] > max_b[0] || min_a[1] > max_b[1] || min_a[2] > max_b[2] ||
+			      min_b[0] > max_a[0] || min_b[1] > max_a[1] || min_b[2] > max_a[2]))
+			{
+				overlap_expect++;
+			}
+		}
+	}
+
+	uint overlap_len;
+	BVHTreeOverlap *overlap = BLI_bvhtree_overlap(tree_a, tree_b, &overlap_len, NULL, NULL);
+	EXPECT_EQ(overlap_len, overlap_expect);
+	MEM_SAFE_FREE(overlap);
+
+	BLI_bvhtree_free(tree_a);
+	BLI_bvhtree_free(tree_b);
+	BLI_rng_free(rng);
+	MEM_freeN(tris_a);
+	MEM_freeN(tris_b);
+}
+
+/* Only AABB trees, k-DOP bounds are tighter than the brute force test. */
+TEST(kdopbvh, Overlap_Binary)		{ overlap_tris_test(2000, 2, 6, 5); }
+TEST(kdopbvh, Overlap_Quad)			{ overlap_tris_test(2000, 4, 6, 6); }
+TEST(kdopbvh, Overlap_Oct)			{ overlap_tris_test(2000, 8, 6, 7); }
+
+/* -------------------------------------------------------------------- */
+/* Batched queries, must match single queries */
+
+static void find_nearest_batch_test(int points_len, int queries_len, int random_seed)
+{
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * points_len, __func__);
+	float (*queries)[3] = (float (*)[3])MEM_mallocN(sizeof(*queries) * queries_len, __func__);
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * queries_len, __func__);
+
+	BVHTree *tree = BLI_bvhtree_new(points_len, 0.0f, 4, 6);
+	for (int i = 0; i < points_len; i++) {
+		rng_v3_round(points[i], 3, rng, 100, 1.0f);
+		BLI_bvhtree_insert(tree, i, points[i], 1);
+	}
+	BLI_bvhtree_balance(tree);
+
+	for (int i = 0; i < queries_len; i++) {
+		rng_v3_round(queries[i], 3, rng, 1000, 1.5f);
+		nearest[i].index = -1;
+		/* Some queries find nothing. */
+		nearest[i].dist_sq = (i % 8) ? FLT_MAX : 1e-6f;
+	}
+
+	BLI_bvhtree_find_nearest_batch(tree, queries, queries_len, nearest, NULL, NULL, true);
+
+	for (int i = 0; i < queries_len; i++) {
+		BVHTreeNearest nearest_expect;
+		nearest_expect.index = -1;
+		nearest_expect.dist_sq = (i % 8) ? FLT_MAX : 1e-6f;
+		BLI_bvhtree_find_nearest(tree, queries[i], &nearest_expect, NULL, NULL);
+		EXPECT_EQ(nearest[i].index, nearest_expect.index);
+		EXPECT_EQ(nearest[i].dist_sq, nearest_expect.dist_sq);
+	}
+
+	BLI_bvhtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(points);
+	MEM_freeN(queries);
+	MEM_freeN(nearest);
+}
+
+TEST(kdopbvh, FindNearestBatch_0)		{ find_nearest_batch_test(100, 0, 8); }
+TEST(kdopbvh, FindNearestBatch_1)		{ find_nearest_batch_test(100, 1, 9); }
+TEST(kdopbvh, FindNearestBatch_5000)	{ find_nearest_batch_test(1000, 5000, 10); }
+
+static void raycast_batch_test(int tris_len, int rays_len, int random_seed)
+{
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*tris)[3][3] = (float (*)[3][3])MEM_mallocN(sizeof(*tris) * tris_len, __func__);
+	float (*co)[3] = (float (*)[3])MEM_mallocN(sizeof(*co) * rays_len, __func__);
+	float (*dir)[3] = (float (*)[3])MEM_mallocN(sizeof(*dir) * rays_len, __func__);
+	BVHTreeRayHit *hit = (BVHTreeRayHit *)MEM_mallocN(sizeof(*hit) * rays_len, __func__);
+
+	rng_tris(tris, tris_len, rng, 0.1f);
+	BVHTree *tree = tris_tree_new(tris, tris_len, 4, 6);
+
+	for (int i = 0; i < rays_len; i++) {
+		rng_v3_round(co[i], 3, rng, 1000, 1.5f);
+		BLI_rng_get_float_unit_v3(rng, dir[i]);
+		hit[i].index = -1;
+		hit[i].dist = BVH_RAYCAST_DIST_MAX;
+	}
+
+	BLI_bvhtree_ray_cast_batch(
+	        tree, co, dir, rays_len, 0.0f, hit, raycast_tris_cb, tris, BVH_RAYCAST_DEFAULT, true);
+
+	for (int i = 0; i < rays_len; i++) {
+		BVHTreeRayHit hit_expect;
+		hit_expect.index = -1;
+		hit_expect.dist = BVH_RAYCAST_DIST_MAX;
+		BLI_bvhtree_ray_cast(tree, co[i], dir[i], 0.0f, &hit_expect, raycast_tris_cb, tris);
+		EXPECT_EQ(hit[i].index, hit_expect.index);
+		EXPECT_EQ(hit[i].dist, hit_expect.dist);
+	}
+
+	BLI_bvhtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(tris);
+	MEM_freeN(co);
+	MEM_freeN(dir);
+	MEM_freeN(hit);
+}
+
+TEST(kdopbvh, RayCastBatch_5000)	{ raycast_batch_test(1000, 5000, 11); }
+
+/* -------------------------------------------------------------------- */
+/* Benchmark */
+
+static void bench_tree_test(int points_len, char tree_type, char axis)
+{
+	struct RNG *rng = BLI_rng_new(points_len);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * points_len, __func__);
+	for (int i = 0; i < points_len; i++) {
+		BLI_rng_get_float_unit_v3(rng, points[i]);
+	}
+
+	printf("\n========== tree_type %d, axis %d, %d points ==========\n", tree_type, axis, points_len);
+
+	BVHTree *tree;
+
+	TIMEIT_START(balance);
+	tree = BLI_bvhtree_new(points_len, 0.0f, tree_type, axis);
+	for (int i = 0; i < points_len; i++) {
+		BLI_bvhtree_insert(tree, i, points[i], 1);
+	}
+	BLI_bvhtree_balance(tree);
+	TIMEIT_END(balance);
+
+	TIMEIT_START(find_nearest);
+	for (int i = 0; i < points_len; i++) {
+		EXPECT_EQ(BLI_bvhtree_find_nearest(tree, points[i], NULL, NULL, NULL), i);
+	}
+	TIMEIT_END(find_nearest);
+
+	BVHTreeNearest *nearest = (BVHTreeNearest *)MEM_mallocN(sizeof(*nearest) * points_len, __func__);
+	for (int i = 0; i < points_len; i++) {
+		nearest[i].index = -1;
+		nearest[i].dist_sq = FLT_MAX;
+	}
+	TIMEIT_START(find_nearest_batch);
+	BLI_bvhtree_find_nearest_batch(tree, points, points_len, nearest, NULL, NULL, true);
+	TIMEIT_END(find_nearest_batch);
+	MEM_freeN(nearest);
+
+	TIMEIT_START(ray_cast);
+	for (int i = 0; i < points_len; i++) {
+		float co[3], dir[3];
+		mul_v3_v3fl(co, points[i], 2.0f);
+		negate_v3_v3(dir, points[i]);
+		BLI_bvhtree_ray_cast(tree, co, dir, 0.0f, NULL, NULL, NULL);
+	}
+	TIMEIT_END(ray_cast);
+
+	BLI_bvhtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(points);
+}
+
+TEST(kdopbvh, Benchmark_Quad)		{ bench_tree_test(100000, 4, 6); }
+TEST(kdopbvh, Benchmark_Oct)		{ bench_tree_test(100000, 8, 8); }
@@ -0,0 +1,139 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "BLI_compiler_attrs.h"
+#include "BLI_kdtree.h"
+#include "BLI_rand.h"
+#include "BLI_math_base.h"
+#include "BLI_math_vector.h"
+#include "MEM_guardedalloc.h"
+}
+
+#include "stubs/bf_intern_eigen_stubs.h"
+
+TEST(kdtree, Empty)
+{
+	KDTree *tree = BLI_kdtree_new(0);
+	BLI_kdtree_balance(tree);
+	{
+		float co[3] = {0};
+		EXPECT_EQ(-1, BLI_kdtree_find_nearest(tree, co, NULL));
+		KDTreeNearest nearest;
+		BLI_kdtree_find_nearest_batch(tree, (const float (*)[3])co, 1, &nearest, false);
+		EXPECT_EQ(-1, nearest.index);
+	}
+	BLI_kdtree_free(tree);
+}
+
+static KDTree *rng_tree_new(float (*points)[3], int points_len, struct RNG *rng, bool use_grid)
+{
+	KDTree *tree = BLI_kdtree_new(points_len);
+	for (int i = 0; i < points_len; i++) {
+		for (int j = 0; j < 3; j++) {
+			const float f = BLI_rng_get_float(rng);
+			/* Grid coordinates give many equal values along the split axis. */
+			points[i][j] = use_grid ? floorf(f * 16.0f) / 16.0f : f;
+		}
+		BLI_kdtree_insert(tree, i, points[i]);
+	}
+	BLI_kdtree_balance(tree);
+	return tree;
+}
+
+static int dist_sq_cmp(const void *a, const void *b)
+{
+	const float fa = *(const float *)a, fb = *(const float *)b;
+	return (fa > fb) - (fa < fb);
+}
+
+/* Compare n-nearest and range search against brute force. */
+static void find_nearest_n_range_test(int points_len, bool use_grid, int random_seed)
+{
+	const int n = 8;
+	const float range = 0.15f;
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*points)[3] = (float (*)[3])MEM_mallocN(sizeof(*points) * points_len, __func__);
+	float *dist_sq = (float *)MEM_mallocN(sizeof(*dist_sq) * points_len, __func__);
+	KDTree *tree = rng_tree_new(points, points_len, rng, use_grid);
+
+	for (int q = 0; q < 100; q++) {
+		float co[3];
+		for (int j = 0; j < 3; j++) {
+			co[j] = BLI_rng_get_float(rng);
+		}
+
+		for (int i = 0; i < points_len; i++) {
+			dist_sq[i] = len_squared_v3v3(points[i], co);
+		}
+		qsort(dist_sq, points_len, sizeof(*dist_sq), dist_sq_cmp);
+
+		KDTreeNearest nearest[n];
+		const int found = BLI_kdtree_find_nearest_n(tree, co, nearest, n);
+		EXPECT_EQ(found, min_ii(n, points_len));
+		for (int i = 0; i < found; i++) {
+			EXPECT_EQ(nearest[i].dist, sqrtf(dist_sq[i]));
+			EXPECT_EQ(nearest[i].dist, len_v3v3(points[nearest[i].index], co));
+		}
+
+		int found_expect = 0;
+		while (found_expect < points_len && dist_sq[found_expect] <= range * range) {
+			found_expect++;
+		}
+		KDTreeNearest *nearest_range = NULL;
+		EXPECT_EQ(BLI_kdtree_range_search(tree, co, &nearest_range, range), found_expect);
+		for (int i = 0; i < found_expect; i++) {
+			EXPECT_EQ(nearest_range[i].dist, sqrtf(dist_sq[i]));
+		}
+		MEM_SAFE_FREE(nearest_range);
+	}
+
+	BLI_kdtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(points);
+	MEM_freeN(dist_sq);
+}
+
+TEST(kdtree, FindNearestRange_1)		{ find_nearest_n_range_test(1, false, 1); }
+TEST(kdtree, FindNearestRange_17)		{ find_nearest_n_range_test(17, false, 2); }
+TEST(kdtree, FindNearestRange_5000)		{ find_nearest_n_range_test(5000, false, 3); }
+TEST(kdtree, FindNearestRange_Grid)		{ find_nearest_n_range_test(5000, true, 4); }
+
+static void find_nearest_batch_test(int points_len, int queries_len, bool use_threading, int random_seed)
+{
+	struct RNG *rng = BLI_rng_new(random_seed);
+	float (*queries)[3] = (float (*)[3])MEM_mallocN(sizeof(*queries) * queries_len, __func__);
+	KDTreeNearest *nearest = (KDTreeNearest *)MEM_mallocN(sizeof(*nearest) * queries_len, __func__);
+
+	KDTree *tree = BLI_kdtree_new(points_len);
+	for (int i = 0; i < points_len; i++) {
+		float co[3];
+		BLI_rng_get_float_unit_v3(rng, co);
+		BLI_kdtree_insert(tree, i, co);
+	}
+	BLI_kdtree_balance(tree);
+
+	for (int i = 0; i < queries_len; i++) {
+		BLI_rng_get_float_unit_v3(rng, queries[i]);
+		mul_v3_fl(queries[i], BLI_rng_get_float(rng) * 2.0f);
+	}
+
+	BLI_kdtree_find_nearest_batch(tree, queries, queries_len, nearest, use_threading);
+
+	for (int i = 0; i < queries_len; i++) {
+		KDTreeNearest nearest_expect;
+		EXPECT_EQ(nearest[i].index, BLI_kdtree_find_nearest(tree, queries[i], &nearest_expect));
+		EXPECT_EQ(nearest[i].dist, nearest_expect.dist);
+		EXPECT_EQ(0, memcmp(nearest[i].co, nearest_expect.co, sizeof(nearest_expect.co)));
+	}
+
+	BLI_kdtree_free(tree);
+	BLI_rng_free(rng);
+	MEM_freeN(queries);
+	MEM_freeN(nearest);
+}
+
+TEST(kdtree, FindNearestBatch_1)			{ find_nearest_batch_test(10, 1, true, 1); }
+TEST(kdtree, FindNearestBatch_Serial)		{ find_nearest_batch_test(1000, 5000, false, 2); }
+TEST(kdtree, FindNearestBatch_Parallel)		{ find_nearest_batch_test(1000, 5000, true, 3); }
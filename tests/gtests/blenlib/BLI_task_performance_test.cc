@@ -0,0 +1,150 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_rand.h"
+#include "BLI_sort.h"
+#include "BLI_task.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Run the longest tests! */
+//#define TASK_RUN_BIG
+
+#ifdef TASK_RUN_BIG
+#  define TESTCASE_SIZE 100000000
+#else
+#  define TESTCASE_SIZE 10000000
+#endif
+
+/* Reduce: sum of squares, serial vs. parallel. */
+
+static void reduce_sumsq_func(void *__restrict userdata, const int start, const int stop, void *__restrict r_value)
+{
+	const float *data = (const float *)userdata;
+	double *sum = (double *)r_value;
+	for (int i = start; i < stop; i++) {
+		*sum += (double)data[i] * (double)data[i];
+	}
+}
+
+static void reduce_sumsq_join(void *__restrict UNUSED(userdata), void *__restrict r_value, const void *__restrict value)
+{
+	*(double *)r_value += *(const double *)value;
+}
+
+static void task_reduce_tests(const bool use_threading, const char *id)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	float *data = (float *)MEM_mallocN(sizeof(*data) * TESTCASE_SIZE, __func__);
+	for (int i = 0; i < TESTCASE_SIZE; i++) {
+		data[i] = (float)(i % 1024) / 1024.0f;
+	}
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.use_threading = use_threading;
+	settings.min_iter_per_thread = 4096;
+
+	const double identity = 0.0;
+	double sum;
+
+	TIMEIT_START(reduce_sumsq);
+	BLI_task_parallel_reduce(0, TESTCASE_SIZE, data, &identity, sizeof(sum),
+	                         reduce_sumsq_func, reduce_sumsq_join, &sum, &settings);
+	TIMEIT_END(reduce_sumsq);
+
+	EXPECT_GT(sum, 0.0);
+
+	MEM_freeN(data);
+}
+
+TEST(task, ReduceSerial)
+{
+	task_reduce_tests(false, "Reduce - Serial");
+}
+
+TEST(task, ReduceParallel)
+{
+	task_reduce_tests(true, "Reduce - Parallel");
+}
+
+/* Scan: exclusive prefix sum of small counts (the usual offsets computation). */
+
+static void task_scan_tests(const bool use_threading, const char *id)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	int *data = (int *)MEM_mallocN(sizeof(*data) * TESTCASE_SIZE, __func__);
+	for (int i = 0; i < TESTCASE_SIZE; i++) {
+		data[i] = 3 + (i & 1);
+	}
+
+	int total;
+
+	TIMEIT_START(scan_exclusive);
+	total = BLI_task_parallel_scan_i(data, data, TESTCASE_SIZE, false, use_threading);
+	TIMEIT_END(scan_exclusive);
+
+	EXPECT_EQ(total, (TESTCASE_SIZE / 2) * 7);
+
+	MEM_freeN(data);
+}
+
+TEST(task, ScanSerial)
+{
+	task_scan_tests(false, "Scan - Serial");
+}
+
+TEST(task, ScanParallel)
+{
+	task_scan_tests(true, "Scan - Parallel");
+}
+
+/* Sort: random floats. */
+
+static int sort_float_cmp(const void *a_v, const void *b_v, void *UNUSED(thunk))
+{
+	const float a = *(const float *)a_v;
+	const float b = *(const float *)b_v;
+	return (a > b) - (a < b);
+}
+
+static void task_sort_tests(const bool use_threading, const char *id)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	float *data = (float *)MEM_mallocN(sizeof(*data) * TESTCASE_SIZE, __func__);
+	RNG *rng = BLI_rng_new(0);
+	for (int i = 0; i < TESTCASE_SIZE; i++) {
+		data[i] = BLI_rng_get_float(rng);
+	}
+	BLI_rng_free(rng);
+
+	TIMEIT_START(sort_float);
+	BLI_task_parallel_sort(data, TESTCASE_SIZE, sizeof(*data), sort_float_cmp, NULL, use_threading);
+	TIMEIT_END(sort_float);
+
+	for (int i = 1; i < TESTCASE_SIZE; i++) {
+		if (data[i - 1] > data[i]) {
+			EXPECT_LE(data[i - 1], data[i]);
+			break;
+		}
+	}
+
+	MEM_freeN(data);
+}
+
+TEST(task, SortSerial)
+{
+	task_sort_tests(false, "Sort - Serial");
+}
+
+TEST(task, SortParallel)
+{
+	task_sort_tests(true, "Sort - Parallel");
+}
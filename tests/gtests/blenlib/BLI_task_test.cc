@@ -6,7 +6,9 @@
 #include "atomic_ops.h"
 
 extern "C" {
+#include "MEM_guardedalloc.h"
 #include "BLI_mempool.h"
+#include "BLI_rand.h"
 #include "BLI_task.h"
 #include "BLI_utildefines.h"
 };
@@ -74,3 +76,236 @@ TEST(task, MempoolIter)
 
 	BLI_mempool_destroy(mempool);
 }
+
+/* Nested pools: tasks push sub-tasks to their own thread's queue and wait for them,
+ * idle threads have to steal them. */
+
+#define NUM_NESTED_TASKS 64
+#define NUM_NESTED_SUBTASKS 256
+
+typedef struct TaskNestedData {
+	TaskScheduler *scheduler;
+	int count;
+	/* tasks run by the test thread (thread ID 0, scheduler threads start at 1) */
+	int count_caller;
+} TaskNestedData;
+
+static void task_nested_count_caller(TaskNestedData *data, int threadid)
+{
+	if (threadid == 0) {
+		atomic_add_and_fetch_int32(&data->count_caller, 1);
+	}
+}
+
+static void task_nested_leaf_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	TaskNestedData *data = (TaskNestedData *)BLI_task_pool_userdata(pool);
+	atomic_add_and_fetch_int32(&data->count, 1);
+	task_nested_count_caller(data, threadid);
+}
+
+static void task_nested_func(TaskPool *__restrict pool, void *UNUSED(taskdata), int threadid)
+{
+	TaskNestedData *data = (TaskNestedData *)BLI_task_pool_userdata(pool);
+	TaskPool *sub_pool = BLI_task_pool_create(data->scheduler, data);
+
+	task_nested_count_caller(data, threadid);
+
+	BLI_task_pool_delayed_push_begin(sub_pool, threadid);
+	for (int i = 0; i < NUM_NESTED_SUBTASKS; i++) {
+		BLI_task_pool_push_from_thread(sub_pool, task_nested_leaf_func, NULL, false, TASK_PRIORITY_LOW, threadid);
+	}
+	BLI_task_pool_delayed_push_end(sub_pool, threadid);
+
+	BLI_task_pool_work_and_wait(sub_pool);
+	BLI_task_pool_free(sub_pool);
+}
+
+TEST(task, NestedPools)
+{
+	TaskNestedData data;
+	TaskSchedulerStats stats;
+
+	data.scheduler = BLI_task_scheduler_create(8);
+	data.count = 0;
+	data.count_caller = 0;
+
+	TaskPool *pool = BLI_task_pool_create(data.scheduler, &data);
+	for (int i = 0; i < NUM_NESTED_TASKS; i++) {
+		BLI_task_pool_push(pool, task_nested_func, NULL, false, TASK_PRIORITY_HIGH);
+	}
+	BLI_task_pool_work_and_wait(pool);
+	BLI_task_pool_free(pool);
+
+	EXPECT_EQ(data.count, NUM_NESTED_TASKS * NUM_NESTED_SUBTASKS);
+
+	/* The test thread isn't the main thread (no BLI_threadapi_init), so tasks it runs
+	 * use pool local storage and are not attributed to any scheduler thread. */
+	BLI_task_scheduler_stats_get(data.scheduler, &stats);
+	EXPECT_EQ(stats.num_tasks_run + (uint64_t)data.count_caller,
+	          (uint64_t)(NUM_NESTED_TASKS * (NUM_NESTED_SUBTASKS + 1)));
+
+	BLI_task_scheduler_free(data.scheduler);
+}
+
+/* Reduce, scan and sort. */
+
+#define NUM_ALGO_ITEMS 100003
+
+static void task_reduce_sum_func(void *__restrict userdata, const int start, const int stop, void *__restrict r_value)
+{
+	const int *data = (const int *)userdata;
+	int64_t *sum = (int64_t *)r_value;
+	for (int i = start; i < stop; i++) {
+		*sum += data[i];
+	}
+}
+
+static void task_reduce_sum_join(void *__restrict UNUSED(userdata), void *__restrict r_value, const void *__restrict value)
+{
+	*(int64_t *)r_value += *(const int64_t *)value;
+}
+
+/* Not commutative, checks chunks are joined in order. */
+static void task_reduce_concat_func(void *__restrict UNUSED(userdata), const int start, const int stop, void *__restrict r_value)
+{
+	int *range = (int *)r_value;
+	if (range[0] == -1) {
+		range[0] = start;
+	}
+	else {
+		EXPECT_EQ(range[1], start);
+	}
+	range[1] = stop;
+}
+
+static void task_reduce_concat_join(void *__restrict userdata, void *__restrict r_value, const void *__restrict value)
+{
+	task_reduce_concat_func(userdata, ((const int *)value)[0], ((const int *)value)[1], r_value);
+}
+
+TEST(task, ParallelReduce)
+{
+	int *data = (int *)MEM_mallocN(sizeof(*data) * NUM_ALGO_ITEMS, __func__);
+	int64_t sum_expected = 0;
+	for (int i = 0; i < NUM_ALGO_ITEMS; i++) {
+		data[i] = (i * 7919) % 1000 - 500;
+		sum_expected += data[i];
+	}
+
+	ParallelRangeSettings settings;
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.min_iter_per_thread = 64;
+
+	const int64_t sum_identity = 0;
+	int64_t sum;
+	BLI_task_parallel_reduce(0, NUM_ALGO_ITEMS, data, &sum_identity, sizeof(sum),
+	                         task_reduce_sum_func, task_reduce_sum_join, &sum, &settings);
+	EXPECT_EQ(sum, sum_expected);
+
+	const int range_identity[2] = {-1, -1};
+	int range[2];
+	BLI_task_parallel_reduce(10, NUM_ALGO_ITEMS, NULL, range_identity, sizeof(range),
+	                         task_reduce_concat_func, task_reduce_concat_join, range, &settings);
+	EXPECT_EQ(range[0], 10);
+	EXPECT_EQ(range[1], NUM_ALGO_ITEMS);
+
+	/* Empty range gives the identity. */
+	BLI_task_parallel_reduce(5, 5, data, &sum_identity, sizeof(sum),
+	                         task_reduce_sum_func, task_reduce_sum_join, &sum, &settings);
+	EXPECT_EQ(sum, 0);
+
+	MEM_freeN(data);
+}
+
+static void task_scan_test(const int len, const bool inclusive)
+{
+	int *src = (int *)MEM_mallocN(sizeof(*src) * (len + 1), __func__);
+	int *dst = (int *)MEM_mallocN(sizeof(*dst) * (len + 1), __func__);
+	for (int i = 0; i < len; i++) {
+		src[i] = (i % 5) - 1;
+	}
+
+	const int total = BLI_task_parallel_scan_i(src, dst, len, inclusive, true);
+
+	int sum = 0;
+	for (int i = 0; i < len; i++) {
+		if (inclusive) {
+			sum += src[i];
+		}
+		if (dst[i] != sum) {
+			EXPECT_EQ(dst[i], sum);
+			break;
+		}
+		if (!inclusive) {
+			sum += src[i];
+		}
+	}
+	EXPECT_EQ(total, sum);
+
+	/* In place. */
+	EXPECT_EQ(BLI_task_parallel_scan_i(src, src, len, inclusive, true), total);
+	EXPECT_EQ(memcmp(src, dst, sizeof(*src) * len), 0);
+
+	MEM_freeN(src);
+	MEM_freeN(dst);
+}
+
+TEST(task, ParallelScan)
+{
+	task_scan_test(0, false);
+	task_scan_test(1, true);
+	task_scan_test(1000, false);
+	task_scan_test(NUM_ALGO_ITEMS, false);
+	task_scan_test(NUM_ALGO_ITEMS, true);
+}
+
+typedef struct TaskSortItem {
+	int key;
+	int index;
+} TaskSortItem;
+
+static int task_sort_cmp(const void *a_v, const void *b_v, void *UNUSED(thunk))
+{
+	const TaskSortItem *a = (const TaskSortItem *)a_v;
+	const TaskSortItem *b = (const TaskSortItem *)b_v;
+	return (a->key > b->key) - (a->key < b->key);
+}
+
+static void task_sort_test(const int len, const int key_range)
+{
+	TaskSortItem *items = (TaskSortItem *)MEM_mallocN(sizeof(*items) * (len + 1), __func__);
+	RNG *rng = BLI_rng_new(len);
+	int64_t index_sum = 0;
+	for (int i = 0; i < len; i++) {
+		items[i].key = BLI_rng_get_int(rng) % key_range;
+		items[i].index = i;
+		index_sum += i;
+	}
+	BLI_rng_free(rng);
+
+	BLI_task_parallel_sort(items, len, sizeof(*items), task_sort_cmp, NULL, true);
+
+	for (int i = 1; i < len; i++) {
+		if (items[i - 1].key > items[i].key) {
+			EXPECT_LE(items[i - 1].key, items[i].key);
+			break;
+		}
+	}
+	/* All items are still there. */
+	for (int i = 0; i < len; i++) {
+		index_sum -= items[i].index;
+	}
+	EXPECT_EQ(index_sum, 0);
+
+	MEM_freeN(items);
+}
+
+TEST(task, ParallelSort)
+{
+	task_sort_test(0, 10);
+	task_sort_test(100, 10);
+	task_sort_test(NUM_ALGO_ITEMS, 1 << 30);
+	/* Many duplicates. */
+	task_sort_test(NUM_ALGO_ITEMS, 3);
+}
@@ -0,0 +1,133 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_path_util.h"
+#include "BLI_rand.h"
+
+#include "MEM_guardedalloc.h"
+
+#include "DNA_sdna_types.h"
+
+#include "BLO_readfile.h"
+
+#include "intern/readfile.h"
+
+#include "PIL_time_utildefines.h"
+}
+
+/* Run the longest tests! */
+//#define OLDNEWMAP_RUN_BIG
+
+#ifdef OLDNEWMAP_RUN_BIG
+#  define BENCHMARK_ITEMS_LEN 20000000
+#else
+#  define BENCHMARK_ITEMS_LEN 2000000
+#endif
+
+/* Addresses as they would be stored in a file, aligned like allocations. */
+#define FAKE_ADDR(i) ((void *)(uintptr_t)(((uintptr_t)(i) + 1) * 16))
+#define FAKE_DATA(i) ((void *)(uintptr_t)(((uintptr_t)(i) + 1) * 8 + 1))
+
+static void oldnewmap_insert_lookup_test(const int items_len)
+{
+	struct OldNewMap *onm = blo_oldnewmap_new();
+	int i;
+
+	/* the map starts small, this passes several resize boundaries */
+	for (i = 0; i < items_len; i++) {
+		blo_do_versions_oldnewmap_insert(onm, FAKE_ADDR(i), FAKE_DATA(i), 0);
+	}
+
+	for (i = 0; i < items_len; i++) {
+		EXPECT_EQ(FAKE_DATA(i), blo_oldnewmap_lookup(onm, FAKE_ADDR(i)));
+	}
+
+	/* reverse order doesn't use the 'lasthit' shortcut */
+	for (i = items_len - 1; i >= 0; i--) {
+		EXPECT_EQ(FAKE_DATA(i), blo_oldnewmap_lookup(onm, FAKE_ADDR(i)));
+	}
+
+	EXPECT_EQ(NULL, blo_oldnewmap_lookup(onm, FAKE_ADDR(items_len)));
+
+	blo_oldnewmap_free(onm);
+}
+
+TEST(oldnewmap, InsertLookupSmall)
+{
+	oldnewmap_insert_lookup_test(10);
+}
+
+TEST(oldnewmap, InsertLookupResize)
+{
+	oldnewmap_insert_lookup_test(1000);
+}
+
+TEST(oldnewmap, InsertLookupLarge)
+{
+	oldnewmap_insert_lookup_test(100000);
+}
+
+TEST(oldnewmap, InsertDuplicate)
+{
+	struct OldNewMap *onm = blo_oldnewmap_new();
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		blo_do_versions_oldnewmap_insert(onm, FAKE_ADDR(i), FAKE_DATA(i), 0);
+	}
+	/* the same address written twice (corrupt files), the last one is used */
+	blo_do_versions_oldnewmap_insert(onm, FAKE_ADDR(500), FAKE_DATA(2000), 0);
+
+	EXPECT_EQ(FAKE_DATA(2000), blo_oldnewmap_lookup(onm, FAKE_ADDR(500)));
+	EXPECT_EQ(FAKE_DATA(999), blo_oldnewmap_lookup(onm, FAKE_ADDR(999)));
+
+	blo_oldnewmap_free(onm);
+}
+
+/* Pointers are mostly relinked in the order they were written, but not only. */
+TEST(oldnewmap, LookupBenchmark)
+{
+	struct OldNewMap *onm = blo_oldnewmap_new();
+	unsigned int *order = (unsigned int *)MEM_mallocN(sizeof(*order) * BENCHMARK_ITEMS_LEN, __func__);
+	unsigned int i, mismatch = 0;
+
+	printf("\n========== STARTING OldNewMap benchmark (%d entries) ==========\n", BENCHMARK_ITEMS_LEN);
+
+	{
+		TIMEIT_START(insert);
+		for (i = 0; i < BENCHMARK_ITEMS_LEN; i++) {
+			blo_do_versions_oldnewmap_insert(onm, FAKE_ADDR(i), FAKE_DATA(i), 0);
+		}
+		TIMEIT_END(insert);
+	}
+
+	for (i = 0; i < BENCHMARK_ITEMS_LEN; i++) {
+		order[i] = i;
+	}
+
+	{
+		TIMEIT_START(lookup_written_order);
+		for (i = 0; i < BENCHMARK_ITEMS_LEN; i++) {
+			mismatch += (blo_oldnewmap_lookup(onm, FAKE_ADDR(order[i])) != FAKE_DATA(order[i]));
+		}
+		TIMEIT_END(lookup_written_order);
+	}
+
+	BLI_array_randomize(order, sizeof(*order), BENCHMARK_ITEMS_LEN, 1);
+
+	{
+		TIMEIT_START(lookup_random_order);
+		for (i = 0; i < BENCHMARK_ITEMS_LEN; i++) {
+			mismatch += (blo_oldnewmap_lookup(onm, FAKE_ADDR(order[i])) != FAKE_DATA(order[i]));
+		}
+		TIMEIT_END(lookup_random_order);
+	}
+
+	EXPECT_EQ(0u, mismatch);
+
+	MEM_freeN(order);
+	blo_oldnewmap_free(onm);
+}
@@ -0,0 +1,188 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "MEM_guardedalloc.h"
+#include "BLI_utildefines.h"
+#include "BLI_math.h"
+#include "DNA_mesh_types.h"
+#include "DNA_meshdata_types.h"
+#include "BKE_customdata.h"
+#include "BKE_mesh.h"
+#include "bmesh.h"
+#include "PIL_time_utildefines.h"
+}
+
+/* Run the longest tests! */
+//#define MESH_CONV_RUN_BIG
+
+#ifdef MESH_CONV_RUN_BIG
+#  define GRID_SIZE 2048
+#else
+#  define GRID_SIZE 512
+#endif
+
+/* Grid of (size - 1)^2 quads, with a float layer on vertices and UVs on loops. */
+static void mesh_grid_init(Mesh *me, const int size)
+{
+	memset(me, 0, sizeof(*me));
+	BKE_mesh_init(me);
+	strcpy(me->id.name, "MEGrid");
+
+	const int edges_per_line = size - 1;
+	me->totvert = size * size;
+	me->totedge = 2 * size * edges_per_line;
+	me->totpoly = edges_per_line * edges_per_line;
+	me->totloop = me->totpoly * 4;
+
+	CustomData_add_layer(&me->vdata, CD_MVERT, CD_CALLOC, NULL, me->totvert);
+	CustomData_add_layer(&me->vdata, CD_PROP_FLT, CD_CALLOC, NULL, me->totvert);
+	CustomData_add_layer(&me->edata, CD_MEDGE, CD_CALLOC, NULL, me->totedge);
+	CustomData_add_layer(&me->ldata, CD_MLOOP, CD_CALLOC, NULL, me->totloop);
+	CustomData_add_layer(&me->ldata, CD_MLOOPUV, CD_CALLOC, NULL, me->totloop);
+	CustomData_add_layer(&me->pdata, CD_MPOLY, CD_CALLOC, NULL, me->totpoly);
+	BKE_mesh_update_customdata_pointers(me, false);
+
+	MFloatProperty *vfloat = (MFloatProperty *)CustomData_get_layer(&me->vdata, CD_PROP_FLT);
+	MLoopUV *mloopuv = (MLoopUV *)CustomData_get_layer(&me->ldata, CD_MLOOPUV);
+
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			const int v = y * size + x;
+			ARRAY_SET_ITEMS(me->mvert[v].co, (float)x, (float)y, 0.0f);
+			me->mvert[v].no[2] = 32767;
+			vfloat[v].f = (float)v * 0.5f;
+		}
+	}
+
+	/* Edges along x first, then along y. */
+	MEdge *med = me->medge;
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < edges_per_line; x++, med++) {
+			med->v1 = (unsigned int)(y * size + x);
+			med->v2 = med->v1 + 1;
+		}
+	}
+	for (int x = 0; x < size; x++) {
+		for (int y = 0; y < edges_per_line; y++, med++) {
+			med->v1 = (unsigned int)(y * size + x);
+			med->v2 = med->v1 + (unsigned int)size;
+		}
+	}
+
+	const int edges_y_start = size * edges_per_line;
+	for (int y = 0; y < edges_per_line; y++) {
+		for (int x = 0; x < edges_per_line; x++) {
+			const int p = y * edges_per_line + x;
+			MPoly *mp = &me->mpoly[p];
+			MLoop *ml = &me->mloop[p * 4];
+			MLoopUV *uv = &mloopuv[p * 4];
+			const int v = y * size + x;
+
+			mp->loopstart = p * 4;
+			mp->totloop = 4;
+
+			ml[0].v = (unsigned int)v;
+			ml[0].e = (unsigned int)(y * edges_per_line + x);
+			ml[1].v = (unsigned int)(v + 1);
+			ml[1].e = (unsigned int)(edges_y_start + (x + 1) * edges_per_line + y);
+			ml[2].v = (unsigned int)(v + size + 1);
+			ml[2].e = (unsigned int)((y + 1) * edges_per_line + x);
+			ml[3].v = (unsigned int)(v + size);
+			ml[3].e = (unsigned int)(edges_y_start + x * edges_per_line + y);
+
+			for (int i = 0; i < 4; i++) {
+				const MVert *mv = &me->mvert[ml[i].v];
+				ARRAY_SET_ITEMS(uv[i].uv, mv->co[0] / (float)size, mv->co[1] / (float)size);
+			}
+		}
+	}
+}
+
+static void mesh_conv_tests(const int size, const char *id)
+{
+	printf("\n========== STARTING %s ==========\n", id);
+
+	Mesh me_src, me_dst;
+	mesh_grid_init(&me_src, size);
+	memset(&me_dst, 0, sizeof(me_dst));
+	BKE_mesh_init(&me_dst);
+
+	BMAllocTemplate allocsize = {me_src.totvert, me_src.totedge, me_src.totloop, me_src.totpoly};
+	BMeshCreateParams create_params = {0};
+	create_params.use_toolflags = false;
+	BMesh *bm = BM_mesh_create(&allocsize, &create_params);
+
+	BMeshFromMeshParams from_params = {0};
+	from_params.calc_face_normal = true;
+	TIMEIT_START(bm_from_me);
+	BM_mesh_bm_from_me(bm, &me_src, &from_params);
+	TIMEIT_END(bm_from_me);
+
+	EXPECT_EQ(bm->totvert, me_src.totvert);
+	EXPECT_EQ(bm->totedge, me_src.totedge);
+	EXPECT_EQ(bm->totface, me_src.totpoly);
+	EXPECT_EQ(bm->totloop, me_src.totloop);
+
+	BMeshToMeshParams to_params = {0};
+	TIMEIT_START(bm_to_me);
+	BM_mesh_bm_to_me(bm, &me_dst, &to_params);
+	TIMEIT_END(bm_to_me);
+
+	BM_mesh_free(bm);
+
+	ASSERT_EQ(me_dst.totvert, me_src.totvert);
+	ASSERT_EQ(me_dst.totedge, me_src.totedge);
+	ASSERT_EQ(me_dst.totpoly, me_src.totpoly);
+	ASSERT_EQ(me_dst.totloop, me_src.totloop);
+
+	const MFloatProperty *vfloat_src = (const MFloatProperty *)CustomData_get_layer(&me_src.vdata, CD_PROP_FLT);
+	const MFloatProperty *vfloat_dst = (const MFloatProperty *)CustomData_get_layer(&me_dst.vdata, CD_PROP_FLT);
+	ASSERT_TRUE(vfloat_dst != NULL);
+	for (int i = 0; i < me_src.totvert; i++) {
+		if (!equals_v3v3(me_src.mvert[i].co, me_dst.mvert[i].co) || vfloat_src[i].f != vfloat_dst[i].f) {
+			ADD_FAILURE() << "Vertex " << i << " differs";
+			break;
+		}
+	}
+	for (int i = 0; i < me_src.totedge; i++) {
+		if (me_src.medge[i].v1 != me_dst.medge[i].v1 || me_src.medge[i].v2 != me_dst.medge[i].v2) {
+			ADD_FAILURE() << "Edge " << i << " differs";
+			break;
+		}
+	}
+	for (int i = 0; i < me_src.totpoly; i++) {
+		if (me_src.mpoly[i].loopstart != me_dst.mpoly[i].loopstart ||
+		    me_src.mpoly[i].totloop != me_dst.mpoly[i].totloop)
+		{
+			ADD_FAILURE() << "Polygon " << i << " differs";
+			break;
+		}
+	}
+	const MLoopUV *uv_src = (const MLoopUV *)CustomData_get_layer(&me_src.ldata, CD_MLOOPUV);
+	const MLoopUV *uv_dst = (const MLoopUV *)CustomData_get_layer(&me_dst.ldata, CD_MLOOPUV);
+	ASSERT_TRUE(uv_dst != NULL);
+	for (int i = 0; i < me_src.totloop; i++) {
+		if (me_src.mloop[i].v != me_dst.mloop[i].v || me_src.mloop[i].e != me_dst.mloop[i].e ||
+		    !equals_v2v2(uv_src[i].uv, uv_dst[i].uv))
+		{
+			ADD_FAILURE() << "Loop " << i << " differs";
+			break;
+		}
+	}
+
+	BKE_mesh_free(&me_src);
+	BKE_mesh_free(&me_dst);
+}
+
+TEST(bmesh_mesh_conv, RoundTripSmall)
+{
+	/* Below threading limits. */
+	mesh_conv_tests(16, "Mesh <-> BMesh - 16x16 grid");
+}
+
+TEST(bmesh_mesh_conv, RoundTripLarge)
+{
+	mesh_conv_tests(GRID_SIZE, "Mesh <-> BMesh - Large grid");
+}
@@ -0,0 +1,84 @@
+/* Apache License, Version 2.0 */
+
+#include "testing/testing.h"
+
+extern "C" {
+#include "BLI_utildefines.h"
+#include "BLI_task.h"
+}
+
+#include "MEM_guardedalloc.h"
+
+#define NUM_ITEMS 20000
+
+namespace {
+
+struct ThreadCacheData {
+	void **blocks;
+};
+
+/* Sizes on both sides of the largest cached size class. */
+size_t test_block_size(const int i)
+{
+	return (size_t)((i * 7) % 700);
+}
+
+void alloc_func(void *__restrict userdata, const int i, const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ThreadCacheData *data = (ThreadCacheData *)userdata;
+	const size_t size = test_block_size(i);
+	char *block = (char *)((i % 2) ? MEM_mallocN(size, __func__) : MEM_callocN(size, __func__));
+	for (size_t j = 0; j < size; j++) {
+		if (i % 2 == 0) {
+			EXPECT_EQ(block[j], 0);
+		}
+		block[j] = (char)i;
+	}
+	data->blocks[i] = block;
+}
+
+/* Free blocks in another order than they were allocated, so most are freed by another thread. */
+void free_func(void *__restrict userdata, const int i, const ParallelRangeTLS *__restrict UNUSED(tls))
+{
+	ThreadCacheData *data = (ThreadCacheData *)userdata;
+	const int i_other = NUM_ITEMS - 1 - i;
+	char *block = (char *)data->blocks[i_other];
+	const size_t size = test_block_size(i_other);
+	EXPECT_EQ(MEM_allocN_len(block), (size + 3) & ~(size_t)3);
+	for (size_t j = 0; j < size; j++) {
+		EXPECT_EQ(block[j], (char)i_other);
+	}
+	MEM_freeN(block);
+}
+
+}  // namespace
+
+/* Memory accounting must remain exact when blocks are recycled between threads. */
+TEST(guardedalloc, LockfreeThreadCache)
+{
+	ThreadCacheData data;
+	ParallelRangeSettings settings;
+
+	data.blocks = (void **)MEM_mallocN(sizeof(*data.blocks) * NUM_ITEMS, __func__);
+
+	BLI_parallel_range_settings_defaults(&settings);
+	settings.scheduling_mode = TASK_SCHEDULING_DYNAMIC;
+
+	/* First run also initializes the task scheduler, which allocates memory of its own. */
+	BLI_task_parallel_range(0, NUM_ITEMS, &data, alloc_func, &settings);
+	BLI_task_parallel_range(0, NUM_ITEMS, &data, free_func, &settings);
+
+	const size_t mem_in_use = MEM_get_memory_in_use();
+	const unsigned int blocks_in_use = MEM_get_memory_blocks_in_use();
+
+	for (int pass = 0; pass < 3; pass++) {
+		BLI_task_parallel_range(0, NUM_ITEMS, &data, alloc_func, &settings);
+		EXPECT_GT(MEM_get_memory_blocks_in_use(), blocks_in_use);
+		BLI_task_parallel_range(0, NUM_ITEMS, &data, free_func, &settings);
+
+		EXPECT_EQ(MEM_get_memory_in_use(), mem_in_use);
+		EXPECT_EQ(MEM_get_memory_blocks_in_use(), blocks_in_use);
+	}
+
+	MEM_freeN(data.blocks);
+}